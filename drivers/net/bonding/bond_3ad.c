@@ -2159,6 +2159,9 @@ void bond_3ad_state_machine_handler(struct bonding *bond)
 		}
 	}
 
+	// follow aggregator changes in the array used for transmit
+	bond_update_slave_arr(bond);
+
 re_arm:
 	mod_timer(&(BOND_AD_INFO(bond).ad_timer), jiffies + ad_delta_in_ticks);
 out:
@@ -2344,71 +2347,42 @@ int bond_3ad_get_active_agg_info(struct bonding *bond, struct ad_info *ad_info)
 
 int bond_3ad_xmit_xor(struct sk_buff *skb, struct net_device *dev)
 {
-	struct slave *slave, *start_at;
+	struct slave *slave;
 	struct bonding *bond = dev->priv;
-	struct ethhdr *data = (struct ethhdr *)skb->data;
-	int slave_agg_no;
-	int slaves_in_agg;
-	int agg_id;
+	struct bond_slave_arr *slaves;
+	int slave_agg_no, count;
 	int i;
-	struct ad_info ad_info;
 	int res = 1;
 
-	/* make sure that the slaves list will
-	 * not change during tx
+	/* bond->slave_arr holds the slaves of the active aggregator,
+	 * kept up to date by the state machine; it is freed by RCU
 	 */
-	read_lock(&bond->lock);
-
-	if (!BOND_IS_OK(bond)) {
-		goto out;
-	}
+	rcu_read_lock();
 
-	if (bond_3ad_get_active_agg_info(bond, &ad_info)) {
-		printk(KERN_DEBUG "ERROR: bond_3ad_get_active_agg_info failed\n");
+	slaves = rcu_dereference(bond->slave_arr);
+	if (!slaves || !(dev->flags & IFF_UP) || !netif_running(dev)) {
 		goto out;
 	}
 
-	slaves_in_agg = ad_info.ports;
-	agg_id = ad_info.aggregator_id;
-
-	if (slaves_in_agg == 0) {
-		/*the aggregator is empty*/
-		printk(KERN_DEBUG "ERROR: active aggregator is empty\n");
-		goto out;
-	}
+	/* the count can shrink under us, see bond_slave_arr_prune() */
+	count = slaves->count;
+	slave_agg_no = bond->xmit_hash_policy(skb, dev, count);
 
-	slave_agg_no = (data->h_dest[5]^bond->dev->dev_addr[5]) % slaves_in_agg;
+	for (i = 0; i < count; i++) {
+		struct aggregator *agg;
 
-	bond_for_each_slave(bond, slave, i) {
-		struct aggregator *agg = SLAVE_AD_INFO(slave).port.aggregator;
+		slave = slaves->arr[slave_agg_no];
+		agg = SLAVE_AD_INFO(slave).port.aggregator;
 
-		if (agg && (agg->aggregator_identifier == agg_id)) {
-			slave_agg_no--;
-			if (slave_agg_no < 0) {
-				break;
-			}
-		}
-	}
-
-	if (slave_agg_no >= 0) {
-		printk(KERN_ERR DRV_NAME ": Error: Couldn't find a slave to tx on for aggregator ID %d\n", agg_id);
-		goto out;
-	}
-
-	start_at = slave;
-
-	bond_for_each_slave_from(bond, slave, i, start_at) {
-		int slave_agg_id = 0;
-		struct aggregator *agg = SLAVE_AD_INFO(slave).port.aggregator;
-
-		if (agg) {
-			slave_agg_id = agg->aggregator_identifier;
-		}
-
-		if (SLAVE_IS_OK(slave) && agg && (slave_agg_id == agg_id)) {
+		if (SLAVE_IS_OK(slave) && agg &&
+		    (agg->aggregator_identifier == slaves->aggregator_id)) {
 			res = bond_dev_queue_xmit(bond, skb, slave->dev);
 			break;
 		}
+
+		if (++slave_agg_no == count) {
+			slave_agg_no = 0;
+		}
 	}
 
 out:
@@ -2416,7 +2390,7 @@ out:
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
+	rcu_read_unlock();
 	return 0;
 }
 
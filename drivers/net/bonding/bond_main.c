@@ -515,6 +515,7 @@
 #include <linux/smp.h>
 #include <linux/if_ether.h>
 #include <net/arp.h>
+#include <net/ip.h>
 #include <linux/mii.h>
 #include <linux/ethtool.h>
 #include <linux/if_vlan.h>
@@ -539,6 +540,7 @@ static char *primary	= NULL;
 static char *lacp_rate	= NULL;
 static int arp_interval = BOND_LINK_ARP_INTERV;
 static char *arp_ip_target[BOND_MAX_ARP_TARGETS] = { NULL, };
+static char *xmit_hash_policy = NULL;
 
 module_param(max_bonds, int, 0);
 MODULE_PARM_DESC(max_bonds, "Max number of bonded devices");
@@ -560,6 +562,8 @@ module_param(arp_interval, int, 0);
 MODULE_PARM_DESC(arp_interval, "arp interval in milliseconds");
 module_param_array(arp_ip_target, charp, NULL, 0);
 MODULE_PARM_DESC(arp_ip_target, "arp targets in n.n.n.n form");
+module_param(xmit_hash_policy, charp, 0);
+MODULE_PARM_DESC(xmit_hash_policy, "XOR hashing method : 0 for layer 2 (default), 1 for layer 3+4, 2 for layer 2+3");
 
 /*----------------------------- Global variables ----------------------------*/
 
@@ -577,6 +581,7 @@ static int arp_ip_count	= 0;
 static u32 my_ip	= 0;
 static int bond_mode	= BOND_MODE_ROUNDROBIN;
 static int lacp_fast	= 0;
+static int xmit_hashtype = BOND_XMIT_POLICY_LAYER2;
 static int app_abi_ver	= 0;
 static int orig_app_abi_ver = -1; /* This is used to save the first ABI version
 				   * we receive from the application. Once set,
@@ -608,6 +613,13 @@ static struct bond_parm_tbl bond_mode_tbl[] = {
 {	NULL,			-1},
 };
 
+static struct bond_parm_tbl xmit_hashtype_tbl[] = {
+{	"layer2",		BOND_XMIT_POLICY_LAYER2},
+{	"layer3+4",		BOND_XMIT_POLICY_LAYER34},
+{	"layer2+3",		BOND_XMIT_POLICY_LAYER23},
+{	NULL,			-1},
+};
+
 /*-------------------------- Forward declarations ---------------------------*/
 
 static inline void bond_set_mode_ops(struct net_device *bond_dev, int mode);
@@ -636,6 +648,20 @@ static const char *bond_mode_name(int mode)
 	}
 }
 
+static const char *bond_xmit_policy_name(int policy)
+{
+	switch (policy) {
+	case BOND_XMIT_POLICY_LAYER2:
+		return "layer2";
+	case BOND_XMIT_POLICY_LAYER34:
+		return "layer3+4";
+	case BOND_XMIT_POLICY_LAYER23:
+		return "layer2+3";
+	default:
+		return "unknown";
+	}
+}
+
 /*---------------------------------- VLAN -----------------------------------*/
 
 /**
@@ -1522,6 +1548,148 @@ static void bond_select_active_slave(struct bonding *bond)
 
 /*--------------------------- slave list handling ---------------------------*/
 
+/* slave arrays waiting for their RCU callback, see bonding_exit() */
+static atomic_t bond_slave_arr_pending = ATOMIC_INIT(0);
+
+static void bond_slave_arr_free(struct rcu_head *head)
+{
+	kfree(container_of(head, struct bond_slave_arr, rcu));
+	atomic_dec(&bond_slave_arr_pending);
+}
+
+static void bond_slave_arr_replace(struct bonding *bond,
+				   struct bond_slave_arr *new_arr)
+{
+	struct bond_slave_arr *old_arr = bond->slave_arr;
+
+	rcu_assign_pointer(bond->slave_arr, new_arr);
+	if (old_arr) {
+		atomic_inc(&bond_slave_arr_pending);
+		call_rcu(&old_arr->rcu, bond_slave_arr_free);
+	}
+}
+
+/*
+ * Take the slaves that left the bond out of arr in place, for when no
+ * new array can be allocated.  A reader sees the old or the new entry
+ * at each index, and both are slaves that are still safe to use; the
+ * entries past the new count are left as they were.
+ */
+static void bond_slave_arr_prune(struct bonding *bond,
+				 struct bond_slave_arr *arr)
+{
+	struct slave *slave;
+	int i, j, count = 0;
+
+	for (j = 0; j < arr->count; j++) {
+		bond_for_each_slave(bond, slave, i) {
+			if (slave == arr->arr[j]) {
+				arr->arr[count++] = slave;
+				break;
+			}
+		}
+	}
+
+	if (!count) {
+		bond_slave_arr_replace(bond, NULL);
+		return;
+	}
+
+	smp_wmb();
+	arr->count = count;
+}
+
+static inline int bond_slave_in_arr(struct slave *slave, int ad, int agg_id)
+{
+	struct aggregator *agg;
+
+	if (!ad) {
+		return 1;
+	}
+
+	agg = SLAVE_AD_INFO(slave).port.aggregator;
+
+	return agg && (agg->aggregator_identifier == agg_id);
+}
+
+/*
+ * Rebuild bond->slave_arr, the array the balance-xor and 802.3ad xmit
+ * functions select a slave from, if its contents changed.
+ *
+ * bond->lock held for writing by caller, or for reading by the 802.3ad
+ * state machine, which is the only updater that does not write-lock.
+ */
+void bond_update_slave_arr(struct bonding *bond)
+{
+	struct bond_slave_arr *old_arr = bond->slave_arr;
+	struct bond_slave_arr *new_arr = NULL;
+	struct ad_info ad_info;
+	struct slave *slave;
+	int ad = 0, agg_id = -1;
+	int count = 0, same;
+	int i;
+
+	switch (bond->params.mode) {
+	case BOND_MODE_XOR:
+		break;
+	case BOND_MODE_8023AD:
+		ad = 1;
+		if (bond->slave_cnt && !bond_3ad_get_active_agg_info(bond, &ad_info)) {
+			agg_id = ad_info.aggregator_id;
+		}
+		break;
+	default:
+		return;
+	}
+
+	/* count the members, checking whether they are the ones we have */
+	same = (old_arr != NULL) && (!ad || old_arr->aggregator_id == agg_id);
+	bond_for_each_slave(bond, slave, i) {
+		if (!bond_slave_in_arr(slave, ad, agg_id)) {
+			continue;
+		}
+
+		if (same && ((count >= old_arr->count) ||
+			     (old_arr->arr[count] != slave))) {
+			same = 0;
+		}
+		count++;
+	}
+
+	if (same && (count == old_arr->count)) {
+		return;
+	}
+
+	if (count) {
+		new_arr = kmalloc(sizeof(*new_arr) + count * sizeof(struct slave *),
+				  GFP_ATOMIC);
+		if (!new_arr) {
+			/* go on with the old array until the next update,
+			 * less the slaves that are leaving
+			 */
+			printk(KERN_ERR DRV_NAME
+			       ": Error: %s: no memory for the slave array\n",
+			       bond->dev->name);
+			if (old_arr) {
+				bond_slave_arr_prune(bond, old_arr);
+			}
+			return;
+		}
+
+		new_arr->count = 0;
+		new_arr->aggregator_id = agg_id;
+		bond_for_each_slave(bond, slave, i) {
+			if (bond_slave_in_arr(slave, ad, agg_id)) {
+				new_arr->arr[new_arr->count++] = slave;
+			}
+		}
+	} else if (!old_arr) {
+		return;
+	}
+
+	bond_slave_arr_replace(bond, new_arr);
+}
+
 /*
  * This function attaches the slave to the end of list.
  *
@@ -1541,6 +1709,7 @@ static void bond_attach_slave(struct bonding *bond, struct slave *new_slave)
 	}
 
 	bond->slave_cnt++;
+	bond_update_slave_arr(bond);
 }
 
 /*
@@ -1574,6 +1743,7 @@ static void bond_detach_slave(struct bonding *bond, struct slave *slave)
 	slave->next = NULL;
 	slave->prev = NULL;
 	bond->slave_cnt--;
+	bond_update_slave_arr(bond);
 }
 
 /*---------------------------------- IOCTL ----------------------------------*/
@@ -3154,6 +3324,13 @@ static void bond_info_show_master(struct seq_file *seq)
 	seq_printf(seq, "Bonding Mode: %s\n",
 		   bond_mode_name(bond->params.mode));
 
+	if ((bond->params.mode == BOND_MODE_XOR) ||
+	    (bond->params.mode == BOND_MODE_8023AD)) {
+		seq_printf(seq, "Transmit Hash Policy: %s (%d)\n",
+			   bond_xmit_policy_name(bond->params.xmit_policy),
+			   bond->params.xmit_policy);
+	}
+
 	if (USES_PRIMARY(bond->params.mode)) {
 		seq_printf(seq, "Primary Slave: %s\n",
 			   (bond->params.primary[0]) ?
@@ -4102,43 +4279,119 @@ out:
 }
 
 /*
- * in XOR mode, we determine the output device by performing xor on
- * the source and destination hw adresses.  If this device is not
+ * Transmit hash policies for balance-xor and 802.3ad.  Each returns a
+ * slave number in the range [0, count).
+ */
+
+/* the IP header, if this is IP and the network header is set up */
+static inline struct iphdr *bond_xmit_iph(struct sk_buff *skb)
+{
+	struct iphdr *iph = skb->nh.iph;
+
+	if ((skb->protocol != __constant_htons(ETH_P_IP)) ||
+	    ((unsigned char *)iph < skb->data) ||
+	    ((unsigned char *)(iph + 1) > skb->tail)) {
+		return NULL;
+	}
+
+	return iph;
+}
+
+/* layer 2: xor of the last byte of the source and destination MACs */
+static int bond_xmit_hash_policy_l2(struct sk_buff *skb,
+				    struct net_device *bond_dev, int count)
+{
+	struct ethhdr *data = (struct ethhdr *)skb->data;
+
+	return (data->h_dest[5] ^ bond_dev->dev_addr[5]) % count;
+}
+
+/*
+ * layer 2+3: also mixes in the IP addresses, so that all traffic to a
+ * peer stays on one slave even when it goes through a router
+ */
+static int bond_xmit_hash_policy_l23(struct sk_buff *skb,
+				     struct net_device *bond_dev, int count)
+{
+	struct ethhdr *data = (struct ethhdr *)skb->data;
+	struct iphdr *iph = bond_xmit_iph(skb);
+
+	if (iph) {
+		return ((ntohl(iph->saddr ^ iph->daddr) & 0xffff) ^
+			(data->h_dest[5] ^ bond_dev->dev_addr[5])) % count;
+	}
+
+	return (data->h_dest[5] ^ bond_dev->dev_addr[5]) % count;
+}
+
+/*
+ * layer 3+4: IP addresses and, for unfragmented TCP and UDP, the ports,
+ * so that connections to one peer can use several slaves.  Other IP
+ * traffic hashes on the addresses, non-IP traffic as in layer 2.
+ */
+static int bond_xmit_hash_policy_l34(struct sk_buff *skb,
+				     struct net_device *bond_dev, int count)
+{
+	struct ethhdr *data = (struct ethhdr *)skb->data;
+	struct iphdr *iph = bond_xmit_iph(skb);
+	u16 *layer4hdr;
+	int layer4_xor = 0;
+
+	if (iph) {
+		layer4hdr = (u16 *)((u32 *)iph + iph->ihl);
+		if (!(iph->frag_off & __constant_htons(IP_MF|IP_OFFSET)) &&
+		    ((iph->protocol == IPPROTO_TCP) ||
+		     (iph->protocol == IPPROTO_UDP)) &&
+		    ((unsigned char *)(layer4hdr + 2) <= skb->tail)) {
+			layer4_xor = ntohs(layer4hdr[0] ^ layer4hdr[1]);
+		}
+		return (layer4_xor ^
+			(ntohl(iph->saddr ^ iph->daddr) & 0xffff)) % count;
+	}
+
+	return (data->h_dest[5] ^ bond_dev->dev_addr[5]) % count;
+}
+
+/*
+ * in XOR mode, we determine the output device by hashing the packet
+ * headers according to the xmit_hash_policy.  If this device is not
  * enabled, find the next slave following this xor slave.
+ *
+ * The slave is picked from bond->slave_arr under RCU, so the transmit
+ * path takes no bond lock.
  */
 static int bond_xmit_xor(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = bond_dev->priv;
-	struct ethhdr *data = (struct ethhdr *)skb->data;
-	struct slave *slave, *start_at;
-	int slave_no;
+	struct bond_slave_arr *slaves;
+	struct slave *slave;
+	int slave_no, count;
 	int i;
 	int res = 1;
 
-	read_lock(&bond->lock);
+	rcu_read_lock();
 
-	if (!BOND_IS_OK(bond)) {
+	slaves = rcu_dereference(bond->slave_arr);
+	if (!slaves || !(bond_dev->flags & IFF_UP) || !netif_running(bond_dev)) {
 		goto out;
 	}
 
-	slave_no = (data->h_dest[5]^bond_dev->dev_addr[5]) % bond->slave_cnt;
+	/* the count can shrink under us, see bond_slave_arr_prune() */
+	count = slaves->count;
+	slave_no = bond->xmit_hash_policy(skb, bond_dev, count);
 
-	bond_for_each_slave(bond, slave, i) {
-		slave_no--;
-		if (slave_no < 0) {
-			break;
-		}
-	}
-
-	start_at = slave;
-
-	bond_for_each_slave_from(bond, slave, i, start_at) {
+	for (i = 0; i < count; i++) {
+		slave = slaves->arr[slave_no];
 		if (IS_UP(slave->dev) &&
 		    (slave->link == BOND_LINK_UP) &&
 		    (slave->state == BOND_STATE_ACTIVE)) {
 			res = bond_dev_queue_xmit(bond, skb, slave->dev);
 			break;
 		}
+
+		if (++slave_no == count) {
+			slave_no = 0;
+		}
 	}
 
 out:
@@ -4146,7 +4399,7 @@ out:
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 	}
-	read_unlock(&bond->lock);
+	rcu_read_unlock();
 	return 0;
 }
 
@@ -4249,6 +4502,25 @@ static inline void bond_set_mode_ops(struct net_device *bond_dev, int mode)
 	}
 }
 
+/*
+ * set the xmit hash function used by balance-xor and 802.3ad
+ */
+static inline void bond_set_xmit_hash_policy(struct bonding *bond)
+{
+	switch (bond->params.xmit_policy) {
+	case BOND_XMIT_POLICY_LAYER34:
+		bond->xmit_hash_policy = bond_xmit_hash_policy_l34;
+		break;
+	case BOND_XMIT_POLICY_LAYER23:
+		bond->xmit_hash_policy = bond_xmit_hash_policy_l23;
+		break;
+	case BOND_XMIT_POLICY_LAYER2:
+	default:
+		bond->xmit_hash_policy = bond_xmit_hash_policy_l2;
+		break;
+	}
+}
+
 /*
  * Does not allocate but creates a /proc entry.
  * Allowed to fail.
@@ -4270,6 +4542,7 @@ static int __init bond_init(struct net_device *bond_dev, struct bond_params *par
 	bond->curr_active_slave = NULL;
 	bond->current_arp_slave = NULL;
 	bond->primary_slave = NULL;
+	bond->slave_arr = NULL;
 	bond->dev = bond_dev;
 	INIT_LIST_HEAD(&bond->vlan_list);
 
@@ -4283,6 +4556,7 @@ static int __init bond_init(struct net_device *bond_dev, struct bond_params *par
 	bond_dev->set_mac_address = bond_set_mac_address;
 
 	bond_set_mode_ops(bond_dev, bond->params.mode);
+	bond_set_xmit_hash_policy(bond);
 
 	bond_dev->destructor = free_netdev;
 
@@ -4405,6 +4679,24 @@ static int bond_check_params(struct bond_params *params)
 		}
 	}
 
+	if (xmit_hash_policy) {
+		if ((bond_mode != BOND_MODE_XOR) &&
+		    (bond_mode != BOND_MODE_8023AD)) {
+			printk(KERN_INFO DRV_NAME
+			       ": xmit_hash_policy param is irrelevant in mode %s\n",
+			       bond_mode_name(bond_mode));
+		} else {
+			xmit_hashtype = bond_parse_parm(xmit_hash_policy,
+							xmit_hashtype_tbl);
+			if (xmit_hashtype == -1) {
+				printk(KERN_ERR DRV_NAME
+				       ": Error: Invalid xmit_hash_policy \"%s\"\n",
+				       xmit_hash_policy);
+				return -EINVAL;
+			}
+		}
+	}
+
 	if (max_bonds < 1 || max_bonds > INT_MAX) {
 		printk(KERN_WARNING DRV_NAME
 		       ": Warning: max_bonds (%d) not in range %d-%d, so it "
@@ -4606,6 +4898,7 @@ static int bond_check_params(struct bond_params *params)
 	params->downdelay = downdelay;
 	params->use_carrier = use_carrier;
 	params->lacp_fast = lacp_fast;
+	params->xmit_policy = xmit_hashtype;
 	params->primary[0] = 0;
 
 	if (primary) {
@@ -4693,6 +4986,15 @@ static void __exit bonding_exit(void)
 	rtnl_lock();
 	bond_free_all();
 	rtnl_unlock();
+
+	/* synchronize_net() does not wait for RCU callbacks, so wait for
+	 * the slave array frees to be done, and once more for the last
+	 * callback to have returned, before the module text goes
+	 */
+	while (atomic_read(&bond_slave_arr_pending)) {
+		synchronize_net();
+	}
+	synchronize_net();
 }
 
 module_init(bonding_init);
@@ -143,6 +143,7 @@ struct bond_params {
 	int updelay;
 	int downdelay;
 	int lacp_fast;
+	int xmit_policy;
 	char primary[IFNAMSIZ];
 	u32 arp_targets[BOND_MAX_ARP_TARGETS];
 };
@@ -169,6 +170,18 @@ struct slave {
 	struct tlb_slave_info tlb_info;
 };
 
+/*
+ * Slaves that the balance-xor and 802.3ad modes hash their traffic over,
+ * in slave list order.  In 802.3ad mode only the slaves of the active
+ * aggregator are included.
+ */
+struct bond_slave_arr {
+	struct rcu_head rcu;
+	int count;
+	u16 aggregator_id;	/* 802.3ad only */
+	struct slave *arr[0];
+};
+
 /*
  * Here are the locking policies for the two bonding locks:
  *
@@ -177,6 +190,11 @@ struct slave {
  *    (It is unnecessary when the write-lock is put with bond->lock.)
  * 3) When we lock with bond->curr_slave_lock, we must lock with bond->lock
  *    beforehand.
+ * 4) bond->slave_arr is read under rcu_read_lock() by the transmit path.
+ *    It is replaced with bond->lock held, and a slave it points to is
+ *    only freed after netdev_set_master() has synchronized the net.
+ *    If no new array can be allocated, leaving slaves are taken out of
+ *    the old one in place, so readers must read its count only once.
  */
 struct bonding {
 	struct   net_device *dev; /* first - usefull for panic debug */
@@ -203,6 +221,8 @@ struct bonding {
 	struct   bond_params params;
 	struct   list_head vlan_list;
 	struct   vlan_group *vlgrp;
+	struct   bond_slave_arr *slave_arr;
+	int      (*xmit_hash_policy)(struct sk_buff *, struct net_device *, int);
 };
 
 /**
@@ -247,6 +267,7 @@ extern inline void bond_set_slave_active_flags(struct slave *slave)
 
 struct vlan_entry *bond_next_vlan(struct bonding *bond, struct vlan_entry *curr);
 int bond_dev_queue_xmit(struct bonding *bond, struct sk_buff *skb, struct net_device *slave_dev);
+void bond_update_slave_arr(struct bonding *bond);
 
 #endif /* _LINUX_BONDING_H */
 
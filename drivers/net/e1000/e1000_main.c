@@ -307,6 +307,7 @@ e1000_up(struct e1000_adapter *adapter)
 	e1000_configure_tx(adapter);
 	e1000_setup_rctl(adapter);
 	e1000_configure_rx(adapter);
+	netdev->rx_recycle_size = adapter->rx_buffer_len + NET_IP_ALIGN;
 	e1000_alloc_rx_buffers(adapter);
 
 	if((err = request_irq(adapter->pdev->irq, &e1000_intr,
@@ -1212,7 +1213,7 @@ e1000_unmap_and_free_tx_resource(struct e1000_adapter *adapter,
 		buffer_info->dma = 0;
 	}
 	if(buffer_info->skb) {
-		dev_kfree_skb_any(buffer_info->skb);
+		dev_kfree_skb_recycle(adapter->netdev, buffer_info->skb);
 		buffer_info->skb = NULL;
 	}
 }
@@ -2585,7 +2586,7 @@ e1000_alloc_rx_buffers(struct e1000_adapter *adapter)
 	while(!buffer_info->skb) {
 		bufsz = adapter->rx_buffer_len + NET_IP_ALIGN;
 
-		skb = dev_alloc_skb(bufsz);
+		skb = netdev_alloc_skb(netdev, bufsz);
 		if(unlikely(!skb)) {
 			/* Better luck next round */
 			break;
@@ -2598,7 +2599,7 @@ e1000_alloc_rx_buffers(struct e1000_adapter *adapter)
 				"skb align check failed: %u bytes at %p\n",
 				bufsz, skb->data);
 			/* try again, without freeing the previous */
-			skb = dev_alloc_skb(bufsz);
+			skb = netdev_alloc_skb(netdev, bufsz);
 			if (!skb) {
 				dev_kfree_skb(oldskb);
 				break;
@@ -2620,8 +2621,6 @@ e1000_alloc_rx_buffers(struct e1000_adapter *adapter)
 		 */
 		skb_reserve(skb, NET_IP_ALIGN);
 
-		skb->dev = netdev;
-
 		buffer_info->skb = skb;
 		buffer_info->length = adapter->rx_buffer_len;
 		buffer_info->dma = pci_map_single(pdev,
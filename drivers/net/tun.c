@@ -56,6 +56,14 @@
 #include <linux/if_ether.h>
 #include <linux/if_tun.h>
 #include <linux/crc32.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/in.h>
+#include <linux/tcp.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <net/checksum.h>
+#include <net/ip.h>
 
 #include <asm/system.h>
 #include <asm/uaccess.h>
@@ -68,6 +76,7 @@ static int debug;
 
 static LIST_HEAD(tun_dev_list);
 static struct ethtool_ops tun_ethtool_ops;
+static u32 tun_hash_rnd;
 
 /* Net device open. */
 static int tun_net_open(struct net_device *dev)
@@ -83,19 +92,72 @@ static int tun_net_close(struct net_device *dev)
 	return 0;
 }
 
+/* Spread packets over the queues by flow, so that a flow stays in
+ * order on one queue.  Called with dev->xmit_lock held. */
+static struct tun_queue *tun_select_queue(struct tun_struct *tun,
+					  struct sk_buff *skb)
+{
+	int nhoff = skb->nh.raw - skb->data;
+	u32 _ports, *ports = NULL;
+	u32 hash;
+
+	if (tun->numqueues == 1 || nhoff < 0)
+		return tun->queues[0];
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP): {
+		struct iphdr _iph, *iph;
+
+		iph = skb_header_pointer(skb, nhoff, sizeof(_iph), &_iph);
+		if (iph == NULL)
+			return tun->queues[0];
+		if (!(iph->frag_off & htons(IP_MF | IP_OFFSET)) &&
+		    (iph->protocol == IPPROTO_TCP ||
+		     iph->protocol == IPPROTO_UDP))
+			ports = skb_header_pointer(skb, nhoff + iph->ihl * 4,
+						   sizeof(_ports), &_ports);
+		hash = jhash_3words(iph->saddr, iph->daddr,
+				    ports ? *ports : 0, tun_hash_rnd);
+		break;
+	}
+	case __constant_htons(ETH_P_IPV6): {
+		struct ipv6hdr _ip6h, *ip6h;
+
+		ip6h = skb_header_pointer(skb, nhoff, sizeof(_ip6h), &_ip6h);
+		if (ip6h == NULL)
+			return tun->queues[0];
+		if (ip6h->nexthdr == IPPROTO_TCP ||
+		    ip6h->nexthdr == IPPROTO_UDP)
+			ports = skb_header_pointer(skb, nhoff + sizeof(*ip6h),
+						   sizeof(_ports), &_ports);
+		hash = jhash_3words(ip6h->saddr.s6_addr32[3],
+				    ip6h->daddr.s6_addr32[3],
+				    ports ? *ports : 0, tun_hash_rnd);
+		break;
+	}
+	default:
+		return tun->queues[0];
+	}
+
+	return tun->queues[hash % tun->numqueues];
+}
+
 /* Net device start xmit */
 static int tun_net_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct tun_struct *tun = netdev_priv(dev);
+	struct tun_queue *q;
 
 	DBG(KERN_INFO "%s: tun_net_xmit %d\n", tun->dev->name, skb->len);
 
 	/* Drop packet if interface is not attached */
-	if (!tun->attached)
+	if (!tun->numqueues)
 		goto drop;
 
+	q = tun_select_queue(tun, skb);
+
 	/* Packet dropping */
-	if (skb_queue_len(&tun->readq) >= dev->tx_queue_len) {
+	if (skb_queue_len(&q->readq) >= dev->tx_queue_len) {
 		if (!(tun->flags & TUN_ONE_QUEUE)) {
 			/* Normal queueing mode. */
 			/* Packet scheduler handles dropping of further packets. */
@@ -112,13 +174,13 @@ static int tun_net_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 
 	/* Queue packet */
-	skb_queue_tail(&tun->readq, skb);
+	skb_queue_tail(&q->readq, skb);
 	dev->trans_start = jiffies;
 
 	/* Notify and wake up reader process */
-	if (tun->flags & TUN_FASYNC)
-		kill_fasync(&tun->fasync, SIGIO, POLL_IN);
-	wake_up_interruptible(&tun->read_wait);
+	if (q->flags & TUN_FASYNC)
+		kill_fasync(&q->fasync, SIGIO, POLL_IN);
+	wake_up_interruptible(&q->read_wait);
 	return 0;
 
 drop:
@@ -205,17 +267,19 @@ static void tun_net_init(struct net_device *dev)
 /* Poll */
 static unsigned int tun_chr_poll(struct file *file, poll_table * wait)
 {  
-	struct tun_struct *tun = file->private_data;
+	struct tun_queue *q = file->private_data;
+	struct tun_struct *tun;
 	unsigned int mask = POLLOUT | POLLWRNORM;
 
-	if (!tun)
+	if (!q)
 		return -EBADFD;
+	tun = q->tun;
 
 	DBG(KERN_INFO "%s: tun_chr_poll\n", tun->dev->name);
 
-	poll_wait(file, &tun->read_wait, wait);
+	poll_wait(file, &q->read_wait, wait);
  
-	if (skb_queue_len(&tun->readq))
+	if (skb_queue_len(&q->readq))
 		mask |= POLLIN | POLLRDNORM;
 
 	return mask;
@@ -225,8 +289,10 @@ static unsigned int tun_chr_poll(struct file *file, poll_table * wait)
 static __inline__ ssize_t tun_get_user(struct tun_struct *tun, struct iovec *iv, size_t count)
 {
 	struct tun_pi pi = { 0, __constant_htons(ETH_P_IP) };
+	struct tun_vnet_hdr gso = { 0 };
 	struct sk_buff *skb;
 	size_t len = count;
+	int csum = 0;
 
 	if (!(tun->flags & TUN_NO_PI)) {
 		if ((len -= sizeof(pi)) > count)
@@ -235,15 +301,45 @@ static __inline__ ssize_t tun_get_user(struct tun_struct *tun, struct iovec *iv,
 		if(memcpy_fromiovec((void *)&pi, iv, sizeof(pi)))
 			return -EFAULT;
 	}
- 
+
+	if (tun->flags & TUN_VNET_HDR) {
+		if ((len -= sizeof(gso)) > count)
+			return -EINVAL;
+
+		if (memcpy_fromiovec((void *)&gso, iv, sizeof(gso)))
+			return -EFAULT;
+
+		/* Received packets cannot be super-packets */
+		if (gso.gso_type != TUN_VNET_HDR_GSO_NONE)
+			return -EINVAL;
+
+		if ((gso.flags & TUN_VNET_HDR_F_NEEDS_CSUM) &&
+		    gso.csum_start + gso.csum_offset + 2 > len)
+			return -EINVAL;
+	}
+
 	if (!(skb = alloc_skb(len + 2, GFP_KERNEL))) {
 		tun->stats.rx_dropped++;
 		return -ENOMEM;
 	}
 
 	skb_reserve(skb, 2);
-	if (memcpy_fromiovec(skb_put(skb, len), iv, len))
-		return -EFAULT;
+	if (gso.flags & TUN_VNET_HDR_F_NEEDS_CSUM) {
+		/* Checksum while copying */
+		if (memcpy_fromiovec(skb_put(skb, gso.csum_start), iv,
+				     gso.csum_start) ||
+		    csum_partial_copy_fromiovecend(skb_put(skb,
+					len - gso.csum_start),
+					iv, 0, len - gso.csum_start, &csum))
+			goto efault;
+	} else if (memcpy_fromiovec(skb_put(skb, len), iv, len))
+		goto efault;
+
+	if (gso.flags & TUN_VNET_HDR_F_NEEDS_CSUM) {
+		*(u16 *)(skb->data + gso.csum_start + gso.csum_offset) =
+			csum_fold(csum);
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+	}
 
 	skb->dev = tun->dev;
 	switch (tun->flags & TUN_TYPE_MASK) {
@@ -266,6 +362,10 @@ static __inline__ ssize_t tun_get_user(struct tun_struct *tun, struct iovec *iv,
 	tun->stats.rx_bytes += len;
 
 	return count;
+
+efault:
+	kfree_skb(skb);
+	return -EFAULT;
 } 
 
 static inline size_t iov_total(const struct iovec *iv, unsigned long count)
@@ -283,10 +383,12 @@ static inline size_t iov_total(const struct iovec *iv, unsigned long count)
 static ssize_t tun_chr_writev(struct file * file, const struct iovec *iv, 
 			      unsigned long count, loff_t *pos)
 {
-	struct tun_struct *tun = file->private_data;
+	struct tun_queue *q = file->private_data;
+	struct tun_struct *tun;
 
-	if (!tun)
+	if (!q)
 		return -EBADFD;
+	tun = q->tun;
 
 	DBG(KERN_INFO "%s: tun_chr_write %ld\n", tun->dev->name, count);
 
@@ -307,6 +409,7 @@ static __inline__ ssize_t tun_put_user(struct tun_struct *tun,
 				       struct iovec *iv, int len)
 {
 	struct tun_pi pi = { 0, skb->protocol };
+	struct tun_vnet_hdr gso = { 0 };
 	ssize_t total = 0;
 
 	if (!(tun->flags & TUN_NO_PI)) {
@@ -323,6 +426,27 @@ static __inline__ ssize_t tun_put_user(struct tun_struct *tun,
 		total += sizeof(pi);
 	}       
 
+	if (tun->flags & TUN_VNET_HDR) {
+		if ((len -= sizeof(gso)) < 0)
+			return -EINVAL;
+
+		if (skb_shinfo(skb)->tso_size) {
+			gso.gso_type = TUN_VNET_HDR_GSO_TCPV4;
+			gso.gso_size = skb_shinfo(skb)->tso_size;
+			gso.hdr_len = skb->h.raw - skb->data +
+				      skb->h.th->doff * 4;
+		}
+		if (skb->ip_summed == CHECKSUM_HW) {
+			gso.flags = TUN_VNET_HDR_F_NEEDS_CSUM;
+			gso.csum_start = skb->h.raw - skb->data;
+			gso.csum_offset = skb->csum;
+		}
+
+		if (memcpy_toiovec(iv, (void *) &gso, sizeof(gso)))
+			return -EFAULT;
+		total += sizeof(gso);
+	}
+
 	len = min_t(int, skb->len, len);
 
 	skb_copy_datagram_iovec(skb, 0, iv, len);
@@ -338,13 +462,15 @@ static __inline__ ssize_t tun_put_user(struct tun_struct *tun,
 static ssize_t tun_chr_readv(struct file *file, const struct iovec *iv,
 			    unsigned long count, loff_t *pos)
 {
-	struct tun_struct *tun = file->private_data;
+	struct tun_queue *q = file->private_data;
+	struct tun_struct *tun;
 	DECLARE_WAITQUEUE(wait, current);
 	struct sk_buff *skb;
 	ssize_t len, ret = 0;
 
-	if (!tun)
+	if (!q)
 		return -EBADFD;
+	tun = q->tun;
 
 	DBG(KERN_INFO "%s: tun_chr_read\n", tun->dev->name);
 
@@ -352,7 +478,7 @@ static ssize_t tun_chr_readv(struct file *file, const struct iovec *iv,
 	if (len < 0)
 		return -EINVAL;
 
-	add_wait_queue(&tun->read_wait, &wait);
+	add_wait_queue(&q->read_wait, &wait);
 	while (len) {
 		const u8 ones[ ETH_ALEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
 		u8 addr[ ETH_ALEN];
@@ -361,7 +487,7 @@ static ssize_t tun_chr_readv(struct file *file, const struct iovec *iv,
 		current->state = TASK_INTERRUPTIBLE;
 
 		/* Read frames from the queue */
-		if (!(skb=skb_dequeue(&tun->readq))) {
+		if (!(skb=skb_dequeue(&q->readq))) {
 			if (file->f_flags & O_NONBLOCK) {
 				ret = -EAGAIN;
 				break;
@@ -412,7 +538,7 @@ static ssize_t tun_chr_readv(struct file *file, const struct iovec *iv,
 	}
 
 	current->state = TASK_RUNNING;
-	remove_wait_queue(&tun->read_wait, &wait);
+	remove_wait_queue(&q->read_wait, &wait);
 
 	return ret;
 }
@@ -429,9 +555,6 @@ static void tun_setup(struct net_device *dev)
 {
 	struct tun_struct *tun = netdev_priv(dev);
 
-	skb_queue_head_init(&tun->readq);
-	init_waitqueue_head(&tun->read_wait);
-
 	tun->owner = -1;
 
 	SET_MODULE_OWNER(dev);
@@ -459,22 +582,37 @@ static struct tun_struct *tun_get_by_name(const char *name)
 static int tun_set_iff(struct file *file, struct ifreq *ifr)
 {
 	struct tun_struct *tun;
+	struct tun_queue *q;
 	struct net_device *dev;
 	int err;
 
+	q = kmalloc(sizeof(*q), GFP_KERNEL);
+	if (!q)
+		return -ENOMEM;
+	memset(q, 0, sizeof(*q));
+	skb_queue_head_init(&q->readq);
+	init_waitqueue_head(&q->read_wait);
+
 	tun = tun_get_by_name(ifr->ifr_name);
 	if (tun) {
-		if (tun->attached)
-			return -EBUSY;
+		/* Only multi-queue devices take more than one file */
+		err = -EBUSY;
+		if (tun->numqueues &&
+		    (!(tun->flags & TUN_MULTI_QUEUE) ||
+		     !(ifr->ifr_flags & IFF_MULTI_QUEUE) ||
+		     tun->numqueues == TUN_MAX_QUEUES))
+			goto failed;
 
 		/* Check permissions */
+		err = -EPERM;
 		if (tun->owner != -1 &&
 		    current->euid != tun->owner && !capable(CAP_NET_ADMIN))
-			return -EPERM;
+			goto failed;
 	} 
-	else if (__dev_get_by_name(ifr->ifr_name)) 
-		return -EINVAL;
-	else {
+	else if (__dev_get_by_name(ifr->ifr_name)) {
+		err = -EINVAL;
+		goto failed;
+	} else {
 		char *name;
 		unsigned long flags = 0;
 
@@ -495,10 +633,11 @@ static int tun_set_iff(struct file *file, struct ifreq *ifr)
 		if (*ifr->ifr_name)
 			name = ifr->ifr_name;
 
+		err = -ENOMEM;
 		dev = alloc_netdev(sizeof(struct tun_struct), name,
 				   tun_setup);
 		if (!dev)
-			return -ENOMEM;
+			goto failed;
 
 		tun = netdev_priv(dev);
 		tun->dev = dev;
@@ -527,14 +666,27 @@ static int tun_set_iff(struct file *file, struct ifreq *ifr)
 
 	DBG(KERN_INFO "%s: tun_set_iff\n", tun->dev->name);
 
-	if (ifr->ifr_flags & IFF_NO_PI)
-		tun->flags |= TUN_NO_PI;
+	/* The queues of a device share its flags */
+	if (!tun->numqueues) {
+		if (ifr->ifr_flags & IFF_NO_PI)
+			tun->flags |= TUN_NO_PI;
+
+		if (ifr->ifr_flags & IFF_ONE_QUEUE)
+			tun->flags |= TUN_ONE_QUEUE;
 
-	if (ifr->ifr_flags & IFF_ONE_QUEUE)
-		tun->flags |= TUN_ONE_QUEUE;
+		if (ifr->ifr_flags & IFF_VNET_HDR)
+			tun->flags |= TUN_VNET_HDR;
 
-	file->private_data = tun;
-	tun->attached = 1;
+		if (ifr->ifr_flags & IFF_MULTI_QUEUE)
+			tun->flags |= TUN_MULTI_QUEUE;
+	}
+
+	q->tun = tun;
+	spin_lock_bh(&tun->dev->xmit_lock);
+	q->index = tun->numqueues;
+	tun->queues[tun->numqueues++] = q;
+	spin_unlock_bh(&tun->dev->xmit_lock);
+	file->private_data = q;
 
 	strcpy(ifr->ifr_name, tun->dev->name);
 	return 0;
@@ -542,13 +694,62 @@ static int tun_set_iff(struct file *file, struct ifreq *ifr)
  err_free_dev:
 	free_netdev(dev);
  failed:
+	kfree(q);
 	return err;
 }
 
+/* Detach a queue from its device, called with RTNL */
+static void tun_detach(struct tun_queue *q)
+{
+	struct tun_struct *tun = q->tun;
+
+	spin_lock_bh(&tun->dev->xmit_lock);
+	tun->queues[q->index] = tun->queues[--tun->numqueues];
+	tun->queues[q->index]->index = q->index;
+	tun->queues[tun->numqueues] = NULL;
+	spin_unlock_bh(&tun->dev->xmit_lock);
+
+	/* The queue may have been what stopped the device */
+	if (tun->numqueues)
+		netif_wake_queue(tun->dev);
+
+	/* Drop read queue */
+	skb_queue_purge(&q->readq);
+	kfree(q);
+}
+
+/* Set the offloads of packets passed to user space */
+static int tun_set_offload(struct tun_struct *tun, unsigned long arg)
+{
+	struct net_device *dev = tun->dev;
+
+	if (arg & ~(TUN_F_CSUM | TUN_F_TSO4))
+		return -EINVAL;
+
+	/* Offloads need the header to describe them, TSO needs checksums */
+	if (arg && !(tun->flags & TUN_VNET_HDR))
+		return -EINVAL;
+	if ((arg & TUN_F_TSO4) && !(arg & TUN_F_CSUM))
+		return -EINVAL;
+
+	rtnl_lock();
+	dev->features &= ~(NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_HIGHDMA |
+			   NETIF_F_TSO);
+	if (arg & TUN_F_CSUM)
+		dev->features |= NETIF_F_SG | NETIF_F_HW_CSUM |
+				 NETIF_F_HIGHDMA;
+	if (arg & TUN_F_TSO4)
+		dev->features |= NETIF_F_TSO;
+	rtnl_unlock();
+
+	return 0;
+}
+
 static int tun_chr_ioctl(struct inode *inode, struct file *file, 
 			 unsigned int cmd, unsigned long arg)
 {
-	struct tun_struct *tun = file->private_data;
+	struct tun_queue *q = file->private_data;
+	struct tun_struct *tun = q ? q->tun : NULL;
 	void __user* argp = (void __user*)arg;
 	struct ifreq ifr;
 
@@ -556,6 +757,13 @@ static int tun_chr_ioctl(struct inode *inode, struct file *file,
 		if (copy_from_user(&ifr, argp, sizeof ifr))
 			return -EFAULT;
 
+	if (cmd == TUNGETFEATURES) {
+		/* TUNSETIFF flags this driver knows about */
+		return put_user(IFF_TUN | IFF_TAP | IFF_NO_PI | IFF_ONE_QUEUE |
+				IFF_VNET_HDR | IFF_MULTI_QUEUE,
+				(unsigned int __user *)argp);
+	}
+
 	if (cmd == TUNSETIFF && !tun) {
 		int err;
 
@@ -608,6 +816,9 @@ static int tun_chr_ioctl(struct inode *inode, struct file *file,
 		DBG(KERN_INFO "%s: owner set to %d\n", tun->dev->name, tun->owner);
 		break;
 
+	case TUNSETOFFLOAD:
+		return tun_set_offload(tun, arg);
+
 #ifdef TUN_DEBUG
 	case TUNSETDEBUG:
 		tun->debug = arg;
@@ -678,24 +889,26 @@ static int tun_chr_ioctl(struct inode *inode, struct file *file,
 
 static int tun_chr_fasync(int fd, struct file *file, int on)
 {
-	struct tun_struct *tun = file->private_data;
+	struct tun_queue *q = file->private_data;
+	struct tun_struct *tun;
 	int ret;
 
-	if (!tun)
+	if (!q)
 		return -EBADFD;
+	tun = q->tun;
 
 	DBG(KERN_INFO "%s: tun_chr_fasync %d\n", tun->dev->name, on);
 
-	if ((ret = fasync_helper(fd, file, on, &tun->fasync)) < 0)
+	if ((ret = fasync_helper(fd, file, on, &q->fasync)) < 0)
 		return ret; 
  
 	if (on) {
 		ret = f_setown(file, current->pid, 0);
 		if (ret)
 			return ret;
-		tun->flags |= TUN_FASYNC;
+		q->flags |= TUN_FASYNC;
 	} else 
-		tun->flags &= ~TUN_FASYNC;
+		q->flags &= ~TUN_FASYNC;
 
 	return 0;
 }
@@ -709,10 +922,12 @@ static int tun_chr_open(struct inode *inode, struct file * file)
 
 static int tun_chr_close(struct inode *inode, struct file *file)
 {
-	struct tun_struct *tun = file->private_data;
+	struct tun_queue *q = file->private_data;
+	struct tun_struct *tun;
 
-	if (!tun)
+	if (!q)
 		return 0;
+	tun = q->tun;
 
 	DBG(KERN_INFO "%s: tun_chr_close\n", tun->dev->name);
 
@@ -722,12 +937,9 @@ static int tun_chr_close(struct inode *inode, struct file *file)
 
 	/* Detach from net device */
 	file->private_data = NULL;
-	tun->attached = 0;
+	tun_detach(q);
 
-	/* Drop read queue */
-	skb_queue_purge(&tun->readq);
-
-	if (!(tun->flags & TUN_PERSIST)) {
+	if (!tun->numqueues && !(tun->flags & TUN_PERSIST)) {
 		list_del(&tun->list);
 		unregister_netdevice(tun->dev);
 	}
@@ -814,7 +1026,7 @@ static void tun_set_msglevel(struct net_device *dev, u32 value)
 static u32 tun_get_link(struct net_device *dev)
 {
 	struct tun_struct *tun = netdev_priv(dev);
-	return tun->attached;
+	return tun->numqueues != 0;
 }
 
 static u32 tun_get_rx_csum(struct net_device *dev)
@@ -850,6 +1062,8 @@ static int __init tun_init(void)
 	printk(KERN_INFO "tun: %s, %s\n", DRV_DESCRIPTION, DRV_VERSION);
 	printk(KERN_INFO "tun: %s\n", DRV_COPYRIGHT);
 
+	get_random_bytes(&tun_hash_rnd, sizeof(tun_hash_rnd));
+
 	ret = misc_register(&tun_miscdev);
 	if (ret)
 		printk(KERN_ERR "tun: Can't register misc device %d\n", TUN_MINOR);
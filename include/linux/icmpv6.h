@@ -151,9 +151,27 @@ struct icmp6_filter {
 
 #ifdef __KERNEL__
 
+#include <linux/in6.h>
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
 
+/* MLDv2 report, also parsed by the bridge for multicast snooping */
+struct mld2_grec {
+	__u8		grec_type;
+	__u8		grec_auxwords;
+	__u16		grec_nsrcs;
+	struct in6_addr	grec_mca;
+	struct in6_addr	grec_src[0];
+};
+
+struct mld2_report {
+	__u8	type;
+	__u8	resv1;
+	__u16	csum;
+	__u16	resv2;
+	__u16	ngrec;
+	struct mld2_grec grec[0];
+};
 
 extern void				icmpv6_send(struct sk_buff *skb,
 						    int type, int code,
@@ -68,6 +68,11 @@
 #define BOND_MODE_TLB           5
 #define BOND_MODE_ALB		6 /* TLB + RLB (receive load balancing) */
 
+/* xmit hashing policies for balance-xor and 802.3ad */
+#define BOND_XMIT_POLICY_LAYER2		0 /* layer 2 (MAC only), default */
+#define BOND_XMIT_POLICY_LAYER34	1 /* layer 3+4 (IP and ports) */
+#define BOND_XMIT_POLICY_LAYER23	2 /* layer 2+3 (MAC and IP) */
+
 /* each slave's link has 4 states */
 #define BOND_LINK_UP    0           /* link is up and running */
 #define BOND_LINK_FAIL  1           /* link has just gone down */
@@ -31,20 +31,33 @@
 #define DBG1( a... )
 #endif
 
+/* Maximum number of queues (file descriptors) of a multi-queue device */
+#define TUN_MAX_QUEUES	8
+
+/* One per attached file descriptor */
+struct tun_queue {
+	struct tun_struct	*tun;
+	int			index;
+	unsigned long		flags;
+
+	wait_queue_head_t	read_wait;
+	struct sk_buff_head	readq;
+
+	struct fasync_struct    *fasync;
+};
+
 struct tun_struct {
 	struct list_head        list;
 	unsigned long 		flags;
-	int			attached;
 	uid_t			owner;
 
-	wait_queue_head_t	read_wait;
-	struct sk_buff_head	readq;
+	/* changed under RTNL and dev->xmit_lock */
+	struct tun_queue	*queues[TUN_MAX_QUEUES];
+	int			numqueues;
 
 	struct net_device	*dev;
 	struct net_device_stats	stats;
 
-	struct fasync_struct    *fasync;
-
 	unsigned long if_flags;
 	u8 dev_addr[ETH_ALEN];
 	u32 chr_filter[2];
@@ -70,6 +83,8 @@ struct tun_struct {
 #define TUN_NO_PI	0x0040
 #define TUN_ONE_QUEUE	0x0080
 #define TUN_PERSIST 	0x0100	
+#define TUN_VNET_HDR	0x0200
+#define TUN_MULTI_QUEUE	0x0400
 
 /* Ioctl defines */
 #define TUNSETNOCSUM  _IOW('T', 200, int) 
@@ -77,12 +92,20 @@ struct tun_struct {
 #define TUNSETIFF     _IOW('T', 202, int) 
 #define TUNSETPERSIST _IOW('T', 203, int) 
 #define TUNSETOWNER   _IOW('T', 204, int)
+#define TUNGETFEATURES _IOR('T', 207, unsigned int)
+#define TUNSETOFFLOAD  _IOW('T', 208, unsigned int)
 
 /* TUNSETIFF ifr flags */
 #define IFF_TUN		0x0001
 #define IFF_TAP		0x0002
 #define IFF_NO_PI	0x1000
 #define IFF_ONE_QUEUE	0x2000
+#define IFF_VNET_HDR	0x4000
+#define IFF_MULTI_QUEUE	0x0100
+
+/* TUNSETOFFLOAD features, need IFF_VNET_HDR */
+#define TUN_F_CSUM	0x01	/* packets may have a partial checksum */
+#define TUN_F_TSO4	0x02	/* packets may be TCPv4 super-packets */
 
 struct tun_pi {
 	unsigned short flags;
@@ -90,4 +113,18 @@ struct tun_pi {
 };
 #define TUN_PKT_STRIP	0x0001
 
+/* With IFF_VNET_HDR every packet is preceded by this header (after
+ * struct tun_pi, if used).  Fields are in host byte order. */
+struct tun_vnet_hdr {
+	__u8 flags;
+	__u8 gso_type;
+	__u16 hdr_len;		/* length of the headers in a super-packet */
+	__u16 gso_size;		/* payload bytes per segment */
+	__u16 csum_start;	/* checksum from here to the end ... */
+	__u16 csum_offset;	/* ... goes here, relative to csum_start */
+};
+#define TUN_VNET_HDR_F_NEEDS_CSUM	1
+#define TUN_VNET_HDR_GSO_NONE		0
+#define TUN_VNET_HDR_GSO_TCPV4		1
+
 #endif /* __IF_TUN_H */
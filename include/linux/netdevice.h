@@ -171,6 +171,8 @@ struct netif_rx_stats
 	unsigned fastroute_deferred_out;
 	unsigned fastroute_latency_reduction;
 	unsigned cpu_collision;
+	unsigned recycle_hit;
+	unsigned recycle_miss;
 };
 
 DECLARE_PER_CPU(struct netif_rx_stats, netdev_rx_stat);
@@ -366,6 +368,13 @@ struct net_device
 	int			quota;
 	int			weight;
 
+	/* skb recycling, see dev_kfree_skb_recycle() */
+	struct sk_buff_head	*rx_recycle_pool; /* per CPU, NULL if off */
+	unsigned int		rx_recycle;	/* pool limit per CPU	*/
+	unsigned int		rx_recycle_size; /* rx buffer size, set
+						  * by drivers supporting it
+						  */
+
 	struct Qdisc		*qdisc;
 	struct Qdisc		*qdisc_sleeping;
 	struct Qdisc		*qdisc_ingress;
@@ -507,6 +516,10 @@ struct packet_type {
 	struct net_device		*dev;	/* NULL is wildcarded here		*/
 	int			(*func) (struct sk_buff *, struct net_device *,
 					 struct packet_type *);
+	/* Optional: take a run of packets from netif_receive_skb_list() */
+	void			(*list_func) (struct sk_buff_head *,
+					      struct net_device *,
+					      struct packet_type *);
 	void			*af_packet_priv;
 	struct list_head	list;
 };
@@ -662,17 +675,26 @@ static inline void dev_kfree_skb_any(struct sk_buff *skb)
 		dev_kfree_skb(skb);
 }
 
+/* Use this on transmit completion of drivers that set rx_recycle_size,
+ * from any context.  If recycling is enabled, the buffer may go to the
+ * per CPU pool netdev_alloc_skb() takes its receive buffers from.
+ */
+extern void dev_kfree_skb_recycle(struct net_device *dev,
+				  struct sk_buff *skb);
+
 #define HAVE_NETIF_RX 1
 extern int		netif_rx(struct sk_buff *skb);
 extern int		netif_rx_ni(struct sk_buff *skb);
 #define HAVE_NETIF_RECEIVE_SKB 1
 extern int		netif_receive_skb(struct sk_buff *skb);
+extern void		netif_receive_skb_list(struct sk_buff_head *list);
 extern int		dev_ioctl(unsigned int cmd, void __user *);
 extern int		dev_ethtool(struct ifreq *);
 extern unsigned		dev_get_flags(const struct net_device *);
 extern int		dev_change_flags(struct net_device *, unsigned);
 extern int		dev_change_name(struct net_device *, char *);
 extern int		dev_set_mtu(struct net_device *, int);
+extern int		dev_set_rx_recycle(struct net_device *, unsigned int);
 extern int		dev_set_mac_address(struct net_device *,
 					    struct sockaddr *);
 extern void		dev_queue_xmit_nit(struct sk_buff *skb, struct net_device *dev);
@@ -917,6 +939,8 @@ extern void		netdev_state_change(struct net_device *dev);
 extern void		dev_load(const char *name);
 extern void		dev_mcast_init(void);
 extern int		netdev_max_backlog;
+#define NETDEV_RX_BATCH_MAX	32
+extern int		netdev_rx_batch;
 extern int		weight_p;
 extern int		netdev_set_master(struct net_device *dev, struct net_device *master);
 extern int skb_checksum_help(struct sk_buff *skb, int inward);
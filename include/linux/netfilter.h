@@ -21,6 +21,15 @@
 #define NF_STOP 5
 #define NF_MAX_VERDICT NF_STOP
 
+/* NF_QUEUE verdicts carry the number of the queue in the upper bits */
+#define NF_VERDICT_MASK 0x0000ffff
+#define NF_VERDICT_BITS 16
+
+#define NF_VERDICT_QMASK 0xffff0000
+#define NF_VERDICT_QBITS 16
+
+#define NF_QUEUE_NR(x) ((((x) << NF_VERDICT_QBITS) & NF_VERDICT_QMASK) | NF_QUEUE)
+
 /* Generic cache responses from hook functions.
    <= 0x2000 is used for protocol-flags. */
 #define NFC_UNKNOWN 0x4000
@@ -88,6 +97,7 @@ struct nf_info
 	unsigned int hook;
 	struct net_device *indev, *outdev;
 	int (*okfn)(struct sk_buff *);
+	unsigned int queuenum;
 };
                                                                                 
 /* Function to register/unregister hook points. */
@@ -72,6 +72,9 @@ enum ip_conntrack_status {
 #include <linux/netfilter_ipv4/ip_conntrack_tuple.h>
 #include <linux/bitops.h>
 #include <linux/compiler.h>
+#include <linux/interrupt.h>
+#include <linux/notifier.h>
+#include <linux/percpu.h>
 #include <asm/atomic.h>
 
 #include <linux/netfilter_ipv4/ip_conntrack_tcp.h>
@@ -277,6 +280,103 @@ static inline int is_confirmed(struct ip_conntrack *ct)
 	return test_bit(IPS_CONFIRMED_BIT, &ct->status);
 }
 
+/* Connection tracking event bits, passed to the notifiers as a set. */
+enum ip_conntrack_events
+{
+	/* New conntrack */
+	IPCT_NEW_BIT = 0,
+	IPCT_NEW = (1 << IPCT_NEW_BIT),
+
+	/* Expected connection */
+	IPCT_RELATED_BIT = 1,
+	IPCT_RELATED = (1 << IPCT_RELATED_BIT),
+
+	/* Destroyed conntrack */
+	IPCT_DESTROY_BIT = 2,
+	IPCT_DESTROY = (1 << IPCT_DESTROY_BIT),
+
+	/* Status bits (seen reply, assured) changed */
+	IPCT_STATUS_BIT = 3,
+	IPCT_STATUS = (1 << IPCT_STATUS_BIT),
+
+	/* Protocol state changed */
+	IPCT_PROTOINFO_BIT = 4,
+	IPCT_PROTOINFO = (1 << IPCT_PROTOINFO_BIT),
+
+	/* Connection mark changed */
+	IPCT_MARK_BIT = 5,
+	IPCT_MARK = (1 << IPCT_MARK_BIT),
+};
+
+#ifdef CONFIG_IP_NF_CONNTRACK_EVENTS
+struct ip_conntrack_ecache {
+	struct ip_conntrack *ct;
+	unsigned int events;
+};
+DECLARE_PER_CPU(struct ip_conntrack_ecache, ip_conntrack_ecache);
+
+extern struct notifier_block *ip_conntrack_chain;
+extern int ip_conntrack_register_notifier(struct notifier_block *nb);
+extern int ip_conntrack_unregister_notifier(struct notifier_block *nb);
+
+extern void __ip_ct_event_cache_init(struct ip_conntrack *ct);
+extern void __ip_ct_deliver_cached_events(struct ip_conntrack_ecache *ecache);
+
+/* Events raised while a packet passes through are merged in a per CPU
+   cache and handed to the notifiers once, from the confirm hook.  The
+   cache holds a reference to its conntrack.  Nothing is recorded while
+   nobody listens. */
+static inline void
+ip_conntrack_event_cache(enum ip_conntrack_events event,
+			 const struct sk_buff *skb)
+{
+	struct ip_conntrack *ct = (struct ip_conntrack *)skb->nfct;
+	struct ip_conntrack_ecache *ecache;
+
+	if (ip_conntrack_chain == NULL)
+		return;
+
+	local_bh_disable();
+	ecache = &__get_cpu_var(ip_conntrack_ecache);
+	if (ct != ecache->ct)
+		__ip_ct_event_cache_init(ct);
+	ecache->events |= event;
+	local_bh_enable();
+}
+
+static inline void
+ip_ct_deliver_cached_events(const struct ip_conntrack *ct)
+{
+	struct ip_conntrack_ecache *ecache;
+
+	if (ip_conntrack_chain == NULL)
+		return;
+
+	local_bh_disable();
+	ecache = &__get_cpu_var(ip_conntrack_ecache);
+	if (ecache->ct == ct)
+		__ip_ct_deliver_cached_events(ecache);
+	local_bh_enable();
+}
+
+/* Immediate delivery, for events that have no packet to ride on. */
+static inline void
+ip_conntrack_event(enum ip_conntrack_events event, struct ip_conntrack *ct)
+{
+	if (ip_conntrack_chain != NULL)
+		notifier_call_chain(&ip_conntrack_chain, event, ct);
+}
+#else /* CONFIG_IP_NF_CONNTRACK_EVENTS */
+static inline void
+ip_conntrack_event_cache(enum ip_conntrack_events event,
+			 const struct sk_buff *skb) {}
+static inline void
+ip_ct_deliver_cached_events(const struct ip_conntrack *ct) {}
+static inline void
+ip_conntrack_event(enum ip_conntrack_events event,
+		   struct ip_conntrack *ct) {}
+#endif /* CONFIG_IP_NF_CONNTRACK_EVENTS */
+
 extern unsigned int ip_conntrack_htable_size;
  
 struct ip_conntrack_stat
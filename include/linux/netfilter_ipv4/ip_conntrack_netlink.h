@@ -0,0 +1,41 @@
+#ifndef _IP_CONNTRACK_NETLINK_H
+#define _IP_CONNTRACK_NETLINK_H
+/* Connection tracking table access and events over NETLINK_CONNTRACK. */
+
+#include <linux/types.h>
+
+enum ipctnl_msg_types {
+	IPCTNL_MSG_BASE = 0x10,
+	IPCTNL_MSG_CT_NEW = 0x10,	/* New or changed conntrack (event, dump) */
+	IPCTNL_MSG_CT_GET,		/* Look up by tuple, or NLM_F_DUMP */
+	IPCTNL_MSG_CT_DELETE,		/* Delete by tuple; destroyed (event) */
+	IPCTNL_MSG_MAX
+};
+
+/* Multicast groups */
+#define IPCTNL_GRP_NEW		0x1	/* New conntracks, NLM_F_CREATE set */
+#define IPCTNL_GRP_UPDATE	0x2	/* Status, protocol state or mark */
+#define IPCTNL_GRP_DESTROY	0x4	/* Conntracks going away */
+
+/* Addresses and ports in network byte order */
+struct ipctnl_tuple {
+	__u32	src;
+	__u32	dst;
+	__u16	sport;			/* Or ICMP id */
+	__u16	dport;			/* Or ICMP type and code */
+	__u8	protonum;
+	__u8	__pad[3];
+};
+
+struct ipctnl_msg {
+	struct ipctnl_tuple tuple[2];	/* Original and reply direction */
+	__u32	status;			/* IPS_* bits */
+	__u32	timeout;		/* Seconds left */
+	__u32	mark;
+	__u8	proto_state;		/* TCP or SCTP conntrack state */
+	__u8	__pad[3];
+	__u64	packets[2];		/* Zero without flow accounting */
+	__u64	bytes[2];
+};
+
+#endif /* _IP_CONNTRACK_NETLINK_H */
@@ -47,10 +47,21 @@ typedef struct ipq_verdict_msg {
 	unsigned char payload[0];	/* Optional replacement packet */
 } ipq_verdict_msg_t;
 
+typedef struct ipq_bind_msg {
+	unsigned short queue_num;	/* Queue to read packets from */
+} ipq_bind_msg_t;
+
+typedef struct ipq_batch_verdict_msg {
+	unsigned int value;		/* Verdict to hand to netfilter */
+	unsigned long id;		/* Applies to this and all older packets */
+} ipq_batch_verdict_msg_t;
+
 typedef struct ipq_peer_msg {
 	union {
 		ipq_verdict_msg_t verdict;
 		ipq_mode_msg_t mode;
+		ipq_bind_msg_t bind;
+		ipq_batch_verdict_msg_t batch;
 	} msg;
 } ipq_peer_msg_t;
 
@@ -67,6 +78,8 @@ enum {
 #define IPQM_MODE	(IPQM_BASE + 1)		/* Mode request from peer */
 #define IPQM_VERDICT	(IPQM_BASE + 2)		/* Verdict from peer */ 
 #define IPQM_PACKET	(IPQM_BASE + 3)		/* Packet from kernel */
-#define IPQM_MAX	(IPQM_BASE + 4)
+#define IPQM_BIND	(IPQM_BASE + 4)		/* Bind peer to a queue */
+#define IPQM_BATCH_VERDICT (IPQM_BASE + 5)	/* Verdict for many packets */
+#define IPQM_MAX	(IPQM_BASE + 6)
 
 #endif /*_IP_QUEUE_H*/
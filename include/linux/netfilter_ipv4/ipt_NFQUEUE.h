@@ -0,0 +1,14 @@
+/* iptables module for queueing packets to a numbered queue.
+ *
+ * With queues_total > 1, flows are spread over the queues
+ * queuenum .. queuenum + queues_total - 1.
+ */
+#ifndef _IPT_NFQ_TARGET_H
+#define _IPT_NFQ_TARGET_H
+
+struct ipt_NFQ_info {
+	u_int16_t queuenum;
+	u_int16_t queues_total;
+};
+
+#endif /* _IPT_NFQ_TARGET_H */
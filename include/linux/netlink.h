@@ -15,6 +15,7 @@
 #define NETLINK_ARPD		8
 #define NETLINK_AUDIT		9	/* auditing */
 #define NETLINK_ROUTE6		11	/* af_inet6 route comm channel */
+#define NETLINK_CONNTRACK	12	/* netfilter connection tracking */
 #define NETLINK_IP6_FW		13
 #define NETLINK_DNRTMSG		14	/* DECnet routing messages */
 #define NETLINK_KOBJECT_UEVENT	15	/* Kernel messages to userspace */
@@ -90,6 +91,41 @@ struct nlmsgerr
 	struct nlmsghdr msg;
 };
 
+/* Socket options for SOL_NETLINK */
+#define NETLINK_RX_RING		1
+#define NETLINK_RING_STATS	2
+
+struct nl_mmap_req
+{
+	unsigned int	nm_block_size;	/* Minimal size of contiguous block */
+	unsigned int	nm_block_nr;	/* Number of blocks */
+	unsigned int	nm_frame_size;	/* Size of frame */
+	unsigned int	nm_frame_nr;	/* Total number of frames */
+};
+
+struct nl_mmap_hdr
+{
+	unsigned int	nm_status;
+	unsigned int	nm_len;		/* Length of the message */
+	__u32		nm_group;	/* Destination groups */
+	__u32		nm_pid;		/* Sending process PID */
+	__u32		nm_uid;
+	__u32		nm_gid;
+};
+
+#define NL_MMAP_STATUS_UNUSED	0	/* Frame owned by the kernel */
+#define NL_MMAP_STATUS_VALID	1	/* Message follows the header */
+#define NL_MMAP_STATUS_COPY	2	/* Too large for a frame: use recvmsg */
+
+#define NL_MMAP_ALIGNMENT	NLMSG_ALIGNTO
+#define NL_MMAP_HDRLEN		NLMSG_ALIGN(sizeof(struct nl_mmap_hdr))
+
+struct nl_mmap_stats
+{
+	unsigned int	nm_frames;	/* Messages put in the ring */
+	unsigned int	nm_drops;	/* Messages lost, ring was full */
+};
+
 #define NET_MAJOR 36		/* Major 36 is reserved for networking 						*/
 
 enum {
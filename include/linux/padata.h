@@ -0,0 +1,44 @@
+/*
+ * padata.h - run jobs in parallel on several CPUs, finish them in order.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _LINUX_PADATA_H
+#define _LINUX_PADATA_H
+
+#ifdef __KERNEL__
+
+#include <linux/list.h>
+
+struct padata_instance;
+
+/*
+ * A job.  Embed it in the caller's own structure.
+ *
+ * ->parallel is called in a per-CPU kernel thread, with bottom halves
+ * disabled, and must end by calling padata_do_serial(), from any
+ * context.  ->serial is then called, also with bottom halves disabled,
+ * in the order the jobs were submitted to the instance.
+ */
+struct padata_priv {
+	struct list_head	list;
+	struct padata_instance	*pinst;
+	unsigned int		seq_nr;
+	int			cpu;
+	int			info;	/* free for the caller */
+	void			(*parallel)(struct padata_priv *padata);
+	void			(*serial)(struct padata_priv *padata);
+};
+
+extern struct padata_instance *padata_alloc(const char *name);
+extern void padata_free(struct padata_instance *pinst);
+extern int padata_do_parallel(struct padata_instance *pinst,
+			      struct padata_priv *padata);
+extern void padata_do_serial(struct padata_priv *padata);
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_PADATA_H */
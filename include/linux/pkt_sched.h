@@ -451,4 +451,26 @@ struct tc_netem_corr
 
 #define NETEM_DIST_SCALE	8192
 
+/* FQ_CODEL section */
+
+struct tc_fq_codel_qopt
+{
+	__u32	target;		/* acceptable queueing delay (psched ticks) */
+	__u32	interval;	/* width of the sojourn time window (psched ticks) */
+	__u32	limit;		/* total packets in all flows */
+	__u32	flows;		/* number of flow queues, fixed at creation */
+	__u32	quantum;	/* bytes a flow may send per round */
+	__u32	ecn;		/* mark ECN capable packets instead of dropping */
+};
+
+struct tc_fq_codel_xstats
+{
+	__u32	maxpacket;	/* largest packet seen so far */
+	__u32	drop_overlimit;	/* drops because the qdisc was full */
+	__u32	ecn_mark;	/* packets marked instead of dropped */
+	__u32	new_flow_count;	/* times a flow became active */
+	__u32	new_flows_len;	/* flows on the new flows list */
+	__u32	old_flows_len;	/* flows on the old flows list */
+};
+
 #endif
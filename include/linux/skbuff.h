@@ -182,6 +182,7 @@ struct skb_shared_info {
  *	@__unused: Dead field, may be reused
  *	@cloned: Head may be cloned (check refcnt to be sure)
  *	@nohdr: Payload reference only, must not modify header
+ *	@head_frag: Head was allocated by netdev_alloc_frag()
  *	@pkt_type: Packet class
  *	@ip_summed: Driver fed us an IP checksum
  *	@priority: Packet queueing priority
@@ -257,6 +258,7 @@ struct sk_buff {
 	unsigned char		local_df,
 				cloned:1,
 				nohdr:1,
+				head_frag:1,
 				pkt_type,
 				ip_summed;
 	__u32			priority;
@@ -312,6 +314,11 @@ extern void	       __kfree_skb(struct sk_buff *skb);
 extern struct sk_buff *alloc_skb(unsigned int size, int priority);
 extern struct sk_buff *alloc_skb_from_cache(kmem_cache_t *cp,
 					    unsigned int size, int priority);
+extern void	      *netdev_alloc_frag(unsigned int fragsz);
+extern void	       netdev_free_frag(void *data);
+extern struct sk_buff *build_skb(void *data, unsigned int frag_size);
+extern struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
+					  unsigned int length, int gfp_mask);
 extern void	       kfree_skbmem(struct sk_buff *skb);
 extern struct sk_buff *skb_clone(struct sk_buff *skb, int priority);
 extern struct sk_buff *skb_copy(const struct sk_buff *skb, int priority);
@@ -974,6 +981,9 @@ static inline void __skb_queue_purge(struct sk_buff_head *list)
 		kfree_skb(skb);
 }
 
+/* Headroom reserved by __dev_alloc_skb() and netdev_alloc_skb(). */
+#define NET_SKB_PAD	16
+
 /**
  *	__dev_alloc_skb - allocate an skbuff for sending
  *	@length: length to allocate
@@ -990,10 +1000,7 @@ static inline void __skb_queue_purge(struct sk_buff_head *list)
 static inline struct sk_buff *__dev_alloc_skb(unsigned int length,
 					      int gfp_mask)
 {
-	struct sk_buff *skb = alloc_skb(length + 16, gfp_mask);
-	if (likely(skb))
-		skb_reserve(skb, 16);
-	return skb;
+	return __netdev_alloc_skb(NULL, length, gfp_mask);
 }
 #else
 extern struct sk_buff *__dev_alloc_skb(unsigned int length, int gfp_mask);
@@ -1016,6 +1023,24 @@ static inline struct sk_buff *dev_alloc_skb(unsigned int length)
 	return __dev_alloc_skb(length, GFP_ATOMIC);
 }
 
+/**
+ *	netdev_alloc_skb - allocate an skbuff for rx on a specific device
+ *	@dev: network device to receive on
+ *	@length: length to allocate
+ *
+ *	Allocate a new &sk_buff for @dev with %NET_SKB_PAD bytes of
+ *	headroom.  Buffers up to a page are carved out of the per-CPU
+ *	fragment cache rather than kmalloc.
+ *
+ *	%NULL is returned if there is no free memory. Although this function
+ *	allocates memory it can be called from an interrupt.
+ */
+static inline struct sk_buff *netdev_alloc_skb(struct net_device *dev,
+					       unsigned int length)
+{
+	return __netdev_alloc_skb(dev, length, GFP_ATOMIC);
+}
+
 /**
  *	skb_cow - copy header of skb when it is required
  *	@skb: buffer to cow
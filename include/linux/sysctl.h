@@ -242,6 +242,7 @@ enum
 	NET_CORE_MOD_CONG=16,
 	NET_CORE_DEV_WEIGHT=17,
 	NET_CORE_SOMAXCONN=18,
+	NET_CORE_RX_BATCH=19,
 };
 
 /* /proc/sys/net/ethernet */
@@ -346,6 +347,10 @@ enum
 	NET_TCP_MODERATE_RCVBUF=106,
 	NET_TCP_TSO_WIN_DIVISOR=107,
 	NET_TCP_BIC_BETA=108,
+	NET_TCP_CONG_CONTROL=109,
+	NET_TCP_TW_REAP_QUOTA=110,
+	NET_TCP_FASTOPEN=111,
+	NET_IPV4_XFRM4_PARALLEL=112,
 };
 
 enum {
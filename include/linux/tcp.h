@@ -127,6 +127,8 @@ enum {
 #define TCP_WINDOW_CLAMP	10	/* Bound advertised window */
 #define TCP_INFO		11	/* Information about this connection. */
 #define TCP_QUICKACK		12	/* Block/reenable quick acks */
+#define TCP_CONGESTION		13	/* Congestion control algorithm */
+#define TCP_FASTOPEN		14	/* Accept data in SYNs, limit of pending children */
 
 #define TCPI_OPT_TIMESTAMPS	1
 #define TCPI_OPT_SACK		2
@@ -203,13 +205,6 @@ struct tcp_sack_block {
 	__u32	end_seq;
 };
 
-enum tcp_congestion_algo {
-	TCP_RENO=0,
-	TCP_VEGAS,
-	TCP_WESTWOOD,
-	TCP_BIC,
-};
-
 struct tcp_options_received {
 /*	PAWS/RTTM data	*/
 	long	ts_recent_stamp;/* Time we stored ts_recent (for aging) */
@@ -294,8 +289,8 @@ struct tcp_sock {
 	__u8	reordering;	/* Packet reordering metric.		*/
 	__u8	frto_counter;	/* Number of new acks after RTO */
 
-	__u8	adv_cong;	/* Using Vegas, Westwood, or BIC */
 	__u8	defer_accept;	/* User waits for some data after accept() */
+	__u8	fastopen_child;	/* Passive fast open, SYN-ACK not yet acked */
 
 /* RTT measurement */
 	__u32	srtt;		/* smoothed round trip time << 3	*/
@@ -347,6 +342,23 @@ struct tcp_sock {
 	struct tcp_sack_block duplicate_sack[1]; /* D-SACK block */
 	struct tcp_sack_block selective_acks[4]; /* The SACKS themselves*/
 
+	struct tcp_sack_block recv_sack_cache[4]; /* SACK blocks of the last ACK */
+
+	/* Retransmit queue walk hints, so that each ACK only looks at what
+	 * changed. The counts are in packets from the head of the queue.
+	 * See tcp_clear_all_retrans_hints().
+	 */
+	struct sk_buff *fastpath_skb_hint;	/* tcp_sacktag_write_queue() */
+	struct sk_buff *lost_skb_hint;		/* tcp_mark_head_lost() */
+	struct sk_buff *scoreboard_skb_hint;	/* timed out segments */
+	struct sk_buff *retransmit_skb_hint;	/* first pass of tcp_xmit_retransmit_queue() */
+	struct sk_buff *forward_skb_hint;	/* forward retransmissions */
+	int	fastpath_cnt_hint;
+	int	lost_cnt_hint;
+	int	retransmit_cnt_hint;	/* lost packets before the hint */
+	int	forward_cnt_hint;
+	__u32	lost_retrans_low;	/* snd_nxt of the oldest retransmit in flight */
+
 	__u8	syn_retries;	/* num of allowed syn retries */
 	__u8	ecn_flags;	/* ECN status bits.			*/
 	__u16	prior_ssthresh; /* ssthresh saved at recovery start	*/
@@ -368,18 +380,20 @@ struct tcp_sock {
 
 	__u32	total_retrans;	/* Total retransmits for entire connection */
 
-	/* The syn_wait_lock is necessary only to avoid proc interface having
-	 * to grab the main lock sock while browsing the listening hash
-	 * (otherwise it's deadlock prone).
-	 * This lock is acquired in read mode only from listening_get_next()
-	 * and it's acquired in write mode _only_ from code that is actively
-	 * changing the syn_wait_queue. All readers that are holding
+	/* The syn_wait_lock lets the proc interface browse the listening
+	 * hash without grabbing the main sock lock (otherwise it's deadlock
+	 * prone), and it is all the lockless SYN path takes.
+	 * It is acquired in read mode from listening_get_next(), tcpdiag
+	 * and the SYN path, and in write mode _only_ from code that is
+	 * actively changing the syn_wait_queue.  Readers that are holding
 	 * the master sock lock don't need to grab this lock in read mode
-	 * too as the syn_wait_queue writes are always protected from
-	 * the main sock lock.
+	 * too as entries are only removed under the main sock lock, new
+	 * ones are added at the head of a chain, see tcp_synq_insert().
 	 */
 	rwlock_t		syn_wait_lock;
 	struct tcp_listen_opt	*listen_opt;
+	int			fastopen_max;	/* TCP_FASTOPEN of a listener */
+	struct tcp_fastopen_request *fastopen_req; /* sendmsg(MSG_FASTOPEN) in progress */
 
 	/* FIFO of established children */
 	struct open_request	*accept_queue;
@@ -405,37 +419,10 @@ struct tcp_sock {
 		__u32	time;
 	} rcvq_space;
 
-/* TCP Westwood structure */
-        struct {
-                __u32    bw_ns_est;        /* first bandwidth estimation..not too smoothed 8) */
-                __u32    bw_est;           /* bandwidth estimate */
-                __u32    rtt_win_sx;       /* here starts a new evaluation... */
-                __u32    bk;
-                __u32    snd_una;          /* used for evaluating the number of acked bytes */
-                __u32    cumul_ack;
-                __u32    accounted;
-                __u32    rtt;
-                __u32    rtt_min;          /* minimum observed RTT */
-        } westwood;
-
-/* Vegas variables */
-	struct {
-		__u32	beg_snd_nxt;	/* right edge during last RTT */
-		__u32	beg_snd_una;	/* left edge  during last RTT */
-		__u32	beg_snd_cwnd;	/* saves the size of the cwnd */
-		__u8	doing_vegas_now;/* if true, do vegas for this RTT */
-		__u16	cntRTT;		/* # of RTTs measured within last RTT */
-		__u32	minRTT;		/* min of RTTs measured within last RTT (in usec) */
-		__u32	baseRTT;	/* the min of all Vegas RTT measurements seen (in usec) */
-	} vegas;
-
-	/* BI TCP Parameters */
-	struct {
-		__u32	cnt;		/* increase cwnd by 1 after this number of ACKs */
-		__u32 	last_max_cwnd;	/* last maximium snd_cwnd */
-		__u32	last_cwnd;	/* the last snd_cwnd */
-		__u32   last_stamp;     /* time when updated last_cwnd */
-	} bictcp;
+/* Congestion control */
+	struct tcp_congestion_ops *ca_ops;
+#define TCP_CA_PRIV_SIZE	16
+	__u32	ca_priv[TCP_CA_PRIV_SIZE];	/* private to ca_ops, see tcp_ca() */
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
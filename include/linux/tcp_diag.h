@@ -99,9 +99,10 @@ enum
 	TCPDIAG_MEMINFO,
 	TCPDIAG_INFO,
 	TCPDIAG_VEGASINFO,
+	TCPDIAG_CONG,
 };
 
-#define TCPDIAG_MAX TCPDIAG_VEGASINFO
+#define TCPDIAG_MAX TCPDIAG_CONG
 
 
 /* TCPDIAG_MEM */
@@ -114,7 +115,7 @@ struct tcpdiag_meminfo
 	__u32	tcpdiag_tmem;
 };
 
-/* TCPDIAG_VEGASINFO */
+/* TCPDIAG_VEGASINFO, filled in by the congestion control algorithm */
 
 struct tcpvegas_info {
 	__u32	tcpv_enabled;
@@ -1,6 +1,7 @@
 #ifndef _NET_ESP_H
 #define _NET_ESP_H
 
+#include <linux/config.h>
 #include <net/xfrm.h>
 #include <asm/scatterlist.h>
 
@@ -36,6 +37,11 @@ struct esp_data
 		                               int offset, int len, u8 *icv);
 		struct crypto_tfm	*tfm;
 	} auth;
+
+#ifdef CONFIG_INET_XFRM_PARALLEL
+	/* Copies with their own transforms and buffers, one per CPU */
+	struct esp_data			*percpu;
+#endif
 };
 
 extern int skb_to_sgvec(struct sk_buff *skb, struct scatterlist *sg, int offset, int len);
@@ -12,6 +12,9 @@ extern void			inet_remove_sock(struct sock *sk1);
 extern void			inet_put_sock(unsigned short num, 
 					      struct sock *sk);
 extern int			inet_release(struct socket *sock);
+extern int			__inet_stream_connect(struct socket *sock,
+						      struct sockaddr *uaddr,
+						      int addr_len, int flags);
 extern int			inet_stream_connect(struct socket *sock,
 						    struct sockaddr * uaddr,
 						    int addr_len, int flags);
@@ -87,7 +87,11 @@ extern int		ip_build_and_send_pkt(struct sk_buff *skb, struct sock *sk,
 					      struct ip_options *opt);
 extern int		ip_rcv(struct sk_buff *skb, struct net_device *dev,
 			       struct packet_type *pt);
+extern void		ip_list_rcv(struct sk_buff_head *list,
+				    struct net_device *dev,
+				    struct packet_type *pt);
 extern int		ip_local_deliver(struct sk_buff *skb);
+extern void		ip_local_deliver_proto(struct sk_buff *skb, int protocol);
 extern int		ip_mr_input(struct sk_buff *skb);
 extern int		ip_output(struct sk_buff *skb);
 extern int		ip_mc_output(struct sk_buff *skb);
@@ -300,7 +304,7 @@ enum ip_defrag_users
 };
 
 struct sk_buff *ip_defrag(struct sk_buff *skb, u32 user);
-extern int ip_frag_nqueues;
+extern atomic_t ip_frag_nqueues;
 extern atomic_t ip_frag_mem;
 
 /*
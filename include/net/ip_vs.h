@@ -258,6 +258,7 @@ struct ip_vs_daemon_user {
 #include <net/tcp.h>
 #include <net/udp.h>
 #include <linux/compiler.h>
+#include <linux/rcupdate.h>		/* for struct rcu_head */
 
 
 #ifdef CONFIG_IP_VS_DEBUG
@@ -359,6 +360,7 @@ enum {
 	NET_IPV4_VS_SYNC_THRESHOLD=24,
 	NET_IPV4_VS_NAT_ICMP_SEND=25,
 	NET_IPV4_VS_EXPIRE_QUIESCENT_TEMPLATE=26,
+	NET_IPV4_VS_SYNC_FLUSH_INTERVAL=27,
 	NET_IPV4_VS_LAST
 };
 
@@ -409,6 +411,19 @@ struct ip_vs_seq {
 };
 
 
+/*
+ *	Per-CPU packet counters, updated locklessly from the packet path
+ *	and folded into struct ip_vs_stats by ip_vs_read_cpu_stats()
+ */
+struct ip_vs_cpu_stats
+{
+	__u32                   conns;          /* connections scheduled */
+	__u32                   inpkts;         /* incoming packets */
+	__u32                   outpkts;        /* outgoing packets */
+	__u64                   inbytes;        /* incoming bytes */
+	__u64                   outbytes;       /* outgoing bytes */
+};
+
 /*
  *	IPVS statistics object
  */
@@ -427,6 +442,8 @@ struct ip_vs_stats
 	__u32			outbps;		/* current out byte rate */
 
 	spinlock_t              lock;           /* spin lock */
+	struct ip_vs_cpu_stats	*cpustats;	/* per-CPU counters */
+	struct ip_vs_cpu_stats	zero;		/* their sums when zeroed */
 };
 
 struct ip_vs_conn;
@@ -499,6 +516,7 @@ extern struct ip_vs_protocol * ip_vs_proto_get(unsigned short proto);
  */
 struct ip_vs_conn {
 	struct list_head        c_list;         /* hashed list heads */
+	struct rcu_head		rcu_head;	/* deferred free after unhash */
 
 	/* Protocol, addresses and port numbers */
 	__u32                   caddr;          /* client address */
@@ -881,6 +899,7 @@ extern int sysctl_ip_vs_expire_nodest_conn;
 extern int sysctl_ip_vs_expire_quiescent_template;
 extern int sysctl_ip_vs_sync_threshold[2];
 extern int sysctl_ip_vs_nat_icmp_send;
+extern int sysctl_ip_vs_sync_flush_interval;
 extern struct ip_vs_stats ip_vs_stats;
 
 extern struct ip_vs_service *
@@ -919,6 +938,10 @@ extern void ip_vs_sync_conn(struct ip_vs_conn *cp);
 extern int ip_vs_new_estimator(struct ip_vs_stats *stats);
 extern void ip_vs_kill_estimator(struct ip_vs_stats *stats);
 extern void ip_vs_zero_estimator(struct ip_vs_stats *stats);
+extern int ip_vs_new_stats(struct ip_vs_stats *stats);
+extern void ip_vs_free_stats(struct ip_vs_stats *stats);
+extern void ip_vs_read_cpu_stats(struct ip_vs_stats *stats);
+extern void ip_vs_zero_cpu_stats(struct ip_vs_stats *stats);
 
 /*
  *	Various IPVS packet transmitters (from ip_vs_xmit.c)
@@ -195,6 +195,8 @@ struct tcp_tw_bucket {
 	volatile unsigned char	tw_substate;
 	unsigned char		tw_rcv_wscale;
 	__u16			tw_sport;
+	__u16			tw_cpu;		/* death row we sit on */
+	unsigned char		tw_ipv6only;
 	/* Socket demultiplex comparisons on incoming packets. */
 	/* these five are in inet_sock */
 	__u32			tw_daddr
@@ -209,17 +211,25 @@ struct tcp_tw_bucket {
 	__u32			tw_snd_nxt;
 	__u32			tw_rcv_wnd;
 	__u32			tw_ts_recent;
-	long			tw_ts_recent_stamp;
+	__u32			tw_ts_recent_stamp;	/* seconds */
 	unsigned long		tw_ttd;
 	struct tcp_bind_bucket	*tw_tb;
 	struct hlist_node	tw_death_node;
+};
+
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+/* IPv6 buckets come from their own cache, so that the far more
+ * common IPv4 ones do not carry 32 bytes of unused addresses.
+ */
+struct tcp6_tw_bucket {
+	struct tcp_tw_bucket	tw;
 	struct in6_addr		tw_v6_daddr;
 	struct in6_addr		tw_v6_rcv_saddr;
-	int			tw_v6_ipv6only;
-#endif
 };
 
+#define tcp6tw(__tw)	((struct tcp6_tw_bucket *)(__tw))
+#endif
+
 static __inline__ void tw_add_node(struct tcp_tw_bucket *tw,
 				   struct hlist_head *list)
 {
@@ -278,7 +288,7 @@ static inline u32 tcp_v4_rcv_saddr(const struct sock *sk)
 static inline struct in6_addr *__tcp_v6_rcv_saddr(const struct sock *sk)
 {
 	return likely(sk->sk_state != TCP_TIME_WAIT) ?
-		&inet6_sk(sk)->rcv_saddr : &tcptw_sk(sk)->tw_v6_rcv_saddr;
+		&inet6_sk(sk)->rcv_saddr : &tcp6tw(sk)->tw_v6_rcv_saddr;
 }
 
 static inline struct in6_addr *tcp_v6_rcv_saddr(const struct sock *sk)
@@ -286,7 +296,7 @@ static inline struct in6_addr *tcp_v6_rcv_saddr(const struct sock *sk)
 	return sk->sk_family == AF_INET6 ? __tcp_v6_rcv_saddr(sk) : NULL;
 }
 
-#define tcptw_sk_ipv6only(__sk)	(tcptw_sk(__sk)->tw_v6_ipv6only)
+#define tcptw_sk_ipv6only(__sk)	(tcptw_sk(__sk)->tw_ipv6only)
 
 static inline int tcp_v6_ipv6only(const struct sock *sk)
 {
@@ -302,18 +312,30 @@ static inline int tcp_v6_ipv6only(const struct sock *sk)
 
 extern kmem_cache_t *tcp_timewait_cachep;
 
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+extern kmem_cache_t *tcp6_timewait_cachep;
+
+static inline kmem_cache_t *tcp_tw_cachep(int family)
+{
+	return family == PF_INET6 ? tcp6_timewait_cachep : tcp_timewait_cachep;
+}
+#else
+# define tcp_tw_cachep(__family)	tcp_timewait_cachep
+#endif
+
 static inline void tcp_tw_put(struct tcp_tw_bucket *tw)
 {
 	if (atomic_dec_and_test(&tw->tw_refcnt)) {
 #ifdef INET_REFCNT_DEBUG
 		printk(KERN_DEBUG "tw_bucket %p released\n", tw);
 #endif
-		kmem_cache_free(tcp_timewait_cachep, tw);
+		kmem_cache_free(tcp_tw_cachep(tw->tw_family), tw);
 	}
 }
 
 extern atomic_t tcp_orphan_count;
-extern int tcp_tw_count;
+extern atomic_t tcp_tw_count;
+extern void tcp_tw_init(void);
 extern void tcp_time_wait(struct sock *sk, int state, int timeo);
 extern void tcp_tw_deschedule(struct tcp_tw_bucket *tw);
 
@@ -464,7 +486,6 @@ static __inline__ int tcp_sk_listen_hashfn(struct sock *sk)
 #define MAX_TCP_SYNCNT		127
 
 #define TCP_SYNQ_INTERVAL	(HZ/5)	/* Period of SYNACK timer */
-#define TCP_SYNQ_HSIZE		512	/* Size of SYNACK hash table */
 
 #define TCP_PAWS_24DAYS	(60 * 60 * 24 * 24)
 #define TCP_PAWS_MSL	60		/* Per-host timestamps are invalidated
@@ -505,24 +526,6 @@ static __inline__ int tcp_sk_listen_hashfn(struct sock *sk)
 # define TCP_TW_RECYCLE_TICK (12+2-TCP_TW_RECYCLE_SLOTS_LOG)
 #endif
 
-#define BICTCP_BETA_SCALE    1024	/* Scale factor beta calculation
-					 * max_cwnd = snd_cwnd * beta
-					 */
-#define BICTCP_MAX_INCREMENT 32		/*
-					 * Limit on the amount of
-					 * increment allowed during
-					 * binary search.
-					 */
-#define BICTCP_FUNC_OF_MIN_INCR 11	/*
-					 * log(B/Smin)/log(B/(B-1))+1,
-					 * Smin:min increment
-					 * B:log factor
-					 */
-#define BICTCP_B		4	 /*
-					  * In binary search,
-					  * go to point (max+min)/N
-					  */
-
 /*
  *	TCP option
  */
@@ -534,6 +537,7 @@ static __inline__ int tcp_sk_listen_hashfn(struct sock *sk)
 #define TCPOPT_SACK_PERM        4       /* SACK Permitted */
 #define TCPOPT_SACK             5       /* SACK Block */
 #define TCPOPT_TIMESTAMP	8	/* Better RTT estimations/PAWS */
+#define TCPOPT_FASTOPEN		34	/* Fast open cookie */
 
 /*
  *     TCP option lengths
@@ -543,6 +547,7 @@ static __inline__ int tcp_sk_listen_hashfn(struct sock *sk)
 #define TCPOLEN_WINDOW         3
 #define TCPOLEN_SACK_PERM      2
 #define TCPOLEN_TIMESTAMP      10
+#define TCPOLEN_FASTOPEN_BASE  2
 
 /* But this is what stacks really send out. */
 #define TCPOLEN_TSTAMP_ALIGNED		12
@@ -584,6 +589,7 @@ extern int sysctl_tcp_rfc1337;
 extern int sysctl_tcp_abort_on_overflow;
 extern int sysctl_tcp_max_orphans;
 extern int sysctl_tcp_max_tw_buckets;
+extern int sysctl_tcp_tw_reap_quota;
 extern int sysctl_tcp_fack;
 extern int sysctl_tcp_reordering;
 extern int sysctl_tcp_ecn;
@@ -596,18 +602,10 @@ extern int sysctl_tcp_adv_win_scale;
 extern int sysctl_tcp_tw_reuse;
 extern int sysctl_tcp_frto;
 extern int sysctl_tcp_low_latency;
-extern int sysctl_tcp_westwood;
-extern int sysctl_tcp_vegas_cong_avoid;
-extern int sysctl_tcp_vegas_alpha;
-extern int sysctl_tcp_vegas_beta;
-extern int sysctl_tcp_vegas_gamma;
 extern int sysctl_tcp_nometrics_save;
-extern int sysctl_tcp_bic;
-extern int sysctl_tcp_bic_fast_convergence;
-extern int sysctl_tcp_bic_low_window;
-extern int sysctl_tcp_bic_beta;
 extern int sysctl_tcp_moderate_rcvbuf;
 extern int sysctl_tcp_tso_win_divisor;
+extern int sysctl_tcp_fastopen;
 
 extern atomic_t tcp_memory_allocated;
 extern atomic_t tcp_sockets_allocated;
@@ -653,7 +651,9 @@ struct open_request {
 		sack_ok : 1,
 		wscale_ok : 1,
 		ecn_ok : 1,
-		acked : 1;
+		acked : 1,
+		fastopen_cookie : 1,	/* SYN-ACK carries a fast open cookie */
+		fastopen : 1;		/* child created from a fast open SYN */
 	/* The following two fields can be easily recomputed I think -AK */
 	__u32			window_clamp;	/* window clamp at creation time */
 	__u32			rcv_wnd;	/* rcv_wnd offered first time */
@@ -882,9 +882,12 @@ extern int			tcp_recvmsg(struct kiocb *iocb, struct sock *sk,
 
 extern int			tcp_listen_start(struct sock *sk);
 
+struct tcp_fastopen_cookie;
+
 extern void			tcp_parse_options(struct sk_buff *skb,
 						  struct tcp_options_received *opt_rx,
-						  int estab);
+						  int estab,
+						  struct tcp_fastopen_cookie *foc);
 
 /*
  *	TCP v4 functions exported for the inet6 API
@@ -951,6 +954,7 @@ extern int  tcp_write_wakeup(struct sock *);
 extern void tcp_send_fin(struct sock *sk);
 extern void tcp_send_active_reset(struct sock *sk, int priority);
 extern int  tcp_send_synack(struct sock *);
+extern int  tcp_queue_synack(struct sock *);
 extern void tcp_push_one(struct sock *, unsigned mss_now);
 extern void tcp_send_ack(struct sock *sk);
 extern void tcp_send_delayed_ack(struct sock *sk);
@@ -1224,88 +1228,104 @@ static __inline__ unsigned int tcp_packets_in_flight(const struct tcp_sock *tp)
 }
 
 /*
- * Which congestion algorithim is in use on the connection.
- */
-#define tcp_is_vegas(__tp)	((__tp)->adv_cong == TCP_VEGAS)
-#define tcp_is_westwood(__tp)	((__tp)->adv_cong == TCP_WESTWOOD)
-#define tcp_is_bic(__tp)	((__tp)->adv_cong == TCP_BIC)
-
-/* Recalculate snd_ssthresh, we want to set it to:
- *
- * Reno:
- * 	one half the current congestion window, but no
- *	less than two segments
+ * Pluggable congestion control.
  *
- * BIC:
- *	behave like Reno until low_window is reached,
- *	then increase congestion window slowly
+ * Every connection runs one algorithm, tp->ca_ops, which keeps its
+ * per connection state in tp->ca_priv.  Algorithms register themselves
+ * (usually from a module), the system wide default is chosen with
+ * net.ipv4.tcp_congestion_control and a socket can pick another one
+ * with the TCP_CONGESTION socket option.
  */
-static inline __u32 tcp_recalc_ssthresh(struct tcp_sock *tp)
-{
-	if (tcp_is_bic(tp)) {
-		if (sysctl_tcp_bic_fast_convergence &&
-		    tp->snd_cwnd < tp->bictcp.last_max_cwnd)
-			tp->bictcp.last_max_cwnd = (tp->snd_cwnd * 
-						    (BICTCP_BETA_SCALE
-						     + sysctl_tcp_bic_beta))
-				/ (2 * BICTCP_BETA_SCALE);
-		else
-			tp->bictcp.last_max_cwnd = tp->snd_cwnd;
+#define TCP_CA_NAME_MAX	16
+
+/* Events passed to cwnd_event() */
+enum tcp_ca_event {
+	CA_EVENT_TX_START,	/* first transmit when no packets in flight */
+	CA_EVENT_CWND_RESTART,	/* congestion window restart after idle */
+	CA_EVENT_COMPLETE_CWR,	/* end of congestion recovery */
+	CA_EVENT_FRTO,		/* fast recovery timeout */
+	CA_EVENT_LOSS,		/* loss timeout */
+	CA_EVENT_FAST_ACK,	/* in sequence ack, header predicted */
+	CA_EVENT_SLOW_ACK,	/* other ack */
+};
 
-		if (tp->snd_cwnd > sysctl_tcp_bic_low_window)
-			return max((tp->snd_cwnd * sysctl_tcp_bic_beta)
-				   / BICTCP_BETA_SCALE, 2U);
-	}
+struct tcp_congestion_ops {
+	struct list_head	list;
+
+	/* initialize private data (optional) */
+	void (*init)(struct tcp_sock *tp);
+	/* cleanup private data  (optional) */
+	void (*release)(struct tcp_sock *tp);
+
+	/* return slow start threshold (required) */
+	u32 (*ssthresh)(struct tcp_sock *tp);
+	/* lower bound for congestion window (optional) */
+	u32 (*min_cwnd)(struct tcp_sock *tp);
+	/* do new cwnd calculation (required) */
+	void (*cong_avoid)(struct tcp_sock *tp, u32 ack,
+			   u32 rtt, u32 in_flight, int good_ack);
+	/* round trip time sample in jiffies (optional) */
+	void (*rtt_sample)(struct tcp_sock *tp, u32 rtt);
+	/* call before changing ca_state (optional) */
+	void (*set_state)(struct tcp_sock *tp, u8 new_state);
+	/* call when cwnd event occurs (optional) */
+	void (*cwnd_event)(struct tcp_sock *tp, enum tcp_ca_event ev);
+	/* new value of cwnd after loss (optional) */
+	u32  (*undo_cwnd)(struct tcp_sock *tp);
+	/* get info for tcp_diag (optional) */
+	void (*get_info)(struct tcp_sock *tp, u32 ext, struct sk_buff *skb);
+
+	char 		name[TCP_CA_NAME_MAX];
+	struct module 	*owner;
+};
 
-	return max(tp->snd_cwnd >> 1U, 2U);
-}
+extern int tcp_register_congestion_control(struct tcp_congestion_ops *type);
+extern void tcp_unregister_congestion_control(struct tcp_congestion_ops *type);
 
-/* Stop taking Vegas samples for now. */
-#define tcp_vegas_disable(__tp)	((__tp)->vegas.doing_vegas_now = 0)
-    
-static inline void tcp_vegas_enable(struct tcp_sock *tp)
+extern void tcp_init_congestion_control(struct tcp_sock *tp);
+extern void tcp_cleanup_congestion_control(struct tcp_sock *tp);
+extern int tcp_set_default_congestion_control(const char *name);
+extern void tcp_get_default_congestion_control(char *name);
+extern int tcp_set_congestion_control(struct tcp_sock *tp, const char *name);
+
+extern struct tcp_congestion_ops tcp_init_congestion_ops;
+extern u32 tcp_reno_ssthresh(struct tcp_sock *tp);
+extern void tcp_reno_cong_avoid(struct tcp_sock *tp, u32 ack,
+				u32 rtt, u32 in_flight, int good_ack);
+extern u32 tcp_reno_min_cwnd(struct tcp_sock *tp);
+extern struct tcp_congestion_ops tcp_reno;
+
+static inline void *tcp_ca(const struct tcp_sock *tp)
 {
-	/* There are several situations when we must "re-start" Vegas:
-	 *
-	 *  o when a connection is established
-	 *  o after an RTO
-	 *  o after fast recovery
-	 *  o when we send a packet and there is no outstanding
-	 *    unacknowledged data (restarting an idle connection)
-	 *
-	 * In these circumstances we cannot do a Vegas calculation at the
-	 * end of the first RTT, because any calculation we do is using
-	 * stale info -- both the saved cwnd and congestion feedback are
-	 * stale.
-	 *
-	 * Instead we must wait until the completion of an RTT during
-	 * which we actually receive ACKs.
-	 */
-    
-	/* Begin taking Vegas samples next time we send something. */
-	tp->vegas.doing_vegas_now = 1;
-     
-	/* Set the beginning of the next send window. */
-	tp->vegas.beg_snd_nxt = tp->snd_nxt;
+	return (void *) tp->ca_priv;
+}
 
-	tp->vegas.cntRTT = 0;
-	tp->vegas.minRTT = 0x7fffffff;
+static inline void tcp_set_ca_state(struct tcp_sock *tp, u8 ca_state)
+{
+	if (tp->ca_ops->set_state)
+		tp->ca_ops->set_state(tp, ca_state);
+	tp->ca_state = ca_state;
 }
 
-/* Should we be taking Vegas samples right now? */
-#define tcp_vegas_enabled(__tp)	((__tp)->vegas.doing_vegas_now)
+static inline void tcp_ca_event(struct tcp_sock *tp, enum tcp_ca_event event)
+{
+	if (tp->ca_ops->cwnd_event)
+		tp->ca_ops->cwnd_event(tp, event);
+}
 
-extern void tcp_ca_init(struct tcp_sock *tp);
+/* The connection can use the window it has, the algorithms do not
+ * grow cwnd when the sender is application limited.
+ */
+static inline int tcp_is_cwnd_limited(const struct tcp_sock *tp, u32 in_flight)
+{
+	return in_flight >= tp->snd_cwnd;
+}
 
-static inline void tcp_set_ca_state(struct tcp_sock *tp, u8 ca_state)
+/* Jacobson's slow start: one more segment per ack. */
+static inline void tcp_slow_start(struct tcp_sock *tp)
 {
-	if (tcp_is_vegas(tp)) {
-		if (ca_state == TCP_CA_Open) 
-			tcp_vegas_enable(tp);
-		else
-			tcp_vegas_disable(tp);
-	}
-	tp->ca_state = ca_state;
+	if (tp->snd_cwnd < tp->snd_cwnd_clamp)
+		tp->snd_cwnd++;
 }
 
 /* If cwnd > ssthresh, we may raise ssthresh to be half-way to cwnd.
@@ -1330,6 +1350,24 @@ static inline void tcp_sync_left_out(struct tcp_sock *tp)
 	tp->left_out = tp->sacked_out + tp->lost_out;
 }
 
+/* The LOST/RETRANS tags changed behind the walks' back. */
+static inline void tcp_clear_retrans_hints_partial(struct tcp_sock *tp)
+{
+	tp->lost_skb_hint = NULL;
+	tp->scoreboard_skb_hint = NULL;
+	tp->retransmit_skb_hint = NULL;
+	tp->forward_skb_hint = NULL;
+}
+
+/* The retransmit queue itself changed: segments were split,
+ * collapsed, trimmed or freed.
+ */
+static inline void tcp_clear_all_retrans_hints(struct tcp_sock *tp)
+{
+	tcp_clear_retrans_hints_partial(tp);
+	tp->fastpath_skb_hint = NULL;
+}
+
 extern void tcp_cwnd_application_limited(struct sock *sk);
 
 /* Congestion window validation. (RFC2861) */
@@ -1356,7 +1394,7 @@ static inline void tcp_cwnd_validate(struct sock *sk, struct tcp_sock *tp)
 static inline void __tcp_enter_cwr(struct tcp_sock *tp)
 {
 	tp->undo_marker = 0;
-	tp->snd_ssthresh = tcp_recalc_ssthresh(tp);
+	tp->snd_ssthresh = tp->ca_ops->ssthresh(tp);
 	tp->snd_cwnd = min(tp->snd_cwnd,
 			   tcp_packets_in_flight(tp) + 1U);
 	tp->snd_cwnd_cnt = 0;
@@ -1692,7 +1730,7 @@ static __inline__ void tcp_build_and_update_options(__u32 *ptr, struct tcp_sock
  * MAX_SYN_SIZE to match the new maximum number of options that you
  * can generate.
  */
-static inline void tcp_syn_build_options(__u32 *ptr, int mss, int ts, int sack,
+static inline __u32 *tcp_syn_build_options(__u32 *ptr, int mss, int ts, int sack,
 					     int offer_wscale, int wscale, __u32 tstamp, __u32 ts_recent)
 {
 	/* We always get an MSS option.
@@ -1723,8 +1761,52 @@ static inline void tcp_syn_build_options(__u32 *ptr, int mss, int ts, int sack,
 					  (TCPOPT_SACK_PERM << 8) | TCPOLEN_SACK_PERM);
 	if (offer_wscale)
 		*ptr++ = htonl((TCPOPT_NOP << 24) | (TCPOPT_WINDOW << 16) | (TCPOLEN_WINDOW << 8) | (wscale));
+	return ptr;
 }
 
+/* Fast open: a client that holds a cookie from an earlier connection
+ * may send data in its SYN, the server hands that data to the child
+ * before the handshake completes.
+ */
+#define TCP_FASTOPEN_COOKIE_SIZE	8
+
+#define TFO_CLIENT_ENABLE	1	/* sysctl_tcp_fastopen bits */
+#define TFO_SERVER_ENABLE	2
+
+struct tcp_fastopen_cookie {
+	__s8	len;		/* -1: no option, 0: cookie request */
+	__u8	val[TCP_FASTOPEN_COOKIE_SIZE];
+};
+
+/* The data of a sendmsg(MSG_FASTOPEN), only valid during the connect. */
+struct tcp_fastopen_request {
+	struct tcp_fastopen_cookie	cookie;
+	struct iovec			*iov;
+	size_t				size;
+	int				copied;
+};
+
+/* Header space of the option, including the NOP padding. */
+static inline int tcp_fastopen_option_len(const struct tcp_fastopen_cookie *foc)
+{
+	return foc->len < 0 ? 0 : 2 + TCPOLEN_FASTOPEN_BASE + foc->len;
+}
+
+static inline void tcp_fastopen_build_option(__u32 *ptr,
+					     const struct tcp_fastopen_cookie *foc)
+{
+	*ptr++ = htonl((TCPOPT_NOP << 24) | (TCPOPT_NOP << 16) |
+		       (TCPOPT_FASTOPEN << 8) | (TCPOLEN_FASTOPEN_BASE + foc->len));
+	memcpy(ptr, foc->val, foc->len);
+}
+
+extern void tcp_fastopen_cookie_gen(__u32 saddr, __u32 daddr,
+				    struct tcp_fastopen_cookie *foc);
+extern void tcp_fastopen_cache_get(struct sock *sk,
+				   struct tcp_fastopen_cookie *foc);
+extern void tcp_fastopen_cache_set(struct sock *sk,
+				   const struct tcp_fastopen_cookie *foc);
+
 /* Determine a window scaling and initial window to offer. */
 extern void tcp_select_initial_window(int __space, __u32 mss,
 				      __u32 *rcv_wnd, __u32 *window_clamp,
@@ -1766,14 +1848,28 @@ static inline void tcp_acceptq_queue(struct sock *sk, struct open_request *req,
 	req->dl_next = NULL;
 }
 
+/* SYN queue of a listening socket.
+ *
+ * Bare SYNs to IPv4 listeners are processed without the socket lock
+ * (see tcp_v4_syn_fastpath()), so the table is only changed under
+ * tp->syn_wait_lock and the counters are atomic.  Lookups done while
+ * holding the socket lock may race with additions, which only ever
+ * happen at the head of a chain.  listen_opt itself is freed only
+ * after a grace period.
+ */
 struct tcp_listen_opt
 {
 	u8			max_qlen_log;	/* log_2 of maximal queued SYNs */
-	int			qlen;
-	int			qlen_young;
+	u8			synflood;	/* answering SYNs with cookies */
+	atomic_t		qlen;
+	atomic_t		qlen_young;
 	int			clock_hand;
 	u32			hash_rnd;
-	struct open_request	*syn_table[TCP_SYNQ_HSIZE];
+	u32			nr_table_entries;
+	unsigned long		synflood_end;
+	int			fastopen_qlen;	/* unaccepted fast open children,
+						 * under the socket lock */
+	struct open_request	*syn_table[0];
 };
 
 static inline void
@@ -1781,41 +1877,79 @@ tcp_synq_removed(struct sock *sk, struct open_request *req)
 {
 	struct tcp_listen_opt *lopt = tcp_sk(sk)->listen_opt;
 
-	if (--lopt->qlen == 0)
-		tcp_delete_keepalive_timer(sk);
+	/* The SYNACK timer stops by itself once the queue is empty,
+	 * deleting it here could race with a lockless addition.
+	 */
+	atomic_dec(&lopt->qlen);
 	if (req->retrans == 0)
-		lopt->qlen_young--;
+		atomic_dec(&lopt->qlen_young);
 }
 
-static inline void tcp_synq_added(struct sock *sk)
+static inline int tcp_synq_len(struct tcp_listen_opt *lopt)
 {
-	struct tcp_listen_opt *lopt = tcp_sk(sk)->listen_opt;
+	return atomic_read(&lopt->qlen);
+}
 
-	if (lopt->qlen++ == 0)
-		tcp_reset_keepalive_timer(sk, TCP_TIMEOUT_INIT);
-	lopt->qlen_young++;
+static inline int tcp_synq_young(struct tcp_listen_opt *lopt)
+{
+	return atomic_read(&lopt->qlen_young);
 }
 
-static inline int tcp_synq_len(struct sock *sk)
+static inline int tcp_synq_is_full(struct tcp_listen_opt *lopt)
 {
-	return tcp_sk(sk)->listen_opt->qlen;
+	return tcp_synq_len(lopt) >> lopt->max_qlen_log;
 }
 
-static inline int tcp_synq_young(struct sock *sk)
+/* Link req into chain h of lopt.  Returns non-zero if the listener
+ * stopped listening meanwhile, the caller then still owns req.
+ */
+static inline int tcp_synq_insert(struct sock *sk,
+				  struct tcp_listen_opt *lopt,
+				  struct open_request *req, u32 h)
 {
-	return tcp_sk(sk)->listen_opt->qlen_young;
+	struct tcp_sock *tp = tcp_sk(sk);
+	int first;
+
+	req->sk = NULL;
+	req->expires = jiffies + TCP_TIMEOUT_INIT;
+	req->retrans = 0;
+
+	write_lock(&tp->syn_wait_lock);
+	if (unlikely(tp->listen_opt != lopt)) {
+		write_unlock(&tp->syn_wait_lock);
+		return -1;
+	}
+	req->dl_next = lopt->syn_table[h];
+	first = atomic_inc_return(&lopt->qlen) == 1;
+	atomic_inc(&lopt->qlen_young);
+	/* Lookups under the socket lock walk the chain without
+	 * syn_wait_lock, req must be complete before it is visible.
+	 */
+	smp_wmb();
+	lopt->syn_table[h] = req;
+	write_unlock(&tp->syn_wait_lock);
+
+	if (first)
+		tcp_reset_keepalive_timer(sk, TCP_TIMEOUT_INIT);
+	return 0;
 }
 
-static inline int tcp_synq_is_full(struct sock *sk)
+/* prev was found without syn_wait_lock, new requests may have been
+ * put in front of req since.  Called with syn_wait_lock held.
+ */
+static inline void __tcp_synq_unlink(struct open_request *req,
+				     struct open_request **prev)
 {
-	return tcp_synq_len(sk) >> tcp_sk(sk)->listen_opt->max_qlen_log;
+	while (*prev != req)
+		prev = &(*prev)->dl_next;
+	*prev = req->dl_next;
 }
 
 static inline void tcp_synq_unlink(struct tcp_sock *tp, struct open_request *req,
 				       struct open_request **prev)
 {
 	write_lock(&tp->syn_wait_lock);
-	*prev = req->dl_next;
+	__tcp_synq_unlink(req, prev);
 	write_unlock(&tp->syn_wait_lock);
 }
 
@@ -1841,6 +1975,8 @@ static __inline__ void tcp_openreq_init(struct open_request *req,
 	req->wscale_ok = rx_opt->wscale_ok;
 	req->acked = 0;
 	req->ecn_ok = 0;
+	req->fastopen_cookie = 0;
+	req->fastopen = 0;
 	req->rmt_port = skb->h.th->source;
 }
 
@@ -1970,53 +2106,4 @@ struct tcp_iter_state {
 
 extern int tcp_proc_register(struct tcp_seq_afinfo *afinfo);
 extern void tcp_proc_unregister(struct tcp_seq_afinfo *afinfo);
-
-/* TCP Westwood functions and constants */
-
-#define TCP_WESTWOOD_INIT_RTT  (20*HZ)           /* maybe too conservative?! */
-#define TCP_WESTWOOD_RTT_MIN   (HZ/20)           /* 50ms */
-
-static inline void tcp_westwood_update_rtt(struct tcp_sock *tp, __u32 rtt_seq)
-{
-        if (tcp_is_westwood(tp))
-                tp->westwood.rtt = rtt_seq;
-}
-
-static inline __u32 __tcp_westwood_bw_rttmin(const struct tcp_sock *tp)
-{
-        return max((tp->westwood.bw_est) * (tp->westwood.rtt_min) /
-		   (__u32) (tp->mss_cache_std),
-		   2U);
-}
-
-static inline __u32 tcp_westwood_bw_rttmin(const struct tcp_sock *tp)
-{
-	return tcp_is_westwood(tp) ? __tcp_westwood_bw_rttmin(tp) : 0;
-}
-
-static inline int tcp_westwood_ssthresh(struct tcp_sock *tp)
-{
-	__u32 ssthresh = 0;
-
-	if (tcp_is_westwood(tp)) {
-		ssthresh = __tcp_westwood_bw_rttmin(tp);
-		if (ssthresh)
-			tp->snd_ssthresh = ssthresh;  
-	}
-
-	return (ssthresh != 0);
-}
-
-static inline int tcp_westwood_cwnd(struct tcp_sock *tp)
-{
-	__u32 cwnd = 0;
-
-	if (tcp_is_westwood(tp)) {
-		cwnd = __tcp_westwood_bw_rttmin(tp);
-		if (cwnd)
-			tp->snd_cwnd = cwnd;
-	}
-
-	return (cwnd != 0);
-}
 #endif	/* _TCP_H */
@@ -213,6 +213,11 @@ struct xfrm_type
 	int			(*input)(struct xfrm_state *, struct xfrm_decap_state *, struct sk_buff *skb);
 	int			(*post_input)(struct xfrm_state *, struct xfrm_decap_state *, struct sk_buff *skb);
 	int			(*output)(struct xfrm_state *, struct sk_buff *pskb);
+	/* Optional split of ->output for parallel processing: prepare is
+	 * called under x->lock, crypt without it.  A type that has them
+	 * must also cope with ->input being called without x->lock. */
+	int			(*output_prepare)(struct xfrm_state *, struct sk_buff *skb);
+	int			(*output_crypt)(struct xfrm_state *, struct sk_buff *skb);
 	/* Estimate maximal size of result of transformation of a dgram */
 	u32			(*get_max_size)(struct xfrm_state *, int size);
 };
@@ -813,6 +818,13 @@ extern int xfrm_state_check(struct xfrm_state *x, struct sk_buff *skb);
 extern int xfrm_state_mtu(struct xfrm_state *x, int mtu);
 extern int xfrm4_rcv(struct sk_buff *skb);
 extern int xfrm4_output(struct sk_buff *skb);
+#ifdef CONFIG_INET_XFRM_PARALLEL
+struct padata_instance;
+extern int sysctl_xfrm4_parallel;
+extern struct padata_instance *xfrm4_output_pinst;
+extern struct padata_instance *xfrm4_input_pinst;
+extern int xfrm4_parallel_set(int on);
+#endif
 extern int xfrm4_tunnel_register(struct xfrm_tunnel *handler);
 extern int xfrm4_tunnel_deregister(struct xfrm_tunnel *handler);
 extern int xfrm6_rcv_spi(struct sk_buff **pskb, unsigned int *nhoffp, u32 spi);
@@ -0,0 +1,289 @@
+/*
+ * padata.c - run jobs in parallel on several CPUs, finish them in order.
+ *
+ * Jobs get a sequence number when they are submitted and are handed
+ * round robin to one kernel thread per CPU.  Each thread works through
+ * its queue in order, so when a job is done it only has to wait for the
+ * jobs with lower numbers on the other CPUs.  Whoever finishes the job
+ * that is next in line runs the serial callbacks for it and for all the
+ * finished jobs following it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/kthread.h>
+#include <linux/interrupt.h>
+#include <linux/err.h>
+#include <linux/padata.h>
+#include <asm/atomic.h>
+
+/* Jobs in flight per instance; beyond this padata_do_parallel fails. */
+#define PADATA_MAX_INFLIGHT	1000
+
+struct padata_queue {
+	spinlock_t		lock;
+	struct list_head	parallel;	/* waiting for the thread */
+	struct list_head	reorder;	/* done, waiting for their turn */
+	struct task_struct	*task;
+};
+
+struct padata_instance {
+	struct padata_queue	*queue;		/* per CPU */
+	spinlock_t		lock;		/* numbers and queues jobs */
+	unsigned int		seq_nr;		/* next to hand out */
+	spinlock_t		reorder_lock;
+	unsigned int		next_nr;	/* next to finish */
+	atomic_t		inflight;
+	int			cpu_count;
+	int			cpus[NR_CPUS];	/* job n runs on cpus[n % cpu_count] */
+};
+
+static inline struct padata_queue *padata_queue(struct padata_instance *pinst,
+						unsigned int seq_nr)
+{
+	return per_cpu_ptr(pinst->queue,
+			   pinst->cpus[seq_nr % pinst->cpu_count]);
+}
+
+static int padata_thread(void *data)
+{
+	struct padata_queue *queue = data;
+	struct padata_priv *padata;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		spin_lock_bh(&queue->lock);
+		if (list_empty(&queue->parallel)) {
+			spin_unlock_bh(&queue->lock);
+			schedule();
+			set_current_state(TASK_INTERRUPTIBLE);
+			continue;
+		}
+		padata = list_entry(queue->parallel.next,
+				    struct padata_priv, list);
+		list_del(&padata->list);
+		spin_unlock_bh(&queue->lock);
+
+		__set_current_state(TASK_RUNNING);
+		local_bh_disable();
+		padata->parallel(padata);
+		local_bh_enable();
+		cond_resched();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/**
+ * padata_do_parallel - submit a job
+ * @pinst: the instance to run it on
+ * @padata: the job, with ->parallel and ->serial set
+ *
+ * Jobs are finished in the order of the calls to this function, so
+ * callers that need an order must serialize their calls.  Returns
+ * -EBUSY if too many jobs are in flight; the job is not queued then.
+ */
+int padata_do_parallel(struct padata_instance *pinst,
+		       struct padata_priv *padata)
+{
+	struct padata_queue *queue;
+
+	if (atomic_inc_return(&pinst->inflight) > PADATA_MAX_INFLIGHT) {
+		atomic_dec(&pinst->inflight);
+		return -EBUSY;
+	}
+
+	padata->pinst = pinst;
+
+	spin_lock_bh(&pinst->lock);
+	padata->seq_nr = pinst->seq_nr++;
+	queue = padata_queue(pinst, padata->seq_nr);
+	padata->cpu = pinst->cpus[padata->seq_nr % pinst->cpu_count];
+	spin_lock(&queue->lock);
+	list_add_tail(&padata->list, &queue->parallel);
+	spin_unlock(&queue->lock);
+	spin_unlock_bh(&pinst->lock);
+
+	wake_up_process(queue->task);
+
+	return 0;
+}
+
+EXPORT_SYMBOL(padata_do_parallel);
+
+/*
+ * The job that is next in line, if it is done.  Jobs that completed
+ * out of order wait on their queue until their turn comes.
+ */
+static struct padata_priv *padata_peek_next(struct padata_instance *pinst)
+{
+	struct padata_queue *queue = padata_queue(pinst, pinst->next_nr);
+	struct padata_priv *padata;
+
+	list_for_each_entry(padata, &queue->reorder, list)
+		if (padata->seq_nr == pinst->next_nr)
+			return padata;
+
+	return NULL;
+}
+
+/* Called with reorder_lock held. */
+static struct padata_priv *padata_get_next(struct padata_instance *pinst)
+{
+	struct padata_queue *queue = padata_queue(pinst, pinst->next_nr);
+	struct padata_priv *padata;
+
+	spin_lock(&queue->lock);
+	padata = padata_peek_next(pinst);
+	if (padata) {
+		list_del(&padata->list);
+		pinst->next_nr++;
+	}
+	spin_unlock(&queue->lock);
+
+	return padata;
+}
+
+static int padata_next_done(struct padata_instance *pinst)
+{
+	struct padata_queue *queue = padata_queue(pinst, pinst->next_nr);
+	int done;
+
+	spin_lock(&queue->lock);
+	done = padata_peek_next(pinst) != NULL;
+	spin_unlock(&queue->lock);
+
+	return done;
+}
+
+static void padata_reorder(struct padata_instance *pinst)
+{
+	struct padata_priv *padata;
+
+again:
+	/* Somebody else is finishing jobs; they will see ours. */
+	if (!spin_trylock(&pinst->reorder_lock))
+		return;
+
+	while ((padata = padata_get_next(pinst)) != NULL) {
+		atomic_dec(&pinst->inflight);
+		padata->serial(padata);
+	}
+
+	spin_unlock(&pinst->reorder_lock);
+
+	/* A job that got done while we held the lock found it taken,
+	 * and has to be finished by us.
+	 */
+	smp_mb();
+	if (padata_next_done(pinst))
+		goto again;
+}
+
+/**
+ * padata_do_serial - mark a job done
+ * @padata: the job
+ *
+ * Called by the ->parallel callback when it is finished with the job.
+ * Must be called with bottom halves disabled.
+ */
+void padata_do_serial(struct padata_priv *padata)
+{
+	struct padata_instance *pinst = padata->pinst;
+	struct padata_queue *queue = per_cpu_ptr(pinst->queue, padata->cpu);
+
+	spin_lock(&queue->lock);
+	list_add_tail(&padata->list, &queue->reorder);
+	spin_unlock(&queue->lock);
+
+	padata_reorder(pinst);
+}
+
+EXPORT_SYMBOL(padata_do_serial);
+
+/**
+ * padata_alloc - set up an instance
+ * @name: name for its threads, which are called "name/cpu"
+ *
+ * Starts a thread on each online CPU.  Must be called from process
+ * context.  Returns NULL on failure.
+ */
+struct padata_instance *padata_alloc(const char *name)
+{
+	struct padata_instance *pinst;
+	int cpu;
+
+	pinst = kmalloc(sizeof(*pinst), GFP_KERNEL);
+	if (!pinst)
+		return NULL;
+
+	memset(pinst, 0, sizeof(*pinst));
+	spin_lock_init(&pinst->lock);
+	spin_lock_init(&pinst->reorder_lock);
+	atomic_set(&pinst->inflight, 0);
+
+	pinst->queue = alloc_percpu(struct padata_queue);
+	if (!pinst->queue)
+		goto err_free;
+
+	for_each_online_cpu(cpu) {
+		struct padata_queue *queue = per_cpu_ptr(pinst->queue, cpu);
+
+		spin_lock_init(&queue->lock);
+		INIT_LIST_HEAD(&queue->parallel);
+		INIT_LIST_HEAD(&queue->reorder);
+
+		queue->task = kthread_create(padata_thread, queue,
+					     "%s/%d", name, cpu);
+		if (IS_ERR(queue->task)) {
+			queue->task = NULL;
+			goto err_stop;
+		}
+		kthread_bind(queue->task, cpu);
+		wake_up_process(queue->task);
+
+		pinst->cpus[pinst->cpu_count++] = cpu;
+	}
+
+	return pinst;
+
+err_stop:
+	padata_free(pinst);
+	return NULL;
+
+err_free:
+	kfree(pinst);
+	return NULL;
+}
+
+EXPORT_SYMBOL(padata_alloc);
+
+/**
+ * padata_free - stop the threads of an instance and free it
+ * @pinst: the instance, which must have no jobs in flight
+ */
+void padata_free(struct padata_instance *pinst)
+{
+	int i;
+
+	BUG_ON(atomic_read(&pinst->inflight));
+
+	for (i = 0; i < pinst->cpu_count; i++)
+		kthread_stop(per_cpu_ptr(pinst->queue, pinst->cpus[i])->task);
+
+	free_percpu(pinst->queue);
+	kfree(pinst);
+}
+
+EXPORT_SYMBOL(padata_free);
@@ -33,6 +33,7 @@ int br_dev_xmit(struct sk_buff *skb, struct net_device *dev)
 	struct net_bridge *br = netdev_priv(dev);
 	const unsigned char *dest = skb->data;
 	struct net_bridge_fdb_entry *dst;
+	struct net_bridge_mdb_entry *mdst;
 
 	br->statistics.tx_packets++;
 	br->statistics.tx_bytes += skb->len;
@@ -41,9 +42,12 @@ int br_dev_xmit(struct sk_buff *skb, struct net_device *dev)
 	skb_pull(skb, ETH_HLEN);
 
 	rcu_read_lock();
-	if (dest[0] & 1) 
-		br_flood_deliver(br, skb, 0);
-	else if ((dst = __br_fdb_get(br, dest)) != NULL)
+	if (dest[0] & 1) {
+		if ((mdst = br_mdb_get(br, skb)) != NULL)
+			br_multicast_deliver(br, mdst, skb, 0);
+		else
+			br_flood_deliver(br, skb, 0);
+	} else if ((dst = __br_fdb_get(br, dest)) != NULL)
 		br_deliver(dst->dst, skb);
 	else
 		br_flood_deliver(br, skb, 0);
@@ -57,6 +61,7 @@ static int br_dev_open(struct net_device *dev)
 	netif_start_queue(dev);
 
 	br_stp_enable_bridge(dev->priv);
+	br_multicast_open(dev->priv);
 
 	return 0;
 }
@@ -68,6 +73,7 @@ static void br_dev_set_multicast_list(struct net_device *dev)
 static int br_dev_stop(struct net_device *dev)
 {
 	br_stp_disable_bridge(dev->priv);
+	br_multicast_stop(dev->priv);
 
 	netif_stop_queue(dev);
 
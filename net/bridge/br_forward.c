@@ -157,3 +157,88 @@ void br_flood_forward(struct net_bridge *br, struct sk_buff *skb, int clone)
 {
 	br_flood(br, skb, clone, __br_forward);
 }
+
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+/*
+ * Send a frame to the member ports of a multicast group and to the
+ * multicast router ports.  Both lists are sorted by descending port
+ * pointer, so walking them in step delivers once to each port.
+ * called with rcu_read_lock
+ */
+static void br_multicast_flood(struct net_bridge *br,
+	struct net_bridge_mdb_entry *mdst, struct sk_buff *skb, int clone,
+	void (*__packet_hook)(const struct net_bridge_port *p,
+			      struct sk_buff *skb))
+{
+	struct net_bridge_port_group *pg;
+	struct hlist_node *rp;
+	struct net_bridge_port *prev, *port, *lport, *rport;
+
+	if (clone) {
+		struct sk_buff *skb2;
+
+		if ((skb2 = skb_clone(skb, GFP_ATOMIC)) == NULL) {
+			br->statistics.tx_dropped++;
+			return;
+		}
+
+		skb = skb2;
+	}
+
+	prev = NULL;
+
+	pg = rcu_dereference(mdst->ports);
+	rp = rcu_dereference(br->router_list.first);
+	while (pg != NULL || rp != NULL) {
+		lport = pg ? pg->port : NULL;
+		rport = rp ? hlist_entry(rp, struct net_bridge_port, rlist) :
+			     NULL;
+		port = (unsigned long)lport > (unsigned long)rport ?
+		       lport : rport;
+
+		if (should_deliver(port, skb)) {
+			if (prev != NULL) {
+				struct sk_buff *skb2;
+
+				if ((skb2 = skb_clone(skb, GFP_ATOMIC)) == NULL) {
+					br->statistics.tx_dropped++;
+					kfree_skb(skb);
+					return;
+				}
+
+				__packet_hook(prev, skb2);
+			}
+
+			prev = port;
+		}
+
+		if ((unsigned long)lport >= (unsigned long)port)
+			pg = rcu_dereference(pg->next);
+		if ((unsigned long)rport >= (unsigned long)port)
+			rp = rcu_dereference(rp->next);
+	}
+
+	if (prev != NULL) {
+		__packet_hook(prev, skb);
+		return;
+	}
+
+	kfree_skb(skb);
+}
+
+/* called with rcu_read_lock */
+void br_multicast_deliver(struct net_bridge *br,
+			  struct net_bridge_mdb_entry *mdst,
+			  struct sk_buff *skb, int clone)
+{
+	br_multicast_flood(br, mdst, skb, clone, __br_deliver);
+}
+
+/* called with rcu_read_lock */
+void br_multicast_forward(struct net_bridge *br,
+			  struct net_bridge_mdb_entry *mdst,
+			  struct sk_buff *skb, int clone)
+{
+	br_multicast_flood(br, mdst, skb, clone, __br_forward);
+}
+#endif
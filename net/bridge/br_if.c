@@ -107,6 +107,7 @@ static void del_nbp(struct net_bridge_port *p)
 	spin_unlock_bh(&br->lock);
 
 	br_fdb_delete_by_port(br, p);
+	br_multicast_del_port(p);
 
 	list_del_rcu(&p->list);
 
@@ -168,6 +169,7 @@ static struct net_device *new_bridge_dev(const char *name)
 	INIT_LIST_HEAD(&br->age_list);
 
 	br_stp_timer_init(br);
+	br_multicast_init(br);
 
 	return dev;
 }
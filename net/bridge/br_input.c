@@ -52,6 +52,7 @@ int br_handle_frame_finish(struct sk_buff *skb)
 	struct net_bridge_port *p = skb->dev->br_port;
 	struct net_bridge *br = p->br;
 	struct net_bridge_fdb_entry *dst;
+	struct net_bridge_mdb_entry *mdst;
 	int passedup = 0;
 
 	if (br->dev->flags & IFF_PROMISC) {
@@ -65,7 +66,11 @@ int br_handle_frame_finish(struct sk_buff *skb)
 	}
 
 	if (dest[0] & 1) {
-		br_flood_forward(br, skb, !passedup);
+		br_multicast_rcv(br, p, skb);
+		if ((mdst = br_mdb_get(br, skb)) != NULL)
+			br_multicast_forward(br, mdst, skb, !passedup);
+		else
+			br_flood_forward(br, skb, !passedup);
 		if (!passedup)
 			br_pass_frame_up(br, skb);
 		goto out;
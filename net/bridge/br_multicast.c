@@ -0,0 +1,644 @@
+/*
+ *	IGMP/MLD snooping
+ *	Linux ethernet bridge
+ *
+ *	The bridge listens to the IGMP and MLD reports and queries it
+ *	forwards, and keeps per group the set of ports with listeners.
+ *	Multicast frames for a known group only go to those ports and to
+ *	the ports multicast routers sit behind; frames for unknown or
+ *	link-local groups are still flooded.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/in.h>
+#include <linux/igmp.h>
+#include <linux/jhash.h>
+#include <linux/rcupdate.h>
+#include <net/checksum.h>
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+#include <linux/ipv6.h>
+#include <linux/icmpv6.h>
+#include <net/ipv6.h>
+#include <net/ip6_checksum.h>
+#endif
+#include "br_private.h"
+
+static inline int br_ip_hash(const struct br_ip *ip)
+{
+	switch (ip->proto) {
+	case __constant_htons(ETH_P_IP):
+		return jhash_1word(ip->u.ip4, 0) & (BR_MDB_HASH_SIZE - 1);
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	case __constant_htons(ETH_P_IPV6):
+		return jhash2((u32 *)ip->u.ip6.s6_addr32, 4, 0)
+			& (BR_MDB_HASH_SIZE - 1);
+#endif
+	}
+	return 0;
+}
+
+static inline int br_ip_equal(const struct br_ip *a, const struct br_ip *b)
+{
+	if (a->proto != b->proto)
+		return 0;
+
+	switch (a->proto) {
+	case __constant_htons(ETH_P_IP):
+		return a->u.ip4 == b->u.ip4;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	case __constant_htons(ETH_P_IPV6):
+		return ipv6_addr_equal(&a->u.ip6, &b->u.ip6);
+#endif
+	}
+	return 0;
+}
+
+static struct net_bridge_mdb_entry *__br_mdb_ip_get(struct net_bridge *br,
+						    const struct br_ip *group,
+						    int hash)
+{
+	struct net_bridge_mdb_entry *mp;
+	struct hlist_node *h;
+
+	hlist_for_each_entry_rcu(mp, h, &br->mdb_hash[hash], hlist) {
+		if (br_ip_equal(&mp->addr, group))
+			return mp;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find the group entry for a multicast frame.  Returns NULL, meaning
+ * flood, for non-IP frames, link-local groups and unknown groups.
+ * called with rcu_read_lock
+ */
+struct net_bridge_mdb_entry *br_mdb_get(struct net_bridge *br,
+					struct sk_buff *skb)
+{
+	struct br_ip ip;
+
+	if (br->multicast_disabled)
+		return NULL;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP): {
+		struct iphdr _iph, *iph;
+
+		iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+		if (iph == NULL || !MULTICAST(iph->daddr) ||
+		    LOCAL_MCAST(iph->daddr))
+			return NULL;
+		ip.u.ip4 = iph->daddr;
+		break;
+	}
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	case __constant_htons(ETH_P_IPV6): {
+		struct ipv6hdr _ip6h, *ip6h;
+
+		ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6h == NULL || ip6h->daddr.s6_addr[0] != 0xff ||
+		    IPV6_ADDR_MC_SCOPE(&ip6h->daddr) <=
+		    IPV6_ADDR_SCOPE_LINKLOCAL)
+			return NULL;
+		ipv6_addr_copy(&ip.u.ip6, &ip6h->daddr);
+		break;
+	}
+#endif
+	default:
+		return NULL;
+	}
+
+	ip.proto = skb->protocol;
+	return __br_mdb_ip_get(br, &ip, br_ip_hash(&ip));
+}
+
+static void br_multicast_free_pg(struct rcu_head *head)
+{
+	kfree(container_of(head, struct net_bridge_port_group, rcu));
+}
+
+static void br_multicast_free_mdb(struct rcu_head *head)
+{
+	kfree(container_of(head, struct net_bridge_mdb_entry, rcu));
+}
+
+/* called under multicast lock */
+static void br_multicast_del_mdb(struct net_bridge *br,
+				 struct net_bridge_mdb_entry *mp)
+{
+	hlist_del_rcu(&mp->hlist);
+	br->mdb_count--;
+	call_rcu(&mp->rcu, br_multicast_free_mdb);
+}
+
+/* called in softirq context */
+static void br_multicast_add_group(struct net_bridge *br,
+				   struct net_bridge_port *port,
+				   struct br_ip *group)
+{
+	struct net_bridge_mdb_entry *mp;
+	struct net_bridge_port_group *pg, **pp;
+	int hash = br_ip_hash(group);
+
+	spin_lock(&br->multicast_lock);
+	if (!netif_running(br->dev) || port->state == BR_STATE_DISABLED)
+		goto out;
+
+	mp = __br_mdb_ip_get(br, group, hash);
+	if (mp == NULL) {
+		/* a full table keeps flooding unknown groups */
+		if (br->mdb_count >= BR_MDB_MAX)
+			goto out;
+
+		pg = kmalloc(sizeof(*pg), GFP_ATOMIC);
+		if (pg == NULL)
+			goto out;
+		mp = kmalloc(sizeof(*mp), GFP_ATOMIC);
+		if (mp == NULL) {
+			kfree(pg);
+			goto out;
+		}
+
+		pg->next = NULL;
+		pg->port = port;
+		mp->ports = pg;
+		mp->addr = *group;
+		hlist_add_head_rcu(&mp->hlist, &br->mdb_hash[hash]);
+		br->mdb_count++;
+		goto found;
+	}
+
+	for (pp = &mp->ports; (pg = *pp) != NULL; pp = &pg->next) {
+		if (pg->port == port)
+			goto found;
+		if ((unsigned long)pg->port < (unsigned long)port)
+			break;
+	}
+
+	pg = kmalloc(sizeof(*pg), GFP_ATOMIC);
+	if (pg == NULL)
+		goto out;
+	pg->port = port;
+	pg->next = *pp;
+	rcu_assign_pointer(*pp, pg);
+
+found:
+	pg->expires = jiffies + br->multicast_membership_interval;
+out:
+	spin_unlock(&br->multicast_lock);
+}
+
+/*
+ * A listener left.  There may be others behind the same port, so only
+ * shorten the membership: the querier asks the remaining ones to
+ * report again, which refreshes it.
+ * called in softirq context
+ */
+static void br_multicast_leave_group(struct net_bridge *br,
+				     struct net_bridge_port *port,
+				     struct br_ip *group)
+{
+	struct net_bridge_mdb_entry *mp;
+	struct net_bridge_port_group *pg;
+	unsigned long expires;
+
+	spin_lock(&br->multicast_lock);
+	mp = __br_mdb_ip_get(br, group, br_ip_hash(group));
+	if (mp == NULL)
+		goto out;
+
+	expires = jiffies + br->multicast_last_member_interval;
+	for (pg = mp->ports; pg != NULL; pg = pg->next) {
+		if (pg->port != port)
+			continue;
+		if (time_after(pg->expires, expires))
+			pg->expires = expires;
+		break;
+	}
+out:
+	spin_unlock(&br->multicast_lock);
+}
+
+/* called in softirq context */
+static void br_multicast_mark_router(struct net_bridge *br,
+				     struct net_bridge_port *port)
+{
+	struct net_bridge_port *p;
+	struct hlist_node *n, *slot = NULL;
+
+	spin_lock(&br->multicast_lock);
+	if (port->state == BR_STATE_DISABLED)
+		goto out;
+
+	port->multicast_router_expires = jiffies +
+					 br->multicast_querier_interval;
+	if (port->multicast_router)
+		goto out;
+
+	hlist_for_each_entry(p, n, &br->router_list, rlist) {
+		if ((unsigned long)port >= (unsigned long)p)
+			break;
+		slot = n;
+	}
+
+	if (slot)
+		hlist_add_after_rcu(slot, &port->rlist);
+	else
+		hlist_add_head_rcu(&port->rlist, &br->router_list);
+	port->multicast_router = 1;
+out:
+	spin_unlock(&br->multicast_lock);
+}
+
+static void br_ip4_multicast_group(struct net_bridge *br,
+				   struct net_bridge_port *port,
+				   u32 group, int join)
+{
+	struct br_ip ip;
+
+	if (!MULTICAST(group) || LOCAL_MCAST(group))
+		return;
+
+	ip.u.ip4 = group;
+	ip.proto = htons(ETH_P_IP);
+	if (join)
+		br_multicast_add_group(br, port, &ip);
+	else
+		br_multicast_leave_group(br, port, &ip);
+}
+
+static void br_ip4_multicast_igmp3_report(struct net_bridge *br,
+					  struct net_bridge_port *port,
+					  struct sk_buff *skb,
+					  int offset, int len)
+{
+	struct igmpv3_report _rep, *rep;
+	struct igmpv3_grec _grec, *grec;
+	int end = offset + len;
+	int i, num;
+
+	rep = skb_header_pointer(skb, offset, sizeof(_rep), &_rep);
+	if (rep == NULL)
+		return;
+
+	num = ntohs(rep->ngrec);
+	offset += sizeof(*rep);
+
+	for (i = 0; i < num; i++) {
+		grec = skb_header_pointer(skb, offset, sizeof(_grec), &_grec);
+		if (grec == NULL)
+			return;
+
+		offset += sizeof(*grec) + 4 * ntohs(grec->grec_nsrcs) +
+			  4 * grec->grec_auxwords;
+		if (offset > end)
+			return;
+
+		/* sources are not tracked, only whether anybody listens */
+		switch (grec->grec_type) {
+		case IGMPV3_MODE_IS_EXCLUDE:
+		case IGMPV3_CHANGE_TO_EXCLUDE:
+		case IGMPV3_ALLOW_NEW_SOURCES:
+			br_ip4_multicast_group(br, port, grec->grec_mca, 1);
+			break;
+
+		case IGMPV3_MODE_IS_INCLUDE:
+		case IGMPV3_CHANGE_TO_INCLUDE:
+			br_ip4_multicast_group(br, port, grec->grec_mca,
+					       grec->grec_nsrcs != 0);
+			break;
+		}
+	}
+}
+
+static void br_ip4_multicast_rcv(struct net_bridge *br,
+				 struct net_bridge_port *port,
+				 struct sk_buff *skb)
+{
+	struct iphdr _iph, *iph;
+	struct igmphdr _ih, *ih;
+	int offset, len;
+
+	iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+	if (iph == NULL || iph->version != 4 || iph->ihl < 5 ||
+	    iph->protocol != IPPROTO_IGMP ||
+	    (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+		return;
+
+	offset = iph->ihl * 4;
+	len = ntohs(iph->tot_len);
+	if (len > skb->len || len < offset + sizeof(*ih))
+		return;
+	len -= offset;
+
+	if (csum_fold(skb_checksum(skb, offset, len, 0)))
+		return;
+
+	ih = skb_header_pointer(skb, offset, sizeof(_ih), &_ih);
+	if (ih == NULL)
+		return;
+
+	switch (ih->type) {
+	case IGMP_HOST_MEMBERSHIP_REPORT:
+	case IGMPV2_HOST_MEMBERSHIP_REPORT:
+		br_ip4_multicast_group(br, port, ih->group, 1);
+		break;
+	case IGMPV3_HOST_MEMBERSHIP_REPORT:
+		br_ip4_multicast_igmp3_report(br, port, skb, offset, len);
+		break;
+	case IGMP_HOST_LEAVE_MESSAGE:
+		br_ip4_multicast_group(br, port, ih->group, 0);
+		break;
+	case IGMP_HOST_MEMBERSHIP_QUERY:
+		/* queries from 0.0.0.0 come from snooping switches */
+		if (iph->saddr)
+			br_multicast_mark_router(br, port);
+		break;
+	}
+}
+
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+static void br_ip6_multicast_group(struct net_bridge *br,
+				   struct net_bridge_port *port,
+				   struct in6_addr *group, int join)
+{
+	struct br_ip ip;
+
+	if (group->s6_addr[0] != 0xff ||
+	    IPV6_ADDR_MC_SCOPE(group) <= IPV6_ADDR_SCOPE_LINKLOCAL)
+		return;
+
+	ipv6_addr_copy(&ip.u.ip6, group);
+	ip.proto = htons(ETH_P_IPV6);
+	if (join)
+		br_multicast_add_group(br, port, &ip);
+	else
+		br_multicast_leave_group(br, port, &ip);
+}
+
+static void br_ip6_multicast_mld2_report(struct net_bridge *br,
+					 struct net_bridge_port *port,
+					 struct sk_buff *skb,
+					 int offset, int len)
+{
+	struct mld2_report _rep, *rep;
+	struct mld2_grec _grec, *grec;
+	int end = offset + len;
+	int i, num;
+
+	rep = skb_header_pointer(skb, offset, sizeof(_rep), &_rep);
+	if (rep == NULL)
+		return;
+
+	num = ntohs(rep->ngrec);
+	offset += sizeof(*rep);
+
+	for (i = 0; i < num; i++) {
+		grec = skb_header_pointer(skb, offset, sizeof(_grec), &_grec);
+		if (grec == NULL)
+			return;
+
+		offset += sizeof(*grec) +
+			  sizeof(struct in6_addr) * ntohs(grec->grec_nsrcs) +
+			  4 * grec->grec_auxwords;
+		if (offset > end)
+			return;
+
+		switch (grec->grec_type) {
+		case MLD2_MODE_IS_EXCLUDE:
+		case MLD2_CHANGE_TO_EXCLUDE:
+		case MLD2_ALLOW_NEW_SOURCES:
+			br_ip6_multicast_group(br, port, &grec->grec_mca, 1);
+			break;
+
+		case MLD2_MODE_IS_INCLUDE:
+		case MLD2_CHANGE_TO_INCLUDE:
+			br_ip6_multicast_group(br, port, &grec->grec_mca,
+					       grec->grec_nsrcs != 0);
+			break;
+		}
+	}
+}
+
+static void br_ip6_multicast_rcv(struct net_bridge *br,
+				 struct net_bridge_port *port,
+				 struct sk_buff *skb)
+{
+	struct ipv6hdr _ip6h, *ip6h;
+	struct icmp6hdr _ih, *ih;
+	struct in6_addr _group, *group;
+	u8 nexthdr;
+	int offset, len;
+
+	ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+	if (ip6h == NULL || ip6h->version != 6)
+		return;
+
+	offset = sizeof(*ip6h);
+	len = offset + ntohs(ip6h->payload_len);
+	if (len > skb->len)
+		return;
+
+	/* MLD is sent with a hop-by-hop router alert option */
+	nexthdr = ip6h->nexthdr;
+	if (nexthdr == NEXTHDR_HOP) {
+		struct ipv6_opt_hdr _hdr, *hp;
+
+		hp = skb_header_pointer(skb, offset, sizeof(_hdr), &_hdr);
+		if (hp == NULL)
+			return;
+		nexthdr = hp->nexthdr;
+		offset += ipv6_optlen(hp);
+	}
+
+	if (nexthdr != IPPROTO_ICMPV6 || len < offset + sizeof(*ih))
+		return;
+	len -= offset;
+
+	if (csum_ipv6_magic(&ip6h->saddr, &ip6h->daddr, len, IPPROTO_ICMPV6,
+			    skb_checksum(skb, offset, len, 0)))
+		return;
+
+	ih = skb_header_pointer(skb, offset, sizeof(_ih), &_ih);
+	if (ih == NULL)
+		return;
+
+	switch (ih->icmp6_type) {
+	case ICMPV6_MGM_REPORT:
+	case ICMPV6_MGM_REDUCTION:
+		group = skb_header_pointer(skb, offset + sizeof(*ih),
+					   sizeof(_group), &_group);
+		if (group != NULL)
+			br_ip6_multicast_group(br, port, group,
+				ih->icmp6_type == ICMPV6_MGM_REPORT);
+		break;
+	case ICMPV6_MLD2_REPORT:
+		br_ip6_multicast_mld2_report(br, port, skb, offset, len);
+		break;
+	case ICMPV6_MGM_QUERY:
+		if (!ipv6_addr_any(&ip6h->saddr))
+			br_multicast_mark_router(br, port);
+		break;
+	}
+}
+#endif
+
+/*
+ * Snoop IGMP/MLD messages received on a port.
+ * called with rcu_read_lock
+ */
+void br_multicast_rcv(struct net_bridge *br, struct net_bridge_port *port,
+		      struct sk_buff *skb)
+{
+	if (br->multicast_disabled)
+		return;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		br_ip4_multicast_rcv(br, port, skb);
+		break;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	case __constant_htons(ETH_P_IPV6):
+		br_ip6_multicast_rcv(br, port, skb);
+		break;
+#endif
+	}
+}
+
+/* Age out memberships and router ports, like br_fdb_cleanup */
+static void br_multicast_cleanup(unsigned long _data)
+{
+	struct net_bridge *br = (struct net_bridge *)_data;
+	struct net_bridge_mdb_entry *mp;
+	struct net_bridge_port_group *pg, **pp;
+	struct net_bridge_port *p;
+	struct hlist_node *h, *n;
+	unsigned long now = jiffies;
+	int i;
+
+	spin_lock(&br->multicast_lock);
+	for (i = 0; i < BR_MDB_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(mp, h, n, &br->mdb_hash[i], hlist) {
+			pp = &mp->ports;
+			while ((pg = *pp) != NULL) {
+				if (time_before_eq(pg->expires, now)) {
+					*pp = pg->next;
+					call_rcu(&pg->rcu, br_multicast_free_pg);
+				} else
+					pp = &pg->next;
+			}
+
+			if (mp->ports == NULL)
+				br_multicast_del_mdb(br, mp);
+		}
+	}
+
+	hlist_for_each_entry_safe(p, h, n, &br->router_list, rlist) {
+		if (time_before_eq(p->multicast_router_expires, now)) {
+			hlist_del_rcu(&p->rlist);
+			p->multicast_router = 0;
+		}
+	}
+	spin_unlock(&br->multicast_lock);
+
+	mod_timer(&br->multicast_timer, jiffies + HZ);
+}
+
+/* called with RTNL, before the port is freed */
+void br_multicast_del_port(struct net_bridge_port *p)
+{
+	struct net_bridge *br = p->br;
+	struct net_bridge_mdb_entry *mp;
+	struct net_bridge_port_group *pg, **pp;
+	struct hlist_node *h, *n;
+	int i;
+
+	spin_lock_bh(&br->multicast_lock);
+	for (i = 0; i < BR_MDB_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(mp, h, n, &br->mdb_hash[i], hlist) {
+			for (pp = &mp->ports; (pg = *pp) != NULL;
+			     pp = &pg->next) {
+				if (pg->port != p)
+					continue;
+				*pp = pg->next;
+				call_rcu(&pg->rcu, br_multicast_free_pg);
+				break;
+			}
+
+			if (mp->ports == NULL)
+				br_multicast_del_mdb(br, mp);
+		}
+	}
+
+	if (p->multicast_router) {
+		hlist_del_rcu(&p->rlist);
+		p->multicast_router = 0;
+	}
+	spin_unlock_bh(&br->multicast_lock);
+}
+
+void br_multicast_init(struct net_bridge *br)
+{
+	int i;
+
+	spin_lock_init(&br->multicast_lock);
+	for (i = 0; i < BR_MDB_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&br->mdb_hash[i]);
+	INIT_HLIST_HEAD(&br->router_list);
+	br->mdb_count = 0;
+	br->multicast_disabled = 0;
+
+	/* RFC 2236/3810 defaults: robustness 2, query interval 125s,
+	 * query response interval 10s, last member query interval 1s */
+	br->multicast_membership_interval = 260 * HZ;
+	br->multicast_querier_interval = 255 * HZ;
+	br->multicast_last_member_interval = 2 * HZ;
+
+	init_timer(&br->multicast_timer);
+	br->multicast_timer.function = br_multicast_cleanup;
+	br->multicast_timer.data = (unsigned long) br;
+}
+
+void br_multicast_open(struct net_bridge *br)
+{
+	mod_timer(&br->multicast_timer, jiffies + HZ);
+}
+
+/* Forget everything when the bridge goes down */
+void br_multicast_stop(struct net_bridge *br)
+{
+	struct net_bridge_mdb_entry *mp;
+	struct net_bridge_port_group *pg;
+	struct net_bridge_port *p;
+	struct hlist_node *h, *n;
+	int i;
+
+	del_timer_sync(&br->multicast_timer);
+
+	spin_lock_bh(&br->multicast_lock);
+	for (i = 0; i < BR_MDB_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(mp, h, n, &br->mdb_hash[i], hlist) {
+			while ((pg = mp->ports) != NULL) {
+				mp->ports = pg->next;
+				call_rcu(&pg->rcu, br_multicast_free_pg);
+			}
+			br_multicast_del_mdb(br, mp);
+		}
+	}
+
+	hlist_for_each_entry_safe(p, h, n, &br->router_list, rlist) {
+		hlist_del_rcu(&p->rlist);
+		p->multicast_router = 0;
+	}
+	spin_unlock_bh(&br->multicast_lock);
+}
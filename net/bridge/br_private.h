@@ -18,6 +18,7 @@
 #include <linux/netdevice.h>
 #include <linux/miscdevice.h>
 #include <linux/if_bridge.h>
+#include <linux/in6.h>
 
 #define BR_HASH_BITS 8
 #define BR_HASH_SIZE (1 << BR_HASH_BITS)
@@ -27,6 +28,10 @@
 #define BR_PORT_BITS	10
 #define BR_MAX_PORTS	(1<<BR_PORT_BITS)
 
+#define BR_MDB_HASH_BITS 8
+#define BR_MDB_HASH_SIZE (1 << BR_MDB_HASH_BITS)
+#define BR_MDB_MAX	4096
+
 typedef struct bridge_id bridge_id;
 typedef struct mac_addr mac_addr;
 typedef __u16 port_id;
@@ -55,6 +60,36 @@ struct net_bridge_fdb_entry
 	unsigned char			is_static;
 };
 
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+struct br_ip
+{
+	union {
+		u32		ip4;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+		struct in6_addr	ip6;
+#endif
+	} u;
+	u16			proto;
+};
+
+/* ports of a group, sorted by descending port pointer */
+struct net_bridge_port_group
+{
+	struct net_bridge_port_group	*next;
+	struct net_bridge_port		*port;
+	struct rcu_head			rcu;
+	unsigned long			expires;
+};
+
+struct net_bridge_mdb_entry
+{
+	struct hlist_node		hlist;
+	struct net_bridge_port_group	*ports;
+	struct rcu_head			rcu;
+	struct br_ip			addr;
+};
+#endif
+
 struct net_bridge_port
 {
 	struct net_bridge		*br;
@@ -79,6 +114,13 @@ struct net_bridge_port
 	struct timer_list		message_age_timer;
 	struct kobject			kobj;
 	struct rcu_head			rcu;
+
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+	/* multicast router port, i.e. queries were seen on it */
+	struct hlist_node		rlist;
+	unsigned long			multicast_router_expires;
+	unsigned char			multicast_router;
+#endif
 };
 
 struct net_bridge
@@ -113,6 +155,19 @@ struct net_bridge
 	struct timer_list		topology_change_timer;
 	struct timer_list		gc_timer;
 	struct kobject			ifobj;
+
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+	/* IGMP/MLD snooping */
+	spinlock_t			multicast_lock;
+	struct hlist_head		mdb_hash[BR_MDB_HASH_SIZE];
+	struct hlist_head		router_list;
+	unsigned int			mdb_count;
+	unsigned char			multicast_disabled;
+	unsigned long			multicast_membership_interval;
+	unsigned long			multicast_querier_interval;
+	unsigned long			multicast_last_member_interval;
+	struct timer_list		multicast_timer;
+#endif
 };
 
 extern struct notifier_block br_device_notifier;
@@ -165,6 +220,17 @@ extern void br_flood_forward(struct net_bridge *br,
 		      struct sk_buff *skb,
 		      int clone);
 
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+extern void br_multicast_deliver(struct net_bridge *br,
+		      struct net_bridge_mdb_entry *mdst,
+		      struct sk_buff *skb,
+		      int clone);
+extern void br_multicast_forward(struct net_bridge *br,
+		      struct net_bridge_mdb_entry *mdst,
+		      struct sk_buff *skb,
+		      int clone);
+#endif
+
 /* br_if.c */
 extern int br_add_bridge(const char *name);
 extern int br_del_bridge(const char *name);
@@ -183,6 +249,28 @@ extern int br_handle_frame(struct net_bridge_port *p, struct sk_buff **pskb);
 extern int br_dev_ioctl(struct net_device *dev, struct ifreq *rq, int cmd);
 extern int br_ioctl_deviceless_stub(unsigned int cmd, void __user *arg);
 
+/* br_multicast.c */
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+extern void br_multicast_init(struct net_bridge *br);
+extern void br_multicast_open(struct net_bridge *br);
+extern void br_multicast_stop(struct net_bridge *br);
+extern void br_multicast_del_port(struct net_bridge_port *p);
+extern void br_multicast_rcv(struct net_bridge *br,
+			     struct net_bridge_port *port,
+			     struct sk_buff *skb);
+extern struct net_bridge_mdb_entry *br_mdb_get(struct net_bridge *br,
+					       struct sk_buff *skb);
+#else
+#define br_multicast_init(br)		do { } while(0)
+#define br_multicast_open(br)		do { } while(0)
+#define br_multicast_stop(br)		do { } while(0)
+#define br_multicast_del_port(p)	do { } while(0)
+#define br_multicast_rcv(br, port, skb)	do { } while(0)
+#define br_mdb_get(br, skb)		(NULL)
+#define br_multicast_deliver(br, mdst, skb, clone)	do { } while(0)
+#define br_multicast_forward(br, mdst, skb, clone)	do { } while(0)
+#endif
+
 /* br_netfilter.c */
 extern int br_netfilter_init(void);
 extern void br_netfilter_fini(void);
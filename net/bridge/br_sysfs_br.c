@@ -241,6 +241,103 @@ static ssize_t show_gc_timer(struct class_device *cd, char *buf)
 }
 static CLASS_DEVICE_ATTR(gc_timer, S_IRUGO, show_gc_timer, NULL);
 
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+static ssize_t show_multicast_snooping(struct class_device *cd, char *buf)
+{
+	struct net_bridge *br = to_bridge(cd);
+	return sprintf(buf, "%d\n", !br->multicast_disabled);
+}
+
+static void set_multicast_snooping(struct net_bridge *br, unsigned long val)
+{
+	br->multicast_disabled = !val;
+}
+
+static ssize_t store_multicast_snooping(struct class_device *cd,
+					const char *buf, size_t len)
+{
+	return store_bridge_parm(cd, buf, len, set_multicast_snooping);
+}
+
+static CLASS_DEVICE_ATTR(multicast_snooping, S_IRUGO | S_IWUSR,
+			 show_multicast_snooping, store_multicast_snooping);
+
+static ssize_t show_multicast_membership_interval(struct class_device *cd,
+						  char *buf)
+{
+	struct net_bridge *br = to_bridge(cd);
+	return sprintf(buf, "%lu\n",
+		       jiffies_to_clock_t(br->multicast_membership_interval));
+}
+
+static void set_multicast_membership_interval(struct net_bridge *br,
+					      unsigned long val)
+{
+	br->multicast_membership_interval = clock_t_to_jiffies(val);
+}
+
+static ssize_t store_multicast_membership_interval(struct class_device *cd,
+						   const char *buf, size_t len)
+{
+	return store_bridge_parm(cd, buf, len,
+				 set_multicast_membership_interval);
+}
+
+static CLASS_DEVICE_ATTR(multicast_membership_interval, S_IRUGO | S_IWUSR,
+			 show_multicast_membership_interval,
+			 store_multicast_membership_interval);
+
+static ssize_t show_multicast_querier_interval(struct class_device *cd,
+					       char *buf)
+{
+	struct net_bridge *br = to_bridge(cd);
+	return sprintf(buf, "%lu\n",
+		       jiffies_to_clock_t(br->multicast_querier_interval));
+}
+
+static void set_multicast_querier_interval(struct net_bridge *br,
+					   unsigned long val)
+{
+	br->multicast_querier_interval = clock_t_to_jiffies(val);
+}
+
+static ssize_t store_multicast_querier_interval(struct class_device *cd,
+						const char *buf, size_t len)
+{
+	return store_bridge_parm(cd, buf, len, set_multicast_querier_interval);
+}
+
+static CLASS_DEVICE_ATTR(multicast_querier_interval, S_IRUGO | S_IWUSR,
+			 show_multicast_querier_interval,
+			 store_multicast_querier_interval);
+
+static ssize_t show_multicast_last_member_interval(struct class_device *cd,
+						   char *buf)
+{
+	struct net_bridge *br = to_bridge(cd);
+	return sprintf(buf, "%lu\n",
+		       jiffies_to_clock_t(br->multicast_last_member_interval));
+}
+
+static void set_multicast_last_member_interval(struct net_bridge *br,
+					       unsigned long val)
+{
+	br->multicast_last_member_interval = clock_t_to_jiffies(val);
+}
+
+static ssize_t store_multicast_last_member_interval(struct class_device *cd,
+						    const char *buf,
+						    size_t len)
+{
+	return store_bridge_parm(cd, buf, len,
+				 set_multicast_last_member_interval);
+}
+
+static CLASS_DEVICE_ATTR(multicast_last_member_interval, S_IRUGO | S_IWUSR,
+			 show_multicast_last_member_interval,
+			 store_multicast_last_member_interval);
+#endif
+
 static struct attribute *bridge_attrs[] = {
 	&class_device_attr_forward_delay.attr,
 	&class_device_attr_hello_time.attr,
@@ -258,6 +355,12 @@ static struct attribute *bridge_attrs[] = {
 	&class_device_attr_tcn_timer.attr,
 	&class_device_attr_topology_change_timer.attr,
 	&class_device_attr_gc_timer.attr,
+#ifdef CONFIG_BRIDGE_IGMP_SNOOPING
+	&class_device_attr_multicast_snooping.attr,
+	&class_device_attr_multicast_membership_interval.attr,
+	&class_device_attr_multicast_querier_interval.attr,
+	&class_device_attr_multicast_last_member_interval.attr,
+#endif
 	NULL
 };
 
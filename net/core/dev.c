@@ -1173,6 +1173,7 @@ int __skb_linearize(struct sk_buff *skb, int gfp_mask)
 
 	skb->head = data;
 	skb->end  = data + size;
+	skb->head_frag = 0;
 
 	/* Set up new pointers */
 	skb->h.raw   += offset;
@@ -1339,6 +1340,8 @@ out:
   =======================================================================*/
 
 int netdev_max_backlog = 300;
+/* Packets process_backlog() hands up in one netif_receive_skb_list() call */
+int netdev_rx_batch = 16;
 int weight_p = 64;            /* old backlog weight */
 /* These numbers are selected based on intuition and some
  * experimentatiom, if you have more scientific way of doing this
@@ -1623,16 +1626,13 @@ static int ing_filter(struct sk_buff *skb)
 }
 #endif
 
-int netif_receive_skb(struct sk_buff *skb)
+/* Common start of the receive paths.  Returns 0 if netpoll took the skb. */
+static inline int netif_receive_prepare(struct sk_buff *skb)
 {
-	struct packet_type *ptype, *pt_prev;
-	int ret = NET_RX_DROP;
-	unsigned short type;
-
 #ifdef CONFIG_NETPOLL
 	if (skb->dev->netpoll_rx && skb->dev->poll && netpoll_rx(skb)) {
 		kfree_skb(skb);
-		return NET_RX_DROP;
+		return 0;
 	}
 #endif
 
@@ -1645,6 +1645,14 @@ int netif_receive_skb(struct sk_buff *skb)
 
 	skb->h.raw = skb->nh.raw = skb->data;
 	skb->mac_len = skb->nh.raw - skb->mac.raw;
+	return 1;
+}
+
+static int __netif_receive_skb(struct sk_buff *skb)
+{
+	struct packet_type *ptype, *pt_prev;
+	int ret = NET_RX_DROP;
+	unsigned short type;
 
 	pt_prev = NULL;
 
@@ -1714,30 +1722,133 @@ out:
 	return ret;
 }
 
+int netif_receive_skb(struct sk_buff *skb)
+{
+	if (!netif_receive_prepare(skb))
+		return NET_RX_DROP;
+
+	return __netif_receive_skb(skb);
+}
+
+/*
+ * The handler that would get skb in netif_receive_skb(), provided it is
+ * the only one and takes lists.  NULL if the skb has to go through the
+ * per packet path: taps, ingress filters, diverter or bridge are in use.
+ * Called under rcu_read_lock().
+ */
+static struct packet_type *netif_list_ptype(struct sk_buff *skb)
+{
+	struct packet_type *ptype, *pt = NULL;
+	unsigned short type = skb->protocol;
+
+	if (!list_empty(&ptype_all))
+		return NULL;
+#ifdef CONFIG_NET_CLS_ACT
+	if ((skb->tc_verd & TC_NCLS) || skb->dev->qdisc_ingress)
+		return NULL;
+#endif
+#ifdef CONFIG_NET_DIVERT
+	if (skb->dev->divert && skb->dev->divert->divert)
+		return NULL;
+#endif
+#if defined(CONFIG_BRIDGE) || defined (CONFIG_BRIDGE_MODULE)
+	if (skb->dev->br_port)
+		return NULL;
+#endif
+
+	list_for_each_entry_rcu(ptype, &ptype_base[ntohs(type)&15], list) {
+		if (ptype->type == type &&
+		    (!ptype->dev || ptype->dev == skb->dev)) {
+			if (pt)
+				return NULL;
+			pt = ptype;
+		}
+	}
+
+	if (pt && !pt->list_func)
+		return NULL;
+	return pt;
+}
+
+/**
+ *	netif_receive_skb_list - process a list of received buffers
+ *	@list: buffers to process
+ *
+ *	Like netif_receive_skb(), for several packets.  Runs of packets that
+ *	go to the same device and protocol handler are passed to the
+ *	handler's list_func in one call, if it has one; the other packets
+ *	take the usual path.  The order of the packets is kept.  Must be
+ *	called from softirq context with interrupts enabled; @list is empty
+ *	on return.
+ */
+void netif_receive_skb_list(struct sk_buff_head *list)
+{
+	struct sk_buff_head batch;
+	struct packet_type *pt, *batch_pt = NULL;
+	struct net_device *batch_dev = NULL;
+	struct sk_buff *skb;
+
+	skb_queue_head_init(&batch);
+
+	rcu_read_lock();
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		if (!netif_receive_prepare(skb))
+			continue;
+
+		pt = netif_list_ptype(skb);
+		if (skb_queue_len(&batch) &&
+		    (pt != batch_pt || skb->dev != batch_dev))
+			batch_pt->list_func(&batch, batch_dev, batch_pt);
+
+		if (!pt) {
+			__netif_receive_skb(skb);
+			continue;
+		}
+
+#ifdef CONFIG_NET_CLS_ACT
+		skb->tc_verd = 0;
+#endif
+		batch_pt = pt;
+		batch_dev = skb->dev;
+		__skb_queue_tail(&batch, skb);
+	}
+	if (skb_queue_len(&batch))
+		batch_pt->list_func(&batch, batch_dev, batch_pt);
+	rcu_read_unlock();
+}
+
 static int process_backlog(struct net_device *backlog_dev, int *budget)
 {
 	int work = 0;
 	int quota = min(backlog_dev->quota, *budget);
+	int batch = max(1, min(netdev_rx_batch, NETDEV_RX_BATCH_MAX));
 	struct softnet_data *queue = &__get_cpu_var(softnet_data);
 	unsigned long start_time = jiffies;
 
 	for (;;) {
+		struct sk_buff_head list;
+		struct net_device *devs[NETDEV_RX_BATCH_MAX];
 		struct sk_buff *skb;
-		struct net_device *dev;
+		int i, n = 0;
+
+		skb_queue_head_init(&list);
 
 		local_irq_disable();
-		skb = __skb_dequeue(&queue->input_pkt_queue);
-		if (!skb)
+		while (n < batch && work + n < quota &&
+		       (skb = __skb_dequeue(&queue->input_pkt_queue)) != NULL) {
+			devs[n++] = skb->dev;
+			__skb_queue_tail(&list, skb);
+		}
+		if (!n)
 			goto job_done;
 		local_irq_enable();
 
-		dev = skb->dev;
-
-		netif_receive_skb(skb);
+		netif_receive_skb_list(&list);
 
-		dev_put(dev);
+		for (i = 0; i < n; i++)
+			dev_put(devs[i]);
 
-		work++;
+		work += n;
 
 		if (work >= quota || jiffies - start_time > 1)
 			break;
@@ -2027,16 +2138,17 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct netif_rx_stats *s = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x "
+		   "%08x %08x\n",
 		   s->total, s->dropped, s->time_squeeze, s->throttled,
 		   s->fastroute_hit, s->fastroute_success, s->fastroute_defer,
 		   s->fastroute_deferred_out,
 #if 0
-		   s->fastroute_latency_reduction
+		   s->fastroute_latency_reduction,
 #else
-		   s->cpu_collision
+		   s->cpu_collision,
 #endif
-		  );
+		   s->recycle_hit, s->recycle_miss);
 	return 0;
 }
 
@@ -2300,6 +2412,51 @@ int dev_set_mtu(struct net_device *dev, int new_mtu)
 	return err;
 }
 
+/**
+ *	dev_set_rx_recycle - size the skb recycling pool of a device
+ *	@dev: device
+ *	@max: buffers to keep per CPU, 0 turns recycling off
+ *
+ *	Only drivers setting rx_recycle_size feed the pool, see
+ *	dev_kfree_skb_recycle().  Turning recycling off waits for users
+ *	of the old pool and frees the buffers in it.  Caller must hold
+ *	the rtnl semaphore.
+ */
+int dev_set_rx_recycle(struct net_device *dev, unsigned int max)
+{
+	struct sk_buff_head *pool = dev->rx_recycle_pool;
+	int cpu;
+
+	ASSERT_RTNL();
+
+	if (max) {
+		if (!dev->rx_recycle_size)
+			return -EOPNOTSUPP;
+		if (!pool) {
+			pool = alloc_percpu(struct sk_buff_head);
+			if (!pool)
+				return -ENOMEM;
+			for_each_cpu(cpu)
+				skb_queue_head_init(per_cpu_ptr(pool, cpu));
+			smp_wmb();
+			dev->rx_recycle_pool = pool;
+		}
+		dev->rx_recycle = max;
+		return 0;
+	}
+
+	dev->rx_recycle = 0;
+	if (!pool)
+		return 0;
+
+	dev->rx_recycle_pool = NULL;
+	synchronize_kernel();
+	for_each_cpu(cpu)
+		__skb_queue_purge(per_cpu_ptr(pool, cpu));
+	free_percpu(pool);
+	return 0;
+}
+
 int dev_set_mac_address(struct net_device *dev, struct sockaddr *sa)
 {
 	int err;
@@ -3157,6 +3314,8 @@ int unregister_netdevice(struct net_device *dev)
 
 	free_divert_blk(dev);
 
+	dev_set_rx_recycle(dev, 0);
+
 	/* Finish processing unregister after unlock */
 	net_set_todo(dev);
 
@@ -3327,12 +3486,14 @@ EXPORT_SYMBOL(dev_set_allmulti);
 EXPORT_SYMBOL(dev_set_promiscuity);
 EXPORT_SYMBOL(dev_change_flags);
 EXPORT_SYMBOL(dev_set_mtu);
+EXPORT_SYMBOL(dev_set_rx_recycle);
 EXPORT_SYMBOL(dev_set_mac_address);
 EXPORT_SYMBOL(free_netdev);
 EXPORT_SYMBOL(netdev_boot_setup_check);
 EXPORT_SYMBOL(netdev_set_master);
 EXPORT_SYMBOL(netdev_state_change);
 EXPORT_SYMBOL(netif_receive_skb);
+EXPORT_SYMBOL(netif_receive_skb_list);
 EXPORT_SYMBOL(netif_rx);
 EXPORT_SYMBOL(register_gifconf);
 EXPORT_SYMBOL(register_netdevice);
@@ -184,12 +184,29 @@ static ssize_t store_tx_queue_len(struct class_device *dev, const char *buf, siz
 static CLASS_DEVICE_ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len, 
 			 store_tx_queue_len);
 
+NETDEVICE_SHOW(rx_recycle, fmt_dec);
+
+static int change_rx_recycle(struct net_device *net, unsigned long new_max)
+{
+	return dev_set_rx_recycle(net, (unsigned int) new_max);
+}
+
+static ssize_t store_rx_recycle(struct class_device *dev, const char *buf,
+				size_t len)
+{
+	return netdev_store(dev, buf, len, change_rx_recycle);
+}
+
+static CLASS_DEVICE_ATTR(rx_recycle, S_IRUGO | S_IWUSR, show_rx_recycle,
+			 store_rx_recycle);
+
 
 static struct class_device_attribute *net_class_attributes[] = {
 	&class_device_attr_ifindex,
 	&class_device_attr_iflink,
 	&class_device_attr_addr_len,
 	&class_device_attr_tx_queue_len,
+	&class_device_attr_rx_recycle,
 	&class_device_attr_features,
 	&class_device_attr_mtu,
 	&class_device_attr_flags,
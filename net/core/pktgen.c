@@ -106,6 +106,9 @@
  *
  * interruptible_sleep_on_timeout() replaced Nishanth Aravamudan <nacc@us.ibm.com> 
  * 050103
+ *
+ * Several threads can share a device as ethX@N, IMIX packet sizes,
+ * receive side accounting of sequence numbers and latency.
  */
 #include <linux/sys.h>
 #include <linux/types.h>
@@ -138,7 +141,10 @@
 #include <linux/udp.h>
 #include <linux/proc_fs.h>
 #include <linux/wait.h>
+#include <linux/percpu.h>
+#include <linux/jhash.h>
 #include <net/checksum.h>
+#include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/addrconf.h>
 #include <asm/byteorder.h>
@@ -190,12 +196,21 @@
 
 #define MAX_CFLOWS  65536
 
+#define MAX_IMIX_ENTRIES 20
+#define IMIX_PRECISION 100 /* Slots in the IMIX size distribution */
+
 struct flow_state
 {
 	__u32		cur_daddr;
 	int		count;
 };
 
+struct imix_pkt
+{
+	int		size;
+	int		weight;
+};
+
 struct pktgen_dev {
 
 	/*
@@ -316,6 +331,11 @@ struct pktgen_dev {
 	unsigned cflows;         /* Concurrent flows (config) */
 	unsigned lflow;          /* Flow length  (config) */
 	unsigned nflows;         /* accumulated flows (stats) */
+
+	/* IMIX: packet sizes picked by weight instead of min/max */
+	struct imix_pkt imix_entries[MAX_IMIX_ENTRIES];
+	int n_imix_entries;
+	__u8 imix_distribution[IMIX_PRECISION];
 };
 
 struct pktgen_hdr {
@@ -493,9 +513,11 @@ static void pktgen_stop_all_threads_ifs(void);
 static int pktgen_stop_device(struct pktgen_dev *pkt_dev);
 static void pktgen_stop(struct pktgen_thread* t);
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev);
-static struct pktgen_dev *pktgen_NN_threads(const char* dev_name, int remove);
 static unsigned int scan_ip6(const char *s,char ip[16]);
 static unsigned int fmt_ip6(char *s,const char ip[16]);
+static int pktgen_rx_enable(const char *ifname);
+static void pktgen_rx_disable(void);
+static void pktgen_rx_reset(void);
 
 /* Module parameters, defaults. */
 static int pg_count_d = 1000; /* 1000 pkts by default */
@@ -589,6 +611,23 @@ static ssize_t proc_pgctrl_write(struct file* file,const char __user * buf,
         else if (!strcmp(data, "start")) 
 		pktgen_run_all_threads();
 
+	else if (!strncmp(data, "rx ", 3)) {
+		rtnl_lock();
+		err = pktgen_rx_enable(data + 3);
+		rtnl_unlock();
+		if (err)
+			goto out_free;
+	}
+
+	else if (!strcmp(data, "rx_disable")) {
+		rtnl_lock();
+		pktgen_rx_disable();
+		rtnl_unlock();
+	}
+
+	else if (!strcmp(data, "rx_reset")) 
+		pktgen_rx_reset();
+
 	else 
 		printk("pktgen: Unknown command: %s\n", data);
 
@@ -620,6 +659,13 @@ static int proc_if_read(char *buf , char **start, off_t offset,
 
 	p += sprintf(p, "     flows: %u flowlen: %u\n", pkt_dev->cflows, pkt_dev->lflow);
 
+	if (pkt_dev->n_imix_entries) {
+		p += sprintf(p, "     imix_weights:");
+		for (i = 0; i < pkt_dev->n_imix_entries; i++)
+			p += sprintf(p, " %d,%d", pkt_dev->imix_entries[i].size,
+				     pkt_dev->imix_entries[i].weight);
+		p += sprintf(p, "\n");
+	}
 
 	if(pkt_dev->flags & F_IPV6) {
 		char b1[128], b2[128], b3[128];
@@ -802,6 +848,28 @@ done_str:
 	return i;
 }
 
+/* Spread the IMIX sizes over IMIX_PRECISION slots by weight, so a
+ * random slot picks a size with the right probability. */
+static void pktgen_imix_setup(struct pktgen_dev *pkt_dev)
+{
+	unsigned long total = 0, cum = 0;
+	int i, j = 0;
+
+	for (i = 0; i < pkt_dev->n_imix_entries; i++)
+		total += pkt_dev->imix_entries[i].weight;
+
+	if (total == 0) {
+		pkt_dev->n_imix_entries = 0;
+		return;
+	}
+
+	for (i = 0; i < pkt_dev->n_imix_entries; i++) {
+		cum += pkt_dev->imix_entries[i].weight;
+		while (j < IMIX_PRECISION * cum / total)
+			pkt_dev->imix_distribution[j++] = i;
+	}
+}
+
 static int proc_if_write(struct file *file, const char __user *user_buffer,
                             unsigned long count, void *data)
 {
@@ -1322,6 +1390,46 @@ static int proc_if_write(struct file *file, const char __user *user_buffer,
 		return count;
 	}
 
+	if (!strcmp(name, "imix_weights")) {
+		unsigned long size, weight;
+		int n = 0;
+		char c;
+
+		/* "imix_weights 64,7 576,4 1500,1", nothing turns IMIX off */
+		pkt_dev->n_imix_entries = 0;
+		while (i < count) {
+			len = num_arg(&user_buffer[i], 10, &size);
+			if (len < 0) { return len; }
+			i += len;
+			if (get_user(c, &user_buffer[i]))
+				return -EFAULT;
+			if (len == 0 || c != ',')
+				return -EINVAL;
+			i++;
+			len = num_arg(&user_buffer[i], 10, &weight);
+			if (len < 0) { return len; }
+			if (len == 0)
+				return -EINVAL;
+			i += len;
+			if (n == MAX_IMIX_ENTRIES)
+				return -E2BIG;
+			if (size < 14+20+8)
+				size = 14+20+8;
+			pkt_dev->imix_entries[n].size = size;
+			pkt_dev->imix_entries[n].weight = weight;
+			n++;
+
+			len = count_trail_chars(&user_buffer[i], count - i);
+			if (len < 0) { return len; }
+			i += len;
+		}
+		pkt_dev->n_imix_entries = n;
+		pktgen_imix_setup(pkt_dev);
+		sprintf(pg_result, "OK: imix_weights=%d entries",
+			pkt_dev->n_imix_entries);
+		return count;
+	}
+
 	if (!strcmp(name, "flowlen")) {
 		len = num_arg(&user_buffer[i], 10, &value);
                 if (len < 0) { return len; }
@@ -1525,15 +1633,27 @@ static struct pktgen_dev *__pktgen_NN_threads(const char* ifname, int remove)
         return pkt_dev;
 }
 
-static struct pktgen_dev *pktgen_NN_threads(const char* ifname, int remove) 
+/* Remove every pktgen_dev sending on dev, there may be several ethX@N */
+static void pktgen_remove_odev(struct net_device *dev)
 {
-	struct pktgen_dev *pkt_dev = NULL;
+	struct pktgen_thread *t;
+	struct pktgen_dev *pkt_dev, *next;
+
 	thread_lock();
-	pkt_dev = __pktgen_NN_threads(ifname, remove);
-        thread_unlock();
-	return pkt_dev;
+	for (t = pktgen_threads; t; t = t->next) {
+		if_lock(t);
+		for (pkt_dev = t->if_list; pkt_dev; pkt_dev = next) {
+			next = pkt_dev->next;
+			if (pkt_dev->odev == dev)
+				pktgen_remove_device(t, pkt_dev);
+		}
+		if_unlock(t);
+	}
+	thread_unlock();
 }
 
+static void pktgen_rx_disable_dev(struct net_device *dev);
+
 static int pktgen_device_event(struct notifier_block *unused, unsigned long event, void *ptr) 
 {
 	struct net_device *dev = (struct net_device *)(ptr);
@@ -1551,7 +1671,8 @@ static int pktgen_device_event(struct notifier_block *unused, unsigned long even
 		break;
 		
 	case NETDEV_UNREGISTER:
-                pktgen_NN_threads(dev->name, REMOVE);
+		pktgen_remove_odev(dev);
+		pktgen_rx_disable_dev(dev);
 		break;
 	};
 
@@ -1562,6 +1683,8 @@ static int pktgen_device_event(struct notifier_block *unused, unsigned long even
 
 static struct net_device* pktgen_setup_dev(struct pktgen_dev *pkt_dev) {
 	struct net_device *odev;
+	char b[IFNAMSIZ];
+	int i;
 
 	/* Clean old setups */
 
@@ -1570,13 +1693,21 @@ static struct net_device* pktgen_setup_dev(struct pktgen_dev *pkt_dev) {
                 pkt_dev->odev = NULL;
         }
 
-	odev = dev_get_by_name(pkt_dev->ifname);
+	/* ethX@N is another generator on ethX, for another thread */
+	for (i = 0; pkt_dev->ifname[i] && pkt_dev->ifname[i] != '@'; i++) {
+		if (i == IFNAMSIZ - 1)
+			break;
+		b[i] = pkt_dev->ifname[i];
+	}
+	b[i] = 0;
+
+	odev = dev_get_by_name(b);
 
 	if (!odev) {
-		printk("pktgen: no such netdevice: \"%s\"\n", pkt_dev->ifname);
+		printk("pktgen: no such netdevice: \"%s\"\n", b);
 		goto out;
 	}
-	if (odev->type != ARPHRD_ETHER) {
+	if (odev->type != ARPHRD_ETHER && odev->type != ARPHRD_LOOPBACK) {
 		printk("pktgen: not an ethernet device: \"%s\"\n", pkt_dev->ifname);
 		goto out_put;
 	}
@@ -1624,6 +1755,10 @@ static void pktgen_setup_inject(struct pktgen_dev *pkt_dev)
         /* Set up Dest MAC */
         memcpy(&(pkt_dev->hh[0]), pkt_dev->dst_mac, 6);
 
+	/* Loopback receives the skb it is given, it cannot be sent again */
+	if (pkt_dev->odev->flags & IFF_LOOPBACK)
+		pkt_dev->clone_skb = 0;
+
         /* Set up pkt size */
         pkt_dev->cur_pkt_size = pkt_dev->min_pkt_size;
 	
@@ -1893,7 +2028,11 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev) {
  		}
 	}
 
-        if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
+	if (pkt_dev->n_imix_entries) {
+		int e = pkt_dev->imix_distribution[pktgen_random() % IMIX_PRECISION];
+		pkt_dev->cur_pkt_size = pkt_dev->imix_entries[e].size;
+	}
+        else if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
                 __u32 t;
                 if (pkt_dev->flags & F_TXSIZE_RND) {
                         t = ((pktgen_random() % (pkt_dev->max_pkt_size - pkt_dev->min_pkt_size))
@@ -2031,7 +2170,6 @@ static struct sk_buff *fill_packet_ipv4(struct net_device *odev,
 	      pgh->tv_sec    = htonl(timestamp.tv_sec);
 	      pgh->tv_usec   = htonl(timestamp.tv_usec);
         }
-        pkt_dev->seq_num++;
         
 	return skb;
 }
@@ -2309,7 +2447,6 @@ static struct sk_buff *fill_packet_ipv6(struct net_device *odev,
 	      pgh->tv_sec    = htonl(timestamp.tv_sec);
 	      pgh->tv_usec   = htonl(timestamp.tv_usec);
         }
-        pkt_dev->seq_num++;
         
 	return skb;
 }
@@ -3021,7 +3158,7 @@ static void _rem_dev_from_if_list(struct pktgen_thread *t, struct pktgen_dev *pk
 	while(i) {
 		if(i == pkt_dev) {
 			if(prev) prev->next = i->next;
-			else t->if_list = NULL;
+			else t->if_list = i->next;
 			break;
 		}
 		prev = i;
@@ -3061,11 +3198,317 @@ static int pktgen_remove_device(struct pktgen_thread *t, struct pktgen_dev *pkt_
         return 0;
 }
 
+/*
+ * Receive side.  "rx ethX" on pgctrl counts the pktgen packets that
+ * arrive on ethX ("rx any" for all devices).  For every stream it
+ * checks the sequence numbers for gaps and late packets and histograms
+ * the one-way latency from the sender's timestamp, so sender and
+ * receiver need synchronized clocks unless they are the same box.
+ * Streams are told apart by source address and UDP source port.  The
+ * sender should use clone_skb 0: clones repeat sequence number and
+ * timestamp.
+ */
+
+#define PG_RX_STREAMS	256
+
+struct pktgen_rx_stream {
+	spinlock_t	lock;
+	__u32		saddr;
+	__u16		sport;
+	__u16		valid;
+	__u32		next_seq;
+};
+
+struct pktgen_rx_stats {
+	__u64		packets;
+	__u64		bytes;
+	__u64		gaps;		/* sequence numbers skipped */
+	__u64		late;		/* arrived after a higher one */
+	__u64		lat_sum;	/* usec */
+	__u32		lat_min;	/* since the reset of generation gen */
+	__u32		lat_max;
+	__u32		gen;
+	__u64		lat_hist[LAT_BUCKETS_MAX];	/* bucket i: < 2^i usec */
+};
+
+static struct pktgen_rx_stream pktgen_rx_streams[PG_RX_STREAMS];
+/*
+ * The per-CPU counters are only written by their CPU.  A reset records
+ * their sums in pktgen_rx_base, which the reader takes off, and starts
+ * a new generation, on which each CPU restarts its own min and max.
+ */
+static struct pktgen_rx_stats *pktgen_rx_stats;
+static struct pktgen_rx_stats pktgen_rx_base;
+static unsigned int pktgen_rx_gen = 1;
+static spinlock_t pktgen_rx_base_lock = SPIN_LOCK_UNLOCKED;
+static struct net_device *pktgen_rx_dev;
+static int pktgen_rx_enabled;
+static struct proc_dir_entry *pktgen_rx_proc_ent;
+
+static void pktgen_rx_account(__u32 saddr, __u16 sport,
+			      struct pktgen_hdr *pgh, unsigned int len)
+{
+	struct pktgen_rx_stats *st;
+	struct pktgen_rx_stream *s;
+	struct timeval now;
+	__u32 seq = ntohl(pgh->seq_num);
+	long lat;
+	int b;
+
+	st = per_cpu_ptr(pktgen_rx_stats, smp_processor_id());
+	st->packets++;
+	st->bytes += len;
+
+	s = &pktgen_rx_streams[jhash_2words(saddr, sport, 0) &
+			       (PG_RX_STREAMS - 1)];
+	spin_lock(&s->lock);
+	if (!s->valid || s->saddr != saddr || s->sport != sport) {
+		/* New stream, or it took over the slot of another one */
+		s->saddr = saddr;
+		s->sport = sport;
+		s->valid = 1;
+		s->next_seq = seq + 1;
+	} else if ((__s32)(seq - s->next_seq) >= 0) {
+		st->gaps += seq - s->next_seq;
+		s->next_seq = seq + 1;
+	} else
+		st->late++;
+	spin_unlock(&s->lock);
+
+	do_gettimeofday(&now);
+	lat = (now.tv_sec - ntohl(pgh->tv_sec)) * USEC_PER_SEC +
+	      now.tv_usec - ntohl(pgh->tv_usec);
+	if (lat < 0)
+		lat = 0;	/* clocks out of sync */
+	if (lat > 0x7fffffff)
+		lat = 0x7fffffff;
+
+	if (st->gen != pktgen_rx_gen) {
+		/* first packet on this CPU since the last reset */
+		st->gen = pktgen_rx_gen;
+		st->lat_min = lat;
+		st->lat_max = lat;
+	}
+	if (st->lat_min > lat)
+		st->lat_min = lat;
+	if (st->lat_max < lat)
+		st->lat_max = lat;
+	st->lat_sum += lat;
+
+	b = fls(lat);
+	if (b >= LAT_BUCKETS_MAX)
+		b = LAT_BUCKETS_MAX - 1;
+	st->lat_hist[b]++;
+}
+
+static int pktgen_rcv(struct sk_buff *skb, struct net_device *dev,
+		      struct packet_type *pt)
+{
+	struct pktgen_hdr _pgh, *pgh;
+	struct udphdr _uh, *uh;
+	__u32 saddr;
+	int off;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP): {
+		struct iphdr _iph, *iph;
+
+		iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+		if (!iph || iph->protocol != IPPROTO_UDP ||
+		    (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+			goto out;
+		saddr = iph->saddr;
+		off = iph->ihl * 4;
+		break;
+	}
+	case __constant_htons(ETH_P_IPV6): {
+		struct ipv6hdr _ip6h, *ip6h;
+
+		ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+		if (!ip6h || ip6h->nexthdr != IPPROTO_UDP)
+			goto out;
+		saddr = ip6h->saddr.s6_addr32[0] ^ ip6h->saddr.s6_addr32[1] ^
+			ip6h->saddr.s6_addr32[2] ^ ip6h->saddr.s6_addr32[3];
+		off = sizeof(*ip6h);
+		break;
+	}
+	default:
+		goto out;
+	}
+
+	uh = skb_header_pointer(skb, off, sizeof(_uh), &_uh);
+	pgh = skb_header_pointer(skb, off + sizeof(_uh), sizeof(_pgh), &_pgh);
+	if (uh && pgh && pgh->pgh_magic == __constant_htonl(PKTGEN_MAGIC))
+		pktgen_rx_account(saddr, uh->source, pgh, skb->len);
+out:
+	kfree_skb(skb);
+	return 0;
+}
+
+static struct packet_type pktgen_rx_ip_pt = {
+	.type =	__constant_htons(ETH_P_IP),
+	.func =	pktgen_rcv,
+};
+
+static struct packet_type pktgen_rx_ipv6_pt = {
+	.type =	__constant_htons(ETH_P_IPV6),
+	.func =	pktgen_rcv,
+};
+
+/* Called with RTNL */
+static void pktgen_rx_disable(void)
+{
+	if (!pktgen_rx_enabled)
+		return;
+
+	dev_remove_pack(&pktgen_rx_ip_pt);
+	dev_remove_pack(&pktgen_rx_ipv6_pt);
+	pktgen_rx_enabled = 0;
+
+	if (pktgen_rx_dev) {
+		dev_put(pktgen_rx_dev);
+		pktgen_rx_dev = NULL;
+	}
+}
+
+/* Called with RTNL */
+static void pktgen_rx_disable_dev(struct net_device *dev)
+{
+	if (pktgen_rx_enabled && pktgen_rx_dev == dev)
+		pktgen_rx_disable();
+}
+
+/* Called with RTNL */
+static int pktgen_rx_enable(const char *ifname)
+{
+	struct net_device *dev = NULL;
+
+	if (strcmp(ifname, "any")) {
+		dev = __dev_get_by_name(ifname);
+		if (!dev) {
+			printk("pktgen: no such netdevice: \"%s\"\n", ifname);
+			return -ENODEV;
+		}
+		dev_hold(dev);
+	}
+
+	pktgen_rx_disable();
+	pktgen_rx_reset();
+
+	pktgen_rx_dev = dev;
+	pktgen_rx_ip_pt.dev = dev;
+	pktgen_rx_ipv6_pt.dev = dev;
+	dev_add_pack(&pktgen_rx_ip_pt);
+	dev_add_pack(&pktgen_rx_ipv6_pt);
+	pktgen_rx_enabled = 1;
+	return 0;
+}
+
+/* Sum the counters of all CPUs; min and max of the current generation */
+static void pktgen_rx_sum(struct pktgen_rx_stats *sum)
+{
+	struct pktgen_rx_stats *st;
+	int cpu, i, seen = 0;
+
+	memset(sum, 0, sizeof(*sum));
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!cpu_possible(cpu))
+			continue;
+		st = per_cpu_ptr(pktgen_rx_stats, cpu);
+		if (st->gen == pktgen_rx_gen) {
+			if (st->lat_min < sum->lat_min || !seen)
+				sum->lat_min = st->lat_min;
+			if (st->lat_max > sum->lat_max)
+				sum->lat_max = st->lat_max;
+			seen = 1;
+		}
+		sum->packets += st->packets;
+		sum->bytes += st->bytes;
+		sum->gaps += st->gaps;
+		sum->late += st->late;
+		sum->lat_sum += st->lat_sum;
+		for (i = 0; i < LAT_BUCKETS_MAX; i++)
+			sum->lat_hist[i] += st->lat_hist[i];
+	}
+}
+
+static void pktgen_rx_reset(void)
+{
+	int i;
+
+	for (i = 0; i < PG_RX_STREAMS; i++) {
+		spin_lock_bh(&pktgen_rx_streams[i].lock);
+		pktgen_rx_streams[i].valid = 0;
+		spin_unlock_bh(&pktgen_rx_streams[i].lock);
+	}
+
+	spin_lock(&pktgen_rx_base_lock);
+	pktgen_rx_gen++;
+	pktgen_rx_sum(&pktgen_rx_base);
+	spin_unlock(&pktgen_rx_base_lock);
+}
+
+static int proc_rx_read(char *buf, char **start, off_t offset,
+			int len, int *eof, void *data)
+{
+	struct pktgen_rx_stats sum;
+	__u64 avg = 0, lost = 0;
+	char *p = buf;
+	int i;
+
+	spin_lock(&pktgen_rx_base_lock);
+	pktgen_rx_sum(&sum);
+	sum.packets -= pktgen_rx_base.packets;
+	sum.bytes -= pktgen_rx_base.bytes;
+	sum.gaps -= pktgen_rx_base.gaps;
+	sum.late -= pktgen_rx_base.late;
+	sum.lat_sum -= pktgen_rx_base.lat_sum;
+	for (i = 0; i < LAT_BUCKETS_MAX; i++)
+		sum.lat_hist[i] -= pktgen_rx_base.lat_hist[i];
+	spin_unlock(&pktgen_rx_base_lock);
+
+	if (sum.packets) {
+		avg = sum.lat_sum;
+		do_div(avg, sum.packets);
+	}
+	/* Late packets filled a gap counted before */
+	if (sum.gaps > sum.late)
+		lost = sum.gaps - sum.late;
+
+	p += sprintf(p, "RX: %s  device: %s\n",
+		     pktgen_rx_enabled ? "enabled" : "disabled",
+		     pktgen_rx_dev ? pktgen_rx_dev->name : "any");
+	p += sprintf(p, "     packets: %llu  bytes: %llu\n",
+		     (unsigned long long) sum.packets,
+		     (unsigned long long) sum.bytes);
+	p += sprintf(p, "     lost: %llu  reordered: %llu\n",
+		     (unsigned long long) lost,
+		     (unsigned long long) sum.late);
+	p += sprintf(p, "     latency: min %uus  avg %lluus  max %uus\n",
+		     sum.lat_min, (unsigned long long) avg, sum.lat_max);
+	p += sprintf(p, "     latency histogram (usec):\n");
+	for (i = 0; i < LAT_BUCKETS_MAX; i++) {
+		if (!sum.lat_hist[i])
+			continue;
+		p += sprintf(p, "       < %-10u %llu\n", 1U << i,
+			     (unsigned long long) sum.lat_hist[i]);
+	}
+
+	*eof = 1;
+	return p - buf;
+}
+
 static int __init pg_init(void) 
 {
-	int cpu;
+	int cpu, i;
 	printk(version);
 
+	pktgen_rx_stats = alloc_percpu(struct pktgen_rx_stats);
+	if (!pktgen_rx_stats)
+		return -ENOMEM;
+	for (i = 0; i < PG_RX_STREAMS; i++)
+		spin_lock_init(&pktgen_rx_streams[i].lock);
+
         module_fname[0] = 0;
 
 	create_proc_dir();
@@ -3074,12 +3517,17 @@ static int __init pg_init(void)
         module_proc_ent = create_proc_entry(module_fname, 0600, NULL);
         if (!module_proc_ent) {
                 printk("pktgen: ERROR: cannot create %s procfs entry.\n", module_fname);
+		free_percpu(pktgen_rx_stats);
                 return -EINVAL;
         }
 
         module_proc_ent->proc_fops =  &pktgen_fops;
         module_proc_ent->data = NULL;
 
+	pktgen_rx_proc_ent = create_proc_read_entry(PG_PROC_DIR "/pgrx", 0444,
+						    proc_net, proc_rx_read,
+						    NULL);
+
 	/* Register us to receive netdevice events */
 	register_netdevice_notifier(&pktgen_notifier_block);
         
@@ -3112,8 +3560,16 @@ static void __exit pg_cleanup(void)
         /* Un-register us from receiving netdevice events */
 	unregister_netdevice_notifier(&pktgen_notifier_block);
 
+	rtnl_lock();
+	pktgen_rx_disable();
+	rtnl_unlock();
+	synchronize_net();	/* pktgen_rcv() callers are gone */
+	free_percpu(pktgen_rx_stats);
+
         /* Clean up proc file system */
 
+	if (pktgen_rx_proc_ent)
+		remove_proc_entry(PG_PROC_DIR "/pgrx", proc_net);
         remove_proc_entry(module_fname, NULL);
         
 	remove_proc_dir();
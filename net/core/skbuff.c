@@ -216,6 +216,257 @@ nodata:
 	goto out;
 }
 
+/*
+ *	Receive buffers are carved out of per-CPU high-order pages
+ *	instead of kmalloc, which would round a 1500 byte frame plus
+ *	skb_shared_info up to the next power of two.  Every fragment
+ *	holds a reference on the page; the cache holds one more until
+ *	it moves on to a fresh page.  The pages are never compound, so
+ *	the page owning a fragment is found from the alignment of the
+ *	block, which the buddy allocator guarantees.
+ */
+#define NETDEV_FRAG_ORDER	3
+#define NETDEV_FRAG_SIZE	(PAGE_SIZE << NETDEV_FRAG_ORDER)
+
+struct netdev_frag_cache {
+	struct page	*page;
+	unsigned int	offset;
+};
+
+static DEFINE_PER_CPU(struct netdev_frag_cache, netdev_frag_cache);
+
+static inline struct page *netdev_frag_page(void *data)
+{
+	return virt_to_page((unsigned long)data & ~(NETDEV_FRAG_SIZE - 1));
+}
+
+/**
+ *	netdev_alloc_frag - allocate a page fragment for a receive buffer
+ *	@fragsz: fragment size, at most %PAGE_SIZE
+ *
+ *	Returns a cache aligned chunk of lowmem from the per-CPU fragment
+ *	cache, or %NULL if no high-order page could be had.  Safe to call
+ *	from any context.  Release it with netdev_free_frag(), or pass it
+ *	to build_skb() which takes it over.
+ */
+void *netdev_alloc_frag(unsigned int fragsz)
+{
+	struct netdev_frag_cache *nc;
+	unsigned long flags;
+	void *data = NULL;
+
+	fragsz = SKB_DATA_ALIGN(fragsz);
+	if (unlikely(fragsz > PAGE_SIZE))
+		return NULL;
+
+	local_irq_save(flags);
+	nc = &__get_cpu_var(netdev_frag_cache);
+	if (unlikely(!nc->page || nc->offset + fragsz > NETDEV_FRAG_SIZE)) {
+		if (nc->page)
+			__free_pages(nc->page, NETDEV_FRAG_ORDER);
+		nc->page = alloc_pages(GFP_ATOMIC | __GFP_NOWARN,
+				       NETDEV_FRAG_ORDER);
+		if (!nc->page)
+			goto out;
+		nc->offset = 0;
+	}
+	data = page_address(nc->page) + nc->offset;
+	nc->offset += fragsz;
+	get_page(nc->page);
+out:
+	local_irq_restore(flags);
+	return data;
+}
+
+/**
+ *	netdev_free_frag - release a page fragment
+ *	@data: fragment returned by netdev_alloc_frag()
+ */
+void netdev_free_frag(void *data)
+{
+	__free_pages(netdev_frag_page(data), NETDEV_FRAG_ORDER);
+}
+
+/**
+ *	build_skb - build a network buffer around filled in data
+ *	@data: fragment returned by netdev_alloc_frag()
+ *	@frag_size: size of the fragment
+ *
+ *	Allocate a new &sk_buff whose head is @data.  The packet is
+ *	expected at the start of @data, the &skb_shared_info is placed
+ *	at the end of the fragment, so @frag_size must account for it.
+ *	The buffer owns the fragment from now on.  On a failure the
+ *	return is %NULL and the fragment still belongs to the caller.
+ */
+struct sk_buff *build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb;
+	unsigned int size;
+
+	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
+	if (!skb)
+		return NULL;
+
+	size = frag_size - SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	memset(skb, 0, offsetof(struct sk_buff, truesize));
+	skb->truesize = size + sizeof(struct sk_buff);
+	atomic_set(&skb->users, 1);
+	skb->head = data;
+	skb->data = data;
+	skb->tail = data;
+	skb->end  = data + size;
+	skb->head_frag = 1;
+
+	atomic_set(&(skb_shinfo(skb)->dataref), 1);
+	skb_shinfo(skb)->nr_frags  = 0;
+	skb_shinfo(skb)->tso_size = 0;
+	skb_shinfo(skb)->tso_segs = 0;
+	skb_shinfo(skb)->frag_list = NULL;
+	return skb;
+}
+
+/**
+ *	__netdev_alloc_skb - allocate a receive buffer for a device
+ *	@dev: device the buffer is for, may be %NULL
+ *	@length: length to allocate
+ *	@gfp_mask: allocation mask, used only when falling back to alloc_skb
+ *
+ *	Like __dev_alloc_skb(), but buffers which fit in a page come from
+ *	the per-CPU fragment cache.  The buffer has %NET_SKB_PAD bytes of
+ *	headroom and skb->dev set to @dev.  %NULL is returned if there
+ *	is no free memory.
+ */
+struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
+				   unsigned int length, int gfp_mask)
+{
+	unsigned int fragsz = SKB_DATA_ALIGN(length + NET_SKB_PAD) +
+			      SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	struct sk_buff *skb = NULL;
+
+	if (dev && dev->rx_recycle_pool) {
+		struct netif_rx_stats *stat;
+		struct sk_buff_head *pool;
+		unsigned long flags;
+
+		/* Disabled interrupts keep dev_set_rx_recycle() from
+		 * freeing the pool under us.
+		 */
+		local_irq_save(flags);
+		stat = &__get_cpu_var(netdev_rx_stat);
+		pool = dev->rx_recycle_pool;
+		if (pool)
+			skb = __skb_dequeue(per_cpu_ptr(pool, smp_processor_id()));
+		if (skb && skb->end - skb->data >= length) {
+			stat->recycle_hit++;
+			local_irq_restore(flags);
+			skb->dev = dev;
+			return skb;
+		}
+		stat->recycle_miss++;
+		local_irq_restore(flags);
+
+		/* Left over from a smaller rx_recycle_size. */
+		if (skb) {
+			kfree_skb(skb);
+			skb = NULL;
+		}
+	}
+
+	if (fragsz <= PAGE_SIZE && !(gfp_mask & __GFP_DMA)) {
+		void *data = netdev_alloc_frag(fragsz);
+
+		if (likely(data)) {
+			skb = build_skb(data, fragsz);
+			if (unlikely(!skb))
+				netdev_free_frag(data);
+		}
+	}
+	if (!skb)
+		skb = alloc_skb(length + NET_SKB_PAD, gfp_mask);
+	if (likely(skb)) {
+		skb_reserve(skb, NET_SKB_PAD);
+		skb->dev = dev;
+	}
+	return skb;
+}
+
+/* Turn a transmitted buffer back into an empty receive buffer of at
+ * least @size bytes, as __netdev_alloc_skb() would have returned it.
+ * Only buffers nobody else refers to qualify.
+ */
+static int skb_recycle_reset(struct sk_buff *skb, unsigned int size)
+{
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	unsigned int head_frag = skb->head_frag;
+
+	if (skb_shared(skb) || skb_cloned(skb) || skb->destructor ||
+	    skb->list)
+		return 0;
+	if (shinfo->nr_frags || shinfo->frag_list)
+		return 0;
+	if (skb->end - skb->head < SKB_DATA_ALIGN(size + NET_SKB_PAD))
+		return 0;
+
+	dst_release(skb->dst);
+#ifdef CONFIG_XFRM
+	secpath_put(skb->sp);
+#endif
+#ifdef CONFIG_NETFILTER
+	nf_conntrack_put(skb->nfct);
+#ifdef CONFIG_BRIDGE_NETFILTER
+	nf_bridge_put(skb->nf_bridge);
+#endif
+#endif
+	memset(skb, 0, offsetof(struct sk_buff, truesize));
+	skb->head_frag = head_frag;
+	skb->data = skb->head + NET_SKB_PAD;
+	skb->tail = skb->data;
+
+	atomic_set(&shinfo->dataref, 1);
+	shinfo->tso_size = 0;
+	shinfo->tso_segs = 0;
+	return 1;
+}
+
+/**
+ *	dev_kfree_skb_recycle - free a transmitted buffer, or recycle it
+ *	@dev: device whose receive pool may take the buffer
+ *	@skb: buffer to free
+ *
+ *	With recycling enabled on @dev (see dev_set_rx_recycle()), a buffer
+ *	large enough for the receive buffers of @dev, not shared and not
+ *	cloned goes to the pool of the current CPU instead of back to the
+ *	slab.  Everything else is freed like dev_kfree_skb_any() would.
+ *	Pooled buffers are handed out by netdev_alloc_skb().
+ */
+void dev_kfree_skb_recycle(struct net_device *dev, struct sk_buff *skb)
+{
+	struct sk_buff_head *pool, *list;
+	unsigned long flags;
+
+	/* Releasing conntrack and dst state is not for hard irqs. */
+	if (!dev->rx_recycle_pool || in_irq() || irqs_disabled())
+		goto out_free;
+
+	if (!skb_recycle_reset(skb, dev->rx_recycle_size))
+		goto out_free;
+
+	local_irq_save(flags);
+	pool = dev->rx_recycle_pool;
+	if (pool) {
+		list = per_cpu_ptr(pool, smp_processor_id());
+		if (skb_queue_len(list) < dev->rx_recycle) {
+			__skb_queue_head(list, skb);
+			local_irq_restore(flags);
+			return;
+		}
+	}
+	local_irq_restore(flags);
+
+out_free:
+	dev_kfree_skb_any(skb);
+}
 
 static void skb_drop_fraglist(struct sk_buff *skb)
 {
@@ -252,7 +503,10 @@ void skb_release_data(struct sk_buff *skb)
 		if (skb_shinfo(skb)->frag_list)
 			skb_drop_fraglist(skb);
 
-		kfree(skb->head);
+		if (skb->head_frag)
+			netdev_free_frag(skb->head);
+		else
+			kfree(skb->head);
 	}
 }
 
@@ -395,6 +649,7 @@ struct sk_buff *skb_clone(struct sk_buff *skb, int gfp_mask)
 	C(data);
 	C(tail);
 	C(end);
+	C(head_frag);
 
 	atomic_inc(&(skb_shinfo(skb)->dataref));
 	skb->cloned = 1;
@@ -607,6 +862,7 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail, int gfp_mask)
 	skb->nh.raw  += off;
 	skb->cloned   = 0;
 	skb->nohdr    = 0;
+	skb->head_frag = 0;
 	atomic_set(&skb_shinfo(skb)->dataref, 1);
 	return 0;
 
@@ -1435,6 +1691,11 @@ EXPORT_SYMBOL(___pskb_trim);
 EXPORT_SYMBOL(__kfree_skb);
 EXPORT_SYMBOL(__pskb_pull_tail);
 EXPORT_SYMBOL(alloc_skb);
+EXPORT_SYMBOL(netdev_alloc_frag);
+EXPORT_SYMBOL(netdev_free_frag);
+EXPORT_SYMBOL(build_skb);
+EXPORT_SYMBOL(__netdev_alloc_skb);
+EXPORT_SYMBOL(dev_kfree_skb_recycle);
 EXPORT_SYMBOL(pskb_copy);
 EXPORT_SYMBOL(pskb_expand_head);
 EXPORT_SYMBOL(skb_checksum);
@@ -7,6 +7,7 @@
 #include <linux/crypto.h>
 #include <linux/pfkeyv2.h>
 #include <linux/random.h>
+#include <linux/percpu.h>
 #include <net/icmp.h>
 #include <net/udp.h>
 
@@ -17,7 +18,43 @@ struct esp_decap_data {
 	__u8		proto;
 };
 
-static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
+/*
+ * With parallel processing the transforms, the ivec and the scratch
+ * buffers are per CPU, so that several CPUs can work on one SA at the
+ * same time.  All users run with bottom halves disabled.
+ */
+static inline struct esp_data *esp_cpu_data(struct esp_data *esp)
+{
+#ifdef CONFIG_INET_XFRM_PARALLEL
+	if (esp->percpu)
+		return per_cpu_ptr(esp->percpu, smp_processor_id());
+#endif
+	return esp;
+}
+
+/* Find the ESP header behind the IP and UDP encapsulation headers. */
+static struct ip_esp_hdr *esp_output_header(struct xfrm_state *x,
+					    struct sk_buff *skb)
+{
+	struct iphdr *top_iph = skb->nh.iph;
+	struct udphdr *uh = (struct udphdr *)(skb->nh.raw + top_iph->ihl*4);
+
+	if (!x->encap)
+		return (struct ip_esp_hdr *)uh;
+
+	switch (x->encap->encap_type) {
+	case UDP_ENCAP_ESPINUDP_NON_IKE:
+		return (struct ip_esp_hdr *)((u32 *)(uh + 1) + 2);
+	default:
+		return (struct ip_esp_hdr *)(uh + 1);
+	}
+}
+
+/*
+ * First half of the output transform: pad the payload and fill in the
+ * headers and the sequence number.  Called with x->lock held.
+ */
+static int esp_output_prepare(struct xfrm_state *x, struct sk_buff *skb)
 {
 	int err;
 	struct iphdr *top_iph;
@@ -28,7 +65,6 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	int blksize;
 	int clen;
 	int alen;
-	int nfrags;
 
 	/* Strip IP+ESP header. */
 	__skb_pull(skb, skb->h.raw - skb->data);
@@ -47,7 +83,7 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	if (esp->conf.padlen)
 		clen = (clen + esp->conf.padlen-1)&~(esp->conf.padlen-1);
 
-	if ((nfrags = skb_cow_data(skb, clen-skb->len+alen, &trailer)) < 0)
+	if ((err = skb_cow_data(skb, clen-skb->len+alen, &trailer)) < 0)
 		goto error;
 
 	/* Fill padding... */
@@ -96,6 +132,33 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	esph->spi = x->id.spi;
 	esph->seq_no = htonl(++x->replay.oseq);
 
+	err = 0;
+
+error:
+	return err;
+}
+
+/*
+ * Second half: encrypt and add the ICV.  This one only touches the
+ * packet and the per-CPU state, so it may run without x->lock.
+ */
+static int esp_output_crypt(struct xfrm_state *x, struct sk_buff *skb)
+{
+	int err;
+	struct iphdr *top_iph = skb->nh.iph;
+	struct ip_esp_hdr *esph = esp_output_header(x, skb);
+	struct esp_data *esp = esp_cpu_data(x->data);
+	struct crypto_tfm *tfm = esp->conf.tfm;
+	struct sk_buff *trailer;
+	int alen = esp->auth.icv_trunc_len;
+	int clen = skb->len - (esph->enc_data + esp->conf.ivlen - skb->data);
+	int nfrags;
+
+	/* The data is private already, this only finds the trailer. */
+	err = -ENOMEM;
+	if ((nfrags = skb_cow_data(skb, alen, &trailer)) < 0)
+		goto error;
+
 	if (esp->conf.ivlen)
 		crypto_cipher_set_iv(tfm, esp->conf.ivec, crypto_tfm_alg_ivsize(tfm));
 
@@ -132,6 +195,16 @@ error:
 	return err;
 }
 
+static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
+{
+	int err;
+
+	err = esp_output_prepare(x, skb);
+	if (!err)
+		err = esp_output_crypt(x, skb);
+	return err;
+}
+
 /*
  * Note: detecting truncated vs. non-truncated authentication data is very
  * expensive, so we only support truncated data, which is the recommended
@@ -141,7 +214,7 @@ static int esp_input(struct xfrm_state *x, struct xfrm_decap_state *decap, struc
 {
 	struct iphdr *iph;
 	struct ip_esp_hdr *esph;
-	struct esp_data *esp = x->data;
+	struct esp_data *esp = esp_cpu_data(x->data);
 	struct sk_buff *trailer;
 	int blksize = crypto_tfm_alg_blocksize(esp->conf.tfm);
 	int alen = esp->auth.icv_trunc_len;
@@ -336,13 +409,8 @@ static void esp4_err(struct sk_buff *skb, u32 info)
 	xfrm_state_put(x);
 }
 
-static void esp_destroy(struct xfrm_state *x)
+static void esp_free_crypto(struct esp_data *esp)
 {
-	struct esp_data *esp = x->data;
-
-	if (!esp)
-		return;
-
 	if (esp->conf.tfm) {
 		crypto_free_tfm(esp->conf.tfm);
 		esp->conf.tfm = NULL;
@@ -359,9 +427,84 @@ static void esp_destroy(struct xfrm_state *x)
 		kfree(esp->auth.work_icv);
 		esp->auth.work_icv = NULL;
 	}
+}
+
+static void esp_destroy(struct xfrm_state *x)
+{
+	struct esp_data *esp = x->data;
+
+	if (!esp)
+		return;
+
+#ifdef CONFIG_INET_XFRM_PARALLEL
+	if (esp->percpu) {
+		int cpu;
+
+		for_each_cpu(cpu)
+			esp_free_crypto(per_cpu_ptr(esp->percpu, cpu));
+		free_percpu(esp->percpu);
+	}
+#endif
+	esp_free_crypto(esp);
 	kfree(esp);
 }
 
+/* Allocate the transforms and buffers; the keys must be set already. */
+static int esp_init_crypto(struct xfrm_state *x, struct esp_data *esp)
+{
+	if (x->aalg) {
+		esp->auth.tfm = crypto_alloc_tfm(x->aalg->alg_name, 0);
+		if (esp->auth.tfm == NULL)
+			return -EINVAL;
+		esp->auth.work_icv = kmalloc(crypto_tfm_alg_digestsize(esp->auth.tfm),
+					     GFP_KERNEL);
+		if (!esp->auth.work_icv)
+			return -ENOMEM;
+	}
+	if (x->props.ealgo == SADB_EALG_NULL)
+		esp->conf.tfm = crypto_alloc_tfm(x->ealg->alg_name, CRYPTO_TFM_MODE_ECB);
+	else
+		esp->conf.tfm = crypto_alloc_tfm(x->ealg->alg_name, CRYPTO_TFM_MODE_CBC);
+	if (esp->conf.tfm == NULL)
+		return -EINVAL;
+	esp->conf.ivlen = crypto_tfm_alg_ivsize(esp->conf.tfm);
+	if (esp->conf.ivlen) {
+		esp->conf.ivec = kmalloc(esp->conf.ivlen, GFP_KERNEL);
+		if (unlikely(esp->conf.ivec == NULL))
+			return -ENOMEM;
+		get_random_bytes(esp->conf.ivec, esp->conf.ivlen);
+	}
+	if (crypto_cipher_setkey(esp->conf.tfm, esp->conf.key, esp->conf.key_len))
+		return -EINVAL;
+	return 0;
+}
+
+#ifdef CONFIG_INET_XFRM_PARALLEL
+/* Give every CPU its own copy of the crypto state. */
+static int esp_init_percpu(struct xfrm_state *x, struct esp_data *esp)
+{
+	int cpu;
+
+	esp->percpu = alloc_percpu(struct esp_data);
+	if (!esp->percpu)
+		return -ENOMEM;
+
+	for_each_cpu(cpu) {
+		struct esp_data *c = per_cpu_ptr(esp->percpu, cpu);
+
+		*c = *esp;
+		c->percpu = NULL;
+		c->conf.tfm = NULL;
+		c->conf.ivec = NULL;
+		c->auth.tfm = NULL;
+		c->auth.work_icv = NULL;
+		if (esp_init_crypto(x, c))
+			return -EINVAL;
+	}
+	return 0;
+}
+#endif
+
 static int esp_init_state(struct xfrm_state *x, void *args)
 {
 	struct esp_data *esp = NULL;
@@ -381,14 +524,17 @@ static int esp_init_state(struct xfrm_state *x, void *args)
 	memset(esp, 0, sizeof(*esp));
 
 	if (x->aalg) {
-		struct xfrm_algo_desc *aalg_desc;
-
 		esp->auth.key = x->aalg->alg_key;
 		esp->auth.key_len = (x->aalg->alg_key_len+7)/8;
-		esp->auth.tfm = crypto_alloc_tfm(x->aalg->alg_name, 0);
-		if (esp->auth.tfm == NULL)
-			goto error;
 		esp->auth.icv = esp_hmac_digest;
+	}
+	esp->conf.key = x->ealg->alg_key;
+	esp->conf.key_len = (x->ealg->alg_key_len+7)/8;
+	if (esp_init_crypto(x, esp))
+		goto error;
+
+	if (x->aalg) {
+		struct xfrm_algo_desc *aalg_desc;
 
 		aalg_desc = xfrm_aalg_get_byname(x->aalg->alg_name, 0);
 		BUG_ON(!aalg_desc);
@@ -404,29 +550,12 @@ static int esp_init_state(struct xfrm_state *x, void *args)
 
 		esp->auth.icv_full_len = aalg_desc->uinfo.auth.icv_fullbits/8;
 		esp->auth.icv_trunc_len = aalg_desc->uinfo.auth.icv_truncbits/8;
-
-		esp->auth.work_icv = kmalloc(esp->auth.icv_full_len, GFP_KERNEL);
-		if (!esp->auth.work_icv)
-			goto error;
 	}
-	esp->conf.key = x->ealg->alg_key;
-	esp->conf.key_len = (x->ealg->alg_key_len+7)/8;
-	if (x->props.ealgo == SADB_EALG_NULL)
-		esp->conf.tfm = crypto_alloc_tfm(x->ealg->alg_name, CRYPTO_TFM_MODE_ECB);
-	else
-		esp->conf.tfm = crypto_alloc_tfm(x->ealg->alg_name, CRYPTO_TFM_MODE_CBC);
-	if (esp->conf.tfm == NULL)
-		goto error;
-	esp->conf.ivlen = crypto_tfm_alg_ivsize(esp->conf.tfm);
 	esp->conf.padlen = 0;
-	if (esp->conf.ivlen) {
-		esp->conf.ivec = kmalloc(esp->conf.ivlen, GFP_KERNEL);
-		if (unlikely(esp->conf.ivec == NULL))
-			goto error;
-		get_random_bytes(esp->conf.ivec, esp->conf.ivlen);
-	}
-	if (crypto_cipher_setkey(esp->conf.tfm, esp->conf.key, esp->conf.key_len))
+#ifdef CONFIG_INET_XFRM_PARALLEL
+	if (esp_init_percpu(x, esp))
 		goto error;
+#endif
 	x->props.header_len = sizeof(struct ip_esp_hdr) + esp->conf.ivlen;
 	if (x->props.mode)
 		x->props.header_len += sizeof(struct iphdr);
@@ -465,7 +594,9 @@ static struct xfrm_type esp_type =
 	.get_max_size	= esp4_get_max_size,
 	.input		= esp_input,
 	.post_input	= esp_post_input,
-	.output		= esp_output
+	.output		= esp_output,
+	.output_prepare	= esp_output_prepare,
+	.output_crypt	= esp_output_crypt
 };
 
 static struct net_protocol esp4_protocol = {
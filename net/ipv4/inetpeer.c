@@ -20,6 +20,9 @@
 #include <linux/kernel.h>
 #include <linux/mm.h>
 #include <linux/net.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
 #include <net/inetpeer.h>
 
 /*
@@ -52,26 +55,36 @@
  *  amount of long living nodes in a single hash slot would significantly delay
  *  lookups performed with disabled BHs.
  *
+ *  Lookups walk the tree without any lock, under rcu_read_lock_bh().  Nodes
+ *  are freed only after a BH grace period, so every pointer a reader
+ *  follows stays valid, but a rebalance running at the same time may hide
+ *  the node from it.  The pool lock is a seqlock: a reader that found
+ *  nothing and sees the sequence change falls back to a locked lookup.
+ *
+ *  A node with a zero refcnt is unused and sits on an unused list.  There
+ *  is one such list per CPU; a node always goes on the list of the CPU it
+ *  was created on, so its list (and lock) never changes.  Lists are only
+ *  locked when refcnt goes to or from zero, never on the hot path.
+ *
  *  Serialisation issues.
  *  1.  Nodes may appear in the tree only with the pool write lock held.
  *  2.  Nodes may disappear from the tree only with the pool write lock held
- *      AND reference count being 0.
- *  3.  Nodes appears and disappears from unused node list only under
- *      "inet_peer_unused_lock".
+ *      AND after peer_kill() succeeded on them, i.e. with refcnt lowered
+ *      by PEER_DEAD_BIAS from 0.  A lockless reader seeing a non-positive
+ *      refcnt after its increment backs off and retries under the lock.
+ *  3.  Nodes appears and disappears from an unused node list only under
+ *      that list's lock.  A node may stay on its list for a while after
+ *      it was taken into use again; the collector checks refcnt anyway.
  *  4.  Global variable peer_total is modified under the pool lock.
  *  5.  struct inet_peer fields modification:
  *		avl_left, avl_right, avl_parent, avl_height: pool lock
- *		unused_next, unused_prevp: unused node list lock
- *		refcnt: atomically against modifications on other CPU;
- *		   usually under some other lock to prevent node disappearing
- *		dtime: unused node list lock
- *		v4daddr: unchangeable
- *		ip_id_count: idlock
+ *		unused: unused node list lock
+ *		refcnt: atomically against modifications on other CPU
+ *		dtime: unlocked, it is only a hint for the collector
+ *		v4daddr, unused_cpu: unchangeable
+ *		ip_id_count: atomically
  */
 
-/* Exported for inet_getid inline function.  */
-DEFINE_SPINLOCK(inet_peer_idlock);
-
 static kmem_cache_t *peer_cachep;
 
 #define node_height(x) x->avl_height
@@ -82,9 +95,12 @@ static struct inet_peer peer_fake_node = {
 };
 #define peer_avl_empty (&peer_fake_node)
 static struct inet_peer *peer_root = peer_avl_empty;
-static DEFINE_RWLOCK(peer_pool_lock);
+static seqlock_t peer_pool_lock = SEQLOCK_UNLOCKED;
 #define PEER_MAXDEPTH 40 /* sufficient for about 2^27 nodes */
 
+/* Subtracted from refcnt of a node being removed from the pool. */
+#define PEER_DEAD_BIAS	(1 << 30)
+
 static volatile int peer_total;
 /* Exported for sysctl_net_ipv4.  */
 int inet_peer_threshold = 65536 + 128;	/* start to throw entries more
@@ -92,11 +108,13 @@ int inet_peer_threshold = 65536 + 128;	/* start to throw entries more
 int inet_peer_minttl = 120 * HZ;	/* TTL under high load: 120 sec */
 int inet_peer_maxttl = 10 * 60 * HZ;	/* usual time to live: 10 min */
 
-/* Exported for inet_putpeer inline function.  */
-struct inet_peer *inet_peer_unused_head,
-		**inet_peer_unused_tailp = &inet_peer_unused_head;
-DEFINE_SPINLOCK(inet_peer_unused_lock);
-#define PEER_MAX_CLEANUP_WORK 30
+struct inet_peer_unused
+{
+	spinlock_t		lock;
+	struct list_head	list;
+};
+static DEFINE_PER_CPU(struct inet_peer_unused, inet_peer_unused);
+#define PEER_MAX_CLEANUP_WORK 30	/* per unused list and timer run */
 
 static void peer_check_expire(unsigned long dummy);
 static struct timer_list peer_periodic_timer =
@@ -110,6 +128,7 @@ int inet_peer_gc_mintime = 10 * HZ,
 void __init inet_initpeers(void)
 {
 	struct sysinfo si;
+	int cpu;
 
 	/* Use the straight interface to information about memory. */
 	si_meminfo(&si);
@@ -132,6 +151,13 @@ void __init inet_initpeers(void)
 	if (!peer_cachep)
 		panic("cannot create inet_peer_cache");
 
+	for_each_cpu(cpu) {
+		struct inet_peer_unused *u = &per_cpu(inet_peer_unused, cpu);
+
+		spin_lock_init(&u->lock);
+		INIT_LIST_HEAD(&u->list);
+	}
+
 	/* All the timers, started at system startup tend
 	   to synchronize. Perturb it a bit.
 	 */
@@ -141,20 +167,84 @@ void __init inet_initpeers(void)
 	add_timer(&peer_periodic_timer);
 }
 
-/* Called with or without local BH being disabled. */
+static void peer_free_rcu(struct rcu_head *head)
+{
+	kmem_cache_free(peer_cachep, container_of(head, struct inet_peer, rcu));
+}
+
+/* Take a reference on a node found without the pool lock.  Fails if the
+ * node is being removed from the pool.
+ */
+static inline int peer_hold(struct inet_peer *p)
+{
+	if (atomic_inc_return(&p->refcnt) > 0)
+		return 1;
+	atomic_dec(&p->refcnt);
+	return 0;
+}
+
+/* Called with the pool write lock held.  Marks an unreferenced node as
+ * dead so that lockless readers cannot take it any more.
+ */
+static inline int peer_kill(struct inet_peer *p)
+{
+	if (atomic_sub_return(PEER_DEAD_BIAS, &p->refcnt) == -PEER_DEAD_BIAS)
+		return 1;
+	atomic_add(PEER_DEAD_BIAS, &p->refcnt);
+	return 0;
+}
+
+/* Called with or without local BH being disabled, holding a reference. */
 static void unlink_from_unused(struct inet_peer *p)
 {
-	spin_lock_bh(&inet_peer_unused_lock);
-	if (p->unused_prevp != NULL) {
-		/* On unused list. */
-		*p->unused_prevp = p->unused_next;
-		if (p->unused_next != NULL)
-			p->unused_next->unused_prevp = p->unused_prevp;
+	struct inet_peer_unused *u;
+
+	/* Unlocked test: if we miss a concurrent list_add, the node just
+	 * stays on the list in use until the collector skips over it.
+	 */
+	if (list_empty(&p->unused))
+		return;
+
+	u = &per_cpu(inet_peer_unused, p->unused_cpu);
+	spin_lock_bh(&u->lock);
+	list_del_init(&p->unused);
+	spin_unlock_bh(&u->lock);
+}
+
+/* can be called from BH context or outside */
+void inet_putpeer(struct inet_peer *p)
+{
+	struct inet_peer_unused *u = &per_cpu(inet_peer_unused, p->unused_cpu);
+
+	local_bh_disable();
+	if (atomic_dec_and_lock(&p->refcnt, &u->lock)) {
+		p->dtime = jiffies;
+		if (list_empty(&p->unused))
+			list_add_tail(&p->unused, &u->list);
+		spin_unlock(&u->lock);
+	}
+	local_bh_enable();
+}
+
+/* Called under rcu_read_lock_bh().  May miss the node if the tree is
+ * being rebalanced; the depth limit keeps us from walking in circles.
+ */
+static struct inet_peer *lookup_rcu_bh(__u32 daddr)
+{
+	struct inet_peer *u = rcu_dereference(peer_root);
+	int depth = 0;
+
+	while (u != peer_avl_empty) {
+		if (daddr == u->v4daddr)
+			return u;
+		if (daddr < u->v4daddr)
+			u = rcu_dereference(u->avl_left);
 		else
-			inet_peer_unused_tailp = p->unused_prevp;
-		p->unused_prevp = NULL; /* mark it as removed */
+			u = rcu_dereference(u->avl_right);
+		if (unlikely(++depth == PEER_MAXDEPTH))
+			break;
 	}
-	spin_unlock_bh(&inet_peer_unused_lock);
+	return NULL;
 }
 
 /* Called with local BH disabled and the pool lock held. */
@@ -268,175 +358,196 @@ static void peer_avl_rebalance(struct inet_peer **stack[],
 	}
 }
 
-/* Called with local BH disabled and the pool write lock held. */
+/* Called with local BH disabled and the pool write lock held.
+ * The node is fully set up before it becomes visible to lockless readers.
+ */
 #define link_to_pool(n)						\
 do {								\
 	n->avl_height = 1;					\
 	n->avl_left = peer_avl_empty;				\
 	n->avl_right = peer_avl_empty;				\
+	smp_wmb();						\
 	**--stackptr = n;					\
 	peer_avl_rebalance(stack, stackptr);			\
 } while(0)
 
-/* May be called with local BH enabled. */
+/* Called with local BH disabled, the pool write lock held and p killed. */
 static void unlink_from_pool(struct inet_peer *p)
 {
-	int do_free;
-
-	do_free = 0;
-
-	write_lock_bh(&peer_pool_lock);
-	/* Check the reference counter.  It was artificially incremented by 1
-	 * in cleanup() function to prevent sudden disappearing.  If the
-	 * reference count is still 1 then the node is referenced only as `p'
-	 * here and from the pool.  So under the exclusive pool lock it's safe
-	 * to remove the node and free it later. */
-	if (atomic_read(&p->refcnt) == 1) {
-		struct inet_peer **stack[PEER_MAXDEPTH];
-		struct inet_peer ***stackptr, ***delp;
-		if (lookup(p->v4daddr) != p)
+	struct inet_peer **stack[PEER_MAXDEPTH];
+	struct inet_peer ***stackptr, ***delp;
+
+	if (lookup(p->v4daddr) != p)
+		BUG();
+	delp = stackptr - 1; /* *delp[0] == p */
+	if (p->avl_left == peer_avl_empty) {
+		*delp[0] = p->avl_right;
+		--stackptr;
+	} else {
+		/* look for a node to insert instead of p */
+		struct inet_peer *t;
+		t = lookup_rightempty(p);
+		if (*stackptr[-1] != t)
 			BUG();
-		delp = stackptr - 1; /* *delp[0] == p */
-		if (p->avl_left == peer_avl_empty) {
-			*delp[0] = p->avl_right;
-			--stackptr;
-		} else {
-			/* look for a node to insert instead of p */
-			struct inet_peer *t;
-			t = lookup_rightempty(p);
-			if (*stackptr[-1] != t)
-				BUG();
-			**--stackptr = t->avl_left;
-			/* t is removed, t->v4daddr > x->v4daddr for any
-			 * x in p->avl_left subtree.
-			 * Put t in the old place of p. */
-			*delp[0] = t;
-			t->avl_left = p->avl_left;
-			t->avl_right = p->avl_right;
-			t->avl_height = p->avl_height;
-			if (delp[1] != &p->avl_left)
-				BUG();
-			delp[1] = &t->avl_left; /* was &p->avl_left */
-		}
-		peer_avl_rebalance(stack, stackptr);
-		peer_total--;
-		do_free = 1;
+		**--stackptr = t->avl_left;
+		/* t is removed, t->v4daddr > x->v4daddr for any
+		 * x in p->avl_left subtree.
+		 * Put t in the old place of p. */
+		t->avl_left = p->avl_left;
+		t->avl_right = p->avl_right;
+		t->avl_height = p->avl_height;
+		smp_wmb();
+		*delp[0] = t;
+		if (delp[1] != &p->avl_left)
+			BUG();
+		delp[1] = &t->avl_left; /* was &p->avl_left */
 	}
-	write_unlock_bh(&peer_pool_lock);
-
-	if (do_free)
-		kmem_cache_free(peer_cachep, p);
-	else
-		/* The node is used again.  Decrease the reference counter
-		 * back.  The loop "cleanup -> unlink_from_unused
-		 *   -> unlink_from_pool -> putpeer -> link_to_unused
-		 *   -> cleanup (for the same node)"
-		 * doesn't really exist because the entry will have a
-		 * recent deletion time and will not be cleaned again soon. */
-		inet_putpeer(p);
+	peer_avl_rebalance(stack, stackptr);
+	peer_total--;
 }
 
-/* May be called with local BH enabled. */
-static int cleanup_once(unsigned long ttl)
+/* Try to free the oldest entry on one CPU's unused list.  Returns -1 if
+ * there is nothing old enough there, 0 if the list head was dealt with.
+ * May be called with local BH enabled.
+ */
+static int cleanup_once(int cpu, unsigned long ttl)
 {
-	struct inet_peer *p;
-
-	/* Remove the first entry from the list of unused nodes. */
-	spin_lock_bh(&inet_peer_unused_lock);
-	p = inet_peer_unused_head;
-	if (p != NULL) {
+	struct inet_peer_unused *u = &per_cpu(inet_peer_unused, cpu);
+	struct inet_peer *p = NULL;
+	int ret = -1;
+
+	write_seqlock_bh(&peer_pool_lock);
+	spin_lock(&u->lock);
+	if (!list_empty(&u->list)) {
+		p = list_entry(u->list.next, struct inet_peer, unused);
 		if (time_after(p->dtime + ttl, jiffies)) {
 			/* Do not prune fresh entries. */
-			spin_unlock_bh(&inet_peer_unused_lock);
-			return -1;
+			p = NULL;
+		} else if (!peer_kill(p)) {
+			/* Taken into use again without being unlinked from
+			 * the list yet.  Let its owner deal with it. */
+			p->dtime = jiffies;
+			list_move_tail(&p->unused, &u->list);
+			p = NULL;
+			ret = 0;
+		} else {
+			list_del_init(&p->unused);
 		}
-		inet_peer_unused_head = p->unused_next;
-		if (p->unused_next != NULL)
-			p->unused_next->unused_prevp = p->unused_prevp;
-		else
-			inet_peer_unused_tailp = p->unused_prevp;
-		p->unused_prevp = NULL; /* mark as not on the list */
-		/* Grab an extra reference to prevent node disappearing
-		 * before unlink_from_pool() call. */
-		atomic_inc(&p->refcnt);
 	}
-	spin_unlock_bh(&inet_peer_unused_lock);
+	spin_unlock(&u->lock);
+	if (p != NULL) {
+		unlink_from_pool(p);
+		ret = 0;
+	}
+	write_sequnlock_bh(&peer_pool_lock);
 
-	if (p == NULL)
-		/* It means that the total number of USED entries has
-		 * grown over inet_peer_threshold.  It shouldn't really
-		 * happen because of entry limits in route cache. */
-		return -1;
+	if (p != NULL)
+		call_rcu_bh(&p->rcu, peer_free_rcu);
+	return ret;
+}
 
-	unlink_from_pool(p);
-	return 0;
+/* Free one less-recently-used entry, starting with our own list. */
+static void cleanup_overflow(int start)
+{
+	int cpu = start;
+
+	do {
+		if (!cleanup_once(cpu, 0))
+			return;
+		cpu = next_cpu(cpu, cpu_possible_map);
+		if (cpu >= NR_CPUS)
+			cpu = first_cpu(cpu_possible_map);
+	} while (cpu != start);
+	/* All unused lists are empty.  It means that the total number of
+	 * USED entries has grown over inet_peer_threshold.  It shouldn't
+	 * really happen because of entry limits in route cache. */
 }
 
 /* Called with or without local BH being disabled. */
 struct inet_peer *inet_getpeer(__u32 daddr, int create)
 {
-	struct inet_peer *p, *n;
+	struct inet_peer *p, *n = NULL;
 	struct inet_peer **stack[PEER_MAXDEPTH], ***stackptr;
+	unsigned int seq;
+	int cpu;
 
-	/* Look up for the address quickly. */
-	read_lock_bh(&peer_pool_lock);
-	p = lookup(daddr);
-	if (p != peer_avl_empty)
-		atomic_inc(&p->refcnt);
-	read_unlock_bh(&peer_pool_lock);
+	/* Look up for the address quickly, without taking any lock. */
+	rcu_read_lock_bh();
+	seq = read_seqbegin(&peer_pool_lock);
+	p = lookup_rcu_bh(daddr);
+	if (p != NULL) {
+		if (!peer_hold(p))
+			p = NULL;
+	} else if (!read_seqretry(&peer_pool_lock, seq) && !create) {
+		/* Definitely not there. */
+		rcu_read_unlock_bh();
+		return NULL;
+	}
+	rcu_read_unlock_bh();
 
-	if (p != peer_avl_empty) {
+	if (p != NULL) {
 		/* The existing node has been found. */
 		/* Remove the entry from unused list if it was there. */
 		unlink_from_unused(p);
 		return p;
 	}
 
-	if (!create)
-		return NULL;
-
-	/* Allocate the space outside the locked region. */
-	n = kmem_cache_alloc(peer_cachep, GFP_ATOMIC);
-	if (n == NULL)
-		return NULL;
-	n->v4daddr = daddr;
-	atomic_set(&n->refcnt, 1);
-	n->ip_id_count = secure_ip_id(daddr);
-	n->tcp_ts_stamp = 0;
+	if (create) {
+		/* Allocate the space outside the locked region. */
+		n = kmem_cache_alloc(peer_cachep, GFP_ATOMIC);
+		if (n == NULL)
+			return NULL;
+		n->v4daddr = daddr;
+		atomic_set(&n->refcnt, 1);
+		INIT_LIST_HEAD(&n->unused);
+		atomic_set(&n->ip_id_count, secure_ip_id(daddr));
+		n->tcp_ts_stamp = 0;
+		memset(n->tcp_fastopen_cookie, 0,
+		       sizeof(n->tcp_fastopen_cookie));
+	}
 
-	write_lock_bh(&peer_pool_lock);
-	/* Check if an entry has suddenly appeared. */
+	write_seqlock_bh(&peer_pool_lock);
+	/* Check if an entry has suddenly appeared, or was hidden from
+	 * the lockless lookup. */
 	p = lookup(daddr);
 	if (p != peer_avl_empty)
 		goto out_free;
 
+	if (n == NULL) {
+		write_sequnlock_bh(&peer_pool_lock);
+		return NULL;
+	}
+
 	/* Link the node. */
+	cpu = smp_processor_id();
+	n->unused_cpu = cpu;
 	link_to_pool(n);
-	n->unused_prevp = NULL; /* not on the list */
 	peer_total++;
-	write_unlock_bh(&peer_pool_lock);
+	write_sequnlock_bh(&peer_pool_lock);
 
 	if (peer_total >= inet_peer_threshold)
 		/* Remove one less-recently-used entry. */
-		cleanup_once(0);
+		cleanup_overflow(cpu);
 
 	return n;
 
 out_free:
-	/* The appropriate node is already in the pool. */
+	/* The appropriate node is already in the pool.  Nodes in the
+	 * pool are never dead while we hold the pool lock. */
 	atomic_inc(&p->refcnt);
-	write_unlock_bh(&peer_pool_lock);
+	write_sequnlock_bh(&peer_pool_lock);
 	/* Remove the entry from unused list if it was there. */
 	unlink_from_unused(p);
-	/* Free preallocated the preallocated node. */
-	kmem_cache_free(peer_cachep, n);
+	/* Free the preallocated node. */
+	if (n != NULL)
+		kmem_cache_free(peer_cachep, n);
 	return p;
 }
 
 /* Called with local BH disabled. */
 static void peer_check_expire(unsigned long dummy)
 {
-	int i;
+	int cpu, i;
 	int ttl;
 
 	if (peer_total >= inet_peer_threshold)
@@ -445,7 +556,9 @@ static void peer_check_expire(unsigned long dummy)
 		ttl = inet_peer_maxttl
 				- (inet_peer_maxttl - inet_peer_minttl) / HZ *
 					peer_total / inet_peer_threshold * HZ;
-	for (i = 0; i < PEER_MAX_CLEANUP_WORK && !cleanup_once(ttl); i++);
+	for_each_cpu(cpu)
+		for (i = 0; i < PEER_MAX_CLEANUP_WORK &&
+			    !cleanup_once(cpu, ttl); i++);
 
 	/* Trigger the timer after inet_peer_gc_mintime .. inet_peer_gc_maxtime
 	 * interval depending on the total number of entries (more entries,
@@ -456,5 +569,3 @@ static void peer_check_expire(unsigned long dummy)
 			peer_total / inet_peer_threshold * HZ;
 	add_timer(&peer_periodic_timer);
 }
-
-EXPORT_SYMBOL(inet_peer_idlock);
@@ -29,6 +29,9 @@
 #include <linux/jiffies.h>
 #include <linux/skbuff.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
 #include <linux/ip.h>
 #include <linux/icmp.h>
 #include <linux/netdevice.h>
@@ -61,18 +64,24 @@ int sysctl_ipfrag_low_thresh = 192*1024;
  */
 int sysctl_ipfrag_time = IP_FRAG_TIME;
 
+/* While queued, a fragment's control block holds its node in the queue's
+ * tree instead of the IP control block.  The IP control block of the
+ * first fragment is kept in the queue and put back on reassembly.
+ */
 struct ipfrag_skb_cb
 {
-	struct inet_skb_parm	h;
+	struct rb_node		node;
 	int			offset;
 };
 
 #define FRAG_CB(skb)	((struct ipfrag_skb_cb*)((skb)->cb))
+#define rb_to_skb(n)	\
+	((struct sk_buff *)((char *)(n) - offsetof(struct sk_buff, cb)))
 
 /* Describe an entry in the "incomplete datagrams" queue. */
 struct ipq {
-	struct ipq	*next;		/* linked list pointers			*/
-	struct list_head lru_list;	/* lru list member 			*/
+	struct list_head list;		/* hash chain, most recent first	*/
+	unsigned int	hash;		/* bucket we are chained on		*/
 	u32		user;
 	u32		saddr;
 	u32		daddr;
@@ -83,42 +92,56 @@ struct ipq {
 #define FIRST_IN		2
 #define LAST_IN			1
 
-	struct sk_buff	*fragments;	/* linked list of received fragments	*/
+	struct rb_root	rb_fragments;	/* received fragments by offset		*/
+	struct sk_buff	*fragments_tail; /* the one with the highest offset	*/
 	int		len;		/* total length of original datagram	*/
 	int		meat;
 	spinlock_t	lock;
 	atomic_t	refcnt;
 	struct timer_list timer;	/* when will this queue expire?		*/
-	struct ipq	**pprev;
+	unsigned long	touched;	/* when did the last fragment arrive?	*/
 	int		iif;
 	struct timeval	stamp;
+	struct inet_skb_parm head_parm;	/* IP control block of the first one	*/
 };
 
-/* Hash table. */
-
-#define IPQ_HASHSZ	64
+/* Hash table.  Each bucket has its own lock and keeps its queues in
+ * most recently used order, which is all the evictor needs.  The hash
+ * secret is changed under ipfrag_rnd_lock: lookups check it after
+ * taking the bucket lock and start over if a rebuild got in between.
+ */
 
-/* Per-bucket lock is easy to add now. */
-static struct ipq *ipq_hash[IPQ_HASHSZ];
-static DEFINE_RWLOCK(ipfrag_lock);
-static u32 ipfrag_hash_rnd;
-static LIST_HEAD(ipq_lru_list);
-int ip_frag_nqueues = 0;
+#define IPQ_HASHSZ	256
 
-static __inline__ void __ipq_unlink(struct ipq *qp)
+struct ipq_bucket
 {
-	if(qp->next)
-		qp->next->pprev = qp->pprev;
-	*qp->pprev = qp->next;
-	list_del(&qp->lru_list);
-	ip_frag_nqueues--;
-}
+	struct list_head	chain;
+	spinlock_t		lock;
+};
+
+static struct ipq_bucket ipq_hash[IPQ_HASHSZ];
+static seqlock_t ipfrag_rnd_lock = SEQLOCK_UNLOCKED;
+static u32 ipfrag_hash_rnd;
+atomic_t ip_frag_nqueues = ATOMIC_INIT(0);
 
-static __inline__ void ipq_unlink(struct ipq *ipq)
+/* Called with the queue lock held. */
+static void ipq_unlink(struct ipq *qp)
 {
-	write_lock(&ipfrag_lock);
-	__ipq_unlink(ipq);
-	write_unlock(&ipfrag_lock);
+	struct ipq_bucket *hb;
+	unsigned int hash;
+
+again:
+	hash = qp->hash;
+	hb = &ipq_hash[hash];
+	spin_lock(&hb->lock);
+	if (unlikely(qp->hash != hash)) {
+		/* Moved by ipfrag_secret_rebuild() meanwhile. */
+		spin_unlock(&hb->lock);
+		goto again;
+	}
+	list_del(&qp->list);
+	spin_unlock(&hb->lock);
+	atomic_dec(&ip_frag_nqueues);
 }
 
 static unsigned int ipqhashfn(u16 id, u32 saddr, u32 daddr, u8 prot)
@@ -135,46 +158,61 @@ static void ipfrag_secret_rebuild(unsigned long dummy)
 	unsigned long now = jiffies;
 	int i;
 
-	write_lock(&ipfrag_lock);
+	write_seqlock(&ipfrag_rnd_lock);
 	get_random_bytes(&ipfrag_hash_rnd, sizeof(u32));
 	for (i = 0; i < IPQ_HASHSZ; i++) {
-		struct ipq *q;
+		struct ipq_bucket *hb = &ipq_hash[i];
+		struct ipq *q, *n;
 
-		q = ipq_hash[i];
-		while (q) {
-			struct ipq *next = q->next;
+		spin_lock(&hb->lock);
+		list_for_each_entry_safe(q, n, &hb->chain, list) {
 			unsigned int hval = ipqhashfn(q->id, q->saddr,
 						      q->daddr, q->protocol);
 
 			if (hval != i) {
-				/* Unlink. */
-				if (q->next)
-					q->next->pprev = q->pprev;
-				*q->pprev = q->next;
-
-				/* Relink to new hash chain. */
-				if ((q->next = ipq_hash[hval]) != NULL)
-					q->next->pprev = &q->next;
-				ipq_hash[hval] = q;
-				q->pprev = &ipq_hash[hval];
+				struct ipq_bucket *hb_dest = &ipq_hash[hval];
+
+				/* Relink to new hash chain.  Nobody else
+				 * ever holds two bucket locks at once. */
+				spin_lock(&hb_dest->lock);
+				list_move_tail(&q->list, &hb_dest->chain);
+				q->hash = hval;
+				spin_unlock(&hb_dest->lock);
 			}
-
-			q = next;
 		}
+		spin_unlock(&hb->lock);
 	}
-	write_unlock(&ipfrag_lock);
+	write_sequnlock(&ipfrag_rnd_lock);
 
 	mod_timer(&ipfrag_secret_timer, now + sysctl_ipfrag_secret_interval);
 }
 
 atomic_t ip_frag_mem = ATOMIC_INIT(0);	/* Memory used for fragments */
 
+/* Each CPU collects its changes to ip_frag_mem and folds them in once they
+ * reach a share of the high threshold, so ip_frag_mem is off by at most
+ * a quarter of it.  Called with BH disabled.
+ */
+static DEFINE_PER_CPU(int, ip_frag_mem_delta);
+
+static void frag_mem_add(int amount)
+{
+	int *delta = &__get_cpu_var(ip_frag_mem_delta);
+	int batch = sysctl_ipfrag_high_thresh / (4 * num_online_cpus());
+
+	*delta += amount;
+	if (*delta >= batch || *delta <= -batch) {
+		atomic_add(*delta, &ip_frag_mem);
+		*delta = 0;
+	}
+}
+
 /* Memory Tracking Functions. */
 static __inline__ void frag_kfree_skb(struct sk_buff *skb, int *work)
 {
 	if (work)
 		*work -= skb->truesize;
-	atomic_sub(skb->truesize, &ip_frag_mem);
+	frag_mem_add(-skb->truesize);
 	kfree_skb(skb);
 }
 
@@ -182,7 +220,7 @@ static __inline__ void frag_free_queue(struct ipq *qp, int *work)
 {
 	if (work)
 		*work -= sizeof(struct ipq);
-	atomic_sub(sizeof(struct ipq), &ip_frag_mem);
+	frag_mem_add(-(int)sizeof(struct ipq));
 	kfree(qp);
 }
 
@@ -192,10 +230,54 @@ static __inline__ struct ipq *frag_alloc_queue(void)
 
 	if(!qp)
 		return NULL;
-	atomic_add(sizeof(struct ipq), &ip_frag_mem);
+	frag_mem_add(sizeof(struct ipq));
 	return qp;
 }
 
+/* Fragment tree helpers.  Called with the queue lock held. */
+static inline struct sk_buff *frag_next(struct sk_buff *skb)
+{
+	struct rb_node *n = rb_next(&FRAG_CB(skb)->node);
+
+	return n ? rb_to_skb(n) : NULL;
+}
+
+static void frag_insert(struct ipq *qp, struct sk_buff *skb)
+{
+	struct rb_node **p = &qp->rb_fragments.rb_node, *parent = NULL;
+	struct sk_buff *tail = qp->fragments_tail;
+	int offset = FRAG_CB(skb)->offset;
+
+	if (tail && FRAG_CB(tail)->offset < offset) {
+		/* In order: the tail is the rightmost node. */
+		parent = &FRAG_CB(tail)->node;
+		p = &parent->rb_right;
+		qp->fragments_tail = skb;
+	} else {
+		while (*p) {
+			parent = *p;
+			if (offset < FRAG_CB(rb_to_skb(parent))->offset)
+				p = &parent->rb_left;
+			else
+				p = &parent->rb_right;
+		}
+		if (tail == NULL)
+			qp->fragments_tail = skb;
+	}
+	rb_link_node(&FRAG_CB(skb)->node, parent, p);
+	rb_insert_color(&FRAG_CB(skb)->node, &qp->rb_fragments);
+}
+
+static void frag_erase(struct ipq *qp, struct sk_buff *skb)
+{
+	if (qp->fragments_tail == skb) {
+		struct rb_node *n = rb_prev(&FRAG_CB(skb)->node);
+
+		qp->fragments_tail = n ? rb_to_skb(n) : NULL;
+	}
+	rb_erase(&FRAG_CB(skb)->node, &qp->rb_fragments);
+}
+
 
 /* Destruction primitives. */
 
@@ -208,12 +290,10 @@ static void ip_frag_destroy(struct ipq *qp, int *work)
 	BUG_TRAP(del_timer(&qp->timer) == 0);
 
 	/* Release all fragment data. */
-	fp = qp->fragments;
-	while (fp) {
-		struct sk_buff *xp = fp->next;
-
+	while (qp->rb_fragments.rb_node != NULL) {
+		fp = rb_to_skb(rb_first(&qp->rb_fragments));
+		frag_erase(qp, fp);
 		frag_kfree_skb(fp, work);
-		fp = xp;
 	}
 
 	/* Finally, release the queue descriptor itself. */
@@ -241,29 +321,43 @@ static void ipq_kill(struct ipq *ipq)
 	}
 }
 
-/* Memory limiting on fragments.  Evictor trashes the oldest 
- * fragment queue until we are back under the threshold.
+/* Memory limiting on fragments.  The evictor visits a few buckets, going
+ * on from where it stopped last time, and trashes the least recently used
+ * queue of each until we are back under the low threshold.  Queues that
+ * got a fragment in the last IPFRAG_EVICT_IDLE are still being filled and
+ * are spared: under a flood of junk fragments the junk goes idle at once,
+ * while real datagrams complete within milliseconds.  If nothing could be
+ * evicted, ip_find() refuses new queues until memory frees up.
  */
+#define IPFRAG_EVICT_BUCKETS	16
+#define IPFRAG_EVICT_IDLE	(HZ/100 ? : 1)
+
 static void ip_evictor(void)
 {
+	static unsigned int evict_bucket;
+	struct ipq_bucket *hb;
 	struct ipq *qp;
-	struct list_head *tmp;
-	int work;
+	int i, work;
 
 	work = atomic_read(&ip_frag_mem) - sysctl_ipfrag_low_thresh;
 	if (work <= 0)
 		return;
 
-	while (work > 0) {
-		read_lock(&ipfrag_lock);
-		if (list_empty(&ipq_lru_list)) {
-			read_unlock(&ipfrag_lock);
-			return;
+	for (i = 0; work > 0 && i < IPFRAG_EVICT_BUCKETS; i++) {
+		hb = &ipq_hash[evict_bucket++ & (IPQ_HASHSZ - 1)];
+
+		spin_lock(&hb->lock);
+		if (list_empty(&hb->chain)) {
+			spin_unlock(&hb->lock);
+			continue;
+		}
+		qp = list_entry(hb->chain.prev, struct ipq, list);
+		if (time_before(jiffies, qp->touched + IPFRAG_EVICT_IDLE)) {
+			spin_unlock(&hb->lock);
+			continue;
 		}
-		tmp = ipq_lru_list.next;
-		qp = list_entry(tmp, struct ipq, lru_list);
 		atomic_inc(&qp->refcnt);
-		read_unlock(&ipfrag_lock);
+		spin_unlock(&hb->lock);
 
 		spin_lock(&qp->lock);
 		if (!(qp->last_in&COMPLETE))
@@ -292,13 +386,18 @@ static void ip_expire(unsigned long arg)
 	IP_INC_STATS_BH(IPSTATS_MIB_REASMTIMEOUT);
 	IP_INC_STATS_BH(IPSTATS_MIB_REASMFAILS);
 
-	if ((qp->last_in&FIRST_IN) && qp->fragments != NULL) {
-		struct sk_buff *head = qp->fragments;
+	if ((qp->last_in&FIRST_IN) && qp->rb_fragments.rb_node != NULL) {
+		struct sk_buff *head = rb_to_skb(rb_first(&qp->rb_fragments));
+
+		/* icmp_send() needs the IP control block back. */
+		frag_erase(qp, head);
+		memcpy(IPCB(head), &qp->head_parm, sizeof(qp->head_parm));
 		/* Send an ICMP "Fragment Reassembly Timeout" message. */
 		if ((head->dev = dev_get_by_index(qp->iif)) != NULL) {
 			icmp_send(head, ICMP_TIME_EXCEEDED, ICMP_EXC_FRAGTIME, 0);
 			dev_put(head->dev);
 		}
+		frag_kfree_skb(head, NULL);
 	}
 out:
 	spin_unlock(&qp->lock);
@@ -307,24 +406,45 @@ out:
 
 /* Creation primitives. */
 
-static struct ipq *ip_frag_intern(unsigned int hash, struct ipq *qp_in)
+/* Lock and return the bucket for a queue, with the hash secret stable. */
+static struct ipq_bucket *ipq_lock_bucket(u16 id, u32 saddr, u32 daddr,
+					  u8 prot, unsigned int *hash)
 {
+	struct ipq_bucket *hb;
+	unsigned int seq;
+
+	for (;;) {
+		seq = read_seqbegin(&ipfrag_rnd_lock);
+		*hash = ipqhashfn(id, saddr, daddr, prot);
+		hb = &ipq_hash[*hash];
+		spin_lock(&hb->lock);
+		if (!read_seqretry(&ipfrag_rnd_lock, seq))
+			return hb;
+		spin_unlock(&hb->lock);
+	}
+}
+
+static struct ipq *ip_frag_intern(struct ipq *qp_in)
+{
+	struct ipq_bucket *hb;
+	unsigned int hash;
 	struct ipq *qp;
 
-	write_lock(&ipfrag_lock);
+	hb = ipq_lock_bucket(qp_in->id, qp_in->saddr, qp_in->daddr,
+			     qp_in->protocol, &hash);
 #ifdef CONFIG_SMP
 	/* With SMP race we have to recheck hash table, because
 	 * such entry could be created on other cpu, while we
-	 * promoted read lock to write lock.
+	 * were allocating ours.
 	 */
-	for(qp = ipq_hash[hash]; qp; qp = qp->next) {
+	list_for_each_entry(qp, &hb->chain, list) {
 		if(qp->id == qp_in->id		&&
 		   qp->saddr == qp_in->saddr	&&
 		   qp->daddr == qp_in->daddr	&&
 		   qp->protocol == qp_in->protocol &&
 		   qp->user == qp_in->user) {
 			atomic_inc(&qp->refcnt);
-			write_unlock(&ipfrag_lock);
+			spin_unlock(&hb->lock);
 			qp_in->last_in |= COMPLETE;
 			ipq_put(qp_in, NULL);
 			return qp;
@@ -337,19 +457,15 @@ static struct ipq *ip_frag_intern(unsigned int hash, struct ipq *qp_in)
 		atomic_inc(&qp->refcnt);
 
 	atomic_inc(&qp->refcnt);
-	if((qp->next = ipq_hash[hash]) != NULL)
-		qp->next->pprev = &qp->next;
-	ipq_hash[hash] = qp;
-	qp->pprev = &ipq_hash[hash];
-	INIT_LIST_HEAD(&qp->lru_list);
-	list_add_tail(&qp->lru_list, &ipq_lru_list);
-	ip_frag_nqueues++;
-	write_unlock(&ipfrag_lock);
+	qp->hash = hash;
+	list_add(&qp->list, &hb->chain);
+	spin_unlock(&hb->lock);
+	atomic_inc(&ip_frag_nqueues);
 	return qp;
 }
 
 /* Add an entry to the 'ipq' queue for a newly received IP datagram. */
-static struct ipq *ip_frag_create(unsigned hash, struct iphdr *iph, u32 user)
+static struct ipq *ip_frag_create(struct iphdr *iph, u32 user)
 {
 	struct ipq *qp;
 
@@ -364,7 +480,9 @@ static struct ipq *ip_frag_create(unsigned hash, struct iphdr *iph, u32 user)
 	qp->user = user;
 	qp->len = 0;
 	qp->meat = 0;
-	qp->fragments = NULL;
+	qp->rb_fragments = RB_ROOT;
+	qp->fragments_tail = NULL;
+	qp->touched = jiffies;
 	qp->iif = 0;
 
 	/* Initialize a timer for this entry. */
@@ -374,7 +492,7 @@ static struct ipq *ip_frag_create(unsigned hash, struct iphdr *iph, u32 user)
 	spin_lock_init(&qp->lock);
 	atomic_set(&qp->refcnt, 1);
 
-	return ip_frag_intern(hash, qp);
+	return ip_frag_intern(qp);
 
 out_nomem:
 	NETDEBUG(if (net_ratelimit()) printk(KERN_ERR "ip_frag_create: no memory left !\n"));
@@ -390,24 +508,33 @@ static inline struct ipq *ip_find(struct iphdr *iph, u32 user)
 	__u32 saddr = iph->saddr;
 	__u32 daddr = iph->daddr;
 	__u8 protocol = iph->protocol;
-	unsigned int hash = ipqhashfn(id, saddr, daddr, protocol);
+	struct ipq_bucket *hb;
+	unsigned int hash;
 	struct ipq *qp;
 
-	read_lock(&ipfrag_lock);
-	for(qp = ipq_hash[hash]; qp; qp = qp->next) {
+	hb = ipq_lock_bucket(id, saddr, daddr, protocol, &hash);
+	list_for_each_entry(qp, &hb->chain, list) {
 		if(qp->id == id		&&
 		   qp->saddr == saddr	&&
 		   qp->daddr == daddr	&&
 		   qp->protocol == protocol &&
 		   qp->user == user) {
 			atomic_inc(&qp->refcnt);
-			read_unlock(&ipfrag_lock);
+			/* Keep the chain in LRU order for the evictor. */
+			list_move(&qp->list, &hb->chain);
+			spin_unlock(&hb->lock);
 			return qp;
 		}
 	}
-	read_unlock(&ipfrag_lock);
+	spin_unlock(&hb->lock);
+
+	/* Memory is short and the evictor found nothing idle: let the
+	 * datagrams in progress complete rather than start new ones.
+	 */
+	if (atomic_read(&ip_frag_mem) > sysctl_ipfrag_high_thresh)
+		return NULL;
 
-	return ip_frag_create(hash, iph, user);
+	return ip_frag_create(iph, user);
 }
 
 /* Add new segment to existing queue. */
@@ -461,14 +588,27 @@ static void ip_frag_queue(struct ipq *qp, struct sk_buff *skb)
 		goto err;
 
 	/* Find out which fragments are in front and at the back of us
-	 * in the chain of fragments so far.  We must know where to put
-	 * this fragment, right?
+	 * in the tree of fragments so far.  We must know where to put
+	 * this fragment, right?  Most arrive in order, right after the
+	 * current tail.
 	 */
-	prev = NULL;
-	for(next = qp->fragments; next != NULL; next = next->next) {
-		if (FRAG_CB(next)->offset >= offset)
-			break;	/* bingo! */
-		prev = next;
+	prev = qp->fragments_tail;
+	next = NULL;
+	if (prev && FRAG_CB(prev)->offset >= offset) {
+		struct rb_node *n = qp->rb_fragments.rb_node;
+
+		prev = NULL;
+		while (n) {
+			struct sk_buff *s = rb_to_skb(n);
+
+			if (FRAG_CB(s)->offset >= offset) {
+				next = s;	/* bingo, unless one is closer */
+				n = n->rb_left;
+			} else {
+				prev = s;
+				n = n->rb_right;
+			}
+		}
 	}
 
 	/* We found where to put this one.  Check for overlap with
@@ -509,40 +649,31 @@ static void ip_frag_queue(struct ipq *qp, struct sk_buff *skb)
 			/* Old fragmnet is completely overridden with
 			 * new one drop it.
 			 */
-			next = next->next;
-
-			if (prev)
-				prev->next = next;
-			else
-				qp->fragments = next;
+			next = frag_next(next);
 
+			frag_erase(qp, free_it);
 			qp->meat -= free_it->len;
 			frag_kfree_skb(free_it, NULL);
 		}
 	}
 
+	if (offset == 0)
+		memcpy(&qp->head_parm, IPCB(skb), sizeof(qp->head_parm));
 	FRAG_CB(skb)->offset = offset;
 
-	/* Insert this fragment in the chain of fragments. */
-	skb->next = next;
-	if (prev)
-		prev->next = skb;
-	else
-		qp->fragments = skb;
+	/* Insert this fragment in the tree of fragments. */
+	frag_insert(qp, skb);
 
  	if (skb->dev)
  		qp->iif = skb->dev->ifindex;
 	skb->dev = NULL;
 	qp->stamp = skb->stamp;
 	qp->meat += skb->len;
-	atomic_add(skb->truesize, &ip_frag_mem);
+	qp->touched = jiffies;
+	frag_mem_add(skb->truesize);
 	if (offset == 0)
 		qp->last_in |= FIRST_IN;
 
-	write_lock(&ipfrag_lock);
-	list_move_tail(&qp->lru_list, &ipq_lru_list);
-	write_unlock(&ipfrag_lock);
-
 	return;
 
 err:
@@ -555,13 +686,15 @@ err:
 static struct sk_buff *ip_frag_reasm(struct ipq *qp, struct net_device *dev)
 {
 	struct iphdr *iph;
-	struct sk_buff *fp, *head = qp->fragments;
+	struct sk_buff *fp, *head, *clone = NULL;
+	struct rb_node *n;
 	int len;
 	int ihlen;
 
 	ipq_kill(qp);
 
-	BUG_TRAP(head != NULL);
+	BUG_TRAP(qp->rb_fragments.rb_node != NULL);
+	head = rb_to_skb(rb_first(&qp->rb_fragments));
 	BUG_TRAP(FRAG_CB(head)->offset == 0);
 
 	/* Allocate a new buffer for the datagram. */
@@ -575,15 +708,28 @@ static struct sk_buff *ip_frag_reasm(struct ipq *qp, struct net_device *dev)
 	if (skb_cloned(head) && pskb_expand_head(head, 0, 0, GFP_ATOMIC))
 		goto out_nomem;
 
+	if (skb_shinfo(head)->frag_list &&
+	    (clone = alloc_skb(0, GFP_ATOMIC)) == NULL)
+		goto out_nomem;
+
+	/* Nothing can fail from here on: chain the fragments up in
+	 * order and give the head its IP control block back. */
+	fp = head;
+	for (n = rb_next(&FRAG_CB(head)->node); n; n = rb_next(n)) {
+		fp->next = rb_to_skb(n);
+		fp = fp->next;
+	}
+	fp->next = NULL;
+	qp->rb_fragments = RB_ROOT;
+	qp->fragments_tail = NULL;
+	memcpy(IPCB(head), &qp->head_parm, sizeof(qp->head_parm));
+
 	/* If the first fragment is fragmented itself, we split
 	 * it to two chunks: the first with data and paged part
 	 * and the second, holding only fragments. */
-	if (skb_shinfo(head)->frag_list) {
-		struct sk_buff *clone;
+	if (clone) {
 		int i, plen = 0;
 
-		if ((clone = alloc_skb(0, GFP_ATOMIC)) == NULL)
-			goto out_nomem;
 		clone->next = head->next;
 		head->next = clone;
 		skb_shinfo(clone)->frag_list = skb_shinfo(head)->frag_list;
@@ -595,12 +741,12 @@ static struct sk_buff *ip_frag_reasm(struct ipq *qp, struct net_device *dev)
 		head->len -= clone->len;
 		clone->csum = 0;
 		clone->ip_summed = head->ip_summed;
-		atomic_add(clone->truesize, &ip_frag_mem);
+		frag_mem_add(clone->truesize);
 	}
 
 	skb_shinfo(head)->frag_list = head->next;
 	skb_push(head, head->data - head->nh.raw);
-	atomic_sub(head->truesize, &ip_frag_mem);
+	frag_mem_add(-head->truesize);
 
 	for (fp=head->next; fp; fp = fp->next) {
 		head->data_len += fp->len;
@@ -610,7 +756,7 @@ static struct sk_buff *ip_frag_reasm(struct ipq *qp, struct net_device *dev)
 		else if (head->ip_summed == CHECKSUM_HW)
 			head->csum = csum_add(head->csum, fp->csum);
 		head->truesize += fp->truesize;
-		atomic_sub(fp->truesize, &ip_frag_mem);
+		frag_mem_add(-fp->truesize);
 	}
 
 	head->next = NULL;
@@ -621,7 +767,6 @@ static struct sk_buff *ip_frag_reasm(struct ipq *qp, struct net_device *dev)
 	iph->frag_off = 0;
 	iph->tot_len = htons(len);
 	IP_INC_STATS_BH(IPSTATS_MIB_REASMOKS);
-	qp->fragments = NULL;
 	return head;
 
 out_nomem:
@@ -679,6 +824,13 @@ struct sk_buff *ip_defrag(struct sk_buff *skb, u32 user)
 
 void ipfrag_init(void)
 {
+	int i;
+
+	for (i = 0; i < IPQ_HASHSZ; i++) {
+		INIT_LIST_HEAD(&ipq_hash[i].chain);
+		spin_lock_init(&ipq_hash[i].lock);
+	}
+
 	ipfrag_hash_rnd = (u32) ((num_physpages ^ (num_physpages>>7)) ^
 				 (jiffies ^ (jiffies >> 6)));
 
@@ -196,27 +196,17 @@ int ip_call_ra_chain(struct sk_buff *skb)
 	return 0;
 }
 
-static inline int ip_local_deliver_finish(struct sk_buff *skb)
+/*
+ *	Hand a packet pulled up to its payload to raw sockets and the
+ *	handler of protocol.  A handler that returns -proto (the IPsec
+ *	ones, once they have decrypted the packet) gets it resubmitted
+ *	to proto.
+ */
+void ip_local_deliver_proto(struct sk_buff *skb, int protocol)
 {
-	int ihl = skb->nh.iph->ihl*4;
-
-#ifdef CONFIG_NETFILTER_DEBUG
-	nf_debug_ip_local_deliver(skb);
-#endif /*CONFIG_NETFILTER_DEBUG*/
-
-	__skb_pull(skb, ihl);
-
-	/* Free reference early: we don't need it any more, and it may
-           hold ip_conntrack module loaded indefinitely. */
-	nf_reset(skb);
-
-        /* Point into the IP datagram, just past the header. */
-        skb->h.raw = skb->data;
-
 	rcu_read_lock();
 	{
 		/* Note: See raw.c and net/raw.h, RAWV4_HTABLE_SIZE==MAX_INET_PROTOS */
-		int protocol = skb->nh.iph->protocol;
 		int hash;
 		struct sock *raw_sk;
 		struct net_protocol *ipprot;
@@ -259,6 +249,26 @@ static inline int ip_local_deliver_finish(struct sk_buff *skb)
 	}
  out:
 	rcu_read_unlock();
+}
+
+static inline int ip_local_deliver_finish(struct sk_buff *skb)
+{
+	int ihl = skb->nh.iph->ihl*4;
+
+#ifdef CONFIG_NETFILTER_DEBUG
+	nf_debug_ip_local_deliver(skb);
+#endif /*CONFIG_NETFILTER_DEBUG*/
+
+	__skb_pull(skb, ihl);
+
+	/* Free reference early: we don't need it any more, and it may
+           hold ip_conntrack module loaded indefinitely. */
+	nf_reset(skb);
+
+        /* Point into the IP datagram, just past the header. */
+        skb->h.raw = skb->data;
+
+	ip_local_deliver_proto(skb, skb->nh.iph->protocol);
 
 	return 0;
 }
@@ -282,20 +292,12 @@ int ip_local_deliver(struct sk_buff *skb)
 		       ip_local_deliver_finish);
 }
 
-static inline int ip_rcv_finish(struct sk_buff *skb)
+/* Second half of ip_rcv_finish(), once skb->dst is set. */
+static inline int ip_rcv_routed(struct sk_buff *skb)
 {
 	struct net_device *dev = skb->dev;
 	struct iphdr *iph = skb->nh.iph;
 
-	/*
-	 *	Initialise the virtual path cache for the packet. It describes
-	 *	how the packet travels inside Linux networking.
-	 */ 
-	if (skb->dst == NULL) {
-		if (ip_route_input(skb, iph->daddr, iph->saddr, iph->tos, dev))
-			goto drop; 
-	}
-
 #ifdef CONFIG_NET_CLS_ROUTE
 	if (skb->dst->tclassid) {
 		struct ip_rt_acct *st = ip_rt_acct + 256*smp_processor_id();
@@ -354,10 +356,29 @@ drop:
         return NET_RX_DROP;
 }
 
+static inline int ip_rcv_finish(struct sk_buff *skb)
+{
+	struct iphdr *iph = skb->nh.iph;
+
+	/*
+	 *	Initialise the virtual path cache for the packet. It describes
+	 *	how the packet travels inside Linux networking.
+	 */ 
+	if (skb->dst == NULL) {
+		if (ip_route_input(skb, iph->daddr, iph->saddr, iph->tos, skb->dev)) {
+			kfree_skb(skb);
+			return NET_RX_DROP;
+		}
+	}
+
+	return ip_rcv_routed(skb);
+}
+
 /*
- * 	Main IP Receive routine.
- */ 
-int ip_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt)
+ *	Header checks of ip_rcv().  Returns the skb to go on with, or NULL
+ *	if it was dropped.
+ */
+static inline struct sk_buff *ip_rcv_check(struct sk_buff *skb)
 {
 	struct iphdr *iph;
 
@@ -416,15 +437,113 @@ int ip_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt)
 		}
 	}
 
-	return NF_HOOK(PF_INET, NF_IP_PRE_ROUTING, skb, dev, NULL,
-		       ip_rcv_finish);
+	return skb;
 
 inhdr_error:
 	IP_INC_STATS_BH(IPSTATS_MIB_INHDRERRORS);
 drop:
         kfree_skb(skb);
 out:
-        return NET_RX_DROP;
+        return NULL;
+}
+
+/*
+ * 	Main IP Receive routine.
+ */ 
+int ip_rcv(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt)
+{
+	if ((skb = ip_rcv_check(skb)) == NULL)
+		return NET_RX_DROP;
+
+	return NF_HOOK(PF_INET, NF_IP_PRE_ROUTING, skb, dev, NULL,
+		       ip_rcv_finish);
+}
+
+/*
+ *	Route a list of packets that passed PRE_ROUTING.  Packets with the
+ *	same addresses, TOS and device as the one before them (a burst of
+ *	one flow) share its route without another lookup.
+ */
+static void ip_list_rcv_finish(struct sk_buff_head *list)
+{
+	struct dst_entry *dst = NULL;
+	struct sk_buff *skb;
+	struct iphdr *iph;
+	u32 daddr = 0, saddr = 0;
+	u8 tos = 0;
+	struct net_device *dev = NULL;
+#ifdef CONFIG_IP_ROUTE_FWMARK
+	u32 mark = 0;
+#endif
+
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		iph = skb->nh.iph;
+
+		if (skb->dst) {
+			/* Looped back, or routed by a PRE_ROUTING hook. */
+		} else if (dst && iph->daddr == daddr && iph->saddr == saddr &&
+			   iph->tos == tos && skb->dev == dev
+#ifdef CONFIG_IP_ROUTE_FWMARK
+			   && skb->nfmark == mark
+#endif
+			   ) {
+			skb->dst = dst_clone(dst);
+		} else {
+			if (ip_route_input(skb, iph->daddr, iph->saddr,
+					   iph->tos, skb->dev)) {
+				kfree_skb(skb);
+				continue;
+			}
+			dst_release(dst);
+			dst = dst_clone(skb->dst);
+			daddr = iph->daddr;
+			saddr = iph->saddr;
+			tos = iph->tos;
+			dev = skb->dev;
+#ifdef CONFIG_IP_ROUTE_FWMARK
+			mark = skb->nfmark;
+#endif
+		}
+
+		ip_rcv_routed(skb);
+	}
+
+	dst_release(dst);
+}
+
+/*
+ *	ip_rcv() for a list of packets: all packets are checked, then all
+ *	are routed and passed on.  The order of the packets is kept.
+ */
+void ip_list_rcv(struct sk_buff_head *list, struct net_device *dev,
+		 struct packet_type *pt)
+{
+	struct sk_buff_head accepted;
+	struct sk_buff *skb;
+
+	skb_queue_head_init(&accepted);
+
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		if ((skb = ip_rcv_check(skb)) == NULL)
+			continue;
+		__skb_queue_tail(&accepted, skb);
+	}
+
+#ifdef CONFIG_NETFILTER
+	if (!list_empty(&nf_hooks[PF_INET][NF_IP_PRE_ROUTING])) {
+		/* Conntrack confirms a new connection when its first packet
+		 * leaves LOCAL_IN or POST_ROUTING.  A packet must get there
+		 * before the next one of the flow enters PRE_ROUTING, or
+		 * both get a conntrack and the second is dropped.
+		 */
+		while ((skb = __skb_dequeue(&accepted)) != NULL)
+			NF_HOOK(PF_INET, NF_IP_PRE_ROUTING, skb, dev, NULL,
+				ip_rcv_finish);
+		return;
+	}
+#endif
+
+	ip_list_rcv_finish(&accepted);
 }
 
 EXPORT_SYMBOL(ip_rcv);
@@ -52,7 +52,9 @@ static atomic_t ip_vs_conn_no_cport_cnt = ATOMIC_INIT(0);
 static unsigned int ip_vs_conn_rnd;
 
 /*
- *  Fine locking granularity for big connection hash table
+ *  Fine locking granularity for big connection hash table.
+ *  The locks serialize writers only; packet path lookups walk
+ *  the chains under rcu_read_lock().
  */
 #define CT_LOCKARRAY_BITS  4
 #define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
@@ -133,9 +135,9 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 	ct_write_lock(hash);
 
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
-		list_add(&cp->c_list, &ip_vs_conn_tab[hash]);
 		cp->flags |= IP_VS_CONN_F_HASHED;
 		atomic_inc(&cp->refcnt);
+		list_add_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
 		ret = 1;
 	} else {
 		IP_VS_ERR("ip_vs_conn_hash(): request for already hashed, "
@@ -164,7 +166,7 @@ static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 	ct_write_lock(hash);
 
 	if (cp->flags & IP_VS_CONN_F_HASHED) {
-		list_del(&cp->c_list);
+		list_del_rcu(&cp->c_list);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		atomic_dec(&cp->refcnt);
 		ret = 1;
@@ -173,10 +175,43 @@ static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 
 	ct_write_unlock(hash);
 
+	/* pairs with the barrier in ip_vs_conn_get_rcu(): either the
+	   lockless reader sees the entry unhashed, or we see its ref */
+	smp_mb();
+
 	return ret;
 }
 
 
+/*
+ *	Take a reference on an entry found by a lockless lookup.
+ *	The entry may be concurrently unhashed by ip_vs_conn_expire,
+ *	so back off if it is no longer in the table; its memory stays
+ *	valid until the RCU grace period ends.
+ */
+static inline int ip_vs_conn_get_rcu(struct ip_vs_conn *cp)
+{
+	atomic_inc(&cp->refcnt);
+	smp_mb__after_atomic_inc();
+	if (likely(cp->flags & IP_VS_CONN_F_HASHED))
+		return 1;
+	atomic_dec(&cp->refcnt);
+	return 0;
+}
+
+
+/*
+ *	ip_vs_conn_fill_cport moves an entry to another chain without
+ *	waiting for lockless readers, so a walk standing on it may go on
+ *	in the new chain. Every chain ends at its head in ip_vs_conn_tab:
+ *	a walk that ends at another head than its own has to restart.
+ */
+static inline int ip_vs_conn_tab_head(struct list_head *e)
+{
+	return e >= ip_vs_conn_tab && e < ip_vs_conn_tab + IP_VS_CONN_TAB_SIZE;
+}
+
+
 /*
  *  Gets ip_vs_conn associated with supplied parameters in the ip_vs_conn_tab.
  *  Called for pkts coming from OUTside-to-INside.
@@ -188,23 +223,29 @@ static inline struct ip_vs_conn *__ip_vs_conn_in_get
 {
 	unsigned hash;
 	struct ip_vs_conn *cp;
+	struct list_head *e;
 
 	hash = ip_vs_conn_hashkey(protocol, s_addr, s_port);
 
-	ct_read_lock(hash);
+  restart:
+	rcu_read_lock();
 
-	list_for_each_entry(cp, &ip_vs_conn_tab[hash], c_list) {
+	for (e = rcu_dereference(ip_vs_conn_tab[hash].next);
+	     !ip_vs_conn_tab_head(e); e = rcu_dereference(e->next)) {
+		cp = list_entry(e, struct ip_vs_conn, c_list);
 		if (s_addr==cp->caddr && s_port==cp->cport &&
 		    d_port==cp->vport && d_addr==cp->vaddr &&
-		    protocol==cp->protocol) {
+		    protocol==cp->protocol && ip_vs_conn_get_rcu(cp)) {
 			/* HIT */
-			atomic_inc(&cp->refcnt);
-			ct_read_unlock(hash);
+			rcu_read_unlock();
 			return cp;
 		}
 	}
 
-	ct_read_unlock(hash);
+	rcu_read_unlock();
+
+	if (e != &ip_vs_conn_tab[hash])
+		goto restart;
 
 	return NULL;
 }
@@ -239,26 +280,32 @@ struct ip_vs_conn *ip_vs_conn_out_get
 {
 	unsigned hash;
 	struct ip_vs_conn *cp, *ret=NULL;
+	struct list_head *e;
 
 	/*
 	 *	Check for "full" addressed entries
 	 */
 	hash = ip_vs_conn_hashkey(protocol, d_addr, d_port);
 
-	ct_read_lock(hash);
+  restart:
+	rcu_read_lock();
 
-	list_for_each_entry(cp, &ip_vs_conn_tab[hash], c_list) {
+	for (e = rcu_dereference(ip_vs_conn_tab[hash].next);
+	     !ip_vs_conn_tab_head(e); e = rcu_dereference(e->next)) {
+		cp = list_entry(e, struct ip_vs_conn, c_list);
 		if (d_addr == cp->caddr && d_port == cp->cport &&
 		    s_port == cp->dport && s_addr == cp->daddr &&
-		    protocol == cp->protocol) {
+		    protocol == cp->protocol && ip_vs_conn_get_rcu(cp)) {
 			/* HIT */
-			atomic_inc(&cp->refcnt);
 			ret = cp;
 			break;
 		}
 	}
 
-	ct_read_unlock(hash);
+	rcu_read_unlock();
+
+	if (!ret && e != &ip_vs_conn_tab[hash])
+		goto restart;
 
 	IP_VS_DBG(7, "lookup/out %s %u.%u.%u.%u:%d->%u.%u.%u.%u:%d %s\n",
 		  ip_vs_proto_name(protocol),
@@ -296,7 +343,8 @@ void ip_vs_conn_fill_cport(struct ip_vs_conn *cp, __u16 cport)
 		}
 		spin_unlock(&cp->lock);
 
-		/* hash on new dport */
+		/* hash on new dport; the entry goes in at the head of
+		   its new chain, see ip_vs_conn_tab_head() */
 		ip_vs_conn_hash(cp);
 	}
 }
@@ -486,6 +534,20 @@ int ip_vs_check_template(struct ip_vs_conn *ct)
 	return 1;
 }
 
+/*
+ *	Free an expired entry once lockless readers are done with it.
+ *	The connection counter drops here, so that ip_vs_conn_flush
+ *	also waits for the pending frees.
+ */
+static void ip_vs_conn_rcu_free(struct rcu_head *head)
+{
+	struct ip_vs_conn *cp = container_of(head, struct ip_vs_conn,
+					     rcu_head);
+
+	kmem_cache_free(ip_vs_conn_cachep, cp);
+	atomic_dec(&ip_vs_conn_count);
+}
+
 static void ip_vs_conn_expire(unsigned long data)
 {
 	struct ip_vs_conn *cp = (struct ip_vs_conn *)data;
@@ -526,9 +588,7 @@ static void ip_vs_conn_expire(unsigned long data)
 		ip_vs_unbind_dest(cp);
 		if (cp->flags & IP_VS_CONN_F_NO_CPORT)
 			atomic_dec(&ip_vs_conn_no_cport_cnt);
-		atomic_dec(&ip_vs_conn_count);
-
-		kmem_cache_free(ip_vs_conn_cachep, cp);
+		call_rcu(&cp->rcu_head, ip_vs_conn_rcu_free);
 		return;
 	}
 
@@ -856,7 +916,8 @@ static void ip_vs_conn_flush(void)
 	}
 
 	/* the counter may be not NULL, because maybe some conn entries
-	   are run by slow timer handler or unhashed but still referred */
+	   are run by slow timer handler, unhashed but still referred,
+	   or waiting for their RCU grace period */
 	if (atomic_read(&ip_vs_conn_count) != 0) {
 		schedule();
 		goto flush_again;
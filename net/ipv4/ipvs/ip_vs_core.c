@@ -30,6 +30,7 @@
 #include <linux/ip.h>
 #include <linux/tcp.h>
 #include <linux/icmp.h>
+#include <linux/percpu.h>
 
 #include <net/ip.h>
 #include <net/tcp.h>
@@ -88,25 +89,32 @@ void ip_vs_init_hash_table(struct list_head *table, int rows)
 		INIT_LIST_HEAD(&table[rows]);
 }
 
+/*
+ *	The packet counters are kept per CPU, so that the hot path does
+ *	not bounce the stats locks between CPUs. We run in softirq context
+ *	here, the counters are folded by ip_vs_read_cpu_stats().
+ */
 static inline void
 ip_vs_in_stats(struct ip_vs_conn *cp, struct sk_buff *skb)
 {
 	struct ip_vs_dest *dest = cp->dest;
+	struct ip_vs_cpu_stats *s;
+	int cpu;
+
 	if (dest && (dest->flags & IP_VS_DEST_F_AVAILABLE)) {
-		spin_lock(&dest->stats.lock);
-		dest->stats.inpkts++;
-		dest->stats.inbytes += skb->len;
-		spin_unlock(&dest->stats.lock);
-
-		spin_lock(&dest->svc->stats.lock);
-		dest->svc->stats.inpkts++;
-		dest->svc->stats.inbytes += skb->len;
-		spin_unlock(&dest->svc->stats.lock);
-
-		spin_lock(&ip_vs_stats.lock);
-		ip_vs_stats.inpkts++;
-		ip_vs_stats.inbytes += skb->len;
-		spin_unlock(&ip_vs_stats.lock);
+		cpu = smp_processor_id();
+
+		s = per_cpu_ptr(dest->stats.cpustats, cpu);
+		s->inpkts++;
+		s->inbytes += skb->len;
+
+		s = per_cpu_ptr(dest->svc->stats.cpustats, cpu);
+		s->inpkts++;
+		s->inbytes += skb->len;
+
+		s = per_cpu_ptr(ip_vs_stats.cpustats, cpu);
+		s->inpkts++;
+		s->inbytes += skb->len;
 	}
 }
 
@@ -115,21 +123,23 @@ static inline void
 ip_vs_out_stats(struct ip_vs_conn *cp, struct sk_buff *skb)
 {
 	struct ip_vs_dest *dest = cp->dest;
+	struct ip_vs_cpu_stats *s;
+	int cpu;
+
 	if (dest && (dest->flags & IP_VS_DEST_F_AVAILABLE)) {
-		spin_lock(&dest->stats.lock);
-		dest->stats.outpkts++;
-		dest->stats.outbytes += skb->len;
-		spin_unlock(&dest->stats.lock);
-
-		spin_lock(&dest->svc->stats.lock);
-		dest->svc->stats.outpkts++;
-		dest->svc->stats.outbytes += skb->len;
-		spin_unlock(&dest->svc->stats.lock);
-
-		spin_lock(&ip_vs_stats.lock);
-		ip_vs_stats.outpkts++;
-		ip_vs_stats.outbytes += skb->len;
-		spin_unlock(&ip_vs_stats.lock);
+		cpu = smp_processor_id();
+
+		s = per_cpu_ptr(dest->stats.cpustats, cpu);
+		s->outpkts++;
+		s->outbytes += skb->len;
+
+		s = per_cpu_ptr(dest->svc->stats.cpustats, cpu);
+		s->outpkts++;
+		s->outbytes += skb->len;
+
+		s = per_cpu_ptr(ip_vs_stats.cpustats, cpu);
+		s->outpkts++;
+		s->outbytes += skb->len;
 	}
 }
 
@@ -137,17 +147,11 @@ ip_vs_out_stats(struct ip_vs_conn *cp, struct sk_buff *skb)
 static inline void
 ip_vs_conn_stats(struct ip_vs_conn *cp, struct ip_vs_service *svc)
 {
-	spin_lock(&cp->dest->stats.lock);
-	cp->dest->stats.conns++;
-	spin_unlock(&cp->dest->stats.lock);
-
-	spin_lock(&svc->stats.lock);
-	svc->stats.conns++;
-	spin_unlock(&svc->stats.lock);
+	int cpu = smp_processor_id();
 
-	spin_lock(&ip_vs_stats.lock);
-	ip_vs_stats.conns++;
-	spin_unlock(&ip_vs_stats.lock);
+	per_cpu_ptr(cp->dest->stats.cpustats, cpu)->conns++;
+	per_cpu_ptr(svc->stats.cpustats, cpu)->conns++;
+	per_cpu_ptr(ip_vs_stats.cpustats, cpu)->conns++;
 }
 
 
@@ -30,6 +30,7 @@
 #include <linux/swap.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/percpu.h>
 
 #include <linux/netfilter.h>
 #include <linux/netfilter_ipv4.h>
@@ -78,6 +79,9 @@ int sysctl_ip_vs_expire_nodest_conn = 0;
 int sysctl_ip_vs_expire_quiescent_template = 0;
 int sysctl_ip_vs_sync_threshold[2] = { 3, 50 };
 int sysctl_ip_vs_nat_icmp_send = 0;
+int sysctl_ip_vs_sync_flush_interval = 2*HZ;
+static int ip_vs_sync_flush_interval_min = HZ;
+static int ip_vs_sync_flush_interval_max = 60*HZ;
 
 
 #ifdef CONFIG_IP_VS_DEBUG
@@ -464,8 +468,10 @@ __ip_vs_unbind_svc(struct ip_vs_dest *dest)
 	struct ip_vs_service *svc = dest->svc;
 
 	dest->svc = NULL;
-	if (atomic_dec_and_test(&svc->refcnt))
+	if (atomic_dec_and_test(&svc->refcnt)) {
+		ip_vs_free_stats(&svc->stats);
 		kfree(svc);
+	}
 }
 
 
@@ -618,6 +624,7 @@ ip_vs_trash_get_dest(struct ip_vs_service *svc, __u32 daddr, __u16 dport)
 			list_del(&dest->n_list);
 			ip_vs_dst_reset(dest);
 			__ip_vs_unbind_svc(dest);
+			ip_vs_free_stats(&dest->stats);
 			kfree(dest);
 		}
 	}
@@ -643,6 +650,7 @@ static void ip_vs_trash_cleanup(void)
 		list_del(&dest->n_list);
 		ip_vs_dst_reset(dest);
 		__ip_vs_unbind_svc(dest);
+		ip_vs_free_stats(&dest->stats);
 		kfree(dest);
 	}
 }
@@ -653,6 +661,7 @@ ip_vs_zero_stats(struct ip_vs_stats *stats)
 {
 	spin_lock_bh(&stats->lock);
 	memset(stats, 0, (char *)&stats->lock - (char *)stats);
+	ip_vs_zero_cpu_stats(stats);
 	spin_unlock_bh(&stats->lock);
 	ip_vs_zero_estimator(stats);
 }
@@ -734,6 +743,12 @@ ip_vs_new_dest(struct ip_vs_service *svc, struct ip_vs_dest_user *udest,
 	}
 	memset(dest, 0, sizeof(struct ip_vs_dest));
 
+	if (ip_vs_new_stats(&dest->stats)) {
+		IP_VS_ERR("ip_vs_new_dest: alloc_percpu failed.\n");
+		kfree(dest);
+		return -ENOMEM;
+	}
+
 	dest->protocol = svc->protocol;
 	dest->vaddr = svc->addr;
 	dest->vport = svc->port;
@@ -748,7 +763,6 @@ ip_vs_new_dest(struct ip_vs_service *svc, struct ip_vs_dest_user *udest,
 
 	INIT_LIST_HEAD(&dest->d_list);
 	spin_lock_init(&dest->dst_lock);
-	spin_lock_init(&dest->stats.lock);
 	__ip_vs_update_dest(svc, dest, udest);
 	ip_vs_new_estimator(&dest->stats);
 
@@ -942,6 +956,7 @@ static void __ip_vs_del_dest(struct ip_vs_dest *dest)
 		   and only one user context can update virtual service at a
 		   time, so the operation here is OK */
 		atomic_dec(&dest->svc->refcnt);
+		ip_vs_free_stats(&dest->stats);
 		kfree(dest);
 	} else {
 		IP_VS_DBG(3, "Moving dest %u.%u.%u.%u:%u into trash, refcnt=%d\n",
@@ -1064,7 +1079,10 @@ ip_vs_add_service(struct ip_vs_service_user *u, struct ip_vs_service **svc_p)
 
 	INIT_LIST_HEAD(&svc->destinations);
 	rwlock_init(&svc->sched_lock);
-	spin_lock_init(&svc->stats.lock);
+
+	ret = ip_vs_new_stats(&svc->stats);
+	if (ret)
+		goto out_err;
 
 	/* Bind the scheduler */
 	ret = ip_vs_bind_scheduler(svc, sched);
@@ -1098,6 +1116,7 @@ ip_vs_add_service(struct ip_vs_service_user *u, struct ip_vs_service **svc_p)
 			ip_vs_app_inc_put(svc->inc);
 			local_bh_enable();
 		}
+		ip_vs_free_stats(&svc->stats);
 		kfree(svc);
 	}
 	ip_vs_scheduler_put(sched);
@@ -1228,8 +1247,10 @@ static void __ip_vs_del_service(struct ip_vs_service *svc)
 	/*
 	 *    Free the service if nobody refers to it
 	 */
-	if (atomic_read(&svc->refcnt) == 0)
+	if (atomic_read(&svc->refcnt) == 0) {
+		ip_vs_free_stats(&svc->stats);
 		kfree(svc);
+	}
 
 	/* decrease the module use count */
 	ip_vs_use_count_dec();
@@ -1388,6 +1409,24 @@ proc_do_sync_threshold(ctl_table *table, int write, struct file *filp,
 	return rc;
 }
 
+static int
+proc_do_sync_flush_interval(ctl_table *table, int write, struct file *filp,
+			    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int *valp = table->data;
+	int val = *valp;
+	int rc;
+
+	rc = proc_dointvec_jiffies(table, write, filp, buffer, lenp, ppos);
+	if (write && (*valp < *(int *)table->extra1 ||
+		      *valp > *(int *)table->extra2)) {
+		/* Restore the correct value */
+		*valp = val;
+		rc = -EINVAL;
+	}
+	return rc;
+}
+
 
 /*
  *	IPVS sysctl table (under the /proc/sys/net/ipv4/vs/)
@@ -1582,6 +1621,16 @@ static struct ctl_table vs_vars[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec,
 	},
+	{
+		.ctl_name	= NET_IPV4_VS_SYNC_FLUSH_INTERVAL,
+		.procname	= "sync_flush_interval",
+		.data		= &sysctl_ip_vs_sync_flush_interval,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_do_sync_flush_interval,
+		.extra1		= &ip_vs_sync_flush_interval_min,
+		.extra2		= &ip_vs_sync_flush_interval_max,
+	},
 	{ .ctl_name = 0 }
 };
 
@@ -1832,6 +1881,7 @@ static int ip_vs_stats_show(struct seq_file *seq, void *v)
 		   "   Conns  Packets  Packets            Bytes            Bytes\n");
 
 	spin_lock_bh(&ip_vs_stats.lock);
+	ip_vs_read_cpu_stats(&ip_vs_stats);
 	seq_printf(seq, "%8X %8X %8X %16LX %16LX\n\n", ip_vs_stats.conns,
 		   ip_vs_stats.inpkts, ip_vs_stats.outpkts,
 		   (unsigned long long) ip_vs_stats.inbytes,
@@ -2048,6 +2098,7 @@ static void
 ip_vs_copy_stats(struct ip_vs_stats_user *dst, struct ip_vs_stats *src)
 {
 	spin_lock_bh(&src->lock);
+	ip_vs_read_cpu_stats(src);
 	memcpy(dst, src, (char*)&src->lock - (char*)src);
 	spin_unlock_bh(&src->lock);
 }
@@ -2345,9 +2396,16 @@ int ip_vs_control_init(void)
 
 	EnterFunction(2);
 
+	ret = ip_vs_new_stats(&ip_vs_stats);
+	if (ret) {
+		IP_VS_ERR("cannot allocate statistics.\n");
+		return ret;
+	}
+
 	ret = nf_register_sockopt(&ip_vs_sockopts);
 	if (ret) {
 		IP_VS_ERR("cannot register sockopt.\n");
+		ip_vs_free_stats(&ip_vs_stats);
 		return ret;
 	}
 
@@ -2365,8 +2423,6 @@ int ip_vs_control_init(void)
 		INIT_LIST_HEAD(&ip_vs_rtable[idx]);
 	}
 
-	memset(&ip_vs_stats, 0, sizeof(ip_vs_stats));
-	spin_lock_init(&ip_vs_stats.lock);
 	ip_vs_new_estimator(&ip_vs_stats);
 
 	/* Hook the defense timer */
@@ -2383,6 +2439,7 @@ void ip_vs_control_cleanup(void)
 	ip_vs_trash_cleanup();
 	cancel_rearming_delayed_work(&defense_work);
 	ip_vs_kill_estimator(&ip_vs_stats);
+	ip_vs_free_stats(&ip_vs_stats);
 	unregister_sysctl_table(sysctl_header);
 	proc_net_remove("ip_vs_stats");
 	proc_net_remove("ip_vs");
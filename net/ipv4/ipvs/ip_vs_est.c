@@ -15,6 +15,7 @@
  */
 #include <linux/kernel.h>
 #include <linux/types.h>
+#include <linux/percpu.h>
 
 #include <net/ip_vs.h>
 
@@ -39,6 +40,9 @@
     rate is ~2.15Gbits/s, average pps and cps are scaled by 2^10.
 
   * A lot code is taken from net/sched/estimator.c
+
+  * The packet path only bumps per-CPU counters; they are folded
+    into the totals here, before the rates are computed.
  */
 
 
@@ -79,6 +83,7 @@ static void estimation_timer(unsigned long arg)
 		s = e->stats;
 
 		spin_lock(&s->lock);
+		ip_vs_read_cpu_stats(s);
 		n_conns = s->conns;
 		n_inpkts = s->inpkts;
 		n_outpkts = s->outpkts;
@@ -116,6 +121,76 @@ static void estimation_timer(unsigned long arg)
 	mod_timer(&est_timer, jiffies + 2*HZ);
 }
 
+static void ip_vs_sum_cpu_stats(struct ip_vs_stats *stats,
+				struct ip_vs_cpu_stats *sum)
+{
+	struct ip_vs_cpu_stats *c;
+	int i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_cpu(i) {
+		c = per_cpu_ptr(stats->cpustats, i);
+		sum->conns += c->conns;
+		sum->inpkts += c->inpkts;
+		sum->outpkts += c->outpkts;
+		sum->inbytes += c->inbytes;
+		sum->outbytes += c->outbytes;
+	}
+}
+
+/*
+ *	Fold the per-CPU counters into the totals of a stats object.
+ *	Called with stats->lock held.
+ */
+void ip_vs_read_cpu_stats(struct ip_vs_stats *stats)
+{
+	struct ip_vs_cpu_stats sum;
+
+	ip_vs_sum_cpu_stats(stats, &sum);
+	stats->conns = sum.conns - stats->zero.conns;
+	stats->inpkts = sum.inpkts - stats->zero.inpkts;
+	stats->outpkts = sum.outpkts - stats->zero.outpkts;
+	stats->inbytes = sum.inbytes - stats->zero.inbytes;
+	stats->outbytes = sum.outbytes - stats->zero.outbytes;
+}
+
+/*
+ *	Zero the totals of a stats object. The per-CPU counters are not
+ *	ours to clear while other CPUs may be adding to them, so their
+ *	current sums are remembered and taken off on every read instead.
+ *	Called with stats->lock held.
+ */
+void ip_vs_zero_cpu_stats(struct ip_vs_stats *stats)
+{
+	ip_vs_sum_cpu_stats(stats, &stats->zero);
+}
+
+/*
+ *	Set up a stats object and its per-CPU counters
+ */
+int ip_vs_new_stats(struct ip_vs_stats *stats)
+{
+	struct ip_vs_cpu_stats *cpustats;
+
+	/* alloc_percpu hands back zeroed counters */
+	cpustats = alloc_percpu(struct ip_vs_cpu_stats);
+	if (cpustats == NULL)
+		return -ENOMEM;
+
+	memset(stats, 0, sizeof(*stats));
+	spin_lock_init(&stats->lock);
+	stats->cpustats = cpustats;
+	return 0;
+}
+
+void ip_vs_free_stats(struct ip_vs_stats *stats)
+{
+	if (stats->cpustats) {
+		free_percpu(stats->cpustats);
+		stats->cpustats = NULL;
+	}
+}
+
 int ip_vs_new_estimator(struct ip_vs_stats *stats)
 {
 	struct ip_vs_estimator *est;
@@ -17,6 +17,8 @@
  *	Alexandre Cassen	:	Added SyncID support for incoming sync
  *					messages filtering.
  *	Justin Ossevoort	:	Fix endian problem on sync message size.
+ *					Per-CPU current sync buffers, flush
+ *					interval configurable via sysctl.
  */
 
 #include <linux/module.h>
@@ -27,6 +29,7 @@
 #include <linux/skbuff.h>
 #include <linux/in.h>
 #include <linux/igmp.h>                 /* for ip_mc_join_group */
+#include <linux/percpu.h>
 
 #include <net/ip.h>
 #include <net/sock.h>
@@ -121,9 +124,18 @@ struct ip_vs_sync_buff {
 static LIST_HEAD(ip_vs_sync_queue);
 static DEFINE_SPINLOCK(ip_vs_sync_lock);
 
-/* current sync_buff for accepting new conn entries */
-static struct ip_vs_sync_buff   *curr_sb = NULL;
-static DEFINE_SPINLOCK(curr_sb_lock);
+/*
+ * current sync_buff for accepting new conn entries, one per CPU so
+ * that the packet path does not serialize on a single buffer
+ */
+struct ip_vs_sync_cpu {
+	spinlock_t		lock;
+	struct ip_vs_sync_buff	*sb;
+};
+
+static DEFINE_PER_CPU(struct ip_vs_sync_cpu, ip_vs_sync_cpu) = {
+	.lock = SPIN_LOCK_UNLOCKED,
+};
 
 /* ipvs sync daemon state */
 volatile int ip_vs_sync_state = IP_VS_STATE_NONE;
@@ -138,11 +150,16 @@ char ip_vs_backup_mcast_ifn[IP_VS_IFNAME_MAXLEN];
 static struct sockaddr_in mcast_addr;
 
 
+static DECLARE_WAIT_QUEUE_HEAD(sync_wait);
+
 static inline void sb_queue_tail(struct ip_vs_sync_buff *sb)
 {
 	spin_lock(&ip_vs_sync_lock);
 	list_add_tail(&sb->list, &ip_vs_sync_queue);
 	spin_unlock(&ip_vs_sync_lock);
+
+	/* a full buffer is ready, kick the master thread */
+	wake_up(&sync_wait);
 }
 
 static inline struct ip_vs_sync_buff * sb_dequeue(void)
@@ -190,22 +207,24 @@ static inline void ip_vs_sync_buff_release(struct ip_vs_sync_buff *sb)
 }
 
 /*
- *	Get the current sync buffer if it has been created for more
- *	than the specified time or the specified time is zero.
+ *	Get the current sync buffer of the given CPU if it has been
+ *	created for more than the specified time or the specified time
+ *	is zero.
  */
 static inline struct ip_vs_sync_buff *
-get_curr_sync_buff(unsigned long time)
+get_curr_sync_buff(int cpu, unsigned long time)
 {
+	struct ip_vs_sync_cpu *sc = &per_cpu(ip_vs_sync_cpu, cpu);
 	struct ip_vs_sync_buff *sb;
 
-	spin_lock_bh(&curr_sb_lock);
-	if (curr_sb && (time == 0 ||
-			time_before(jiffies - curr_sb->firstuse, time))) {
-		sb = curr_sb;
-		curr_sb = NULL;
-	} else
+	spin_lock_bh(&sc->lock);
+	sb = sc->sb;
+	if (sb && (time == 0 ||
+		   time_after_eq(jiffies - sb->firstuse, time)))
+		sc->sb = NULL;
+	else
 		sb = NULL;
-	spin_unlock_bh(&curr_sb_lock);
+	spin_unlock_bh(&sc->lock);
 	return sb;
 }
 
@@ -216,14 +235,17 @@ get_curr_sync_buff(unsigned long time)
  */
 void ip_vs_sync_conn(struct ip_vs_conn *cp)
 {
+	struct ip_vs_sync_cpu *sc;
+	struct ip_vs_sync_buff *sb;
 	struct ip_vs_sync_mesg *m;
 	struct ip_vs_sync_conn *s;
 	int len;
 
-	spin_lock(&curr_sb_lock);
-	if (!curr_sb) {
-		if (!(curr_sb=ip_vs_sync_buff_create())) {
-			spin_unlock(&curr_sb_lock);
+	sc = &__get_cpu_var(ip_vs_sync_cpu);
+	spin_lock(&sc->lock);
+	if (!(sb = sc->sb)) {
+		if (!(sb = sc->sb = ip_vs_sync_buff_create())) {
+			spin_unlock(&sc->lock);
 			IP_VS_ERR("ip_vs_sync_buff_create failed.\n");
 			return;
 		}
@@ -231,8 +253,8 @@ void ip_vs_sync_conn(struct ip_vs_conn *cp)
 
 	len = (cp->flags & IP_VS_CONN_F_SEQ_MASK) ? FULL_CONN_SIZE :
 		SIMPLE_CONN_SIZE;
-	m = curr_sb->mesg;
-	s = (struct ip_vs_sync_conn *)curr_sb->head;
+	m = sb->mesg;
+	s = (struct ip_vs_sync_conn *)sb->head;
 
 	/* copy members */
 	s->protocol = cp->protocol;
@@ -252,14 +274,15 @@ void ip_vs_sync_conn(struct ip_vs_conn *cp)
 
 	m->nr_conns++;
 	m->size += len;
-	curr_sb->head += len;
+	sb->head += len;
 
 	/* check if there is a space for next one */
-	if (curr_sb->head+FULL_CONN_SIZE > curr_sb->end) {
-		sb_queue_tail(curr_sb);
-		curr_sb = NULL;
-	}
-	spin_unlock(&curr_sb_lock);
+	if (sb->head+FULL_CONN_SIZE > sb->end) {
+		sc->sb = NULL;
+		spin_unlock(&sc->lock);
+		sb_queue_tail(sb);
+	} else
+		spin_unlock(&sc->lock);
 
 	/* synchronize its controller if it has */
 	if (cp->control)
@@ -610,7 +633,6 @@ ip_vs_receive(struct socket *sock, char *buffer, const size_t buflen)
 }
 
 
-static DECLARE_WAIT_QUEUE_HEAD(sync_wait);
 static pid_t sync_master_pid = 0;
 static pid_t sync_backup_pid = 0;
 
@@ -618,10 +640,29 @@ static DECLARE_WAIT_QUEUE_HEAD(stop_sync_wait);
 static int stop_master_sync = 0;
 static int stop_backup_sync = 0;
 
+/*
+ *	Send out the current sync buffers that are older than the
+ *	flush interval, or all of them when time is zero.
+ */
+static void sync_flush_curr_buffs(struct socket *sock, unsigned long time)
+{
+	struct ip_vs_sync_buff *sb;
+	int cpu;
+
+	for_each_cpu(cpu) {
+		if ((sb = get_curr_sync_buff(cpu, time))) {
+			if (sock)
+				ip_vs_send_sync_msg(sock, sb->mesg);
+			ip_vs_sync_buff_release(sb);
+		}
+	}
+}
+
 static void sync_master_loop(void)
 {
 	struct socket *sock;
 	struct ip_vs_sync_buff *sb;
+	unsigned long interval;
 
 	/* create the sending multicast socket */
 	sock = make_send_sock();
@@ -638,16 +679,19 @@ static void sync_master_loop(void)
 			ip_vs_sync_buff_release(sb);
 		}
 
-		/* check if entries stay in curr_sb for 2 seconds */
-		if ((sb = get_curr_sync_buff(2*HZ))) {
-			ip_vs_send_sync_msg(sock, sb->mesg);
-			ip_vs_sync_buff_release(sb);
-		}
+		/* send partially filled buffers after the flush interval */
+		interval = sysctl_ip_vs_sync_flush_interval;
+		sync_flush_curr_buffs(sock, interval);
 
 		if (stop_master_sync)
 			break;
 
-		ssleep(1);
+		/* full buffers wake us up, otherwise poll twice per
+		   interval so that no entry waits much longer */
+		wait_event_interruptible_timeout(sync_wait,
+				!list_empty(&ip_vs_sync_queue) ||
+				stop_master_sync,
+				interval > 1 ? interval / 2 : 1);
 	}
 
 	/* clean up the sync_buff queue */
@@ -655,10 +699,8 @@ static void sync_master_loop(void)
 		ip_vs_sync_buff_release(sb);
 	}
 
-	/* clean up the current sync_buff */
-	if ((sb = get_curr_sync_buff(0))) {
-		ip_vs_sync_buff_release(sb);
-	}
+	/* clean up the current sync_buffs */
+	sync_flush_curr_buffs(NULL, 0);
 
 	/* release the sending multicast socket */
 	sock_release(sock);
@@ -78,6 +78,73 @@ static int ip_conntrack_vmalloc;
 
 DEFINE_PER_CPU(struct ip_conntrack_stat, ip_conntrack_stat);
 
+#ifdef CONFIG_IP_NF_CONNTRACK_EVENTS
+struct notifier_block *ip_conntrack_chain;
+
+DEFINE_PER_CPU(struct ip_conntrack_ecache, ip_conntrack_ecache);
+
+/* Deliver cached events and empty the cache.  Softirqs must be off. */
+void __ip_ct_deliver_cached_events(struct ip_conntrack_ecache *ecache)
+{
+	struct ip_conntrack *ct = ecache->ct;
+
+	if (is_confirmed(ct) && ecache->events)
+		notifier_call_chain(&ip_conntrack_chain, ecache->events, ct);
+	ecache->events = 0;
+	ecache->ct = NULL;
+	ip_conntrack_put(ct);
+}
+
+/* Point the cache at a new conntrack, delivering what the previous one
+   had collected.  Softirqs must be off. */
+void __ip_ct_event_cache_init(struct ip_conntrack *ct)
+{
+	struct ip_conntrack_ecache *ecache = &__get_cpu_var(ip_conntrack_ecache);
+
+	if (ecache->ct)
+		__ip_ct_deliver_cached_events(ecache);
+	ecache->ct = ct;
+	nf_conntrack_get(&ct->ct_general);
+}
+
+/* Drop the references held by the caches of all CPUs.  Only safe once
+   nothing can fill them any more. */
+static void ip_ct_event_cache_flush(void)
+{
+	struct ip_conntrack_ecache *ecache;
+	int cpu;
+
+	for_each_cpu(cpu) {
+		ecache = &per_cpu(ip_conntrack_ecache, cpu);
+		if (ecache->ct) {
+			ip_conntrack_put(ecache->ct);
+			ecache->ct = NULL;
+			ecache->events = 0;
+		}
+	}
+}
+
+int ip_conntrack_register_notifier(struct notifier_block *nb)
+{
+	return notifier_chain_register(&ip_conntrack_chain, nb);
+}
+
+int ip_conntrack_unregister_notifier(struct notifier_block *nb)
+{
+	int ret;
+
+	ret = notifier_chain_unregister(&ip_conntrack_chain, nb);
+	/* With the last listener gone the caches are not touched once the
+	   packets in flight are done with them. */
+	synchronize_net();
+	if (ip_conntrack_chain == NULL)
+		ip_ct_event_cache_flush();
+	return ret;
+}
+#else
+static inline void ip_ct_event_cache_flush(void) {}
+#endif /* CONFIG_IP_NF_CONNTRACK_EVENTS */
+
 void 
 ip_conntrack_put(struct ip_conntrack *ct)
 {
@@ -233,6 +300,9 @@ destroy_conntrack(struct nf_conntrack *nfct)
 	/* To make sure we don't get any weird locking issues here:
 	 * destroy_conntrack() MUST NOT be called with a write lock
 	 * to ip_conntrack_lock!!! -HW */
+	if (is_confirmed(ct))
+		ip_conntrack_event(IPCT_DESTROY, ct);
+
 	proto = ip_ct_find_proto(ct->tuplehash[IP_CT_DIR_REPLY].tuple.dst.protonum);
 	if (proto && proto->destroy)
 		proto->destroy(ct);
@@ -381,6 +451,8 @@ __ip_conntrack_confirm(struct sk_buff **pskb)
 		set_bit(IPS_CONFIRMED_BIT, &ct->status);
 		CONNTRACK_STAT_INC(insert);
 		WRITE_UNLOCK(&ip_conntrack_lock);
+		ip_conntrack_event_cache(ct->master ? IPCT_RELATED : IPCT_NEW,
+					 *pskb);
 		return NF_ACCEPT;
 	}
 
@@ -681,8 +753,8 @@ unsigned int ip_conntrack_in(unsigned int hooknum,
 		return -ret;
 	}
 
-	if (set_reply)
-		set_bit(IPS_SEEN_REPLY_BIT, &ct->status);
+	if (set_reply && !test_and_set_bit(IPS_SEEN_REPLY_BIT, &ct->status))
+		ip_conntrack_event_cache(IPCT_STATUS, *pskb);
 
 	return ret;
 }
@@ -1129,6 +1201,7 @@ void ip_conntrack_cleanup(void)
            netfilter framework.  Roll on, two-stage module
            delete... */
 	synchronize_net();
+	ip_ct_event_cache_flush();
  
  i_see_dead_people:
 	ip_ct_iterate_cleanup(kill_all, NULL);
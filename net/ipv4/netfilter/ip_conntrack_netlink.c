@@ -0,0 +1,404 @@
+/* Connection tracking over netlink: table dump, lookup and delete by
+ * tuple, and a stream of new, update and destroy events.
+ *
+ * Events are batched: each CPU appends them to one pending skb per
+ * multicast group, which is broadcast when it is full or on the next
+ * timer tick, whichever comes first.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/in.h>
+#include <linux/skbuff.h>
+#include <linux/netlink.h>
+#include <linux/notifier.h>
+#include <linux/percpu.h>
+#include <linux/timer.h>
+#include <linux/security.h>
+#include <net/sock.h>
+
+#include <linux/netfilter_ipv4/ip_conntrack.h>
+#include <linux/netfilter_ipv4/ip_conntrack_core.h>
+#include <linux/netfilter_ipv4/ip_conntrack_netlink.h>
+#include <linux/netfilter_ipv4/lockhelp.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Connection tracking netlink interface");
+
+#if 0
+#define DEBUGP printk
+#else
+#define DEBUGP(format, args...)
+#endif
+
+/* One pending skb per multicast group, indexed by the group bit */
+#define CTNL_NGROUPS	3
+
+struct ctnetlink_batch {
+	struct sk_buff *skb[CTNL_NGROUPS];
+	struct timer_list timer;
+};
+
+static DEFINE_PER_CPU(struct ctnetlink_batch, ctnetlink_batch);
+static struct sock *ctnl;
+
+static void
+ctnetlink_fill_tuple(struct ipctnl_tuple *t,
+		     const struct ip_conntrack_tuple *tuple)
+{
+	t->src = tuple->src.ip;
+	t->dst = tuple->dst.ip;
+	t->sport = tuple->src.u.all;
+	t->dport = tuple->dst.u.all;
+	t->protonum = tuple->dst.protonum;
+}
+
+static void
+ctnetlink_fill_info(struct ipctnl_msg *m, struct ip_conntrack *ct, int dead)
+{
+	memset(m, 0, sizeof(*m));
+	ctnetlink_fill_tuple(&m->tuple[IP_CT_DIR_ORIGINAL],
+			     &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+	ctnetlink_fill_tuple(&m->tuple[IP_CT_DIR_REPLY],
+			     &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	m->status = ct->status;
+
+	if (!dead && timer_pending(&ct->timeout)) {
+		long left = (long)(ct->timeout.expires - jiffies);
+
+		m->timeout = left > 0 ? left / HZ : 0;
+	}
+#ifdef CONFIG_IP_NF_CONNTRACK_MARK
+	m->mark = ct->mark;
+#endif
+	switch (ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum) {
+	case IPPROTO_TCP:
+		m->proto_state = ct->proto.tcp.state;
+		break;
+	case IPPROTO_SCTP:
+		m->proto_state = ct->proto.sctp.state;
+		break;
+	}
+#ifdef CONFIG_IP_NF_CT_ACCT
+	m->packets[IP_CT_DIR_ORIGINAL] = ct->counters[IP_CT_DIR_ORIGINAL].packets;
+	m->packets[IP_CT_DIR_REPLY] = ct->counters[IP_CT_DIR_REPLY].packets;
+	m->bytes[IP_CT_DIR_ORIGINAL] = ct->counters[IP_CT_DIR_ORIGINAL].bytes;
+	m->bytes[IP_CT_DIR_REPLY] = ct->counters[IP_CT_DIR_REPLY].bytes;
+#endif
+}
+
+static int
+ctnetlink_fill(struct sk_buff *skb, u32 pid, u32 seq, int type,
+	       unsigned int flags, struct ip_conntrack *ct)
+{
+	unsigned char *b = skb->tail;
+	struct nlmsghdr *nlh;
+
+	nlh = NLMSG_PUT(skb, pid, seq, type, sizeof(struct ipctnl_msg));
+	nlh->nlmsg_flags = flags;
+	ctnetlink_fill_info(NLMSG_DATA(nlh), ct, type == IPCTNL_MSG_CT_DELETE);
+	return skb->len;
+
+nlmsg_failure:
+	skb_trim(skb, b - skb->data);
+	return -1;
+}
+
+/* Batched event delivery.  Softirqs must be off. */
+static void
+ctnetlink_flush_group(struct ctnetlink_batch *batch, int group)
+{
+	struct sk_buff *skb = batch->skb[group];
+
+	batch->skb[group] = NULL;
+	netlink_broadcast(ctnl, skb, 0, 1 << group, GFP_ATOMIC);
+}
+
+static void
+ctnetlink_flush(struct ctnetlink_batch *batch)
+{
+	int i;
+
+	for (i = 0; i < CTNL_NGROUPS; i++)
+		if (batch->skb[i])
+			ctnetlink_flush_group(batch, i);
+}
+
+/* Armed only from the owning CPU, so it runs there too, unless the CPU
+   went away, and then nobody else touches its batch. */
+static void
+ctnetlink_batch_timer(unsigned long cpu)
+{
+	ctnetlink_flush(&per_cpu(ctnetlink_batch, cpu));
+}
+
+static int
+ctnetlink_conntrack_event(struct notifier_block *this,
+			  unsigned long events, void *ptr)
+{
+	struct ip_conntrack *ct = ptr;
+	struct ctnetlink_batch *batch;
+	struct sk_buff *skb;
+	unsigned int flags = 0;
+	int type, group;
+
+	if (events & IPCT_DESTROY) {
+		type = IPCTNL_MSG_CT_DELETE;
+		group = 2;
+	} else if (events & (IPCT_NEW | IPCT_RELATED)) {
+		type = IPCTNL_MSG_CT_NEW;
+		flags = NLM_F_CREATE | NLM_F_EXCL;
+		group = 0;
+	} else if (events & (IPCT_STATUS | IPCT_PROTOINFO | IPCT_MARK)) {
+		type = IPCTNL_MSG_CT_NEW;
+		group = 1;
+	} else
+		return NOTIFY_DONE;
+
+	local_bh_disable();
+	batch = &__get_cpu_var(ctnetlink_batch);
+
+	skb = batch->skb[group];
+	if (skb && skb_tailroom(skb) < NLMSG_SPACE(sizeof(struct ipctnl_msg))) {
+		ctnetlink_flush_group(batch, group);
+		skb = NULL;
+	}
+	if (skb == NULL) {
+		skb = alloc_skb(NLMSG_GOODSIZE, GFP_ATOMIC);
+		if (skb == NULL)
+			goto out;
+		batch->skb[group] = skb;
+		if (!timer_pending(&batch->timer))
+			mod_timer(&batch->timer, jiffies + 1);
+	}
+	ctnetlink_fill(skb, 0, 0, type, flags, ct);
+out:
+	local_bh_enable();
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ctnl_notifier = {
+	.notifier_call	= ctnetlink_conntrack_event,
+};
+
+/* Table dump: cb->args[0] is the bucket, cb->args[1] how many entries of
+   it went out already.  Each conntrack is reported from its original
+   direction hash entry only. */
+static int
+ctnetlink_dump_table(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct ip_conntrack_tuple_hash *h;
+	unsigned int bucket;
+	int idx = 0, s_idx = cb->args[1];
+
+	READ_LOCK(&ip_conntrack_lock);
+	for (bucket = cb->args[0]; bucket < ip_conntrack_htable_size;
+	     bucket++, s_idx = 0) {
+		idx = 0;
+		list_for_each_entry(h, &ip_conntrack_hash[bucket], list) {
+			if (DIRECTION(h) != IP_CT_DIR_ORIGINAL)
+				continue;
+			if (idx++ < s_idx)
+				continue;
+			if (ctnetlink_fill(skb, NETLINK_CB(cb->skb).pid,
+					   cb->nlh->nlmsg_seq,
+					   IPCTNL_MSG_CT_NEW, NLM_F_MULTI,
+					   tuplehash_to_ctrack(h)) < 0) {
+				idx--;
+				goto out;
+			}
+		}
+	}
+out:
+	READ_UNLOCK(&ip_conntrack_lock);
+
+	cb->args[0] = bucket;
+	cb->args[1] = idx;
+	return skb->len;
+}
+
+static int
+ctnetlink_done(struct netlink_callback *cb)
+{
+	return 0;
+}
+
+static int
+ctnetlink_parse_tuple(struct nlmsghdr *nlh, struct ip_conntrack_tuple *tuple)
+{
+	struct ipctnl_tuple *t;
+
+	if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*t)))
+		return -EINVAL;
+	t = NLMSG_DATA(nlh);
+
+	memset(tuple, 0, sizeof(*tuple));
+	tuple->src.ip = t->src;
+	tuple->dst.ip = t->dst;
+	tuple->src.u.all = t->sport;
+	tuple->dst.u.all = t->dport;
+	tuple->dst.protonum = t->protonum;
+	return 0;
+}
+
+static int
+ctnetlink_get_conntrack(struct sk_buff *skb, struct nlmsghdr *nlh)
+{
+	struct ip_conntrack_tuple tuple;
+	struct ip_conntrack_tuple_hash *h;
+	struct ip_conntrack *ct;
+	struct sk_buff *rep;
+	int err;
+
+	err = ctnetlink_parse_tuple(nlh, &tuple);
+	if (err < 0)
+		return err;
+
+	h = ip_conntrack_find_get(&tuple, NULL);
+	if (h == NULL)
+		return -ENOENT;
+	ct = tuplehash_to_ctrack(h);
+
+	err = -ENOMEM;
+	rep = alloc_skb(NLMSG_SPACE(sizeof(struct ipctnl_msg)), GFP_KERNEL);
+	if (rep) {
+		ctnetlink_fill(rep, NETLINK_CB(skb).pid, nlh->nlmsg_seq,
+			       IPCTNL_MSG_CT_NEW, 0, ct);
+		err = netlink_unicast(ctnl, rep, NETLINK_CB(skb).pid,
+				      MSG_DONTWAIT);
+		if (err > 0)
+			err = 0;
+	}
+	nf_conntrack_put(&ct->ct_general);
+	return err;
+}
+
+static int
+ctnetlink_del_conntrack(struct sk_buff *skb, struct nlmsghdr *nlh)
+{
+	struct ip_conntrack_tuple tuple;
+	struct ip_conntrack_tuple_hash *h;
+	struct ip_conntrack *ct;
+	int err;
+
+	err = ctnetlink_parse_tuple(nlh, &tuple);
+	if (err < 0)
+		return err;
+
+	h = ip_conntrack_find_get(&tuple, NULL);
+	if (h == NULL)
+		return -ENOENT;
+	ct = tuplehash_to_ctrack(h);
+
+	/* Same as an early timeout; if it is already dying, let it. */
+	if (del_timer(&ct->timeout))
+		ct->timeout.function((unsigned long)ct);
+	nf_conntrack_put(&ct->ct_general);
+	return 0;
+}
+
+static int
+ctnetlink_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh)
+{
+	if (!(nlh->nlmsg_flags & NLM_F_REQUEST))
+		return 0;
+
+	/* The table is as private as /proc/net/ip_conntrack */
+	if (security_netlink_recv(skb))
+		return -EPERM;
+
+	switch (nlh->nlmsg_type) {
+	case IPCTNL_MSG_CT_GET:
+		if (nlh->nlmsg_flags & NLM_F_DUMP)
+			return netlink_dump_start(ctnl, skb, nlh,
+						  ctnetlink_dump_table,
+						  ctnetlink_done);
+		return ctnetlink_get_conntrack(skb, nlh);
+
+	case IPCTNL_MSG_CT_DELETE:
+		return ctnetlink_del_conntrack(skb, nlh);
+	}
+	return -EINVAL;
+}
+
+static inline void
+ctnetlink_rcv_skb(struct sk_buff *skb)
+{
+	int err;
+	struct nlmsghdr *nlh;
+
+	if (skb->len >= NLMSG_SPACE(0)) {
+		nlh = (struct nlmsghdr *)skb->data;
+		if (nlh->nlmsg_len < sizeof(*nlh) || skb->len < nlh->nlmsg_len)
+			return;
+		err = ctnetlink_rcv_msg(skb, nlh);
+		if (err || nlh->nlmsg_flags & NLM_F_ACK)
+			netlink_ack(skb, nlh, err);
+	}
+}
+
+static void
+ctnetlink_rcv(struct sock *sk, int len)
+{
+	struct sk_buff *skb;
+
+	while ((skb = skb_dequeue(&sk->sk_receive_queue)) != NULL) {
+		ctnetlink_rcv_skb(skb);
+		kfree_skb(skb);
+	}
+}
+
+static int __init init(void)
+{
+	struct ctnetlink_batch *batch;
+	int cpu, ret;
+
+	need_ip_conntrack();
+
+	ctnl = netlink_kernel_create(NETLINK_CONNTRACK, ctnetlink_rcv);
+	if (ctnl == NULL) {
+		printk(KERN_ERR "ip_conntrack_netlink: cannot create socket\n");
+		return -ENOMEM;
+	}
+
+	for_each_cpu(cpu) {
+		batch = &per_cpu(ctnetlink_batch, cpu);
+		init_timer(&batch->timer);
+		batch->timer.function = ctnetlink_batch_timer;
+		batch->timer.data = cpu;
+	}
+
+	ret = ip_conntrack_register_notifier(&ctnl_notifier);
+	if (ret < 0) {
+		printk(KERN_ERR "ip_conntrack_netlink: cannot register "
+		       "notifier\n");
+		sock_release(ctnl->sk_socket);
+	}
+	return ret;
+}
+
+static void __exit fini(void)
+{
+	struct ctnetlink_batch *batch;
+	int cpu, i;
+
+	ip_conntrack_unregister_notifier(&ctnl_notifier);
+
+	for_each_cpu(cpu) {
+		batch = &per_cpu(ctnetlink_batch, cpu);
+		del_timer_sync(&batch->timer);
+		for (i = 0; i < CTNL_NGROUPS; i++)
+			if (batch->skb[i])
+				kfree_skb(batch->skb[i]);
+	}
+
+	sock_release(ctnl->sk_socket);
+}
+
+module_init(init);
+module_exit(fini);
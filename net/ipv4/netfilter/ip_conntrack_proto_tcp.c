@@ -963,6 +963,8 @@ static int tcp_packet(struct ip_conntrack *conntrack,
 		old_state, new_state);
 
 	conntrack->proto.tcp.state = new_state;
+	if (old_state != new_state)
+		ip_conntrack_event_cache(IPCT_PROTOINFO, skb);
 	if (old_state != new_state 
 	    && (new_state == TCP_CONNTRACK_FIN_WAIT
 	    	|| new_state == TCP_CONNTRACK_CLOSE))
@@ -991,6 +993,7 @@ static int tcp_packet(struct ip_conntrack *conntrack,
 		   after SYN_RECV or a valid answer for a picked up 
 		   connection. */
 			set_bit(IPS_ASSURED_BIT, &conntrack->status);
+			ip_conntrack_event_cache(IPCT_STATUS, skb);
 	}
 	ip_ct_refresh_acct(conntrack, ctinfo, skb, timeout);
 
@@ -41,6 +41,9 @@
 #define NET_IPQ_QMAX 2088
 #define NET_IPQ_QMAX_NAME "ip_queue_maxlen"
 
+#define IPQ_INSTANCE_BUCKETS 16
+#define IPQ_ID_BUCKETS 256
+
 struct ipq_rt_info {
 	__u8 tos;
 	__u32 daddr;
@@ -49,23 +52,38 @@ struct ipq_rt_info {
 
 struct ipq_queue_entry {
 	struct list_head list;
+	struct hlist_node id_hnode;
+	unsigned long id;
 	struct nf_info *info;
 	struct sk_buff *skb;
 	struct ipq_rt_info rt_info;
 };
 
+/*
+ * One instance per numbered queue.  Packets are kept in arrival order on
+ * queue_list, which is also id order, and hashed by id for verdicts.
+ */
+struct ipq_instance {
+	struct hlist_node hnode;
+	unsigned short queue_num;
+	int peer_pid;
+	unsigned char copy_mode;
+	unsigned int copy_range;
+	unsigned int queue_total;
+	unsigned int queue_dropped;
+	unsigned int queue_user_dropped;
+	unsigned long id_sequence;
+	spinlock_t lock;
+	struct list_head queue_list;
+	struct hlist_head id_hash[IPQ_ID_BUCKETS];
+};
+
 typedef int (*ipq_cmpfn)(struct ipq_queue_entry *, unsigned long);
 
-static unsigned char copy_mode = IPQ_COPY_NONE;
 static unsigned int queue_maxlen = IPQ_QMAX_DEFAULT;
-static DEFINE_RWLOCK(queue_lock);
-static int peer_pid;
-static unsigned int copy_range;
-static unsigned int queue_total;
-static unsigned int queue_dropped = 0;
-static unsigned int queue_user_dropped = 0;
+static struct hlist_head instance_table[IPQ_INSTANCE_BUCKETS];
+static DEFINE_RWLOCK(instances_lock);
 static struct sock *ipqnl;
-static LIST_HEAD(queue_list);
 static DECLARE_MUTEX(ipqnl_sem);
 
 static void
@@ -75,78 +93,146 @@ ipq_issue_verdict(struct ipq_queue_entry *entry, int verdict)
 	kfree(entry);
 }
 
-static inline void
-__ipq_enqueue_entry(struct ipq_queue_entry *entry)
+static void
+ipq_issue_verdicts(struct list_head *list, int verdict)
 {
-       list_add(&entry->list, &queue_list);
-       queue_total++;
+	struct ipq_queue_entry *entry, *next;
+
+	list_for_each_entry_safe(entry, next, list, list)
+		ipq_issue_verdict(entry, verdict);
 }
 
-/*
- * Find and return a queued entry matched by cmpfn, or return the last
- * entry if cmpfn is NULL.
- */
-static inline struct ipq_queue_entry *
-__ipq_find_entry(ipq_cmpfn cmpfn, unsigned long data)
+static inline struct ipq_instance *
+__instance_lookup(unsigned short queue_num)
 {
-	struct list_head *p;
-
-	list_for_each_prev(p, &queue_list) {
-		struct ipq_queue_entry *entry = (struct ipq_queue_entry *)p;
-		
-		if (!cmpfn || cmpfn(entry, data))
-			return entry;
+	struct ipq_instance *inst;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(inst, pos,
+			     &instance_table[queue_num % IPQ_INSTANCE_BUCKETS],
+			     hnode) {
+		if (inst->queue_num == queue_num)
+			return inst;
 	}
 	return NULL;
 }
 
-static inline void
-__ipq_dequeue_entry(struct ipq_queue_entry *entry)
+/* There are as many instances as reading processes, a walk is cheap. */
+static struct ipq_instance *
+__instance_lookup_pid(int pid)
 {
-	list_del(&entry->list);
-	queue_total--;
+	struct ipq_instance *inst;
+	struct hlist_node *pos;
+	int i;
+
+	for (i = 0; i < IPQ_INSTANCE_BUCKETS; i++) {
+		hlist_for_each_entry(inst, pos, &instance_table[i], hnode) {
+			if (inst->peer_pid == pid)
+				return inst;
+		}
+	}
+	return NULL;
 }
 
-static inline struct ipq_queue_entry *
-__ipq_find_dequeue_entry(ipq_cmpfn cmpfn, unsigned long data)
+static struct ipq_instance *
+__instance_create(unsigned short queue_num, int pid)
 {
-	struct ipq_queue_entry *entry;
+	struct ipq_instance *inst;
+	int i;
 
-	entry = __ipq_find_entry(cmpfn, data);
-	if (entry == NULL)
+	inst = kmalloc(sizeof(*inst), GFP_ATOMIC);
+	if (inst == NULL)
 		return NULL;
 
-	__ipq_dequeue_entry(entry);
-	return entry;
+	memset(inst, 0, sizeof(*inst));
+	inst->queue_num = queue_num;
+	inst->peer_pid = pid;
+	inst->copy_mode = IPQ_COPY_NONE;
+	spin_lock_init(&inst->lock);
+	INIT_LIST_HEAD(&inst->queue_list);
+	for (i = 0; i < IPQ_ID_BUCKETS; i++)
+		INIT_HLIST_HEAD(&inst->id_hash[i]);
+
+	hlist_add_head(&inst->hnode,
+		       &instance_table[queue_num % IPQ_INSTANCE_BUCKETS]);
+	net_enable_timestamp();
+	return inst;
 }
 
+static inline void
+__ipq_enqueue_entry(struct ipq_instance *inst, struct ipq_queue_entry *entry)
+{
+	list_add_tail(&entry->list, &inst->queue_list);
+	hlist_add_head(&entry->id_hnode,
+		       &inst->id_hash[entry->id % IPQ_ID_BUCKETS]);
+	inst->queue_total++;
+}
 
 static inline void
-__ipq_flush(int verdict)
+__ipq_dequeue_entry(struct ipq_instance *inst, struct ipq_queue_entry *entry)
+{
+	list_del(&entry->list);
+	hlist_del(&entry->id_hnode);
+	inst->queue_total--;
+}
+
+static struct ipq_queue_entry *
+ipq_find_dequeue_id(struct ipq_instance *inst, unsigned long id)
 {
 	struct ipq_queue_entry *entry;
-	
-	while ((entry = __ipq_find_dequeue_entry(NULL, 0)))
-		ipq_issue_verdict(entry, verdict);
+	struct hlist_node *pos;
+
+	spin_lock_bh(&inst->lock);
+	hlist_for_each_entry(entry, pos, &inst->id_hash[id % IPQ_ID_BUCKETS],
+			     id_hnode) {
+		if (entry->id == id) {
+			__ipq_dequeue_entry(inst, entry);
+			spin_unlock_bh(&inst->lock);
+			return entry;
+		}
+	}
+	spin_unlock_bh(&inst->lock);
+	return NULL;
+}
+
+/*
+ * Move the entries matched by cmpfn, or all of them if cmpfn is NULL,
+ * to a private list, so that verdicts are issued without the lock.
+ */
+static void
+ipq_dequeue_matching(struct ipq_instance *inst, ipq_cmpfn cmpfn,
+		     unsigned long data, struct list_head *list)
+{
+	struct ipq_queue_entry *entry, *next;
+
+	spin_lock_bh(&inst->lock);
+	list_for_each_entry_safe(entry, next, &inst->queue_list, list) {
+		if (cmpfn && !cmpfn(entry, data))
+			continue;
+		__ipq_dequeue_entry(inst, entry);
+		list_add_tail(&entry->list, list);
+	}
+	spin_unlock_bh(&inst->lock);
 }
 
 static inline int
-__ipq_set_mode(unsigned char mode, unsigned int range)
+__ipq_set_mode(struct ipq_instance *inst, unsigned char mode,
+	       unsigned int range)
 {
 	int status = 0;
 	
 	switch(mode) {
 	case IPQ_COPY_NONE:
 	case IPQ_COPY_META:
-		copy_mode = mode;
-		copy_range = 0;
+		inst->copy_mode = mode;
+		inst->copy_range = 0;
 		break;
 		
 	case IPQ_COPY_PACKET:
-		copy_mode = mode;
-		copy_range = range;
-		if (copy_range > 0xFFFF)
-			copy_range = 0xFFFF;
+		inst->copy_mode = mode;
+		inst->copy_range = range;
+		if (inst->copy_range > 0xFFFF)
+			inst->copy_range = 0xFFFF;
 		break;
 		
 	default:
@@ -156,36 +242,21 @@ __ipq_set_mode(unsigned char mode, unsigned int range)
 	return status;
 }
 
-static inline void
-__ipq_reset(void)
-{
-	peer_pid = 0;
-	net_disable_timestamp();
-	__ipq_set_mode(IPQ_COPY_NONE, 0);
-	__ipq_flush(NF_DROP);
-}
-
-static struct ipq_queue_entry *
-ipq_find_dequeue_entry(ipq_cmpfn cmpfn, unsigned long data)
-{
-	struct ipq_queue_entry *entry;
-	
-	write_lock_bh(&queue_lock);
-	entry = __ipq_find_dequeue_entry(cmpfn, data);
-	write_unlock_bh(&queue_lock);
-	return entry;
-}
-
+/* Unhash with instances_lock held for writing, then destroy. */
 static void
-ipq_flush(int verdict)
+instance_destroy(struct ipq_instance *inst)
 {
-	write_lock_bh(&queue_lock);
-	__ipq_flush(verdict);
-	write_unlock_bh(&queue_lock);
+	LIST_HEAD(list);
+
+	ipq_dequeue_matching(inst, NULL, 0, &list);
+	ipq_issue_verdicts(&list, NF_DROP);
+	net_disable_timestamp();
+	kfree(inst);
 }
 
 static struct sk_buff *
-ipq_build_packet_message(struct ipq_queue_entry *entry, int *errp)
+ipq_build_packet_message(struct ipq_instance *inst,
+			 struct ipq_queue_entry *entry, int *errp)
 {
 	unsigned char *old_tail;
 	size_t size = 0;
@@ -194,9 +265,7 @@ ipq_build_packet_message(struct ipq_queue_entry *entry, int *errp)
 	struct ipq_packet_msg *pmsg;
 	struct nlmsghdr *nlh;
 
-	read_lock_bh(&queue_lock);
-	
-	switch (copy_mode) {
+	switch (inst->copy_mode) {
 	case IPQ_COPY_META:
 	case IPQ_COPY_NONE:
 		size = NLMSG_SPACE(sizeof(*pmsg));
@@ -204,22 +273,20 @@ ipq_build_packet_message(struct ipq_queue_entry *entry, int *errp)
 		break;
 	
 	case IPQ_COPY_PACKET:
-		if (copy_range == 0 || copy_range > entry->skb->len)
+		if (inst->copy_range == 0 ||
+		    inst->copy_range > entry->skb->len)
 			data_len = entry->skb->len;
 		else
-			data_len = copy_range;
+			data_len = inst->copy_range;
 		
 		size = NLMSG_SPACE(sizeof(*pmsg) + data_len);
 		break;
 	
 	default:
 		*errp = -EINVAL;
-		read_unlock_bh(&queue_lock);
 		return NULL;
 	}
 
-	read_unlock_bh(&queue_lock);
-
 	skb = alloc_skb(size, GFP_ATOMIC);
 	if (!skb)
 		goto nlmsg_failure;
@@ -229,7 +296,7 @@ ipq_build_packet_message(struct ipq_queue_entry *entry, int *errp)
 	pmsg = NLMSG_DATA(nlh);
 	memset(pmsg, 0, sizeof(*pmsg));
 
-	pmsg->packet_id       = (unsigned long )entry;
+	/* packet_id is filled in when the entry is queued */
 	pmsg->data_len        = data_len;
 	pmsg->timestamp_sec   = entry->skb->stamp.tv_sec;
 	pmsg->timestamp_usec  = entry->skb->stamp.tv_usec;
@@ -276,9 +343,8 @@ ipq_enqueue_packet(struct sk_buff *skb, struct nf_info *info, void *data)
 	int status = -EINVAL;
 	struct sk_buff *nskb;
 	struct ipq_queue_entry *entry;
-
-	if (copy_mode == IPQ_COPY_NONE)
-		return -EAGAIN;
+	struct ipq_instance *inst;
+	struct ipq_packet_msg *pmsg;
 
 	entry = kmalloc(sizeof(*entry), GFP_ATOMIC);
 	if (entry == NULL) {
@@ -297,44 +363,55 @@ ipq_enqueue_packet(struct sk_buff *skb, struct nf_info *info, void *data)
 		entry->rt_info.saddr = iph->saddr;
 	}
 
-	nskb = ipq_build_packet_message(entry, &status);
+	read_lock_bh(&instances_lock);
+
+	inst = __instance_lookup(info->queuenum);
+	if (inst == NULL || inst->copy_mode == IPQ_COPY_NONE) {
+		status = -EAGAIN;
+		goto err_out_unlock;
+	}
+
+	nskb = ipq_build_packet_message(inst, entry, &status);
 	if (nskb == NULL)
-		goto err_out_free;
+		goto err_out_unlock;
+	pmsg = NLMSG_DATA((struct nlmsghdr *)nskb->data);
 		
-	write_lock_bh(&queue_lock);
+	spin_lock(&inst->lock);
 	
-	if (!peer_pid)
-		goto err_out_free_nskb; 
-
-	if (queue_total >= queue_maxlen) {
-                queue_dropped++;
+	if (inst->queue_total >= queue_maxlen) {
+		inst->queue_dropped++;
 		status = -ENOSPC;
 		if (net_ratelimit())
-		          printk (KERN_WARNING "ip_queue: full at %d entries, "
-				  "dropping packets(s). Dropped: %d\n", queue_total,
-				  queue_dropped);
+		          printk (KERN_WARNING "ip_queue: queue %u full at %d "
+				  "entries, dropping packets(s). Dropped: %d\n",
+				  inst->queue_num, inst->queue_total,
+				  inst->queue_dropped);
 		goto err_out_free_nskb;
 	}
 
+	entry->id = ++inst->id_sequence;
+	pmsg->packet_id = entry->id;
+
  	/* netlink_unicast will either free the nskb or attach it to a socket */ 
-	status = netlink_unicast(ipqnl, nskb, peer_pid, MSG_DONTWAIT);
+	status = netlink_unicast(ipqnl, nskb, inst->peer_pid, MSG_DONTWAIT);
 	if (status < 0) {
-	        queue_user_dropped++;
+	        inst->queue_user_dropped++;
+		spin_unlock(&inst->lock);
 		goto err_out_unlock;
 	}
 
-	__ipq_enqueue_entry(entry);
+	__ipq_enqueue_entry(inst, entry);
 
-	write_unlock_bh(&queue_lock);
+	spin_unlock(&inst->lock);
+	read_unlock_bh(&instances_lock);
 	return status;
 
 err_out_free_nskb:
+	spin_unlock(&inst->lock);
 	kfree_skb(nskb); 
 	
 err_out_unlock:
-	write_unlock_bh(&queue_lock);
-
-err_out_free:
+	read_unlock_bh(&instances_lock);
 	kfree(entry);
 	return status;
 }
@@ -392,21 +469,16 @@ ipq_mangle_ipv4(ipq_verdict_msg_t *v, struct ipq_queue_entry *e)
 	return 0;
 }
 
-static inline int
-id_cmp(struct ipq_queue_entry *e, unsigned long id)
-{
-	return (id == (unsigned long )e);
-}
-
 static int
-ipq_set_verdict(struct ipq_verdict_msg *vmsg, unsigned int len)
+ipq_set_verdict(struct ipq_instance *inst, struct ipq_verdict_msg *vmsg,
+		unsigned int len)
 {
 	struct ipq_queue_entry *entry;
 
 	if (vmsg->value > NF_MAX_VERDICT)
 		return -EINVAL;
 
-	entry = ipq_find_dequeue_entry(id_cmp, vmsg->id);
+	entry = ipq_find_dequeue_id(inst, vmsg->id);
 	if (entry == NULL)
 		return -ENOENT;
 	else {
@@ -422,18 +494,42 @@ ipq_set_verdict(struct ipq_verdict_msg *vmsg, unsigned int len)
 }
 
 static int
-ipq_set_mode(unsigned char mode, unsigned int range)
+older_cmp(struct ipq_queue_entry *entry, unsigned long id)
+{
+	return (long)(entry->id - id) <= 0;
+}
+
+/* One verdict for the packet with this id and every packet queued before it */
+static int
+ipq_set_batch_verdict(struct ipq_instance *inst,
+		      struct ipq_batch_verdict_msg *bmsg)
+{
+	LIST_HEAD(list);
+
+	if (bmsg->value > NF_MAX_VERDICT)
+		return -EINVAL;
+
+	ipq_dequeue_matching(inst, older_cmp, bmsg->id, &list);
+	if (list_empty(&list))
+		return -ENOENT;
+
+	ipq_issue_verdicts(&list, bmsg->value);
+	return 0;
+}
+
+static int
+ipq_set_mode(struct ipq_instance *inst, unsigned char mode, unsigned int range)
 {
 	int status;
 
-	write_lock_bh(&queue_lock);
-	status = __ipq_set_mode(mode, range);
-	write_unlock_bh(&queue_lock);
+	spin_lock_bh(&inst->lock);
+	status = __ipq_set_mode(inst, mode, range);
+	spin_unlock_bh(&inst->lock);
 	return status;
 }
 
 static int
-ipq_receive_peer(struct ipq_peer_msg *pmsg,
+ipq_receive_peer(struct ipq_instance *inst, struct ipq_peer_msg *pmsg,
                  unsigned char type, unsigned int len)
 {
 	int status = 0;
@@ -443,7 +539,7 @@ ipq_receive_peer(struct ipq_peer_msg *pmsg,
 
 	switch (type) {
 	case IPQM_MODE:
-		status = ipq_set_mode(pmsg->msg.mode.value,
+		status = ipq_set_mode(inst, pmsg->msg.mode.value,
 		                      pmsg->msg.mode.range);
 		break;
 		
@@ -451,9 +547,18 @@ ipq_receive_peer(struct ipq_peer_msg *pmsg,
 		if (pmsg->msg.verdict.value > NF_MAX_VERDICT)
 			status = -EINVAL;
 		else
-			status = ipq_set_verdict(&pmsg->msg.verdict,
+			status = ipq_set_verdict(inst, &pmsg->msg.verdict,
 			                         len - sizeof(*pmsg));
-			break;
+		break;
+
+	case IPQM_BATCH_VERDICT:
+		status = ipq_set_batch_verdict(inst, &pmsg->msg.batch);
+		break;
+
+	case IPQM_BIND:
+		/* Already bound by ipq_bind_peer() */
+		break;
+
 	default:
 		status = -EINVAL;
 	}
@@ -477,10 +582,68 @@ dev_cmp(struct ipq_queue_entry *entry, unsigned long ifindex)
 static void
 ipq_dev_drop(int ifindex)
 {
-	struct ipq_queue_entry *entry;
-	
-	while ((entry = ipq_find_dequeue_entry(dev_cmp, ifindex)) != NULL)
-		ipq_issue_verdict(entry, NF_DROP);
+	struct ipq_instance *inst;
+	struct hlist_node *pos;
+	LIST_HEAD(list);
+	int i;
+
+	read_lock_bh(&instances_lock);
+	for (i = 0; i < IPQ_INSTANCE_BUCKETS; i++) {
+		hlist_for_each_entry(inst, pos, &instance_table[i], hnode)
+			ipq_dequeue_matching(inst, dev_cmp, ifindex, &list);
+	}
+	read_unlock_bh(&instances_lock);
+
+	ipq_issue_verdicts(&list, NF_DROP);
+}
+
+/*
+ * A peer reads one queue.  IPQM_BIND picks it; a peer that never sent
+ * one gets queue 0, where plain QUEUE targets deliver.
+ */
+static int
+ipq_bind_peer(int pid, int type, struct ipq_peer_msg *pmsg, unsigned int len)
+{
+	struct ipq_instance *inst;
+	unsigned short queue_num = 0;
+	int status = 0;
+
+	if (type == IPQM_BIND) {
+		if (len < sizeof(*pmsg))
+			return -EINVAL;
+		queue_num = pmsg->msg.bind.queue_num;
+	}
+
+	/* Verdicts from a bound peer must not serialise on the write lock */
+	read_lock_bh(&instances_lock);
+	inst = __instance_lookup_pid(pid);
+	if (inst && type == IPQM_BIND && inst->queue_num != queue_num)
+		status = -EBUSY;
+	read_unlock_bh(&instances_lock);
+	if (inst)
+		return status;
+
+	write_lock_bh(&instances_lock);
+
+	inst = __instance_lookup_pid(pid);
+	if (inst) {
+		if (type == IPQM_BIND && inst->queue_num != queue_num)
+			status = -EBUSY;
+		goto out_unlock;
+	}
+
+	inst = __instance_lookup(queue_num);
+	if (inst) {
+		status = -EBUSY;
+		goto out_unlock;
+	}
+
+	if (__instance_create(queue_num, pid) == NULL)
+		status = -ENOMEM;
+
+out_unlock:
+	write_unlock_bh(&instances_lock);
+	return status;
 }
 
 #define RCV_SKB_FAIL(err) do { netlink_ack(skb, nlh, (err)); return; } while (0)
@@ -489,6 +652,7 @@ static inline void
 ipq_rcv_skb(struct sk_buff *skb)
 {
 	int status, type, pid, flags, nlmsglen, skblen;
+	struct ipq_instance *inst;
 	struct nlmsghdr *nlh;
 
 	skblen = skb->len;
@@ -519,22 +683,20 @@ ipq_rcv_skb(struct sk_buff *skb)
 	if (security_netlink_recv(skb))
 		RCV_SKB_FAIL(-EPERM);
 	
-	write_lock_bh(&queue_lock);
-	
-	if (peer_pid) {
-		if (peer_pid != pid) {
-			write_unlock_bh(&queue_lock);
-			RCV_SKB_FAIL(-EBUSY);
-		}
-	} else {
-		net_enable_timestamp();
-		peer_pid = pid;
-	}
-		
-	write_unlock_bh(&queue_lock);
-	
-	status = ipq_receive_peer(NLMSG_DATA(nlh), type,
-	                          skblen - NLMSG_LENGTH(0));
+	status = ipq_bind_peer(pid, type, NLMSG_DATA(nlh),
+			       skblen - NLMSG_LENGTH(0));
+	if (status < 0)
+		RCV_SKB_FAIL(status);
+
+	/* Keeps the instance alive against a concurrent NETLINK_URELEASE */
+	read_lock_bh(&instances_lock);
+	inst = __instance_lookup_pid(pid);
+	if (inst)
+		status = ipq_receive_peer(inst, NLMSG_DATA(nlh), type,
+		                          skblen - NLMSG_LENGTH(0));
+	else
+		status = -ENOENT;
+	read_unlock_bh(&instances_lock);
 	if (status < 0)
 		RCV_SKB_FAIL(status);
 		
@@ -583,13 +745,17 @@ ipq_rcv_nl_event(struct notifier_block *this,
                  unsigned long event, void *ptr)
 {
 	struct netlink_notify *n = ptr;
+	struct ipq_instance *inst;
 
 	if (event == NETLINK_URELEASE &&
 	    n->protocol == NETLINK_FIREWALL && n->pid) {
-		write_lock_bh(&queue_lock);
-		if (n->pid == peer_pid)
-			__ipq_reset();
-		write_unlock_bh(&queue_lock);
+		write_lock_bh(&instances_lock);
+		inst = __instance_lookup_pid(n->pid);
+		if (inst)
+			hlist_del(&inst->hnode);
+		write_unlock_bh(&instances_lock);
+		if (inst)
+			instance_destroy(inst);
 	}
 	return NOTIFY_DONE;
 }
@@ -636,27 +802,35 @@ static ctl_table ipq_root_table[] = {
 static int
 ipq_get_info(char *buffer, char **start, off_t offset, int length)
 {
-	int len;
+	struct ipq_instance *inst;
+	struct hlist_node *pos;
+	int len, i;
 
-	read_lock_bh(&queue_lock);
+	read_lock_bh(&instances_lock);
 	
 	len = sprintf(buffer,
-	              "Peer PID          : %d\n"
-	              "Copy mode         : %hu\n"
-	              "Copy range        : %u\n"
-	              "Queue length      : %u\n"
 	              "Queue max. length : %u\n"
-		      "Queue dropped     : %u\n"
-		      "Netlink dropped   : %u\n",
-	              peer_pid,
-	              copy_mode,
-	              copy_range,
-	              queue_total,
-	              queue_maxlen,
-		      queue_dropped,
-		      queue_user_dropped);
-
-	read_unlock_bh(&queue_lock);
+	              "queue   pid mode  range length  dropped nl_dropped\n",
+	              queue_maxlen);
+
+	for (i = 0; i < IPQ_INSTANCE_BUCKETS; i++) {
+		hlist_for_each_entry(inst, pos, &instance_table[i], hnode) {
+			/* One page is all get_info can return */
+			if (len > PAGE_SIZE - 80)
+				break;
+			len += sprintf(buffer + len,
+			               "%5u %5d %4hu %6u %6u %8u %10u\n",
+			               inst->queue_num,
+			               inst->peer_pid,
+			               inst->copy_mode,
+			               inst->copy_range,
+			               inst->queue_total,
+			               inst->queue_dropped,
+			               inst->queue_user_dropped);
+		}
+	}
+
+	read_unlock_bh(&instances_lock);
 	
 	*start = buffer + offset;
 	len -= offset;
@@ -668,6 +842,29 @@ ipq_get_info(char *buffer, char **start, off_t offset, int length)
 }
 #endif /* CONFIG_PROC_FS */
 
+static void
+ipq_destroy_all(void)
+{
+	struct ipq_instance *inst;
+	int i;
+
+	for (i = 0; i < IPQ_INSTANCE_BUCKETS; i++) {
+		for (;;) {
+			write_lock_bh(&instances_lock);
+			inst = NULL;
+			if (!hlist_empty(&instance_table[i])) {
+				inst = hlist_entry(instance_table[i].first,
+						   struct ipq_instance, hnode);
+				hlist_del(&inst->hnode);
+			}
+			write_unlock_bh(&instances_lock);
+			if (inst == NULL)
+				break;
+			instance_destroy(inst);
+		}
+	}
+}
+
 static int
 init_or_cleanup(int init)
 {
@@ -705,7 +902,7 @@ init_or_cleanup(int init)
 cleanup:
 	nf_unregister_queue_handler(PF_INET);
 	synchronize_net();
-	ipq_flush(NF_DROP);
+	ipq_destroy_all();
 	
 cleanup_sysctl:
 	unregister_sysctl_table(ipq_sysctl_header);
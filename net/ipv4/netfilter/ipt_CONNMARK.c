@@ -50,13 +50,17 @@ target(struct sk_buff **pskb,
 	    switch(markinfo->mode) {
 	    case IPT_CONNMARK_SET:
 		newmark = (ct->mark & ~markinfo->mask) | markinfo->mark;
-		if (newmark != ct->mark)
+		if (newmark != ct->mark) {
 		    ct->mark = newmark;
+		    ip_conntrack_event_cache(IPCT_MARK, *pskb);
+		}
 		break;
 	    case IPT_CONNMARK_SAVE:
 		newmark = (ct->mark & ~markinfo->mask) | ((*pskb)->nfmark & markinfo->mask);
-		if (ct->mark != newmark)
+		if (ct->mark != newmark) {
 		    ct->mark = newmark;
+		    ip_conntrack_event_cache(IPCT_MARK, *pskb);
+		}
 		break;
 	    case IPT_CONNMARK_RESTORE:
 		nfmark = (*pskb)->nfmark;
@@ -0,0 +1,100 @@
+/* iptables module for queueing packets to a numbered userspace queue.
+ *
+ * The queue number travels in the upper bits of the NF_QUEUE verdict.
+ * Several queues can share the load: a packet then goes to the queue
+ * picked by a hash of its addresses and protocol, the same for both
+ * directions, so a flow always meets the same userspace process.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/netfilter_ipv4/ipt_NFQUEUE.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("iptables NFQUEUE target");
+
+static u32 jhash_initval;
+
+static unsigned int
+target(struct sk_buff **pskb,
+       const struct net_device *in,
+       const struct net_device *out,
+       unsigned int hooknum,
+       const void *targinfo,
+       void *userinfo)
+{
+	const struct ipt_NFQ_info *tinfo = targinfo;
+	unsigned int queue = tinfo->queuenum;
+
+	if (tinfo->queues_total > 1) {
+		struct iphdr *iph = (*pskb)->nh.iph;
+		u32 a = iph->saddr, b = iph->daddr;
+
+		if (a > b) {
+			u32 tmp = a;
+			a = b;
+			b = tmp;
+		}
+		queue += jhash_3words(a, b, iph->protocol, jhash_initval)
+			 % tinfo->queues_total;
+	}
+	return NF_QUEUE_NR(queue);
+}
+
+static int
+checkentry(const char *tablename,
+	   const struct ipt_entry *e,
+	   void *targinfo,
+	   unsigned int targinfosize,
+	   unsigned int hook_mask)
+{
+	const struct ipt_NFQ_info *tinfo = targinfo;
+
+	if (targinfosize != IPT_ALIGN(sizeof(struct ipt_NFQ_info))) {
+		printk(KERN_WARNING "NFQUEUE: targinfosize %u != %Zu\n",
+		       targinfosize,
+		       IPT_ALIGN(sizeof(struct ipt_NFQ_info)));
+		return 0;
+	}
+
+	if (tinfo->queues_total > 1 &&
+	    tinfo->queuenum + tinfo->queues_total - 1 > 0xffff) {
+		printk(KERN_WARNING "NFQUEUE: queues %u..%u out of range\n",
+		       tinfo->queuenum,
+		       tinfo->queuenum + tinfo->queues_total - 1);
+		return 0;
+	}
+
+	return 1;
+}
+
+static struct ipt_target ipt_NFQ_reg = {
+	.name		= "NFQUEUE",
+	.target		= target,
+	.checkentry	= checkentry,
+	.me		= THIS_MODULE,
+};
+
+static int __init init(void)
+{
+	get_random_bytes(&jhash_initval, sizeof(jhash_initval));
+	return ipt_register_target(&ipt_NFQ_reg);
+}
+
+static void __exit fini(void)
+{
+	ipt_unregister_target(&ipt_NFQ_reg);
+}
+
+module_init(init);
+module_exit(fini);
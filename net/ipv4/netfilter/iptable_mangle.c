@@ -150,7 +150,8 @@ ipt_local_hook(unsigned int hook,
 
 	ret = ipt_do_table(pskb, hook, in, out, &packet_mangler, NULL);
 	/* Reroute for ANY change. */
-	if (ret != NF_DROP && ret != NF_STOLEN && ret != NF_QUEUE
+	if (ret != NF_DROP && ret != NF_STOLEN
+	    && (ret & NF_VERDICT_MASK) != NF_QUEUE
 	    && ((*pskb)->nh.iph->saddr != saddr
 		|| (*pskb)->nh.iph->daddr != daddr
 #ifdef CONFIG_IP_ROUTE_FWMARK
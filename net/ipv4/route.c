@@ -2414,7 +2414,7 @@ static int rt_fill_info(struct sk_buff *skb, u32 pid, u32 seq, int event,
 	ci.rta_error	= rt->u.dst.error;
 	ci.rta_id	= ci.rta_ts = ci.rta_tsage = 0;
 	if (rt->peer) {
-		ci.rta_id = rt->peer->ip_id_count;
+		ci.rta_id = atomic_read(&rt->peer->ip_id_count);
 		if (rt->peer->tcp_ts_stamp) {
 			ci.rta_ts = rt->peer->tcp_ts;
 			ci.rta_tsage = xtime.tv_sec - rt->peer->tcp_ts_stamp;
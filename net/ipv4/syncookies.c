@@ -241,6 +241,7 @@ struct sock *cookie_v4_check(struct sock *sk, struct sk_buff *skb,
 
 	req->snd_wscale = req->rcv_wscale = req->tstamp_ok = 0;
 	req->wscale_ok	= req->sack_ok = 0; 
+	req->fastopen_cookie = req->fastopen = 0;
 	req->expires	= 0UL; 
 	req->retrans	= 0; 
 	
@@ -257,8 +257,11 @@
 #include <linux/fs.h>
 #include <linux/random.h>
 #include <linux/bootmem.h>
+#include <linux/vmalloc.h>
+#include <linux/rcupdate.h>
 
 #include <net/icmp.h>
+#include <net/inet_common.h>
 #include <net/tcp.h>
 #include <net/xfrm.h>
 #include <net/ip.h>
@@ -274,6 +277,9 @@ DEFINE_SNMP_STAT(struct tcp_mib, tcp_statistics);
 kmem_cache_t *tcp_openreq_cachep;
 kmem_cache_t *tcp_bucket_cachep;
 kmem_cache_t *tcp_timewait_cachep;
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+kmem_cache_t *tcp6_timewait_cachep;
+#endif
 
 atomic_t tcp_orphan_count = ATOMIC_INIT(0);
 
@@ -378,8 +384,11 @@ unsigned int tcp_poll(struct file *file, struct socket *sock, poll_table *wait)
 	if (sk->sk_shutdown & RCV_SHUTDOWN)
 		mask |= POLLIN | POLLRDNORM;
 
-	/* Connected? */
-	if ((1 << sk->sk_state) & ~(TCPF_SYN_SENT | TCPF_SYN_RECV)) {
+	/* Connected?  A fast open child already has data to read and
+	 * may send before the handshake completes.
+	 */
+	if (((1 << sk->sk_state) & ~(TCPF_SYN_SENT | TCPF_SYN_RECV)) ||
+	    tp->fastopen_child) {
 		/* Potential race condition. If read of tp below will
 		 * escape above sk->sk_state, we can be illegally awaken
 		 * in SYN_* states. */
@@ -459,6 +468,44 @@ int tcp_ioctl(struct sock *sk, int cmd, unsigned long arg)
 }
 
 
+/* The SYN table has one chain per queued SYN we allow, so it grows
+ * with tcp_max_syn_backlog instead of degrading into long chains.
+ */
+static struct tcp_listen_opt *tcp_listen_opt_alloc(void)
+{
+	struct tcp_listen_opt *lopt;
+	size_t size;
+	int max_qlen_log;
+
+	for (max_qlen_log = 6; max_qlen_log < 16; max_qlen_log++)
+		if ((1 << max_qlen_log) >= sysctl_max_syn_backlog)
+			break;
+
+	size = sizeof(struct tcp_listen_opt) +
+	       (sizeof(struct open_request *) << max_qlen_log);
+	if (size <= PAGE_SIZE)
+		lopt = kmalloc(size, GFP_KERNEL);
+	else
+		lopt = vmalloc(size);
+	if (!lopt)
+		return NULL;
+
+	memset(lopt, 0, size);
+	lopt->max_qlen_log = max_qlen_log;
+	lopt->nr_table_entries = 1 << max_qlen_log;
+	get_random_bytes(&lopt->hash_rnd, 4);
+	return lopt;
+}
+
+static void tcp_listen_opt_free(struct tcp_listen_opt *lopt)
+{
+	if (sizeof(struct tcp_listen_opt) +
+	    sizeof(struct open_request *) * lopt->nr_table_entries <= PAGE_SIZE)
+		kfree(lopt);
+	else
+		vfree(lopt);
+}
+
 int tcp_listen_start(struct sock *sk)
 {
 	struct inet_sock *inet = inet_sk(sk);
@@ -471,16 +518,10 @@ int tcp_listen_start(struct sock *sk)
 	rwlock_init(&tp->syn_wait_lock);
 	tcp_delack_init(tp);
 
-	lopt = kmalloc(sizeof(struct tcp_listen_opt), GFP_KERNEL);
+	lopt = tcp_listen_opt_alloc();
 	if (!lopt)
 		return -ENOMEM;
 
-	memset(lopt, 0, sizeof(struct tcp_listen_opt));
-	for (lopt->max_qlen_log = 6; ; lopt->max_qlen_log++)
-		if ((1 << lopt->max_qlen_log) >= sysctl_max_syn_backlog)
-			break;
-	get_random_bytes(&lopt->hash_rnd, 4);
-
 	write_lock_bh(&tp->syn_wait_lock);
 	tp->listen_opt = lopt;
 	write_unlock_bh(&tp->syn_wait_lock);
@@ -504,7 +545,7 @@ int tcp_listen_start(struct sock *sk)
 	write_lock_bh(&tp->syn_wait_lock);
 	tp->listen_opt = NULL;
 	write_unlock_bh(&tp->syn_wait_lock);
-	kfree(lopt);
+	tcp_listen_opt_free(lopt);
 	return -EADDRINUSE;
 }
 
@@ -521,19 +562,23 @@ static void tcp_listen_stop (struct sock *sk)
 	struct open_request *req;
 	int i;
 
-	tcp_delete_keepalive_timer(sk);
-
 	/* make all the listen_opt local to us */
 	write_lock_bh(&tp->syn_wait_lock);
 	tp->listen_opt = NULL;
 	write_unlock_bh(&tp->syn_wait_lock);
 	tp->accept_queue = tp->accept_queue_tail = NULL;
 
-	if (lopt->qlen) {
-		for (i = 0; i < TCP_SYNQ_HSIZE; i++) {
+	/* Wait for SYNs that found listen_opt without the socket lock,
+	 * they may still add requests and arm the SYNACK timer.
+	 */
+	synchronize_kernel();
+	tcp_delete_keepalive_timer(sk);
+
+	if (tcp_synq_len(lopt)) {
+		for (i = 0; i < lopt->nr_table_entries; i++) {
 			while ((req = lopt->syn_table[i]) != NULL) {
 				lopt->syn_table[i] = req->dl_next;
-				lopt->qlen--;
+				atomic_dec(&lopt->qlen);
 				tcp_openreq_free(req);
 
 		/* Following specs, it would be better either to send FIN
@@ -547,9 +592,9 @@ static void tcp_listen_stop (struct sock *sk)
 			}
 		}
 	}
-	BUG_TRAP(!lopt->qlen);
+	BUG_TRAP(!tcp_synq_len(lopt));
 
-	kfree(lopt);
+	tcp_listen_opt_free(lopt);
 
 	while ((req = acc_req) != NULL) {
 		struct sock *child = req->sk;
@@ -785,6 +830,38 @@ static inline int select_size(struct sock *sk, struct tcp_sock *tp)
 	return tmp;
 }
 
+/* sendto(MSG_FASTOPEN) on a fresh socket connects, and tcp_connect()
+ * sends as much of the data as fits into one segment with the SYN.
+ * *copied is what went out that way, the rest is left in the iovec.
+ */
+static int tcp_sendmsg_fastopen(struct sock *sk, struct msghdr *msg,
+				size_t size, int *copied)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_fastopen_request fo;
+	int err;
+
+	if (!(sysctl_tcp_fastopen & TFO_CLIENT_ENABLE))
+		return -EOPNOTSUPP;
+	if (!msg->msg_name)
+		return -EDESTADDRREQ;
+
+	fo.cookie.len = -1;
+	fo.iov = msg->msg_iov;
+	fo.size = size;
+	fo.copied = 0;
+
+	tp->fastopen_req = &fo;
+	err = __inet_stream_connect(sk->sk_socket, msg->msg_name,
+				    msg->msg_namelen,
+				    (msg->msg_flags & MSG_DONTWAIT) ?
+				    O_NONBLOCK : 0);
+	tp->fastopen_req = NULL;
+
+	*copied = fo.copied;
+	return err;
+}
+
 int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t size)
 {
@@ -793,17 +870,30 @@ int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	struct sk_buff *skb;
 	int iovlen, flags;
 	int mss_now;
-	int err, copied;
+	int err, copied, copied_syn = 0;
 	long timeo;
 
 	lock_sock(sk);
 	TCP_CHECK_TIMER(sk);
 
 	flags = msg->msg_flags;
+	if (unlikely(flags & MSG_FASTOPEN)) {
+		err = tcp_sendmsg_fastopen(sk, msg, size, &copied_syn);
+		if (err == -EINPROGRESS && copied_syn > 0) {
+			/* The rest has to wait for the handshake. */
+			TCP_CHECK_TIMER(sk);
+			release_sock(sk);
+			return copied_syn;
+		}
+		if (err)
+			goto out_err;
+	}
+
 	timeo = sock_sndtimeo(sk, flags & MSG_DONTWAIT);
 
 	/* Wait for a connection to finish. */
-	if ((1 << sk->sk_state) & ~(TCPF_ESTABLISHED | TCPF_CLOSE_WAIT))
+	if (((1 << sk->sk_state) & ~(TCPF_ESTABLISHED | TCPF_CLOSE_WAIT)) &&
+	    !tp->fastopen_child)
 		if ((err = sk_stream_wait_connect(sk, &timeo)) != 0)
 			goto out_err;
 
@@ -984,7 +1074,7 @@ out:
 		tcp_push(sk, tp, flags, mss_now, tp->nonagle);
 	TCP_CHECK_TIMER(sk);
 	release_sock(sk);
-	return copied;
+	return copied + copied_syn;
 
 do_fault:
 	if (!skb->len) {
@@ -995,7 +1085,7 @@ do_fault:
 	}
 
 do_error:
-	if (copied)
+	if (copied + copied_syn)
 		goto out;
 out_err:
 	err = sk_stream_error(sk, flags, err);
@@ -1928,8 +2018,11 @@ struct sock *tcp_accept(struct sock *sk, int flags, int *err)
 
  	newsk = req->sk;
 	sk_acceptq_removed(sk);
+	if (req->fastopen)
+		tp->listen_opt->fastopen_qlen--;
+	else
+		BUG_TRAP(newsk->sk_state != TCP_SYN_RECV);
 	tcp_openreq_fastfree(req);
-	BUG_TRAP(newsk->sk_state != TCP_SYN_RECV);
 	release_sock(sk);
 	return newsk;
 
@@ -1953,6 +2046,25 @@ int tcp_setsockopt(struct sock *sk, int level, int optname, char __user *optval,
 		return tp->af_specific->setsockopt(sk, level, optname,
 						   optval, optlen);
 
+	/* This is a string value all the others are int's */
+	if (optname == TCP_CONGESTION) {
+		char name[TCP_CA_NAME_MAX];
+
+		if (optlen < 1)
+			return -EINVAL;
+
+		val = strncpy_from_user(name, optval,
+					min(TCP_CA_NAME_MAX-1, optlen));
+		if (val < 0)
+			return -EFAULT;
+		name[val] = 0;
+
+		lock_sock(sk);
+		err = tcp_set_congestion_control(tp, name);
+		release_sock(sk);
+		return err;
+	}
+
 	if (optlen < sizeof(int))
 		return -EINVAL;
 
@@ -2082,6 +2194,17 @@ int tcp_setsockopt(struct sock *sk, int level, int optname, char __user *optval,
 						SOCK_MIN_RCVBUF / 2 : val;
 		break;
 
+	case TCP_FASTOPEN:
+		/* SYNs to a listener are handled without the socket
+		 * lock unless they may create a fast open child, so
+		 * this cannot change under a listening socket.
+		 */
+		if (sk->sk_state != TCP_CLOSE || val < 0)
+			err = -EINVAL;
+		else
+			tp->fastopen_max = val;
+		break;
+
 	case TCP_QUICKACK:
 		if (!val) {
 			tp->ack.pingpong = 1;
@@ -2237,6 +2360,18 @@ int tcp_getsockopt(struct sock *sk, int level, int optname, char __user *optval,
 	case TCP_QUICKACK:
 		val = !tp->ack.pingpong;
 		break;
+	case TCP_FASTOPEN:
+		val = tp->fastopen_max;
+		break;
+	case TCP_CONGESTION:
+		if (get_user(len, optlen))
+			return -EFAULT;
+		len = min_t(unsigned int, len, TCP_CA_NAME_MAX);
+		if (put_user(len, optlen))
+			return -EFAULT;
+		if (copy_to_user(optval, tp->ca_ops->name, len))
+			return -EFAULT;
+		return 0;
 	default:
 		return -ENOPROTOOPT;
 	};
@@ -2292,6 +2427,16 @@ void __init tcp_init(void)
 	if (!tcp_timewait_cachep)
 		panic("tcp_init: Cannot alloc tcp_tw_bucket cache.");
 
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+	tcp6_timewait_cachep = kmem_cache_create("tcp6_tw_bucket",
+						 sizeof(struct tcp6_tw_bucket),
+						 0, SLAB_HWCACHE_ALIGN,
+						 NULL, NULL);
+	if (!tcp6_timewait_cachep)
+		panic("tcp_init: Cannot alloc tcp6_tw_bucket cache.");
+#endif
+	tcp_tw_init();
+
 	/* Size and allocate the main established and bind bucket
 	 * hash tables.
 	 *
@@ -2366,6 +2511,8 @@ void __init tcp_init(void)
 	printk(KERN_INFO "TCP: Hash tables configured "
 	       "(established %d bind %d)\n",
 	       tcp_ehash_size << 1, tcp_bhash_size);
+
+	tcp_register_congestion_control(&tcp_reno);
 }
 
 EXPORT_SYMBOL(tcp_accept);
@@ -2384,3 +2531,6 @@ EXPORT_SYMBOL(tcp_setsockopt);
 EXPORT_SYMBOL(tcp_shutdown);
 EXPORT_SYMBOL(tcp_statistics);
 EXPORT_SYMBOL(tcp_timewait_cachep);
+#if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
+EXPORT_SYMBOL(tcp6_timewait_cachep);
+#endif
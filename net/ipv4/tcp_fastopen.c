@@ -0,0 +1,93 @@
+/*
+ * TCP Fast Open: data in the SYN for clients holding a server cookie.
+ *
+ * The server hands out a cookie, a MAC of the client address under a
+ * local secret, in the SYN-ACK of a connection that asked for one.
+ * The client remembers it in the inet_peer entry of the server and
+ * sends it back with data in the SYN of later connections, so the
+ * server may deliver that data before the handshake completes.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/tcp.h>
+#include <linux/random.h>
+#include <linux/cryptohash.h>
+#include <linux/kernel.h>
+#include <net/inetpeer.h>
+#include <net/route.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen = TFO_CLIENT_ENABLE;
+
+static __u32 tcp_fastopen_secret[16 - 2 + SHA_DIGEST_WORDS];
+
+static __init int tcp_fastopen_init(void)
+{
+	get_random_bytes(tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	return 0;
+}
+module_init(tcp_fastopen_init);
+
+void tcp_fastopen_cookie_gen(__u32 saddr, __u32 daddr,
+			     struct tcp_fastopen_cookie *foc)
+{
+	__u32 tmp[16 + 5 + SHA_WORKSPACE_WORDS];
+
+	memcpy(tmp + 2, tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	tmp[0] = saddr;
+	tmp[1] = daddr;
+	sha_transform(tmp + 16, (__u8 *)tmp, tmp + 16 + 5);
+
+	memcpy(foc->val, tmp + 16, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* The cookie lives in the inet_peer entry of the server.  Readers and
+ * writers do not lock it: a torn cookie is just rejected by the server,
+ * which costs one fallback to the normal handshake.
+ */
+void tcp_fastopen_cache_get(struct sock *sk, struct tcp_fastopen_cookie *foc)
+{
+	struct rtable *rt = (struct rtable *)__sk_dst_get(sk);
+	struct inet_peer *peer;
+	int i;
+
+	foc->len = -1;
+	if (sk->sk_family != AF_INET || !rt)
+		return;
+
+	/* Nothing known yet, ask for a cookie. */
+	peer = rt_get_peer(rt);
+	if (!peer) {
+		foc->len = 0;
+		return;
+	}
+
+	memcpy(foc->val, peer->tcp_fastopen_cookie, TCP_FASTOPEN_COOKIE_SIZE);
+	for (i = 0; i < TCP_FASTOPEN_COOKIE_SIZE; i++) {
+		if (foc->val[i]) {
+			foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+			return;
+		}
+	}
+	foc->len = 0;
+}
+
+void tcp_fastopen_cache_set(struct sock *sk,
+			    const struct tcp_fastopen_cookie *foc)
+{
+	struct rtable *rt = (struct rtable *)__sk_dst_get(sk);
+
+	if (sk->sk_family != AF_INET || !rt)
+		return;
+
+	if (!rt->peer)
+		rt_bind_peer(rt, 1);
+	if (rt->peer)
+		memcpy(rt->peer->tcp_fastopen_cookie, foc->val,
+		       TCP_FASTOPEN_COOKIE_SIZE);
+}
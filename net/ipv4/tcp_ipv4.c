@@ -861,9 +861,10 @@ static __inline__ int tcp_v4_iif(struct sk_buff *skb)
 	return ((struct rtable *)skb->dst)->rt_iif;
 }
 
-static __inline__ u32 tcp_v4_synq_hash(u32 raddr, u16 rport, u32 rnd)
+static __inline__ u32 tcp_v4_synq_hash(u32 raddr, u16 rport, u32 rnd,
+				       u32 synq_hsize)
 {
-	return (jhash_2words(raddr, (u32) rport, rnd) & (TCP_SYNQ_HSIZE - 1));
+	return (jhash_2words(raddr, (u32) rport, rnd) & (synq_hsize - 1));
 }
 
 static struct open_request *tcp_v4_search_req(struct tcp_sock *tp,
@@ -874,7 +875,8 @@ static struct open_request *tcp_v4_search_req(struct tcp_sock *tp,
 	struct tcp_listen_opt *lopt = tp->listen_opt;
 	struct open_request *req, **prev;
 
-	for (prev = &lopt->syn_table[tcp_v4_synq_hash(raddr, rport, lopt->hash_rnd)];
+	for (prev = &lopt->syn_table[tcp_v4_synq_hash(raddr, rport, lopt->hash_rnd,
+						      lopt->nr_table_entries)];
 	     (req = *prev) != NULL;
 	     prev = &req->dl_next) {
 		if (req->rmt_port == rport &&
@@ -890,22 +892,13 @@ static struct open_request *tcp_v4_search_req(struct tcp_sock *tp,
 	return req;
 }
 
-static void tcp_v4_synq_add(struct sock *sk, struct open_request *req)
+static int tcp_v4_synq_add(struct sock *sk, struct tcp_listen_opt *lopt,
+			   struct open_request *req)
 {
-	struct tcp_sock *tp = tcp_sk(sk);
-	struct tcp_listen_opt *lopt = tp->listen_opt;
-	u32 h = tcp_v4_synq_hash(req->af.v4_req.rmt_addr, req->rmt_port, lopt->hash_rnd);
-
-	req->expires = jiffies + TCP_TIMEOUT_INIT;
-	req->retrans = 0;
-	req->sk = NULL;
-	req->dl_next = lopt->syn_table[h];
+	u32 h = tcp_v4_synq_hash(req->af.v4_req.rmt_addr, req->rmt_port,
+				 lopt->hash_rnd, lopt->nr_table_entries);
 
-	write_lock(&tp->syn_wait_lock);
-	lopt->syn_table[h] = req;
-	write_unlock(&tp->syn_wait_lock);
-
-	tcp_synq_added(sk);
+	return tcp_synq_insert(sk, lopt, req, h);
 }
 
 
@@ -1390,8 +1383,102 @@ struct or_calltable or_ipv4 = {
 	.send_reset	=	tcp_v4_send_reset,
 };
 
+/* Fast open: the SYN carries a valid cookie and data, so the child is
+ * created right away.  It holds the data, sits in the accept queue and
+ * retransmits its own SYN-ACK until the handshake completes.  Only ever
+ * called with the listener locked, see tcp_v4_syn_fastpath().
+ */
+static int tcp_v4_fastopen_child(struct sock *sk, struct sk_buff *skb,
+				 struct open_request *req,
+				 struct dst_entry *dst)
+{
+	struct tcp_listen_opt *lopt = tcp_sk(sk)->listen_opt;
+	struct tcphdr *th = skb->h.th;
+	struct tcp_sock *newtp;
+	struct sk_buff *data;
+	struct sock *child;
+
+	data = skb_clone(skb, GFP_ATOMIC);
+	if (!data)
+		return 0;
+
+	child = tcp_v4_syn_recv_sock(sk, skb, req, dst_clone(dst));
+	if (!child) {
+		kfree_skb(data);
+		return 0;
+	}
+	dst_release(dst);
+
+	/* Our SYN-ACK is still to be acknowledged, and the window
+	 * in a SYN is never scaled.
+	 */
+	newtp = tcp_sk(child);
+	newtp->fastopen_child = 1;
+	newtp->snd_una = req->snt_isn;
+	newtp->snd_wnd = ntohs(th->window);
+	newtp->max_window = newtp->snd_wnd;
+
+	/* tcp_recvmsg() skips the SYN in the sequence space. */
+	__skb_pull(data, th->doff << 2);
+	if (sk_stream_rmem_schedule(child, data)) {
+		sk_stream_set_owner_r(data, child);
+		__skb_queue_tail(&child->sk_receive_queue, data);
+		newtp->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+	} else
+		kfree_skb(data);
+
+	tcp_queue_synack(child);
+
+	req->fastopen = 1;
+	lopt->fastopen_qlen++;
+	tcp_acceptq_queue(sk, req, child);
+	sk->sk_data_ready(sk, 0);
+
+	bh_unlock_sock(child);
+	sock_put(child);
+	NET_INC_STATS_BH(LINUX_MIB_TCPFASTOPENPASSIVE);
+	return 1;
+}
+
+/* Returns 1 if the SYN created a fast open child, which then owns req
+ * and dst.  Otherwise the SYN-ACK may have to carry a cookie.
+ */
+static int tcp_v4_fastopen(struct sock *sk, struct sk_buff *skb,
+			   struct open_request *req,
+			   struct tcp_fastopen_cookie *foc,
+			   struct dst_entry *dst)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_fastopen_cookie valid;
+	struct tcphdr *th = skb->h.th;
+
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) || !tp->fastopen_max)
+		return 0;
+
+	tcp_fastopen_cookie_gen(req->af.v4_req.rmt_addr,
+				req->af.v4_req.loc_addr, &valid);
+	if (foc->len != TCP_FASTOPEN_COOKIE_SIZE ||
+	    memcmp(foc->val, valid.val, TCP_FASTOPEN_COOKIE_SIZE)) {
+		if (foc->len > 0)
+			NET_INC_STATS_BH(LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		req->fastopen_cookie = 1;
+		return 0;
+	}
+
+	if (skb->len == (th->doff << 2) || th->fin)
+		return 0;
+
+	if (tp->listen_opt->fastopen_qlen >= tp->fastopen_max) {
+		NET_INC_STATS_BH(LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		return 0;
+	}
+	return tcp_v4_fastopen_child(sk, skb, req, dst);
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
+	struct tcp_listen_opt *lopt = tcp_sk(sk)->listen_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
 	struct tcp_options_received tmp_opt;
 	struct open_request *req;
 	__u32 saddr = skb->nh.iph->saddr;
@@ -1409,14 +1496,33 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	    (RTCF_BROADCAST | RTCF_MULTICAST))
 		goto drop;
 
+	/* Listener is going away under the lockless SYN path. */
+	if (!lopt)
+		goto drop;
+
 	/* TW buckets are converted to open requests without
 	 * limitations, they conserve resources and peer is
 	 * evidently real one.
 	 */
-	if (tcp_synq_is_full(sk) && !isn) {
+#ifdef CONFIG_SYN_COOKIES
+	/* Once the queue overflowed, stay stateless for a second
+	 * rather than refilling it with flood entries as soon as
+	 * the SYNACK timer makes room.
+	 */
+	if (lopt->synflood && !isn) {
+		if (sysctl_tcp_syncookies &&
+		    time_before(jiffies, lopt->synflood_end))
+			want_cookie = 1;
+		else
+			lopt->synflood = 0;
+	}
+#endif
+	if (!want_cookie && tcp_synq_is_full(lopt) && !isn) {
 #ifdef CONFIG_SYN_COOKIES
 		if (sysctl_tcp_syncookies) {
 			want_cookie = 1;
+			lopt->synflood_end = jiffies + HZ;
+			lopt->synflood = 1;
 		} else
 #endif
 		goto drop;
@@ -1427,7 +1533,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	 * clogging syn queue with openreqs with exponentially increasing
 	 * timeout.
 	 */
-	if (sk_acceptq_is_full(sk) && tcp_synq_young(sk) > 1)
+	if (sk_acceptq_is_full(sk) && tcp_synq_young(lopt) > 1)
 		goto drop;
 
 	req = tcp_openreq_alloc();
@@ -1438,7 +1544,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tmp_opt.mss_clamp = 536;
 	tmp_opt.user_mss  = tcp_sk(sk)->rx_opt.user_mss;
 
-	tcp_parse_options(skb, &tmp_opt, 0);
+	tcp_parse_options(skb, &tmp_opt, 0, &foc);
 
 	if (want_cookie) {
 		tcp_clear_options(&tmp_opt);
@@ -1497,7 +1603,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 		}
 		/* Kill the following clause, if you dislike this way. */
 		else if (!sysctl_tcp_syncookies &&
-			 (sysctl_max_syn_backlog - tcp_synq_len(sk) <
+			 (sysctl_max_syn_backlog - tcp_synq_len(lopt) <
 			  (sysctl_max_syn_backlog >> 2)) &&
 			 (!peer || !peer->tcp_ts_stamp) &&
 			 (!dst || !dst_metric(dst, RTAX_RTT))) {
@@ -1522,14 +1628,15 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	}
 	req->snt_isn = isn;
 
+	if (!want_cookie && foc.len >= 0 &&
+	    tcp_v4_fastopen(sk, skb, req, &foc, dst))
+		return 0;
+
 	if (tcp_v4_send_synack(sk, req, dst))
 		goto drop_and_free;
 
-	if (want_cookie) {
+	if (want_cookie || tcp_v4_synq_add(sk, lopt, req))
 	   	tcp_openreq_free(req);
-	} else {
-		tcp_v4_synq_add(sk, req);
-	}
 	return 0;
 
 drop_and_free:
@@ -1713,6 +1820,53 @@ csum_err:
 	goto discard;
 }
 
+/* Bare SYNs to an IPv4 listener are answered without the socket lock,
+ * so a SYN flood neither serializes all CPUs on one listener nor sits
+ * in its backlog while a process owns it.  Only the SYN table is
+ * changed, under syn_wait_lock.  Returns 0 when the segment has to
+ * take the usual path.
+ */
+static int tcp_v4_syn_fastpath(struct sock *sk, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcphdr *th = skb->h.th;
+	struct open_request *req, **prev;
+
+	if (!th->syn || th->ack || th->rst || sk->sk_family != PF_INET)
+		return 0;
+
+	/* Data in the SYN may create a fast open child. */
+	if (tp->fastopen_max && skb->len > (th->doff << 2))
+		return 0;
+
+	if (skb->len < (th->doff << 2) || tcp_checksum_complete(skb)) {
+		TCP_INC_STATS_BH(TCP_MIB_INERRS);
+		goto discard;
+	}
+
+	/* A retransmitted SYN of a pending request is for
+	 * tcp_check_req(), under the socket lock.
+	 */
+	req = NULL;
+	read_lock(&tp->syn_wait_lock);
+	if (tp->listen_opt)
+		req = tcp_v4_search_req(tp, &prev, th->source,
+					skb->nh.iph->saddr, skb->nh.iph->daddr);
+	read_unlock(&tp->syn_wait_lock);
+	if (req)
+		return 0;
+
+	/* tcp_listen_stop() waits for a grace period before it
+	 * frees listen_opt.
+	 */
+	rcu_read_lock();
+	tcp_v4_conn_request(sk, skb);
+	rcu_read_unlock();
+discard:
+	kfree_skb(skb);
+	return 1;
+}
+
 /*
  *	From tcp_input.c
  */
@@ -1775,6 +1929,11 @@ process:
 
 	skb->dev = NULL;
 
+	if (sk->sk_state == TCP_LISTEN && tcp_v4_syn_fastpath(sk, skb)) {
+		sock_put(sk);
+		return 0;
+	}
+
 	bh_lock_sock(sk);
 	ret = 0;
 	if (!sock_owned_by_user(sk)) {
@@ -2060,6 +2219,7 @@ static int tcp_v4_init_sock(struct sock *sk)
 	tp->mss_cache_std = tp->mss_cache = 536;
 
 	tp->reordering = sysctl_tcp_reordering;
+	tp->ca_ops = &tcp_init_congestion_ops;
 
 	sk->sk_state = TCP_CLOSE;
 
@@ -2082,6 +2242,8 @@ int tcp_v4_destroy_sock(struct sock *sk)
 
 	tcp_clear_xmit_timers(sk);
 
+	tcp_cleanup_congestion_control(tp);
+
 	/* Cleanup up the write buffer. */
   	sk_stream_writequeue_purge(sk);
 
@@ -2153,7 +2315,7 @@ static void *listening_get_next(struct seq_file *seq, void *cur)
 				}
 				req = req->dl_next;
 			}
-			if (++st->sbucket >= TCP_SYNQ_HSIZE)
+			if (++st->sbucket >= tp->listen_opt->nr_table_entries)
 				break;
 get_req:
 			req = tp->listen_opt->syn_table[st->sbucket];
@@ -2164,7 +2326,7 @@ get_req:
 	} else {
 	       	tp = tcp_sk(sk);
 		read_lock_bh(&tp->syn_wait_lock);
-		if (tp->listen_opt && tp->listen_opt->qlen)
+		if (tp->listen_opt && tcp_synq_len(tp->listen_opt))
 			goto start_req;
 		read_unlock_bh(&tp->syn_wait_lock);
 		sk = sk_next(sk);
@@ -2177,7 +2339,7 @@ get_sk:
 		}
 	       	tp = tcp_sk(sk);
 		read_lock_bh(&tp->syn_wait_lock);
-		if (tp->listen_opt && tp->listen_opt->qlen) {
+		if (tp->listen_opt && tcp_synq_len(tp->listen_opt)) {
 start_req:
 			st->uid		= sock_i_uid(sk);
 			st->syn_wait_sk = sk;
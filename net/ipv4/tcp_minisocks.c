@@ -54,7 +54,7 @@ static __inline__ int tcp_in_window(u32 seq, u32 end_seq, u32 s_win, u32 e_win)
 
 /* New-style handling of TIME_WAIT sockets. */
 
-int tcp_tw_count;
+atomic_t tcp_tw_count = ATOMIC_INIT(0);
 
 
 /* Must be called with locally disabled BHs. */
@@ -130,7 +130,7 @@ tcp_timewait_state_process(struct tcp_tw_bucket *tw, struct sk_buff *skb,
 
 	tmp_opt.saw_tstamp = 0;
 	if (th->doff > (sizeof(struct tcphdr) >> 2) && tw->tw_ts_recent_stamp) {
-		tcp_parse_options(skb, &tmp_opt, 0);
+		tcp_parse_options(skb, &tmp_opt, 0, NULL);
 
 		if (tmp_opt.saw_tstamp) {
 			tmp_opt.ts_recent	   = tw->tw_ts_recent;
@@ -335,8 +335,8 @@ void tcp_time_wait(struct sock *sk, int state, int timeo)
 	if (sysctl_tcp_tw_recycle && tp->rx_opt.ts_recent_stamp)
 		recycle_ok = tp->af_specific->remember_stamp(sk);
 
-	if (tcp_tw_count < sysctl_tcp_max_tw_buckets)
-		tw = kmem_cache_alloc(tcp_timewait_cachep, SLAB_ATOMIC);
+	if (atomic_read(&tcp_tw_count) < sysctl_tcp_max_tw_buckets)
+		tw = kmem_cache_alloc(tcp_tw_cachep(sk->sk_family), SLAB_ATOMIC);
 
 	if(tw != NULL) {
 		struct inet_sock *inet = inet_sk(sk);
@@ -362,19 +362,17 @@ void tcp_time_wait(struct sock *sk, int state, int timeo)
 		tw->tw_rcv_wnd		= tcp_receive_window(tp);
 		tw->tw_ts_recent	= tp->rx_opt.ts_recent;
 		tw->tw_ts_recent_stamp	= tp->rx_opt.ts_recent_stamp;
+		tw->tw_ipv6only		= 0;
+		tw->tw_cpu		= smp_processor_id();
 		tw_dead_node_init(tw);
 
 #if defined(CONFIG_IPV6) || defined(CONFIG_IPV6_MODULE)
 		if (tw->tw_family == PF_INET6) {
 			struct ipv6_pinfo *np = inet6_sk(sk);
 
-			ipv6_addr_copy(&tw->tw_v6_daddr, &np->daddr);
-			ipv6_addr_copy(&tw->tw_v6_rcv_saddr, &np->rcv_saddr);
-			tw->tw_v6_ipv6only = np->ipv6only;
-		} else {
-			memset(&tw->tw_v6_daddr, 0, sizeof(tw->tw_v6_daddr));
-			memset(&tw->tw_v6_rcv_saddr, 0, sizeof(tw->tw_v6_rcv_saddr));
-			tw->tw_v6_ipv6only = 0;
+			ipv6_addr_copy(&tcp6tw(tw)->tw_v6_daddr, &np->daddr);
+			ipv6_addr_copy(&tcp6tw(tw)->tw_v6_rcv_saddr, &np->rcv_saddr);
+			tw->tw_ipv6only = np->ipv6only;
 		}
 #endif
 		/* Linkage updates. */
@@ -408,30 +406,81 @@ void tcp_time_wait(struct sock *sk, int state, int timeo)
 }
 
 /* Kill off TIME_WAIT sockets once their lifetime has expired. */
-static int tcp_tw_death_row_slot;
-
-static void tcp_twkill(unsigned long);
 
 /* TIME_WAIT reaping mechanism. */
 #define TCP_TWKILL_SLOTS	8	/* Please keep this a power of 2. */
 #define TCP_TWKILL_PERIOD	(TCP_TIMEWAIT_LEN/TCP_TWKILL_SLOTS)
 
-#define TCP_TWKILL_QUOTA	100
+int sysctl_tcp_tw_reap_quota = 100;
+
+/* Each CPU keeps the buckets it creates on its own death row, so
+ * connections closing on different CPUs do not fight over one lock.
+ * A bucket stays on the row it was born on (tw_cpu), rescheduling
+ * and early kills from other CPUs simply take that row's lock.
+ *
+ * When the hand of the slow timer reaches a slot, the slot is moved
+ * to its reap list and destroyed from there at most
+ * sysctl_tcp_tw_reap_quota buckets per tick.  A slot holding tens
+ * of thousands of buckets is thus spread over many ticks instead
+ * of stalling softirq processing for milliseconds.
+ */
+struct tcp_tw_death_row {
+	spinlock_t		lock;
+	int			tw_count;
+
+	/* Slow timer, buckets living about TCP_TIMEWAIT_LEN. */
+	struct timer_list	tw_timer;
+	int			slot;
+	unsigned long		period_end;
+	u32			reap_slots;
+	unsigned long		reap_due[TCP_TWKILL_SLOTS];
+	struct hlist_head	cells[TCP_TWKILL_SLOTS];
+	struct hlist_head	reap[TCP_TWKILL_SLOTS];
+
+	/* Short-time calendar for recycled buckets. */
+	struct timer_list	twcal_timer;
+	int			twcal_hand;
+	unsigned long		twcal_jiffie;
+	struct hlist_head	twcal_row[TCP_TW_RECYCLE_SLOTS];
+};
+
+static DEFINE_PER_CPU(struct tcp_tw_death_row, tcp_death_row);
+
+static inline struct tcp_tw_death_row *tcp_tw_row(struct tcp_tw_bucket *tw)
+{
+	return &per_cpu(tcp_death_row, tw->tw_cpu);
+}
+
+static inline int tcp_tw_reap_quota(void)
+{
+	return max(sysctl_tcp_tw_reap_quota, 1);
+}
+
+/* Move all inmates of @from to the tail of @to. */
+static void tw_move_inmates(struct hlist_head *from, struct hlist_head *to)
+{
+	struct hlist_node **pprev = &to->first;
+
+	if (hlist_empty(from))
+		return;
 
-static struct hlist_head tcp_tw_death_row[TCP_TWKILL_SLOTS];
-static DEFINE_SPINLOCK(tw_death_lock);
-static struct timer_list tcp_tw_timer = TIMER_INITIALIZER(tcp_twkill, 0, 0);
-static void twkill_work(void *);
-static DECLARE_WORK(tcp_twkill_work, twkill_work, NULL);
-static u32 twkill_thread_slots;
+	/* @to is only non-empty when the reaper fell behind by
+	 * a whole TIME_WAIT period.
+	 */
+	while (*pprev)
+		pprev = &(*pprev)->next;
+	*pprev = from->first;
+	from->first->pprev = pprev;
+	INIT_HLIST_HEAD(from);
+}
 
-/* Returns non-zero if quota exceeded.  */
-static int tcp_do_twkill_work(int slot, unsigned int quota)
+/* Destroys at most quota buckets from reap list slot, returns how many.  */
+static int tcp_do_twkill_work(struct tcp_tw_death_row *row, int slot,
+			      int quota)
 {
 	struct tcp_tw_bucket *tw;
 	struct hlist_node *node;
-	unsigned int killed;
-	int ret;
+	int killed;
 
 	/* NOTE: compare this to previous version where lock
 	 * was released after detaching chain. It was racy,
@@ -440,21 +489,18 @@ static int tcp_do_twkill_work(int slot, unsigned int quota)
 	 * soft irqs are not sequenced.
 	 */
 	killed = 0;
-	ret = 0;
 rescan:
-	tw_for_each_inmate(tw, node, &tcp_tw_death_row[slot]) {
+	tw_for_each_inmate(tw, node, &row->reap[slot]) {
 		__tw_del_dead_node(tw);
-		spin_unlock(&tw_death_lock);
+		spin_unlock(&row->lock);
 		tcp_timewait_kill(tw);
 		tcp_tw_put(tw);
 		killed++;
-		spin_lock(&tw_death_lock);
-		if (killed > quota) {
-			ret = 1;
+		spin_lock(&row->lock);
+		if (killed >= quota)
 			break;
-		}
 
-		/* While we dropped tw_death_lock, another cpu may have
+		/* While we dropped the row lock, another cpu may have
 		 * killed off the next TW bucket in the list, therefore
 		 * do a fresh re-read of the hlist head node with the
 		 * lock reacquired.  We still use the hlist traversal
@@ -463,68 +509,61 @@ rescan:
 		goto rescan;
 	}
 
-	tcp_tw_count -= killed;
+	row->tw_count -= killed;
+	atomic_sub(killed, &tcp_tw_count);
 	NET_ADD_STATS_BH(LINUX_MIB_TIMEWAITED, killed);
 
-	return ret;
+	return killed;
 }
 
-static void tcp_twkill(unsigned long dummy)
+static void tcp_twkill(unsigned long data)
 {
-	int need_timer, ret;
+	struct tcp_tw_death_row *row = (struct tcp_tw_death_row *)data;
+	unsigned long now = jiffies;
+	unsigned long lag = 0;
+	int quota = tcp_tw_reap_quota();
+	int i, killed;
 
-	spin_lock(&tw_death_lock);
+	spin_lock(&row->lock);
 
-	if (tcp_tw_count == 0)
+	if (row->tw_count == 0) {
+		row->reap_slots = 0;
 		goto out;
-
-	need_timer = 0;
-	ret = tcp_do_twkill_work(tcp_tw_death_row_slot, TCP_TWKILL_QUOTA);
-	if (ret) {
-		twkill_thread_slots |= (1 << tcp_tw_death_row_slot);
-		mb();
-		schedule_work(&tcp_twkill_work);
-		need_timer = 1;
-	} else {
-		/* We purged the entire slot, anything left?  */
-		if (tcp_tw_count)
-			need_timer = 1;
 	}
-	tcp_tw_death_row_slot =
-		((tcp_tw_death_row_slot + 1) & (TCP_TWKILL_SLOTS - 1));
-	if (need_timer)
-		mod_timer(&tcp_tw_timer, jiffies + TCP_TWKILL_PERIOD);
-out:
-	spin_unlock(&tw_death_lock);
-}
 
-extern void twkill_slots_invalid(void);
+	if (time_after_eq(now, row->period_end)) {
+		/* The hand reached this slot, all of it is due now. */
+		i = row->slot;
+		tw_move_inmates(&row->cells[i], &row->reap[i]);
+		if (!hlist_empty(&row->reap[i]) &&
+		    !(row->reap_slots & (1 << i))) {
+			row->reap_slots |= (1 << i);
+			row->reap_due[i] = row->period_end;
+		}
+		row->slot = (i + 1) & (TCP_TWKILL_SLOTS - 1);
+		row->period_end = now + TCP_TWKILL_PERIOD;
+	}
 
-static void twkill_work(void *dummy)
-{
-	int i;
-
-	if ((TCP_TWKILL_SLOTS - 1) > (sizeof(twkill_thread_slots) * 8))
-		twkill_slots_invalid();
-
-	while (twkill_thread_slots) {
-		spin_lock_bh(&tw_death_lock);
-		for (i = 0; i < TCP_TWKILL_SLOTS; i++) {
-			if (!(twkill_thread_slots & (1 << i)))
-				continue;
-
-			while (tcp_do_twkill_work(i, TCP_TWKILL_QUOTA) != 0) {
-				if (need_resched()) {
-					spin_unlock_bh(&tw_death_lock);
-					schedule();
-					spin_lock_bh(&tw_death_lock);
-				}
-			}
+	for (i = 0; i < TCP_TWKILL_SLOTS && quota > 0; i++) {
+		if (!(row->reap_slots & (1 << i)))
+			continue;
 
-			twkill_thread_slots &= ~(1 << i);
-		}
-		spin_unlock_bh(&tw_death_lock);
+		killed = tcp_do_twkill_work(row, i, quota);
+		lag += (now - row->reap_due[i]) * killed;
+		quota -= killed;
+		if (hlist_empty(&row->reap[i]))
+			row->reap_slots &= ~(1 << i);
 	}
+	NET_ADD_STATS_BH(LINUX_MIB_TWREAPLAG, jiffies_to_msecs(lag));
+
+	if (row->reap_slots) {
+		/* Out of quota, continue on the next tick. */
+		NET_INC_STATS_BH(LINUX_MIB_TWREAPDEFERRED);
+		mod_timer(&row->tw_timer, now + 1);
+	} else if (row->tw_count)
+		mod_timer(&row->tw_timer, row->period_end);
+out:
+	spin_unlock(&row->lock);
 }
 
 /* These are always called from BH context.  See callers in
@@ -534,27 +573,22 @@ static void twkill_work(void *dummy)
 /* This is for handling early-kills of TIME_WAIT sockets. */
 void tcp_tw_deschedule(struct tcp_tw_bucket *tw)
 {
-	spin_lock(&tw_death_lock);
+	struct tcp_tw_death_row *row = tcp_tw_row(tw);
+
+	spin_lock(&row->lock);
 	if (tw_del_dead_node(tw)) {
 		tcp_tw_put(tw);
-		if (--tcp_tw_count == 0)
-			del_timer(&tcp_tw_timer);
+		atomic_dec(&tcp_tw_count);
+		if (--row->tw_count == 0)
+			del_timer(&row->tw_timer);
 	}
-	spin_unlock(&tw_death_lock);
+	spin_unlock(&row->lock);
 	tcp_timewait_kill(tw);
 }
 
-/* Short-time timewait calendar */
-
-static int tcp_twcal_hand = -1;
-static int tcp_twcal_jiffie;
-static void tcp_twcal_tick(unsigned long);
-static struct timer_list tcp_twcal_timer =
-		TIMER_INITIALIZER(tcp_twcal_tick, 0, 0);
-static struct hlist_head tcp_twcal_row[TCP_TW_RECYCLE_SLOTS];
-
 static void tcp_tw_schedule(struct tcp_tw_bucket *tw, int timeo)
 {
+	struct tcp_tw_death_row *row = tcp_tw_row(tw);
 	struct hlist_head *list;
 	int slot;
 
@@ -584,13 +618,15 @@ static void tcp_tw_schedule(struct tcp_tw_bucket *tw, int timeo)
 	 */
 	slot = (timeo + (1<<TCP_TW_RECYCLE_TICK) - 1) >> TCP_TW_RECYCLE_TICK;
 
-	spin_lock(&tw_death_lock);
+	spin_lock(&row->lock);
 
 	/* Unlink it, if it was scheduled */
 	if (tw_del_dead_node(tw))
-		tcp_tw_count--;
-	else
+		row->tw_count--;
+	else {
 		atomic_inc(&tw->tw_refcnt);
+		atomic_inc(&tcp_tw_count);
+	}
 
 	if (slot >= TCP_TW_RECYCLE_SLOTS) {
 		/* Schedule to slow timer */
@@ -602,45 +638,52 @@ static void tcp_tw_schedule(struct tcp_tw_bucket *tw, int timeo)
 				slot = TCP_TWKILL_SLOTS-1;
 		}
 		tw->tw_ttd = jiffies + timeo;
-		slot = (tcp_tw_death_row_slot + slot) & (TCP_TWKILL_SLOTS - 1);
-		list = &tcp_tw_death_row[slot];
+		slot = (row->slot + slot) & (TCP_TWKILL_SLOTS - 1);
+		list = &row->cells[slot];
 	} else {
 		tw->tw_ttd = jiffies + (slot << TCP_TW_RECYCLE_TICK);
 
-		if (tcp_twcal_hand < 0) {
-			tcp_twcal_hand = 0;
-			tcp_twcal_jiffie = jiffies;
-			tcp_twcal_timer.expires = tcp_twcal_jiffie + (slot<<TCP_TW_RECYCLE_TICK);
-			add_timer(&tcp_twcal_timer);
+		if (row->twcal_hand < 0) {
+			row->twcal_hand = 0;
+			row->twcal_jiffie = jiffies;
+			row->twcal_timer.expires = row->twcal_jiffie + (slot<<TCP_TW_RECYCLE_TICK);
+			add_timer(&row->twcal_timer);
 		} else {
-			if (time_after(tcp_twcal_timer.expires, jiffies + (slot<<TCP_TW_RECYCLE_TICK)))
-				mod_timer(&tcp_twcal_timer, jiffies + (slot<<TCP_TW_RECYCLE_TICK));
-			slot = (tcp_twcal_hand + slot)&(TCP_TW_RECYCLE_SLOTS-1);
+			if (time_after(row->twcal_timer.expires, jiffies + (slot<<TCP_TW_RECYCLE_TICK)))
+				mod_timer(&row->twcal_timer, jiffies + (slot<<TCP_TW_RECYCLE_TICK));
+			slot = (row->twcal_hand + slot)&(TCP_TW_RECYCLE_SLOTS-1);
 		}
-		list = &tcp_twcal_row[slot];
+		list = &row->twcal_row[slot];
 	}
 
 	hlist_add_head(&tw->tw_death_node, list);
 
-	if (tcp_tw_count++ == 0)
-		mod_timer(&tcp_tw_timer, jiffies+TCP_TWKILL_PERIOD);
-	spin_unlock(&tw_death_lock);
+	if (row->tw_count++ == 0) {
+		row->period_end = jiffies + TCP_TWKILL_PERIOD;
+		mod_timer(&row->tw_timer, row->period_end);
+	}
+	spin_unlock(&row->lock);
 }
 
-void tcp_twcal_tick(unsigned long dummy)
+/* Short-time timewait calendar */
+
+static void tcp_twcal_tick(unsigned long data)
 {
+	struct tcp_tw_death_row *row = (struct tcp_tw_death_row *)data;
 	int n, slot;
 	unsigned long j;
 	unsigned long now = jiffies;
+	unsigned long lag = 0;
+	int quota = tcp_tw_reap_quota();
 	int killed = 0;
 	int adv = 0;
 
-	spin_lock(&tw_death_lock);
-	if (tcp_twcal_hand < 0)
+	spin_lock(&row->lock);
+	if (row->twcal_hand < 0)
 		goto out;
 
-	slot = tcp_twcal_hand;
-	j = tcp_twcal_jiffie;
+	slot = row->twcal_hand;
+	j = row->twcal_jiffie;
 
 	for (n=0; n<TCP_TW_RECYCLE_SLOTS; n++) {
 		if (time_before_eq(j, now)) {
@@ -648,8 +691,20 @@ void tcp_twcal_tick(unsigned long dummy)
 			struct tcp_tw_bucket *tw;
 
 			tw_for_each_inmate_safe(tw, node, safe,
-					   &tcp_twcal_row[slot]) {
+					   &row->twcal_row[slot]) {
+				if (killed >= quota) {
+					/* Keep the hand here and finish
+					 * this slot on the next tick.
+					 */
+					row->twcal_jiffie = j;
+					row->twcal_hand = slot;
+					mod_timer(&row->twcal_timer, now + 1);
+					NET_INC_STATS_BH(LINUX_MIB_TWREAPDEFERRED);
+					goto out;
+				}
 				__tw_del_dead_node(tw);
+				if (time_after(now, tw->tw_ttd))
+					lag += now - tw->tw_ttd;
 				tcp_timewait_kill(tw);
 				tcp_tw_put(tw);
 				killed++;
@@ -657,25 +712,45 @@ void tcp_twcal_tick(unsigned long dummy)
 		} else {
 			if (!adv) {
 				adv = 1;
-				tcp_twcal_jiffie = j;
-				tcp_twcal_hand = slot;
+				row->twcal_jiffie = j;
+				row->twcal_hand = slot;
 			}
 
-			if (!hlist_empty(&tcp_twcal_row[slot])) {
-				mod_timer(&tcp_twcal_timer, j);
+			if (!hlist_empty(&row->twcal_row[slot])) {
+				mod_timer(&row->twcal_timer, j);
 				goto out;
 			}
 		}
 		j += (1<<TCP_TW_RECYCLE_TICK);
 		slot = (slot+1)&(TCP_TW_RECYCLE_SLOTS-1);
 	}
-	tcp_twcal_hand = -1;
+	row->twcal_hand = -1;
 
 out:
-	if ((tcp_tw_count -= killed) == 0)
-		del_timer(&tcp_tw_timer);
+	atomic_sub(killed, &tcp_tw_count);
+	if ((row->tw_count -= killed) == 0)
+		del_timer(&row->tw_timer);
 	NET_ADD_STATS_BH(LINUX_MIB_TIMEWAITKILLED, killed);
-	spin_unlock(&tw_death_lock);
+	NET_ADD_STATS_BH(LINUX_MIB_TWREAPLAG, jiffies_to_msecs(lag));
+	spin_unlock(&row->lock);
+}
+
+void __init tcp_tw_init(void)
+{
+	int cpu;
+
+	for_each_cpu(cpu) {
+		struct tcp_tw_death_row *row = &per_cpu(tcp_death_row, cpu);
+
+		spin_lock_init(&row->lock);
+		init_timer(&row->tw_timer);
+		row->tw_timer.function = tcp_twkill;
+		row->tw_timer.data = (unsigned long)row;
+		init_timer(&row->twcal_timer);
+		row->twcal_timer.function = tcp_twcal_tick;
+		row->twcal_timer.data = (unsigned long)row;
+		row->twcal_hand = -1;
+	}
 }
 
 /* This is not only more efficient than what we used to do, it eliminates
@@ -843,7 +918,10 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct open_request *req,
 		if (newtp->ecn_flags&TCP_ECN_OK)
 			sock_set_flag(newsk, SOCK_NO_LARGESEND);
 
-		tcp_ca_init(newtp);
+		/* The child inherits the listener's congestion control */
+		if (!try_module_get(newtp->ca_ops->owner))
+			newtp->ca_ops = &tcp_init_congestion_ops;
+		tcp_init_congestion_control(newtp);
 
 		TCP_INC_STATS_BH(TCP_MIB_PASSIVEOPENS);
 	}
@@ -868,7 +946,7 @@ struct sock *tcp_check_req(struct sock *sk,struct sk_buff *skb,
 
 	tmp_opt.saw_tstamp = 0;
 	if (th->doff > (sizeof(struct tcphdr)>>2)) {
-		tcp_parse_options(skb, &tmp_opt, 0);
+		tcp_parse_options(skb, &tmp_opt, 0, NULL);
 
 		if (tmp_opt.saw_tstamp) {
 			tmp_opt.ts_recent = req->ts_recent;
@@ -111,8 +111,7 @@ static void tcp_cwnd_restart(struct tcp_sock *tp, struct dst_entry *dst)
 	u32 restart_cwnd = tcp_init_cwnd(tp, dst);
 	u32 cwnd = tp->snd_cwnd;
 
-	if (tcp_is_vegas(tp)) 
-		tcp_vegas_enable(tp);
+	tcp_ca_event(tp, CA_EVENT_CWND_RESTART);
 
 	tp->snd_ssthresh = tcp_current_ssthresh(tp);
 	restart_cwnd = min(restart_cwnd, cwnd);
@@ -282,20 +281,25 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb)
 
 		sysctl_flags = 0;
 		if (tcb->flags & TCPCB_FLAG_SYN) {
+			/* A SYN-ACK only echoes what the peer's SYN offered. */
+			int synack = tcb->flags & TCPCB_FLAG_ACK;
+
 			tcp_header_size = sizeof(struct tcphdr) + TCPOLEN_MSS;
-			if(sysctl_tcp_timestamps) {
+			if(synack ? tp->rx_opt.tstamp_ok : sysctl_tcp_timestamps) {
 				tcp_header_size += TCPOLEN_TSTAMP_ALIGNED;
 				sysctl_flags |= SYSCTL_FLAG_TSTAMPS;
 			}
-			if(sysctl_tcp_window_scaling) {
+			if(synack ? tp->rx_opt.wscale_ok : sysctl_tcp_window_scaling) {
 				tcp_header_size += TCPOLEN_WSCALE_ALIGNED;
 				sysctl_flags |= SYSCTL_FLAG_WSCALE;
 			}
-			if(sysctl_tcp_sack) {
+			if(synack ? tp->rx_opt.sack_ok : sysctl_tcp_sack) {
 				sysctl_flags |= SYSCTL_FLAG_SACK;
 				if(!(sysctl_flags & SYSCTL_FLAG_TSTAMPS))
 					tcp_header_size += TCPOLEN_SACKPERM_ALIGNED;
 			}
+			if (tp->fastopen_req)
+				tcp_header_size += tcp_fastopen_option_len(&tp->fastopen_req->cookie);
 		} else if (tp->rx_opt.eff_sacks) {
 			/* A SACK is 2 pad bytes, a 2 byte header, plus
 			 * 2 32-bit sequence numbers for each SACK block.
@@ -304,17 +308,11 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb)
 					    (tp->rx_opt.eff_sacks * TCPOLEN_SACK_PERBLOCK));
 		}
 		
-		/*
-		 * If the connection is idle and we are restarting,
-		 * then we don't want to do any Vegas calculations
-		 * until we get fresh RTT samples.  So when we
-		 * restart, we reset our Vegas state to a clean
-		 * slate. After we get acks for this flight of
-		 * packets, _then_ we can make Vegas calculations
-		 * again.
+		/* Let the congestion control (e.g. Vegas) know that an
+		 * idle connection restarts, its old samples are stale.
 		 */
-		if (tcp_is_vegas(tp) && tcp_packets_in_flight(tp) == 0)
-			tcp_vegas_enable(tp);
+		if (tcp_packets_in_flight(tp) == 0)
+			tcp_ca_event(tp, CA_EVENT_TX_START);
 
 		th = (struct tcphdr *) skb_push(skb, tcp_header_size);
 		skb->h.th = th;
@@ -344,14 +342,18 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb)
 		}
 
 		if (tcb->flags & TCPCB_FLAG_SYN) {
-			tcp_syn_build_options((__u32 *)(th + 1),
-					      tcp_advertise_mss(sk),
-					      (sysctl_flags & SYSCTL_FLAG_TSTAMPS),
-					      (sysctl_flags & SYSCTL_FLAG_SACK),
-					      (sysctl_flags & SYSCTL_FLAG_WSCALE),
-					      tp->rx_opt.rcv_wscale,
-					      tcb->when,
-		      			      tp->rx_opt.ts_recent);
+			__u32 *ptr;
+
+			ptr = tcp_syn_build_options((__u32 *)(th + 1),
+						    tcp_advertise_mss(sk),
+						    (sysctl_flags & SYSCTL_FLAG_TSTAMPS),
+						    (sysctl_flags & SYSCTL_FLAG_SACK),
+						    (sysctl_flags & SYSCTL_FLAG_WSCALE),
+						    tp->rx_opt.rcv_wscale,
+						    tcb->when,
+						    tp->rx_opt.ts_recent);
+			if (tp->fastopen_req && tp->fastopen_req->cookie.len >= 0)
+				tcp_fastopen_build_option(ptr, &tp->fastopen_req->cookie);
 		} else {
 			tcp_build_and_update_options((__u32 *)(th + 1),
 						     tp, tcb->when);
@@ -485,6 +487,12 @@ static int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len)
 		return -ENOMEM; /* We'll just try again later. */
 	sk_charge_skb(sk, buff);
 
+	/* Splitting a sent segment changes the packet counts the
+	 * retransmit queue hints rely on.
+	 */
+	if (before(TCP_SKB_CB(skb)->seq, tp->snd_nxt))
+		tcp_clear_all_retrans_hints(tp);
+
 	/* Correct the sequence numbers. */
 	TCP_SKB_CB(buff)->seq = TCP_SKB_CB(skb)->seq + len;
 	TCP_SKB_CB(buff)->end_seq = TCP_SKB_CB(skb)->end_seq;
@@ -591,6 +599,7 @@ int tcp_trim_head(struct sock *sk, struct sk_buff *skb, u32 len)
 
 	TCP_SKB_CB(skb)->seq += len;
 	skb->ip_summed = CHECKSUM_HW;
+	tcp_clear_all_retrans_hints(tcp_sk(sk));
 
 	skb->truesize	     -= len;
 	sk->sk_wmem_queued   -= len;
@@ -930,6 +939,7 @@ static void tcp_retrans_try_collapse(struct sock *sk, struct sk_buff *skb, int m
 
 		/* Ok.  We will be able to collapse the packet. */
 		__skb_unlink(next_skb, next_skb->list);
+		tcp_clear_all_retrans_hints(tp);
 
 		memcpy(skb_put(skb, next_skb_size), next_skb->data, next_skb_size);
 
@@ -1000,6 +1010,7 @@ void tcp_simple_retransmit(struct sock *sk)
 	if (!lost)
 		return;
 
+	tcp_clear_retrans_hints_partial(tp);
 	tcp_sync_left_out(tp);
 
  	/* Don't muck with the congestion window here.
@@ -1122,6 +1133,8 @@ int tcp_retransmit_skb(struct sock *sk, struct sk_buff *skb)
 		}
 #endif
 		TCP_SKB_CB(skb)->sacked |= TCPCB_RETRANS;
+		if (!tp->retrans_out)
+			tp->lost_retrans_low = tp->snd_nxt;
 		tp->retrans_out += tcp_skb_pcount(skb);
 
 		/* Save stamp of the first retransmit. */
@@ -1131,7 +1144,7 @@ int tcp_retransmit_skb(struct sock *sk, struct sk_buff *skb)
 		tp->undo_retrans++;
 
 		/* snd_nxt is stored to detect loss of retransmitted segment,
-		 * see tcp_input.c tcp_sacktag_write_queue().
+		 * see tcp_input.c tcp_mark_lost_retrans().
 		 */
 		TCP_SKB_CB(skb)->ack_seq = tp->snd_nxt;
 	}
@@ -1150,13 +1163,27 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct sk_buff *skb;
-	int packet_cnt = tp->lost_out;
+	int packet_cnt;
+
+	/* First pass: retransmit lost packets. Resume after the
+	 * segments handled last time, packet_cnt counts the lost
+	 * packets in front of skb.
+	 */
+	if (tp->retransmit_skb_hint) {
+		skb = tp->retransmit_skb_hint;
+		packet_cnt = tp->retransmit_cnt_hint;
+	} else {
+		skb = sk->sk_write_queue.next;
+		packet_cnt = 0;
+	}
 
-	/* First pass: retransmit lost packets. */
-	if (packet_cnt) {
-		sk_stream_for_retrans_queue(skb, sk) {
+	if (tp->lost_out) {
+		sk_stream_for_retrans_queue_from(skb, sk) {
 			__u8 sacked = TCP_SKB_CB(skb)->sacked;
 
+			tp->retransmit_skb_hint = skb;
+			tp->retransmit_cnt_hint = packet_cnt;
+
 			/* Assume this retransmit will generate
 			 * only one packet for congestion window
 			 * calculation purposes.  This works because
@@ -1169,8 +1196,10 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 
 			if (sacked&TCPCB_LOST) {
 				if (!(sacked&(TCPCB_SACKED_ACKED|TCPCB_SACKED_RETRANS))) {
-					if (tcp_retransmit_skb(sk, skb))
+					if (tcp_retransmit_skb(sk, skb)) {
+						tp->retransmit_skb_hint = NULL;
 						return;
+					}
 					if (tp->ca_state != TCP_CA_Loss)
 						NET_INC_STATS_BH(LINUX_MIB_TCPFASTRETRANS);
 					else
@@ -1181,8 +1210,8 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 						tcp_reset_xmit_timer(sk, TCP_TIME_RETRANS, tp->rto);
 				}
 
-				packet_cnt -= tcp_skb_pcount(skb);
-				if (packet_cnt <= 0)
+				packet_cnt += tcp_skb_pcount(skb);
+				if (packet_cnt >= tp->lost_out)
 					break;
 			}
 		}
@@ -1208,9 +1237,18 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 	if (tcp_may_send_now(sk, tp))
 		return;
 
-	packet_cnt = 0;
+	if (tp->forward_skb_hint) {
+		skb = tp->forward_skb_hint;
+		packet_cnt = tp->forward_cnt_hint;
+	} else {
+		skb = sk->sk_write_queue.next;
+		packet_cnt = 0;
+	}
+
+	sk_stream_for_retrans_queue_from(skb, sk) {
+		tp->forward_skb_hint = skb;
+		tp->forward_cnt_hint = packet_cnt;
 
-	sk_stream_for_retrans_queue(skb, sk) {
 		/* Similar to the retransmit loop above we
 		 * can pretend that the retransmitted SKB
 		 * we send out here will be composed of one
@@ -1227,8 +1265,10 @@ void tcp_xmit_retransmit_queue(struct sock *sk)
 			continue;
 
 		/* Ok, retransmit it. */
-		if (tcp_retransmit_skb(sk, skb))
+		if (tcp_retransmit_skb(sk, skb)) {
+			tp->forward_skb_hint = NULL;
 			break;
+		}
 
 		if (skb == skb_peek(&sk->sk_write_queue))
 			tcp_reset_xmit_timer(sk, TCP_TIME_RETRANS, tp->rto);
@@ -1349,6 +1389,39 @@ int tcp_send_synack(struct sock *sk)
 	return tcp_transmit_skb(sk, skb_clone(skb, GFP_ATOMIC));
 }
 
+/* A fast open child answers the SYN itself.  Its SYN-ACK sits on the
+ * write queue and is retransmitted like any other segment until the
+ * handshake completes.
+ */
+int tcp_queue_synack(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct sk_buff *skb;
+
+	skb = alloc_skb(MAX_TCP_HEADER + 15, GFP_ATOMIC);
+	if (unlikely(skb == NULL))
+		return -ENOBUFS;
+
+	/* Reserve space for headers. */
+	skb_reserve(skb, MAX_TCP_HEADER);
+
+	TCP_SKB_CB(skb)->flags = TCPCB_FLAG_SYN | TCPCB_FLAG_ECE;
+	TCP_SKB_CB(skb)->sacked = 0;
+	skb_shinfo(skb)->tso_segs = 1;
+	skb_shinfo(skb)->tso_size = 0;
+	skb->csum = 0;
+	TCP_SKB_CB(skb)->seq = tp->snd_una;
+	TCP_SKB_CB(skb)->end_seq = tp->snd_una + 1;
+	tp->retrans_stamp = tcp_time_stamp;
+	skb_header_release(skb);
+	__skb_queue_tail(&sk->sk_write_queue, skb);
+	sk_charge_skb(sk, skb);
+	tp->packets_out += tcp_skb_pcount(skb);
+
+	tcp_reset_xmit_timer(sk, TCP_TIME_RETRANS, tp->rto);
+	return tcp_send_synack(sk);
+}
+
 /*
  * Prepare a SYN-ACK.
  */
@@ -1356,9 +1429,11 @@ struct sk_buff * tcp_make_synack(struct sock *sk, struct dst_entry *dst,
 				 struct open_request *req)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_fastopen_cookie foc = { .len = -1 };
 	struct tcphdr *th;
 	int tcp_header_size;
 	struct sk_buff *skb;
+	__u32 *ptr;
 
 	skb = sock_wmalloc(sk, MAX_TCP_HEADER + 15, 1, GFP_ATOMIC);
 	if (skb == NULL)
@@ -1369,11 +1444,17 @@ struct sk_buff * tcp_make_synack(struct sock *sk, struct dst_entry *dst,
 
 	skb->dst = dst_clone(dst);
 
+	/* Only IPv4 listeners hand out fast open cookies. */
+	if (req->fastopen_cookie)
+		tcp_fastopen_cookie_gen(req->af.v4_req.rmt_addr,
+					req->af.v4_req.loc_addr, &foc);
+
 	tcp_header_size = (sizeof(struct tcphdr) + TCPOLEN_MSS +
 			   (req->tstamp_ok ? TCPOLEN_TSTAMP_ALIGNED : 0) +
 			   (req->wscale_ok ? TCPOLEN_WSCALE_ALIGNED : 0) +
 			   /* SACK_PERM is in the place of NOP NOP of TS */
-			   ((req->sack_ok && !req->tstamp_ok) ? TCPOLEN_SACKPERM_ALIGNED : 0));
+			   ((req->sack_ok && !req->tstamp_ok) ? TCPOLEN_SACKPERM_ALIGNED : 0) +
+			   tcp_fastopen_option_len(&foc));
 	skb->h.th = th = (struct tcphdr *) skb_push(skb, tcp_header_size);
 
 	memset(th, 0, sizeof(struct tcphdr));
@@ -1409,10 +1490,12 @@ struct sk_buff * tcp_make_synack(struct sock *sk, struct dst_entry *dst,
 	th->window = htons(req->rcv_wnd);
 
 	TCP_SKB_CB(skb)->when = tcp_time_stamp;
-	tcp_syn_build_options((__u32 *)(th + 1), dst_metric(dst, RTAX_ADVMSS), req->tstamp_ok,
-			      req->sack_ok, req->wscale_ok, req->rcv_wscale,
-			      TCP_SKB_CB(skb)->when,
-			      req->ts_recent);
+	ptr = tcp_syn_build_options((__u32 *)(th + 1), dst_metric(dst, RTAX_ADVMSS), req->tstamp_ok,
+				    req->sack_ok, req->wscale_ok, req->rcv_wscale,
+				    TCP_SKB_CB(skb)->when,
+				    req->ts_recent);
+	if (foc.len >= 0)
+		tcp_fastopen_build_option(ptr, &foc);
 
 	skb->csum = 0;
 	th->doff = (tcp_header_size >> 2);
@@ -1445,7 +1528,6 @@ static inline void tcp_connect_init(struct sock *sk)
 		tp->window_clamp = dst_metric(dst, RTAX_WINDOW);
 	tp->advmss = dst_metric(dst, RTAX_ADVMSS);
 	tcp_initialize_rcv_mss(sk);
-	tcp_ca_init(tp);
 
 	tcp_select_initial_window(tcp_full_space(sk),
 				  tp->advmss - (tp->rx_opt.ts_recent_stamp ? tp->tcp_header_len - sizeof(struct tcphdr) : 0),
@@ -1472,6 +1554,74 @@ static inline void tcp_connect_init(struct sock *sk)
 	tcp_clear_retrans(tp);
 }
 
+/* Fast open: send the SYN with the cookie this server gave us before
+ * and as much of the caller's data as fits into one segment.  The data
+ * is queued as a segment of its own behind the bare SYN, so if the
+ * server only acknowledges the SYN, it is sent again like any other
+ * data.  Without a cookie the SYN asks for one.
+ */
+static void tcp_send_syn_data(struct sock *sk, struct sk_buff *syn)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_fastopen_request *fo = tp->fastopen_req;
+	struct sk_buff *data, *syn_data;
+	int space;
+
+	tcp_fastopen_cache_get(sk, &fo->cookie);
+	if (fo->cookie.len <= 0)
+		goto fallback;
+
+	/* The SYN options the MSS does not account for. */
+	space = tp->mss_cache_std - (TCPOLEN_MSS + TCPOLEN_WSCALE_ALIGNED +
+				     TCPOLEN_SACKPERM_ALIGNED +
+				     tcp_fastopen_option_len(&fo->cookie));
+	space = min_t(int, space, fo->size);
+	if (space <= 0)
+		goto fallback;
+
+	data = alloc_skb(MAX_TCP_HEADER + space, sk->sk_allocation);
+	if (unlikely(data == NULL))
+		goto fallback;
+
+	skb_reserve(data, MAX_TCP_HEADER);
+	if (memcpy_fromiovec(skb_put(data, space), fo->iov, space)) {
+		kfree_skb(data);
+		goto fallback;
+	}
+	data->csum = csum_partial(data->data, space, 0);
+
+	TCP_SKB_CB(data)->flags = TCPCB_FLAG_ACK | TCPCB_FLAG_PSH;
+	TCP_SKB_CB(data)->sacked = 0;
+	skb_shinfo(data)->tso_segs = 1;
+	skb_shinfo(data)->tso_size = 0;
+	TCP_SKB_CB(data)->seq = tp->write_seq;
+	TCP_SKB_CB(data)->end_seq = tp->write_seq + space;
+	TCP_SKB_CB(data)->when = TCP_SKB_CB(syn)->when;
+
+	tp->write_seq = TCP_SKB_CB(data)->end_seq;
+	tp->snd_nxt = tp->write_seq;
+	tp->pushed_seq = tp->write_seq;
+	skb_header_release(data);
+	__skb_queue_tail(&sk->sk_write_queue, data);
+	sk_charge_skb(sk, data);
+	tp->packets_out += tcp_skb_pcount(data);
+	fo->copied = space;
+
+	/* What goes on the wire is the SYN with the data in it. */
+	syn_data = skb_clone(data, sk->sk_allocation);
+	if (unlikely(syn_data == NULL))
+		goto fallback;
+
+	TCP_SKB_CB(syn_data)->seq = TCP_SKB_CB(syn)->seq;
+	TCP_SKB_CB(syn_data)->flags = TCP_SKB_CB(syn)->flags;
+	NET_INC_STATS(LINUX_MIB_TCPFASTOPENACTIVE);
+	tcp_transmit_skb(sk, syn_data);
+	return;
+
+fallback:
+	tcp_transmit_skb(sk, skb_clone(syn, sk->sk_allocation));
+}
+
 /*
  * Build a SYN and send it off.
  */ 
@@ -1499,7 +1649,7 @@ int tcp_connect(struct sock *sk)
 	TCP_SKB_CB(buff)->end_seq = tp->write_seq;
 	tp->snd_nxt = tp->write_seq;
 	tp->pushed_seq = tp->write_seq;
-	tcp_ca_init(tp);
+	tcp_init_congestion_control(tp);
 
 	/* Send it off. */
 	TCP_SKB_CB(buff)->when = tcp_time_stamp;
@@ -1508,7 +1658,12 @@ int tcp_connect(struct sock *sk)
 	__skb_queue_tail(&sk->sk_write_queue, buff);
 	sk_charge_skb(sk, buff);
 	tp->packets_out += tcp_skb_pcount(buff);
-	tcp_transmit_skb(sk, skb_clone(buff, GFP_KERNEL));
+	if (tp->fastopen_req) {
+		tcp_send_syn_data(sk, buff);
+		/* Retransmitted SYNs go without cookie and data. */
+		tp->fastopen_req = NULL;
+	} else
+		tcp_transmit_skb(sk, skb_clone(buff, GFP_KERNEL));
 	TCP_INC_STATS(TCP_MIB_ACTIVEOPENS);
 
 	/* Timer for repeating the SYN until an answer. */
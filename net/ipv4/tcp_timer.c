@@ -471,7 +471,7 @@ static void tcp_synack_timer(struct sock *sk)
 	struct open_request **reqp, *req;
 	int i, budget;
 
-	if (lopt == NULL || lopt->qlen == 0)
+	if (lopt == NULL || tcp_synq_len(lopt) == 0)
 		return;
 
 	/* Normally all the openreqs are young and become mature
@@ -491,11 +491,11 @@ static void tcp_synack_timer(struct sock *sk)
 	 * embrions; and abort old ones without pity, if old
 	 * ones are about to clog our table.
 	 */
-	if (lopt->qlen>>(lopt->max_qlen_log-1)) {
-		int young = (lopt->qlen_young<<1);
+	if (tcp_synq_len(lopt)>>(lopt->max_qlen_log-1)) {
+		int young = (tcp_synq_young(lopt)<<1);
 
 		while (thresh > 2) {
-			if (lopt->qlen < young)
+			if (tcp_synq_len(lopt) < young)
 				break;
 			thresh--;
 			young <<= 1;
@@ -505,7 +505,7 @@ static void tcp_synack_timer(struct sock *sk)
 	if (tp->defer_accept)
 		max_retries = tp->defer_accept;
 
-	budget = 2*(TCP_SYNQ_HSIZE/(TCP_TIMEOUT_INIT/TCP_SYNQ_INTERVAL));
+	budget = 2*(lopt->nr_table_entries/(TCP_TIMEOUT_INIT/TCP_SYNQ_INTERVAL));
 	i = lopt->clock_hand;
 
 	do {
@@ -518,7 +518,7 @@ static void tcp_synack_timer(struct sock *sk)
 					unsigned long timeo;
 
 					if (req->retrans++ == 0)
-						lopt->qlen_young--;
+						atomic_dec(&lopt->qlen_young);
 					timeo = min((TCP_TIMEOUT_INIT << req->retrans),
 						    TCP_RTO_MAX);
 					req->expires = now + timeo;
@@ -527,25 +527,21 @@ static void tcp_synack_timer(struct sock *sk)
 				}
 
 				/* Drop this request */
-				write_lock(&tp->syn_wait_lock);
-				*reqp = req->dl_next;
-				write_unlock(&tp->syn_wait_lock);
-				lopt->qlen--;
-				if (req->retrans == 0)
-					lopt->qlen_young--;
+				tcp_synq_unlink(tp, req, reqp);
+				tcp_synq_removed(sk, req);
 				tcp_openreq_free(req);
 				continue;
 			}
 			reqp = &req->dl_next;
 		}
 
-		i = (i+1)&(TCP_SYNQ_HSIZE-1);
+		i = (i+1)&(lopt->nr_table_entries-1);
 
 	} while (--budget > 0);
 
 	lopt->clock_hand = i;
 
-	if (lopt->qlen)
+	if (tcp_synq_len(lopt))
 		tcp_reset_keepalive_timer(sk, TCP_SYNQ_INTERVAL);
 }
 
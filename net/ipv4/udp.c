@@ -1047,42 +1047,68 @@ static int udp_queue_rcv_skb(struct sock * sk, struct sk_buff *skb)
 /*
  *	Multicasts and broadcasts go to each listener.
  *
- *	Note: called only from the BH handler context,
- *	so we don't need to lock the hashes.
+ *	The listeners are collected, with a reference held, while the
+ *	hash is locked, and the datagram is cloned and queued to them
+ *	after it is unlocked.  A group with hundreds of sockets then
+ *	holds up neither socket creation nor other receiving CPUs.
+ *	Small groups fit in an array on the stack.
+ *
+ *	Note: called only from the BH handler context.
  */
+#define UDP_MCAST_STACK	32
+
 static int udp_v4_mcast_deliver(struct sk_buff *skb, struct udphdr *uh,
 				 u32 saddr, u32 daddr)
 {
+	struct sock *stack[UDP_MCAST_STACK], **socks = stack;
+	int count = 0, size = UDP_MCAST_STACK;
 	struct sock *sk;
-	int dif;
+	int dif, i;
 
 	read_lock(&udp_hash_lock);
 	sk = sk_head(&udp_hash[ntohs(uh->dest) & (UDP_HTABLE_SIZE - 1)]);
 	dif = skb->dev->ifindex;
 	sk = udp_v4_mcast_next(sk, uh->dest, daddr, uh->source, saddr, dif);
-	if (sk) {
-		struct sock *sknext = NULL;
-
-		do {
-			struct sk_buff *skb1 = skb;
-
-			sknext = udp_v4_mcast_next(sk_next(sk), uh->dest, daddr,
-						   uh->source, saddr, dif);
-			if(sknext)
-				skb1 = skb_clone(skb, GFP_ATOMIC);
-
-			if(skb1) {
-				int ret = udp_queue_rcv_skb(sk, skb1);
-				if (ret > 0)
-					/* we should probably re-process instead
-					 * of dropping packets here. */
-					kfree_skb(skb1);
-			}
-			sk = sknext;
-		} while(sknext);
-	} else
-		kfree_skb(skb);
+	while (sk) {
+		if (count == size) {
+			struct sock **more;
+
+			more = kmalloc(2 * size * sizeof(*more), GFP_ATOMIC);
+			if (!more)
+				break;	/* deliver to those we have */
+			memcpy(more, socks, count * sizeof(*more));
+			if (socks != stack)
+				kfree(socks);
+			socks = more;
+			size *= 2;
+		}
+		sock_hold(sk);
+		socks[count++] = sk;
+		sk = udp_v4_mcast_next(sk_next(sk), uh->dest, daddr,
+				       uh->source, saddr, dif);
+	}
 	read_unlock(&udp_hash_lock);
+
+	for (i = 0; i < count; i++) {
+		struct sk_buff *skb1 = skb;
+
+		/* The last listener gets the original. */
+		if (i != count - 1)
+			skb1 = skb_clone(skb, GFP_ATOMIC);
+
+		if (skb1) {
+			int ret = udp_queue_rcv_skb(socks[i], skb1);
+			if (ret > 0)
+				/* we should probably re-process instead
+				 * of dropping packets here. */
+				kfree_skb(skb1);
+		}
+		sock_put(socks[i]);
+	}
+	if (!count)
+		kfree_skb(skb);
+	if (socks != stack)
+		kfree(socks);
 	return 0;
 }
 
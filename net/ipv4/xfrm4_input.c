@@ -11,6 +11,7 @@
 
 #include <linux/module.h>
 #include <linux/string.h>
+#include <linux/padata.h>
 #include <net/inet_ecn.h>
 #include <net/ip.h>
 #include <net/xfrm.h>
@@ -45,17 +46,94 @@ static int xfrm4_parse_spi(struct sk_buff *skb, u8 nexthdr, u32 *spi, u32 *seq)
 	return xfrm_parse_spi(skb, nexthdr, spi, seq);
 }
 
-int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
+/*
+ * Called after x has been applied.  In tunnel mode this strips the outer
+ * header and returns 1 with *decaps set.  Otherwise it looks for the next
+ * transform and returns what xfrm_parse_spi() returns: 0 if there is one,
+ * 1 if not, and <0 on errors.
+ */
+static int xfrm4_rcv_next(struct sk_buff *skb, struct xfrm_state *x,
+			  u32 *spi, u32 *seq, int *decaps)
+{
+	struct iphdr *iph = skb->nh.iph;
+
+	if (x->props.mode) {
+		if (iph->protocol != IPPROTO_IPIP)
+			return -EINVAL;
+		if (!pskb_may_pull(skb, sizeof(struct iphdr)))
+			return -EINVAL;
+		if (skb_cloned(skb) &&
+		    pskb_expand_head(skb, 0, 0, GFP_ATOMIC))
+			return -ENOMEM;
+		if (x->props.flags & XFRM_STATE_DECAP_DSCP)
+			ipv4_copy_dscp(iph, skb->h.ipiph);
+		if (!(x->props.flags & XFRM_STATE_NOECN))
+			ipip_ecn_decapsulate(skb);
+		skb->mac.raw = memmove(skb->data - skb->mac_len,
+				       skb->mac.raw, skb->mac_len);
+		skb->nh.raw = skb->data;
+		memset(&(IPCB(skb)->opt), 0, sizeof(struct ip_options));
+		*decaps = 1;
+		return 1;
+	}
+
+	return xfrm_parse_spi(skb, skb->nh.iph->protocol, spi, seq);
+}
+
+/* Record the applied transforms; the secpath takes over their references. */
+static int xfrm4_rcv_secpath(struct sk_buff *skb,
+			     struct sec_decap_state *xfrm_vec, int xfrm_nr)
+{
+	/* Allocate new secpath or COW existing one. */
+
+	if (!skb->sp || atomic_read(&skb->sp->refcnt) != 1) {
+		struct sec_path *sp;
+		sp = secpath_dup(skb->sp);
+		if (!sp)
+			return -ENOMEM;
+		if (skb->sp)
+			secpath_put(skb->sp);
+		skb->sp = sp;
+	}
+	if (xfrm_nr + skb->sp->len > XFRM_MAX_DEPTH)
+		return -EINVAL;
+
+	memcpy(skb->sp->x+skb->sp->len, xfrm_vec, xfrm_nr*sizeof(struct sec_decap_state));
+	skb->sp->len += xfrm_nr;
+	return 0;
+}
+
+static void xfrm4_rcv_decaps(struct sk_buff *skb)
+{
+	if (!(skb->dev->flags&IFF_LOOPBACK)) {
+		dst_release(skb->dst);
+		skb->dst = NULL;
+	}
+	netif_rx(skb);
+}
+
+#ifdef CONFIG_INET_XFRM_PARALLEL
+static void xfrm4_rcv_parallel(struct sk_buff *skb, struct xfrm_state *x,
+			       u32 seq, __u16 encap_type);
+
+static inline int xfrm4_rcv_parallel_ok(struct xfrm_state *x)
+{
+	return sysctl_xfrm4_parallel && xfrm4_input_pinst &&
+	       x->type->output_crypt;
+}
+#endif
+
+/*
+ * Apply the transforms from xfrm_vec[xfrm_nr] on, starting with the one
+ * identified by spi.  Returns what xfrm4_rcv_encap() returns.
+ */
+static int xfrm4_rcv_xfrms(struct sk_buff *skb,
+			   struct sec_decap_state *xfrm_vec, int xfrm_nr,
+			   u32 spi, u32 seq, __u16 encap_type)
 {
-	int err;
-	u32 spi, seq;
-	struct sec_decap_state xfrm_vec[XFRM_MAX_DEPTH];
 	struct xfrm_state *x;
-	int xfrm_nr = 0;
 	int decaps = 0;
-
-	if ((err = xfrm4_parse_spi(skb, skb->nh.iph->protocol, &spi, &seq)) != 0)
-		goto drop;
+	int err;
 
 	do {
 		struct iphdr *iph = skb->nh.iph;
@@ -77,6 +155,15 @@ int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
 		if (xfrm_state_check_expire(x))
 			goto drop_unlock;
 
+#ifdef CONFIG_INET_XFRM_PARALLEL
+		/* Only the outermost transform goes to another CPU. */
+		if (!xfrm_nr && xfrm4_rcv_parallel_ok(x)) {
+			spin_unlock(&x->lock);
+			xfrm4_rcv_parallel(skb, x, seq, encap_type);
+			return 0;
+		}
+#endif
+
 		xfrm_vec[xfrm_nr].decap.decap_type = encap_type;
 		if (x->type->input(x, &(xfrm_vec[xfrm_nr].decap), skb))
 			goto drop_unlock;
@@ -94,55 +181,15 @@ int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
 
 		xfrm_vec[xfrm_nr++].xvec = x;
 
-		iph = skb->nh.iph;
-
-		if (x->props.mode) {
-			if (iph->protocol != IPPROTO_IPIP)
-				goto drop;
-			if (!pskb_may_pull(skb, sizeof(struct iphdr)))
-				goto drop;
-			if (skb_cloned(skb) &&
-			    pskb_expand_head(skb, 0, 0, GFP_ATOMIC))
-				goto drop;
-			if (x->props.flags & XFRM_STATE_DECAP_DSCP)
-				ipv4_copy_dscp(iph, skb->h.ipiph);
-			if (!(x->props.flags & XFRM_STATE_NOECN))
-				ipip_ecn_decapsulate(skb);
-			skb->mac.raw = memmove(skb->data - skb->mac_len,
-					       skb->mac.raw, skb->mac_len);
-			skb->nh.raw = skb->data;
-			memset(&(IPCB(skb)->opt), 0, sizeof(struct ip_options));
-			decaps = 1;
-			break;
-		}
-
-		if ((err = xfrm_parse_spi(skb, skb->nh.iph->protocol, &spi, &seq)) < 0)
+		if ((err = xfrm4_rcv_next(skb, x, &spi, &seq, &decaps)) < 0)
 			goto drop;
 	} while (!err);
 
-	/* Allocate new secpath or COW existing one. */
-
-	if (!skb->sp || atomic_read(&skb->sp->refcnt) != 1) {
-		struct sec_path *sp;
-		sp = secpath_dup(skb->sp);
-		if (!sp)
-			goto drop;
-		if (skb->sp)
-			secpath_put(skb->sp);
-		skb->sp = sp;
-	}
-	if (xfrm_nr + skb->sp->len > XFRM_MAX_DEPTH)
+	if (xfrm4_rcv_secpath(skb, xfrm_vec, xfrm_nr))
 		goto drop;
 
-	memcpy(skb->sp->x+skb->sp->len, xfrm_vec, xfrm_nr*sizeof(struct sec_decap_state));
-	skb->sp->len += xfrm_nr;
-
 	if (decaps) {
-		if (!(skb->dev->flags&IFF_LOOPBACK)) {
-			dst_release(skb->dst);
-			skb->dst = NULL;
-		}
-		netif_rx(skb);
+		xfrm4_rcv_decaps(skb);
 		return 0;
 	} else {
 		return -skb->nh.iph->protocol;
@@ -158,3 +205,127 @@ drop:
 	kfree_skb(skb);
 	return 0;
 }
+
+int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
+{
+	u32 spi, seq;
+	struct sec_decap_state xfrm_vec[XFRM_MAX_DEPTH];
+
+	if (xfrm4_parse_spi(skb, skb->nh.iph->protocol, &spi, &seq) != 0) {
+		kfree_skb(skb);
+		return 0;
+	}
+
+	return xfrm4_rcv_xfrms(skb, xfrm_vec, 0, spi, seq, encap_type);
+}
+
+#ifdef CONFIG_INET_XFRM_PARALLEL
+struct xfrm4_rcv_job {
+	struct padata_priv	padata;
+	struct sk_buff		*skb;
+	u32			seq;
+	int			err;
+	struct sec_decap_state	xfrm_vec[XFRM_MAX_DEPTH];
+};
+
+static void xfrm4_rcv_job_parallel(struct padata_priv *padata)
+{
+	struct xfrm4_rcv_job *job = container_of(padata, struct xfrm4_rcv_job,
+						 padata);
+	struct xfrm_state *x = job->xfrm_vec[0].xvec;
+
+	job->err = x->type->input(x, &job->xfrm_vec[0].decap, job->skb);
+	padata_do_serial(padata);
+}
+
+/*
+ * Back in order: redo the replay check, since packets that were behind
+ * this one may have been accepted meanwhile, then carry on as the
+ * synchronous path does.
+ */
+static void xfrm4_rcv_job_serial(struct padata_priv *padata)
+{
+	struct xfrm4_rcv_job *job = container_of(padata, struct xfrm4_rcv_job,
+						 padata);
+	struct sk_buff *skb = job->skb;
+	struct xfrm_state *x = job->xfrm_vec[0].xvec;
+	u32 spi, seq;
+	int decaps = 0;
+	int err;
+
+	if (job->err)
+		goto drop;
+
+	spin_lock(&x->lock);
+	if (unlikely(x->km.state != XFRM_STATE_VALID) ||
+	    (x->props.replay_window && xfrm_replay_check(x, job->seq))) {
+		spin_unlock(&x->lock);
+		goto drop;
+	}
+	if (x->props.replay_window)
+		xfrm_replay_advance(x, job->seq);
+
+	x->curlft.bytes += skb->len;
+	x->curlft.packets++;
+	spin_unlock(&x->lock);
+
+	err = xfrm4_rcv_next(skb, x, &spi, &seq, &decaps);
+	if (err < 0)
+		goto drop;
+	if (!err) {
+		err = xfrm4_rcv_xfrms(skb, job->xfrm_vec, 1, spi, seq, 0);
+		goto out;
+	}
+
+	if (xfrm4_rcv_secpath(skb, job->xfrm_vec, 1))
+		goto drop;
+
+	if (decaps) {
+		xfrm4_rcv_decaps(skb);
+		goto out_free;
+	}
+
+	/* Transport mode: resubmit to the inner protocol, as
+	 * ip_local_deliver_finish() does for the synchronous path.  The
+	 * packet has been through LOCAL_IN already.
+	 */
+	err = -skb->nh.iph->protocol;
+
+out:
+	if (err < 0)
+		ip_local_deliver_proto(skb, -err);
+out_free:
+	kfree(job);
+	return;
+
+drop:
+	xfrm_state_put(x);
+	kfree_skb(skb);
+	kfree(job);
+}
+
+static void xfrm4_rcv_parallel(struct sk_buff *skb, struct xfrm_state *x,
+			       u32 seq, __u16 encap_type)
+{
+	struct xfrm4_rcv_job *job;
+
+	job = kmalloc(sizeof(*job), GFP_ATOMIC);
+	if (!job)
+		goto drop;
+
+	job->skb = skb;
+	job->seq = seq;
+	job->xfrm_vec[0].xvec = x;
+	job->xfrm_vec[0].decap.decap_type = encap_type;
+	job->padata.parallel = xfrm4_rcv_job_parallel;
+	job->padata.serial = xfrm4_rcv_job_serial;
+
+	if (padata_do_parallel(xfrm4_input_pinst, &job->padata) == 0)
+		return;
+
+	kfree(job);
+drop:
+	xfrm_state_put(x);
+	kfree_skb(skb);
+}
+#endif
@@ -10,6 +10,7 @@
 
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
+#include <linux/padata.h>
 #include <net/inet_ecn.h>
 #include <net/ip.h>
 #include <net/xfrm.h>
@@ -91,6 +92,93 @@ out:
 	return ret;
 }
 
+#ifdef CONFIG_INET_XFRM_PARALLEL
+struct xfrm4_output_job {
+	struct padata_priv	padata;
+	struct sk_buff		*skb;
+	int			err;
+};
+
+static void xfrm4_output_job_parallel(struct padata_priv *padata)
+{
+	struct xfrm4_output_job *job = container_of(padata,
+						    struct xfrm4_output_job,
+						    padata);
+	struct sk_buff *skb = job->skb;
+	struct xfrm_state *x = skb->dst->xfrm;
+
+	job->err = x->type->output_crypt(x, skb);
+	padata_do_serial(padata);
+}
+
+/* Back in sequence number order: account and send on. */
+static void xfrm4_output_job_serial(struct padata_priv *padata)
+{
+	struct xfrm4_output_job *job = container_of(padata,
+						    struct xfrm4_output_job,
+						    padata);
+	struct sk_buff *skb = job->skb;
+	struct dst_entry *dst = skb->dst;
+	struct xfrm_state *x = dst->xfrm;
+
+	if (job->err)
+		goto drop;
+
+	spin_lock(&x->lock);
+	x->curlft.bytes += skb->len;
+	x->curlft.packets++;
+	spin_unlock(&x->lock);
+
+	if (!(skb->dst = dst_pop(dst)))
+		goto drop;
+
+	dst_output(skb);
+	kfree(job);
+	return;
+
+drop:
+	kfree_skb(skb);
+	kfree(job);
+}
+
+static inline int xfrm4_output_parallel_ok(struct xfrm_state *x)
+{
+	return sysctl_xfrm4_parallel && xfrm4_output_pinst &&
+	       x->type->output_crypt;
+}
+
+/*
+ * Number the packet and queue the encryption.  Called with x->lock held,
+ * so that the jobs are in sequence number order.
+ */
+static int xfrm4_output_parallel(struct xfrm_state *x, struct sk_buff *skb)
+{
+	struct xfrm4_output_job *job;
+	int err;
+
+	job = kmalloc(sizeof(*job), GFP_ATOMIC);
+	if (!job)
+		return -ENOMEM;
+
+	err = x->type->output_prepare(x, skb);
+	if (err)
+		goto error;
+
+	job->skb = skb;
+	job->padata.parallel = xfrm4_output_job_parallel;
+	job->padata.serial = xfrm4_output_job_serial;
+
+	err = padata_do_parallel(xfrm4_output_pinst, &job->padata);
+	if (err)
+		goto error;
+	return 0;
+
+error:
+	kfree(job);
+	return err;
+}
+#endif
+
 int xfrm4_output(struct sk_buff *skb)
 {
 	struct dst_entry *dst = skb->dst;
@@ -116,6 +204,16 @@ int xfrm4_output(struct sk_buff *skb)
 
 	xfrm4_encap(skb);
 
+#ifdef CONFIG_INET_XFRM_PARALLEL
+	if (xfrm4_output_parallel_ok(x)) {
+		err = xfrm4_output_parallel(x, skb);
+		if (err)
+			goto error;
+		spin_unlock_bh(&x->lock);
+		return 0;
+	}
+#endif
+
 	err = x->type->output(x, skb);
 	if (err)
 		goto error;
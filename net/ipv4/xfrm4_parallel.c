@@ -0,0 +1,58 @@
+/*
+ * xfrm4_parallel.c - Spread IPsec crypto for one SA over several CPUs.
+ *
+ * Packets are numbered and queued to padata instances by xfrm4_output()
+ * and xfrm4_rcv_encap(); the transforms run on all CPUs and the packets
+ * come back out in the order they went in.  Controlled by the
+ * net.ipv4.xfrm4_parallel sysctl.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/padata.h>
+#include <asm/semaphore.h>
+#include <net/xfrm.h>
+
+int sysctl_xfrm4_parallel;
+
+struct padata_instance *xfrm4_output_pinst;
+struct padata_instance *xfrm4_input_pinst;
+
+static DECLARE_MUTEX(xfrm4_parallel_sem);
+
+/*
+ * The instances are created the first time parallel processing is
+ * switched on and are kept afterwards, so that packets still in flight
+ * when it is switched off again can drain.
+ */
+int xfrm4_parallel_set(int on)
+{
+	int err = 0;
+
+	down(&xfrm4_parallel_sem);
+	if (on && !xfrm4_output_pinst) {
+		struct padata_instance *out, *in;
+
+		out = padata_alloc("xfrm4_out");
+		in = padata_alloc("xfrm4_in");
+		if (!out || !in) {
+			if (out)
+				padata_free(out);
+			if (in)
+				padata_free(in);
+			err = -ENOMEM;
+			goto out;
+		}
+		wmb();
+		xfrm4_input_pinst = in;
+		xfrm4_output_pinst = out;
+	}
+	sysctl_xfrm4_parallel = on ? 1 : 0;
+out:
+	up(&xfrm4_parallel_sem);
+	return err;
+}
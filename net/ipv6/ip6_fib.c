@@ -80,7 +80,6 @@ DEFINE_RWLOCK(fib6_walker_lock);
 #define SUBTREE(fn) NULL
 #endif
 
-static void fib6_prune_clones(struct fib6_node *fn, struct rt6_info *rt);
 static struct fib6_node * fib6_repair_tree(struct fib6_node *fn);
 
 /*
@@ -187,15 +186,27 @@ static __inline__ struct fib6_node * node_alloc(void)
 	return fn;
 }
 
-static __inline__ void node_free(struct fib6_node * fn)
+/*
+ *	Lookups walk the tree under rcu_read_lock_bh() only, so nodes and
+ *	routes unlinked by an update are freed after a grace period.
+ */
+
+static void node_free_rcu(struct rcu_head *head)
 {
+	struct fib6_node *fn = container_of(head, struct fib6_node, rcu);
+
 	kmem_cache_free(fib6_node_kmem, fn);
 }
 
+static __inline__ void node_free(struct fib6_node * fn)
+{
+	call_rcu(&fn->rcu, node_free_rcu);
+}
+
 static __inline__ void rt6_release(struct rt6_info *rt)
 {
 	if (atomic_dec_and_test(&rt->rt6i_ref))
-		dst_free(&rt->u.dst);
+		call_rcu_bh(&rt->u.dst.rcu_head, dst_rcu_free);
 }
 
 
@@ -276,9 +287,9 @@ static struct fib6_node * fib6_add_1(struct fib6_node *root, void *addr,
 	ln->fn_sernum = sernum;
 
 	if (dir)
-		pn->right = ln;
+		rcu_assign_pointer(pn->right, ln);
 	else
-		pn->left  = ln;
+		rcu_assign_pointer(pn->left, ln);
 
 	return ln;
 
@@ -335,12 +346,6 @@ insert_above:
 
 		in->fn_sernum = sernum;
 
-		/* update parent pointer */
-		if (dir)
-			pn->right = in;
-		else
-			pn->left  = in;
-
 		ln->fn_bit = plen;
 
 		ln->parent = in;
@@ -355,6 +360,12 @@ insert_above:
 			in->left  = ln;
 			in->right = fn;
 		}
+
+		/* update parent pointer, readers see a complete subtree */
+		if (dir)
+			rcu_assign_pointer(pn->right, in);
+		else
+			rcu_assign_pointer(pn->left, in);
 	} else { /* plen <= bit */
 
 		/* 
@@ -373,11 +384,6 @@ insert_above:
 		ln->parent = pn;
 
 		ln->fn_sernum = sernum;
-		
-		if (dir)
-			pn->right = ln;
-		else
-			pn->left  = ln;
 
 		if (addr_bit_set(&key->addr, plen))
 			ln->right = fn;
@@ -385,6 +391,11 @@ insert_above:
 			ln->left  = fn;
 
 		fn->parent = ln;
+
+		if (dir)
+			rcu_assign_pointer(pn->right, ln);
+		else
+			rcu_assign_pointer(pn->left, ln);
 	}
 	return ln;
 }
@@ -403,11 +414,8 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 
 	if (fn->fn_flags&RTN_TL_ROOT &&
 	    fn->leaf == &ip6_null_entry &&
-	    !(rt->rt6i_flags & (RTF_DEFAULT | RTF_ADDRCONF)) ){
-		fn->leaf = rt;
-		rt->u.next = NULL;
+	    !(rt->rt6i_flags & (RTF_DEFAULT | RTF_ADDRCONF)) )
 		goto out;
-	}
 
 	for (iter = fn->leaf; iter; iter=iter->u.next) {
 		/*
@@ -446,9 +454,9 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 
 out:
 	rt->u.next = iter;
-	*ins = rt;
 	rt->rt6i_node = fn;
 	atomic_inc(&rt->rt6i_ref);
+	rcu_assign_pointer(*ins, rt);
 	inet6_rt_notify(RTM_NEWROUTE, rt, nlh);
 	rt6_stats.fib_rt_entries++;
 
@@ -463,7 +471,7 @@ out:
 static __inline__ void fib6_start_gc(struct rt6_info *rt)
 {
 	if (ip6_fib_timer.expires == 0 &&
-	    (rt->rt6i_flags & (RTF_EXPIRES|RTF_CACHE)))
+	    (rt->rt6i_flags & RTF_EXPIRES))
 		mod_timer(&ip6_fib_timer, jiffies + ip6_rt_gc_interval);
 }
 
@@ -534,7 +542,7 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt, struct nlmsghdr *nlh,
 
 			/* Now link new subtree to main tree */
 			sfn->parent = fn;
-			fn->subtree = sfn;
+			rcu_assign_pointer(fn->subtree, sfn);
 			if (fn->leaf == NULL) {
 				fn->leaf = rt;
 				atomic_inc(&rt->rt6i_ref);
@@ -556,8 +564,7 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt, struct nlmsghdr *nlh,
 
 	if (err == 0) {
 		fib6_start_gc(rt);
-		if (!(rt->rt6i_flags&RTF_CACHE))
-			fib6_prune_clones(fn, rt);
+		rt6_cache_flush();
 	}
 
 out:
@@ -604,7 +611,7 @@ static struct fib6_node * fib6_lookup_1(struct fib6_node *root,
 
 		dir = addr_bit_set(args->addr, fn->fn_bit);
 
-		next = dir ? fn->right : fn->left;
+		next = rcu_dereference(dir ? fn->right : fn->left);
 
 		if (next) {
 			fn = next;
@@ -616,14 +623,16 @@ static struct fib6_node * fib6_lookup_1(struct fib6_node *root,
 
 	while ((fn->fn_flags & RTN_ROOT) == 0) {
 #ifdef CONFIG_IPV6_SUBTREES
-		if (fn->subtree) {
+		struct fib6_node *subtree = rcu_dereference(fn->subtree);
+
+		if (subtree) {
 			struct fib6_node *st;
 			struct lookup_args *narg;
 
 			narg = args + 1;
 
 			if (narg->addr) {
-				st = fib6_lookup_1(fn->subtree, narg);
+				st = fib6_lookup_1(subtree, narg);
 
 				if (st && !(st->fn_flags & RTN_ROOT))
 					return st;
@@ -632,13 +641,18 @@ static struct fib6_node * fib6_lookup_1(struct fib6_node *root,
 #endif
 
 		if (fn->fn_flags & RTN_RTINFO) {
+			struct rt6_info *leaf = rcu_dereference(fn->leaf);
 			struct rt6key *key;
 
-			key = (struct rt6key *) ((u8 *) fn->leaf +
-						 args->offset);
+			/* The last route of the node may be going away. */
+			if (leaf) {
+				key = (struct rt6key *) ((u8 *) leaf +
+							 args->offset);
 
-			if (ipv6_prefix_equal(&key->addr, args->addr, key->plen))
-				return fn;
+				if (ipv6_prefix_equal(&key->addr, args->addr,
+						      key->plen))
+					return fn;
+			}
 		}
 
 		fn = fn->parent;
@@ -866,12 +880,22 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 
 	RT6_TRACE("fib6_del_route\n");
 
-	/* Unlink it */
-	*rtp = rt->u.next;
+	/* Unlink it.  The top level root is never left without a leaf,
+	 * lookups fall back to it without checking.  rt->u.next is kept,
+	 * a lookup may still be walking this route.
+	 */
+	if (rtp == &fn->leaf && rt->u.next == NULL &&
+	    fn->fn_flags&RTN_TL_ROOT)
+		rcu_assign_pointer(*rtp, &ip6_null_entry);
+	else
+		*rtp = rt->u.next;
 	rt->rt6i_node = NULL;
 	rt6_stats.fib_rt_entries--;
 	rt6_stats.fib_discarded_routes++;
 
+	/* Host routes cloned from it may point at nodes freed below. */
+	rt6_cache_flush();
+
 	/* Adjust walkers */
 	read_lock(&fib6_walker_lock);
 	FOR_WALKERS(w) {
@@ -884,11 +908,6 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 	}
 	read_unlock(&fib6_walker_lock);
 
-	rt->u.next = NULL;
-
-	if (fn->leaf == NULL && fn->fn_flags&RTN_TL_ROOT)
-		fn->leaf = &ip6_null_entry;
-
 	/* If it was last route, expunge its radix tree node */
 	if (fn->leaf == NULL) {
 		fn->fn_flags &= ~RTN_RTINFO;
@@ -935,9 +954,6 @@ int fib6_del(struct rt6_info *rt, struct nlmsghdr *nlh, void *_rtattr)
 
 	BUG_TRAP(fn->fn_flags&RTN_RTINFO);
 
-	if (!(rt->rt6i_flags&RTF_CACHE))
-		fib6_prune_clones(fn, rt);
-
 	/*
 	 *	Walk the leaf entries looking for ourself
 	 */
@@ -1114,21 +1130,6 @@ void fib6_clean_tree(struct fib6_node *root,
 	fib6_walk(&c.w);
 }
 
-static int fib6_prune_clone(struct rt6_info *rt, void *arg)
-{
-	if (rt->rt6i_flags & RTF_CACHE) {
-		RT6_TRACE("pruning clone %p\n", rt);
-		return -1;
-	}
-
-	return 0;
-}
-
-static void fib6_prune_clones(struct fib6_node *fn, struct rt6_info *rt)
-{
-	fib6_clean_tree(fn, fib6_prune_clone, 1, rt);
-}
-
 /*
  *	Garbage collection
  */
@@ -1147,8 +1148,8 @@ static int fib6_age(struct rt6_info *rt, void *arg)
 	 *	check addrconf expiration here.
 	 *	Routes are expired even if they are in use.
 	 *
-	 *	Also age clones. Note, that clones are aged out
-	 *	only if they are not in use now.
+	 *	Clones live in the host route cache and are aged
+	 *	by rt6_cache_gc().
 	 */
 
 	if (rt->rt6i_flags&RTF_EXPIRES && rt->rt6i_expires) {
@@ -1158,18 +1159,6 @@ static int fib6_age(struct rt6_info *rt, void *arg)
 			return -1;
 		}
 		gc_args.more++;
-	} else if (rt->rt6i_flags & RTF_CACHE) {
-		if (atomic_read(&rt->u.dst.__refcnt) == 0 &&
-		    time_after_eq(now, rt->u.dst.lastuse + gc_args.timeout)) {
-			RT6_TRACE("aging clone %p\n", rt);
-			return -1;
-		} else if ((rt->rt6i_flags & RTF_GATEWAY) &&
-			   (!(rt->rt6i_nexthop->flags & NTF_ROUTER))) {
-			RT6_TRACE("purging route %p via non-router but gateway\n",
-				  rt);
-			return -1;
-		}
-		gc_args.more++;
 	}
 
 	return 0;
@@ -1198,6 +1187,7 @@ void fib6_run_gc(unsigned long dummy)
 	ndisc_dst_gc(&gc_args.more);
 	fib6_clean_tree(&ip6_routing_table, fib6_age, 0, NULL);
 	write_unlock_bh(&rt6_lock);
+	rt6_cache_gc(gc_args.timeout, &gc_args.more);
 
 	if (gc_args.more)
 		mod_timer(&ip6_fib_timer, jiffies + ip6_rt_gc_interval);
@@ -1221,5 +1211,7 @@ void __init fib6_init(void)
 void fib6_gc_cleanup(void)
 {
 	del_timer(&ip6_fib_timer);
+	/* Let node_free_rcu() callbacks drain. */
+	synchronize_kernel();
 	kmem_cache_destroy(fib6_node_kmem);
 }
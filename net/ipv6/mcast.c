@@ -74,29 +74,12 @@
 /*
  *  These header formats should be in a separate include file, but icmpv6.h
  *  doesn't have in6_addr defined in all cases, there is no __u128, and no
- *  other files reference these.
+ *  other files reference these.  The report formats moved to icmpv6.h
+ *  once the bridge started snooping them.
  *
  *  			+-DLS 4/14/03
  */
 
-/* Multicast Listener Discovery version 2 headers */
-
-struct mld2_grec {
-	__u8		grec_type;
-	__u8		grec_auxwords;
-	__u16		grec_nsrcs;
-	struct in6_addr	grec_mca;
-	struct in6_addr	grec_src[0];
-};
-
-struct mld2_report {
-	__u8	type;
-	__u8	resv1;
-	__u16	csum;
-	__u16	resv2;
-	__u16	ngrec;
-	struct mld2_grec grec[0];
-};
 
 struct mld2_query {
 	__u8 type;
@@ -37,6 +37,9 @@
 #include <linux/init.h>
 #include <linux/netlink.h>
 #include <linux/if_arp.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
 
 #ifdef 	CONFIG_PROC_FS
 #include <linux/proc_fs.h>
@@ -132,10 +135,41 @@ struct fib6_node ip6_routing_table = {
 	.fn_flags	= RTN_ROOT | RTN_TL_ROOT | RTN_RTINFO,
 };
 
-/* Protects all the ip6 fib */
+/* Serializes updates of the fib6 tree and its walkers.  Lookups do
+   not take it, they run under rcu_read_lock_bh().
+ */
 
 DEFINE_RWLOCK(rt6_lock);
 
+/*
+ *	Host route cache.
+ *
+ *	Clones made by rt6_cow(), redirects and path MTU discovery are
+ *	kept in this hash instead of as /128 leaves of the fib6 tree.
+ *	Lookups walk a chain under rcu_read_lock_bh(), updates take
+ *	rt6_cache_lock and free entries after a grace period.  A chain
+ *	holds at most ip6_rt_max_size / RT6_CACHE_HSIZE entries, the
+ *	least recently used one is evicted to make room.
+ *
+ *	Any change of the tree flushes the whole cache and bumps
+ *	rt6_cache_genid, so a clone of a route looked up before the
+ *	change is never inserted after it.
+ */
+
+#define RT6_CACHE_HBITS		9
+#define RT6_CACHE_HSIZE		(1 << RT6_CACHE_HBITS)
+
+struct rt6_cache_bucket
+{
+	struct rt6_info		*chain;
+	int			len;
+};
+
+static struct rt6_cache_bucket rt6_cache_hash[RT6_CACHE_HSIZE];
+static DEFINE_SPINLOCK(rt6_cache_lock);
+static u32 rt6_cache_rnd;
+static u32 rt6_cache_genid;
+
 
 /* allocate dst with ip6_dst_ops */
 static __inline__ struct rt6_info *ip6_dst_alloc(void)
@@ -175,8 +209,241 @@ static __inline__ int rt6_check_expired(const struct rt6_info *rt)
 		time_after(jiffies, rt->rt6i_expires));
 }
 
+static __inline__ unsigned int rt6_cache_hashfn(const struct in6_addr *daddr)
+{
+	return jhash_3words(daddr->s6_addr32[0] ^ daddr->s6_addr32[1],
+			    daddr->s6_addr32[2], daddr->s6_addr32[3],
+			    rt6_cache_rnd) & (RT6_CACHE_HSIZE - 1);
+}
+
+static __inline__ int rt6_cache_depth(void)
+{
+	int depth = ip6_rt_max_size >> RT6_CACHE_HBITS;
+
+	return depth > 0 ? depth : 1;
+}
+
+static __inline__ int rt6_cache_same(const struct rt6_info *a,
+				     const struct rt6_info *b)
+{
+	return ipv6_addr_equal(&a->rt6i_dst.addr, &b->rt6i_dst.addr) &&
+#ifdef CONFIG_IPV6_SUBTREES
+	       a->rt6i_src.plen == b->rt6i_src.plen &&
+	       ipv6_addr_equal(&a->rt6i_src.addr, &b->rt6i_src.addr) &&
+#endif
+	       a->rt6i_dev == b->rt6i_dev;
+}
+
+/* Prefer an unreferenced entry, then the least recently used one. */
+static __inline__ int rt6_cache_victim(const struct rt6_info *rt,
+				       const struct rt6_info *cand)
+{
+	int rt_busy = atomic_read(&rt->u.dst.__refcnt) != 0;
+	int cand_busy = atomic_read(&cand->u.dst.__refcnt) != 0;
+
+	if (rt_busy != cand_busy)
+		return cand_busy;
+	return time_before(rt->u.dst.lastuse, cand->u.dst.lastuse);
+}
+
+/* Called with rt6_cache_lock held, the entry is already unlinked. */
+static void rt6_cache_free(struct rt6_info *rt)
+{
+	rt->rt6i_node = NULL;
+	rt6_stats.fib_rt_cache--;
+	call_rcu_bh(&rt->u.dst.rcu_head, dst_rcu_free);
+}
+
 /*
- *	Route lookup. Any rt6_lock is implied.
+ *	Find a host route for daddr (and saddr), preferring one through
+ *	oif.  With strict set only an oif match is accepted.  Called
+ *	under rcu_read_lock_bh(), the caller takes the reference.
+ */
+static struct rt6_info *rt6_cache_lookup(struct in6_addr *daddr,
+					 struct in6_addr *saddr,
+					 int oif, int strict)
+{
+	struct rt6_info *rt, *match = NULL;
+	unsigned int hash = rt6_cache_hashfn(daddr);
+
+	for (rt = rcu_dereference(rt6_cache_hash[hash].chain); rt;
+	     rt = rcu_dereference(rt->u.next)) {
+		if (!ipv6_addr_equal(&rt->rt6i_dst.addr, daddr))
+			continue;
+#ifdef CONFIG_IPV6_SUBTREES
+		if (rt->rt6i_src.plen &&
+		    (saddr == NULL ||
+		     !ipv6_addr_equal(&rt->rt6i_src.addr, saddr)))
+			continue;
+#endif
+		if (!oif || rt->rt6i_dev->ifindex == oif)
+			return rt;
+		if (!strict && match == NULL)
+			match = rt;
+	}
+	return match;
+}
+
+/*
+ *	Insert a host route the caller holds.  An entry for the same
+ *	destination and device is replaced, or with replace unset
+ *	returned instead and rt is dropped.  If the tree changed since
+ *	genid was sampled, rt is returned without being cached.  The
+ *	returned entry is held for the caller in all cases.
+ */
+static struct rt6_info *rt6_cache_insert(struct rt6_info *rt, u32 genid,
+					 int replace)
+{
+	struct rt6_cache_bucket *b;
+	struct rt6_info *rth, **rthp, *cand = NULL, **candp = NULL;
+
+	b = &rt6_cache_hash[rt6_cache_hashfn(&rt->rt6i_dst.addr)];
+
+	spin_lock_bh(&rt6_cache_lock);
+	if (genid != rt6_cache_genid) {
+		spin_unlock_bh(&rt6_cache_lock);
+		rt->rt6i_node = NULL;
+		dst_free(&rt->u.dst);
+		return rt;
+	}
+
+	for (rthp = &b->chain; (rth = *rthp) != NULL; rthp = &rth->u.next) {
+		if (rt6_cache_same(rth, rt)) {
+			if (!replace) {
+				dst_hold(&rth->u.dst);
+				spin_unlock_bh(&rt6_cache_lock);
+				dst_release(&rt->u.dst);
+				dst_free(&rt->u.dst);
+				return rth;
+			}
+			rt->u.next = rth->u.next;
+			rcu_assign_pointer(*rthp, rt);
+			rt6_stats.fib_rt_cache++;
+			rt6_cache_free(rth);
+			goto out;
+		}
+		if (cand == NULL || rt6_cache_victim(rth, cand)) {
+			cand = rth;
+			candp = rthp;
+		}
+	}
+
+	if (b->len >= rt6_cache_depth()) {
+		*candp = cand->u.next;
+		b->len--;
+		rt6_cache_free(cand);
+	}
+
+	rt->u.next = b->chain;
+	rcu_assign_pointer(b->chain, rt);
+	b->len++;
+	rt6_stats.fib_rt_cache++;
+out:
+	spin_unlock_bh(&rt6_cache_lock);
+	fib6_force_start_gc();
+	return rt;
+}
+
+static int rt6_cache_del(struct rt6_info *rt)
+{
+	struct rt6_cache_bucket *b;
+	struct rt6_info *rth, **rthp;
+	int err = -ENOENT;
+
+	b = &rt6_cache_hash[rt6_cache_hashfn(&rt->rt6i_dst.addr)];
+
+	spin_lock_bh(&rt6_cache_lock);
+	for (rthp = &b->chain; (rth = *rthp) != NULL; rthp = &rth->u.next) {
+		if (rth == rt) {
+			*rthp = rt->u.next;
+			b->len--;
+			rt6_cache_free(rt);
+			err = 0;
+			break;
+		}
+	}
+	spin_unlock_bh(&rt6_cache_lock);
+	return err;
+}
+
+/* Called on every change of the fib6 tree, rt6_lock may be held. */
+void rt6_cache_flush(void)
+{
+	struct rt6_info *rt, *next;
+	int i;
+
+	spin_lock_bh(&rt6_cache_lock);
+	rt6_cache_genid++;
+	for (i = 0; i < RT6_CACHE_HSIZE; i++) {
+		rt = rt6_cache_hash[i].chain;
+		if (rt == NULL)
+			continue;
+		rt6_cache_hash[i].chain = NULL;
+		rt6_cache_hash[i].len = 0;
+		for (; rt; rt = next) {
+			next = rt->u.next;
+			rt6_cache_free(rt);
+		}
+	}
+	spin_unlock_bh(&rt6_cache_lock);
+}
+
+/*
+ *	Age the cache, called from fib6_run_gc().  Entries with an
+ *	expiry time go when it passes, the others once they are unused
+ *	for timeout or their gateway stopped being a router.
+ */
+void rt6_cache_gc(int timeout, int *more)
+{
+	unsigned long now = jiffies;
+	struct rt6_info *rt, **rtp;
+	int i;
+
+	spin_lock_bh(&rt6_cache_lock);
+	for (i = 0; i < RT6_CACHE_HSIZE; i++) {
+		rtp = &rt6_cache_hash[i].chain;
+		while ((rt = *rtp) != NULL) {
+			if (rt->rt6i_flags&RTF_EXPIRES && rt->rt6i_expires) {
+				if (!time_after(now, rt->rt6i_expires))
+					goto keep;
+				RT6_TRACE("expiring clone %p\n", rt);
+			} else if (atomic_read(&rt->u.dst.__refcnt) == 0 &&
+				   time_after_eq(now, rt->u.dst.lastuse + timeout)) {
+				RT6_TRACE("aging clone %p\n", rt);
+			} else if ((rt->rt6i_flags & RTF_GATEWAY) &&
+				   (!(rt->rt6i_nexthop->flags & NTF_ROUTER))) {
+				RT6_TRACE("purging route %p via non-router but gateway\n",
+					  rt);
+			} else
+				goto keep;
+
+			*rtp = rt->u.next;
+			rt6_cache_hash[i].len--;
+			rt6_cache_free(rt);
+			continue;
+keep:
+			(*more)++;
+			rtp = &rt->u.next;
+		}
+	}
+	spin_unlock_bh(&rt6_cache_lock);
+}
+
+static void rt6_cache_foreach(int (*func)(struct rt6_info *, void *arg),
+			      void *arg)
+{
+	struct rt6_info *rt;
+	int i;
+
+	spin_lock_bh(&rt6_cache_lock);
+	for (i = 0; i < RT6_CACHE_HSIZE; i++)
+		for (rt = rt6_cache_hash[i].chain; rt; rt = rt->u.next)
+			func(rt, arg);
+	spin_unlock_bh(&rt6_cache_lock);
+}
+
+/*
+ *	Route lookup. Called under rcu_read_lock_bh() or rt6_lock.
  */
 
 static __inline__ struct rt6_info *rt6_device_match(struct rt6_info *rt,
@@ -358,18 +625,39 @@ static struct rt6_info *rt6_best_dflt(struct rt6_info *rt, int oif)
 	return match;
 }
 
+/*
+ *	Routes of the node returned by fib6_lookup().  Lookups do not lock
+ *	out updates, so the last route of the node may just have been
+ *	unlinked; climb to the nearest node still carrying routes then.
+ *	The top level root always has a leaf.
+ */
+static __inline__ struct rt6_info *fib6_node_leaf(struct fib6_node **fnp)
+{
+	struct fib6_node *fn = *fnp;
+	struct rt6_info *rt;
+
+	while ((rt = rcu_dereference(fn->leaf)) == NULL ||
+	       !(fn->fn_flags & (RTN_RTINFO | RTN_ROOT)))
+		fn = fn->parent;
+	*fnp = fn;
+	return rt;
+}
+
 struct rt6_info *rt6_lookup(struct in6_addr *daddr, struct in6_addr *saddr,
 			    int oif, int strict)
 {
 	struct fib6_node *fn;
 	struct rt6_info *rt;
 
-	read_lock_bh(&rt6_lock);
-	fn = fib6_lookup(&ip6_routing_table, daddr, saddr);
-	rt = rt6_device_match(fn->leaf, oif, strict);
+	rcu_read_lock_bh();
+	rt = rt6_cache_lookup(daddr, saddr, oif, strict);
+	if (rt == NULL) {
+		fn = fib6_lookup(&ip6_routing_table, daddr, saddr);
+		rt = rt6_device_match(fib6_node_leaf(&fn), oif, strict);
+	}
 	dst_hold(&rt->u.dst);
 	rt->u.dst.__use++;
-	read_unlock_bh(&rt6_lock);
+	rcu_read_unlock_bh();
 
 	rt->u.dst.lastuse = jiffies;
 	if (rt->u.dst.error == 0)
@@ -381,7 +669,7 @@ struct rt6_info *rt6_lookup(struct in6_addr *daddr, struct in6_addr *saddr,
 /* ip6_ins_rt is called with FREE rt6_lock.
    It takes new route entry, the addition fails by any reason the
    route is freed. In any case, if caller does not hold it, it may
-   be destroyed.
+   be destroyed.  Host route clones go to rt6_cache_insert() instead.
  */
 
 int ip6_ins_rt(struct rt6_info *rt, struct nlmsghdr *nlh, void *_rtattr)
@@ -395,14 +683,14 @@ int ip6_ins_rt(struct rt6_info *rt, struct nlmsghdr *nlh, void *_rtattr)
 	return err;
 }
 
-/* No rt6_lock! If COW failed, the function returns dead route entry
-   with dst->error set to errno value.
+/* No rt6_lock!  genid is rt6_cache_genid as sampled before ort was
+   looked up.  Returns the held clone, or ip6_null_entry if none could
+   be allocated.
  */
 
 static struct rt6_info *rt6_cow(struct rt6_info *ort, struct in6_addr *daddr,
-				struct in6_addr *saddr)
+				struct in6_addr *saddr, u32 genid)
 {
-	int err;
 	struct rt6_info *rt;
 
 	/*
@@ -429,16 +717,11 @@ static struct rt6_info *rt6_cow(struct rt6_info *ort, struct in6_addr *daddr,
 #endif
 
 		rt->rt6i_nexthop = ndisc_get_neigh(rt->rt6i_dev, &rt->rt6i_gateway);
+		rt->rt6i_node = ort->rt6i_node;
 
 		dst_hold(&rt->u.dst);
 
-		err = ip6_ins_rt(rt, NULL, NULL);
-		if (err == 0)
-			return rt;
-
-		rt->u.dst.error = err;
-
-		return rt;
+		return rt6_cache_insert(rt, genid, 0);
 	}
 	dst_hold(&ip6_null_entry.u.dst);
 	return &ip6_null_entry;
@@ -447,10 +730,8 @@ static struct rt6_info *rt6_cow(struct rt6_info *ort, struct in6_addr *daddr,
 #define BACKTRACK() \
 if (rt == &ip6_null_entry && strict) { \
        while ((fn = fn->parent) != NULL) { \
-		if (fn->fn_flags & RTN_ROOT) { \
-			dst_hold(&rt->u.dst); \
+		if (fn->fn_flags & RTN_ROOT) \
 			goto out; \
-		} \
 		if (fn->fn_flags & RTN_RTINFO) \
 			goto restart; \
 	} \
@@ -462,53 +743,41 @@ void ip6_route_input(struct sk_buff *skb)
 	struct fib6_node *fn;
 	struct rt6_info *rt;
 	int strict;
-	int attempts = 3;
+	u32 genid;
 
 	strict = ipv6_addr_type(&skb->nh.ipv6h->daddr) & (IPV6_ADDR_MULTICAST|IPV6_ADDR_LINKLOCAL);
 
-relookup:
-	read_lock_bh(&rt6_lock);
+	rcu_read_lock_bh();
+
+	genid = rt6_cache_genid;
+	rt = rt6_cache_lookup(&skb->nh.ipv6h->daddr, &skb->nh.ipv6h->saddr,
+			      skb->dev->ifindex, strict);
+	if (rt)
+		goto out;
 
 	fn = fib6_lookup(&ip6_routing_table, &skb->nh.ipv6h->daddr,
 			 &skb->nh.ipv6h->saddr);
 
 restart:
-	rt = fn->leaf;
-
-	if ((rt->rt6i_flags & RTF_CACHE)) {
-		rt = rt6_device_match(rt, skb->dev->ifindex, strict);
-		BACKTRACK();
-		dst_hold(&rt->u.dst);
-		goto out;
-	}
-
-	rt = rt6_device_match(rt, skb->dev->ifindex, 0);
+	rt = rt6_device_match(fib6_node_leaf(&fn), skb->dev->ifindex, 0);
 	BACKTRACK();
 
 	if (!rt->rt6i_nexthop && !(rt->rt6i_flags & RTF_NONEXTHOP)) {
 		struct rt6_info *nrt;
 		dst_hold(&rt->u.dst);
-		read_unlock_bh(&rt6_lock);
+		rcu_read_unlock_bh();
 
 		nrt = rt6_cow(rt, &skb->nh.ipv6h->daddr,
-			      &skb->nh.ipv6h->saddr);
+			      &skb->nh.ipv6h->saddr, genid);
 
 		dst_release(&rt->u.dst);
 		rt = nrt;
-
-		if (rt->u.dst.error != -EEXIST || --attempts <= 0)
-			goto out2;
-
-		/* Race condition! In the gap, when rt6_lock was
-		   released someone could insert this route.  Relookup.
-		*/
-		dst_release(&rt->u.dst);
-		goto relookup;
+		goto out2;
 	}
-	dst_hold(&rt->u.dst);
 
 out:
-	read_unlock_bh(&rt6_lock);
+	dst_hold(&rt->u.dst);
+	rcu_read_unlock_bh();
 out2:
 	rt->u.dst.lastuse = jiffies;
 	rt->u.dst.__use++;
@@ -520,24 +789,22 @@ struct dst_entry * ip6_route_output(struct sock *sk, struct flowi *fl)
 	struct fib6_node *fn;
 	struct rt6_info *rt;
 	int strict;
-	int attempts = 3;
+	u32 genid;
 
 	strict = ipv6_addr_type(&fl->fl6_dst) & (IPV6_ADDR_MULTICAST|IPV6_ADDR_LINKLOCAL);
 
-relookup:
-	read_lock_bh(&rt6_lock);
+	rcu_read_lock_bh();
+
+	genid = rt6_cache_genid;
+	rt = rt6_cache_lookup(&fl->fl6_dst, &fl->fl6_src, fl->oif, strict);
+	if (rt)
+		goto out;
 
 	fn = fib6_lookup(&ip6_routing_table, &fl->fl6_dst, &fl->fl6_src);
 
 restart:
-	rt = fn->leaf;
+	rt = fib6_node_leaf(&fn);
 
-	if ((rt->rt6i_flags & RTF_CACHE)) {
-		rt = rt6_device_match(rt, fl->oif, strict);
-		BACKTRACK();
-		dst_hold(&rt->u.dst);
-		goto out;
-	}
 	if (rt->rt6i_flags & RTF_DEFAULT) {
 		if (rt->rt6i_metric >= IP6_RT_PRIO_ADDRCONF)
 			rt = rt6_best_dflt(rt, fl->oif);
@@ -549,26 +816,18 @@ restart:
 	if (!rt->rt6i_nexthop && !(rt->rt6i_flags & RTF_NONEXTHOP)) {
 		struct rt6_info *nrt;
 		dst_hold(&rt->u.dst);
-		read_unlock_bh(&rt6_lock);
+		rcu_read_unlock_bh();
 
-		nrt = rt6_cow(rt, &fl->fl6_dst, &fl->fl6_src);
+		nrt = rt6_cow(rt, &fl->fl6_dst, &fl->fl6_src, genid);
 
 		dst_release(&rt->u.dst);
 		rt = nrt;
-
-		if (rt->u.dst.error != -EEXIST || --attempts <= 0)
-			goto out2;
-
-		/* Race condition! In the gap, when rt6_lock was
-		   released someone could insert this route.  Relookup.
-		*/
-		dst_release(&rt->u.dst);
-		goto relookup;
+		goto out2;
 	}
-	dst_hold(&rt->u.dst);
 
 out:
-	read_unlock_bh(&rt6_lock);
+	dst_hold(&rt->u.dst);
+	rcu_read_unlock_bh();
 out2:
 	rt->u.dst.lastuse = jiffies;
 	rt->u.dst.__use++;
@@ -583,13 +842,20 @@ out2:
 static struct dst_entry *ip6_dst_check(struct dst_entry *dst, u32 cookie)
 {
 	struct rt6_info *rt;
+	struct fib6_node *fn;
+	int valid = 0;
 
 	rt = (struct rt6_info *) dst;
 
-	if (rt && rt->rt6i_node && (rt->rt6i_node->fn_sernum == cookie))
-		return dst;
+	/* The node is freed after a grace period once rt6i_node of
+	   every route pointing at it is cleared.
+	 */
+	rcu_read_lock();
+	if (rt && (fn = rt->rt6i_node) != NULL && fn->fn_sernum == cookie)
+		valid = 1;
+	rcu_read_unlock();
 
-	return NULL;
+	return valid ? dst : NULL;
 }
 
 static struct dst_entry *ip6_negative_advice(struct dst_entry *dst)
@@ -990,6 +1256,12 @@ int ip6_del_rt(struct rt6_info *rt, struct nlmsghdr *nlh, void *_rtattr)
 {
 	int err;
 
+	if (rt->rt6i_flags & RTF_CACHE) {
+		err = rt6_cache_del(rt);
+		dst_release(&rt->u.dst);
+		return err;
+	}
+
 	write_lock_bh(&rt6_lock);
 
 	rt6_reset_dflt_pointer(NULL);
@@ -1044,6 +1316,7 @@ void rt6_redirect(struct in6_addr *dest, struct in6_addr *saddr,
 		  struct neighbour *neigh, u8 *lladdr, int on_link)
 {
 	struct rt6_info *rt, *nrt;
+	u32 genid = rt6_cache_genid;
 
 	/* Locate old route to this destination. */
 	rt = rt6_lookup(dest, NULL, neigh->dev->ifindex, 1);
@@ -1135,9 +1408,11 @@ source_ok:
 	/* Reset pmtu, it may be better */
 	nrt->u.dst.metrics[RTAX_MTU-1] = ipv6_get_mtu(neigh->dev);
 	nrt->u.dst.metrics[RTAX_ADVMSS-1] = ipv6_advmss(dst_mtu(&nrt->u.dst));
+	nrt->rt6i_node = rt->rt6i_node;
 
-	if (ip6_ins_rt(nrt, NULL, NULL))
-		goto out;
+	dst_hold(&nrt->u.dst);
+	nrt = rt6_cache_insert(nrt, genid, 1);
+	dst_release(&nrt->u.dst);
 
 	if (rt->rt6i_flags&RTF_CACHE) {
 		ip6_del_rt(rt, NULL, NULL);
@@ -1159,6 +1434,7 @@ void rt6_pmtu_discovery(struct in6_addr *daddr, struct in6_addr *saddr,
 {
 	struct rt6_info *rt, *nrt;
 	int allfrag = 0;
+	u32 genid = rt6_cache_genid;
 
 	rt = rt6_lookup(daddr, saddr, dev->ifindex, 0);
 	if (rt == NULL)
@@ -1204,7 +1480,7 @@ void rt6_pmtu_discovery(struct in6_addr *daddr, struct in6_addr *saddr,
 	   2. It is gatewayed route or NONEXTHOP route. Action: clone it.
 	 */
 	if (!rt->rt6i_nexthop && !(rt->rt6i_flags & RTF_NONEXTHOP)) {
-		nrt = rt6_cow(rt, daddr, saddr);
+		nrt = rt6_cow(rt, daddr, saddr, genid);
 		if (!nrt->u.dst.error) {
 			nrt->u.dst.metrics[RTAX_MTU-1] = pmtu;
 			if (allfrag)
@@ -1232,7 +1508,10 @@ void rt6_pmtu_discovery(struct in6_addr *daddr, struct in6_addr *saddr,
 		nrt->u.dst.metrics[RTAX_MTU-1] = pmtu;
 		if (allfrag)
 			nrt->u.dst.metrics[RTAX_FEATURES-1] |= RTAX_FEATURE_ALLFRAG;
-		ip6_ins_rt(nrt, NULL, NULL);
+		nrt->rt6i_node = rt->rt6i_node;
+		dst_hold(&nrt->u.dst);
+		nrt = rt6_cache_insert(nrt, genid, 1);
+		dst_release(&nrt->u.dst);
 	}
 
 out:
@@ -1441,6 +1720,7 @@ void rt6_ifdown(struct net_device *dev)
 	write_lock_bh(&rt6_lock);
 	fib6_clean_tree(&ip6_routing_table, fib6_ifdown, 0, dev);
 	write_unlock_bh(&rt6_lock);
+	rt6_cache_flush();
 }
 
 struct rt6_mtu_change_arg
@@ -1497,6 +1777,7 @@ void rt6_mtu_change(struct net_device *dev, unsigned mtu)
 	read_lock_bh(&rt6_lock);
 	fib6_clean_tree(&ip6_routing_table, rt6_mtu_change_route, 0, &arg);
 	read_unlock_bh(&rt6_lock);
+	rt6_cache_foreach(rt6_mtu_change_route, &arg);
 }
 
 static int inet6_rtm_to_rtmsg(struct rtmsg *r, struct rtattr **rta,
@@ -1695,6 +1976,42 @@ static int fib6_dump_node(struct fib6_walker_t *w)
 	return 0;
 }
 
+/*
+ *	Dump the host route cache after the tree.  cb->args[2] is one
+ *	more than the bucket being dumped, cb->args[3] the number of
+ *	entries of it already sent.
+ */
+static int rt6_cache_dump(struct rt6_rtnl_dump_arg *arg)
+{
+	struct netlink_callback *cb = arg->cb;
+	struct rt6_info *rt;
+	int h, idx, s_idx;
+
+	if (cb->args[2] == 0)
+		cb->args[2] = 1;
+
+	rcu_read_lock_bh();
+	for (h = cb->args[2] - 1; h < RT6_CACHE_HSIZE; h++) {
+		s_idx = cb->args[3];
+		idx = 0;
+		for (rt = rcu_dereference(rt6_cache_hash[h].chain); rt;
+		     rt = rcu_dereference(rt->u.next), idx++) {
+			if (idx < s_idx)
+				continue;
+			if (rt6_dump_route(rt, arg) < 0) {
+				rcu_read_unlock_bh();
+				cb->args[2] = h + 1;
+				cb->args[3] = idx;
+				return 1;
+			}
+		}
+		cb->args[3] = 0;
+	}
+	rcu_read_unlock_bh();
+	cb->args[2] = h + 1;
+	return 0;
+}
+
 static void fib6_dump_end(struct netlink_callback *cb)
 {
 	struct fib6_walker_t *w = (void*)cb->args[0];
@@ -1749,12 +2066,17 @@ int inet6_dump_fib(struct sk_buff *skb, struct netlink_callback *cb)
 		read_lock_bh(&rt6_lock);
 		res = fib6_walk(w);
 		read_unlock_bh(&rt6_lock);
+	} else if (cb->args[2]) {
+		/* The tree is done, we are in the cache. */
+		res = 0;
 	} else {
 		w->args = &arg;
 		read_lock_bh(&rt6_lock);
 		res = fib6_walk_continue(w);
 		read_unlock_bh(&rt6_lock);
 	}
+	if (res == 0)
+		res = rt6_cache_dump(&arg);
 #if RT6_DEBUG >= 3
 	if (res <= 0 && skb->len == 0)
 		RT6_TRACE("%p>dump end\n", w);
@@ -1940,6 +2262,7 @@ static int rt6_proc_info(char *buffer, char **start, off_t offset, int length)
 	read_lock_bh(&rt6_lock);
 	fib6_clean_tree(&ip6_routing_table, rt6_info_route, 0, &arg);
 	read_unlock_bh(&rt6_lock);
+	rt6_cache_foreach(rt6_info_route, &arg);
 
 	*start = buffer;
 	if (offset)
@@ -1955,8 +2278,6 @@ static int rt6_proc_info(char *buffer, char **start, off_t offset, int length)
 	return arg.len;
 }
 
-extern struct rt6_statistics rt6_stats;
-
 static int rt6_stats_seq_show(struct seq_file *seq, void *v)
 {
 	seq_printf(seq, "%04x %04x %04x %04x %04x %04x %04x\n",
@@ -2103,6 +2424,7 @@ void __init ip6_route_init(void)
 	if (!ip6_dst_ops.kmem_cachep)
 		panic("cannot create ip6_dst_cache");
 
+	get_random_bytes(&rt6_cache_rnd, sizeof(rt6_cache_rnd));
 	fib6_init();
 #ifdef 	CONFIG_PROC_FS
 	p = proc_net_create("ipv6_route", 0, rt6_proc_info);
@@ -50,9 +50,17 @@
 #include <linux/bitops.h>
 #include <linux/mm.h>
 #include <linux/types.h>
+#include <linux/poll.h>
+#include <linux/rcupdate.h>
 #include <net/sock.h>
 #include <net/scm.h>
 
+#ifdef CONFIG_NETLINK_MMAP
+#include <asm/page.h>
+#include <asm/cacheflush.h>
+#include <asm/io.h>
+#endif
+
 #define Nprintk(a...)
 
 #if defined(CONFIG_NETLINK_DEV) || defined(CONFIG_NETLINK_DEV_MODULE)
@@ -71,7 +79,20 @@ struct netlink_sock {
 	wait_queue_head_t	wait;
 	struct netlink_callback	*cb;
 	spinlock_t		cb_lock;
+	struct sk_buff		*dump_skb;	/* the ring had no room for it */
 	void			(*data_ready)(struct sock *sk, int bytes);
+#ifdef CONFIG_NETLINK_MMAP
+	char			**pg_vec;
+	unsigned int		head;
+	unsigned int		frames_per_block;
+	unsigned int		frame_size;
+	unsigned int		frame_max;
+	unsigned int		pg_vec_order;
+	unsigned int		pg_vec_pages;
+	unsigned int		pg_vec_len;
+	atomic_t		mapped;
+	struct nl_mmap_stats	stats;
+#endif
 };
 
 static inline struct netlink_sock *nlk_sk(struct sock *sk)
@@ -104,6 +125,9 @@ static DECLARE_WAIT_QUEUE_HEAD(nl_table_wait);
 
 static int netlink_dump(struct sock *sk);
 static void netlink_destroy_callback(struct netlink_callback *cb);
+#ifdef CONFIG_NETLINK_MMAP
+static int netlink_set_ring(struct sock *sk, struct nl_mmap_req *req, int closing);
+#endif
 
 static DEFINE_RWLOCK(nl_table_lock);
 static atomic_t nl_table_users = ATOMIC_INIT(0);
@@ -377,11 +401,23 @@ static int netlink_release(struct socket *sock)
 		nlk->cb = NULL;
 		__sock_put(sk);
 	}
+	if (nlk->dump_skb) {
+		kfree_skb(nlk->dump_skb);
+		nlk->dump_skb = NULL;
+	}
 	spin_unlock(&nlk->cb_lock);
 
 	/* OK. Socket is unlinked, and, therefore,
 	   no new packets will arrive */
 
+#ifdef CONFIG_NETLINK_MMAP
+	if (nlk->pg_vec) {
+		struct nl_mmap_req req;
+		memset(&req, 0, sizeof(req));
+		netlink_set_ring(sk, &req, 1);
+	}
+#endif
+
 	sock_orphan(sk);
 	sock->sk = NULL;
 	wake_up_interruptible_all(&nlk->wait);
@@ -577,6 +613,136 @@ struct sock *netlink_getsockbyfilp(struct file *filp)
 	return sock;
 }
 
+#ifdef CONFIG_NETLINK_MMAP
+static inline struct nl_mmap_hdr *netlink_lookup_frame(struct netlink_sock *nlk,
+						       unsigned int position)
+{
+	unsigned int pg_vec_pos, frame_offset;
+
+	pg_vec_pos = position / nlk->frames_per_block;
+	frame_offset = position % nlk->frames_per_block;
+
+	return (struct nl_mmap_hdr *)(nlk->pg_vec[pg_vec_pos] +
+				      frame_offset * nlk->frame_size);
+}
+
+/* Whether the next message has a free frame to go to */
+static int netlink_ring_has_room(struct sock *sk)
+{
+	struct netlink_sock *nlk = nlk_sk(sk);
+	int room = 0;
+
+	spin_lock_bh(&sk->sk_receive_queue.lock);
+	if (nlk->pg_vec)
+		room = netlink_lookup_frame(nlk, nlk->head)->nm_status ==
+		       NL_MMAP_STATUS_UNUSED;
+	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	return room;
+}
+
+/*
+ * Put a message in the receive ring of a socket.  The skb is left to
+ * the caller, so one broadcast skb serves every ring listener without
+ * a clone.  A message too large for a frame is queued as a clone and
+ * announced by a NL_MMAP_STATUS_COPY frame, to keep the order.
+ * The frame is filled in after sk_receive_queue.lock is dropped, inside
+ * an RCU read side section that netlink_set_ring waits for before it
+ * frees the ring.
+ * Return values:
+ * 1: the socket has no ring, queue the skb as usual.
+ * 0: delivered.
+ * < 0: ring full or out of memory, counted as a drop.
+ */
+static int netlink_ring_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	struct netlink_sock *nlk = nlk_sk(sk);
+	struct sk_buff *copy_skb = NULL;
+	struct nl_mmap_hdr *hdr;
+	struct page *p_start, *p_end;
+	unsigned int status = NL_MMAP_STATUS_VALID;
+	unsigned int len = 0;
+
+	rcu_read_lock();
+	spin_lock_bh(&sk->sk_receive_queue.lock);
+	if (nlk->pg_vec == NULL) {
+		spin_unlock_bh(&sk->sk_receive_queue.lock);
+		rcu_read_unlock();
+		return 1;
+	}
+	hdr = netlink_lookup_frame(nlk, nlk->head);
+	if (hdr->nm_status != NL_MMAP_STATUS_UNUSED)
+		goto ring_is_full;
+	if (NL_MMAP_HDRLEN + skb->len > nlk->frame_size) {
+		status = NL_MMAP_STATUS_COPY;
+		if (atomic_read(&sk->sk_rmem_alloc) > sk->sk_rcvbuf)
+			goto ring_is_full;
+		copy_skb = skb_clone(skb, GFP_ATOMIC);
+		if (copy_skb == NULL)
+			goto ring_is_full;
+		skb_set_owner_r(copy_skb, sk);
+		__skb_queue_tail(&sk->sk_receive_queue, copy_skb);
+	} else
+		len = skb->len;
+	nlk->head = nlk->head != nlk->frame_max ? nlk->head + 1 : 0;
+	nlk->stats.nm_frames++;
+	spin_unlock_bh(&sk->sk_receive_queue.lock);
+
+	if (len)
+		skb_copy_bits(skb, 0, (u8 *)hdr + NL_MMAP_HDRLEN, len);
+	hdr->nm_len = skb->len;
+	hdr->nm_group = NETLINK_CB(skb).dst_groups;
+	hdr->nm_pid = NETLINK_CB(skb).pid;
+	hdr->nm_uid = NETLINK_CREDS(skb)->uid;
+	hdr->nm_gid = NETLINK_CREDS(skb)->gid;
+	smp_wmb();
+	hdr->nm_status = status;
+	mb();
+
+	p_start = virt_to_page(hdr);
+	p_end = virt_to_page((u8 *)hdr + NL_MMAP_HDRLEN + len - 1);
+	while (p_start <= p_end) {
+		flush_dcache_page(p_start);
+		p_start++;
+	}
+	rcu_read_unlock();
+
+	sk->sk_data_ready(sk, skb->len);
+	return 0;
+
+ring_is_full:
+	nlk->stats.nm_drops++;
+	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	rcu_read_unlock();
+	sk->sk_data_ready(sk, 0);
+	return -ENOBUFS;
+}
+#endif
+
+/*
+ * Hand a skb charged to sk to the reader, through the ring if it has one.
+ * If the ring is full the skb is left to the caller.
+ */
+static int netlink_queue_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	int len = skb->len;
+
+#ifdef CONFIG_NETLINK_MMAP
+	if (nlk_sk(sk)->pg_vec) {
+		int err = netlink_ring_rcv(sk, skb);
+
+		if (err < 0)
+			return err;
+		if (err == 0) {
+			kfree_skb(skb);
+			return 0;
+		}
+	}
+#endif
+	skb_queue_tail(&sk->sk_receive_queue, skb);
+	sk->sk_data_ready(sk, len);
+	return 0;
+}
+
 /*
  * Attach a skb to a netlink socket.
  * The caller must hold a reference to the destination socket. On error, the
@@ -634,6 +800,7 @@ int netlink_sendskb(struct sock *sk, struct sk_buff *skb, int protocol)
 {
 	struct netlink_sock *nlk;
 	int len = skb->len;
+	int err;
 
 	nlk = nlk_sk(sk);
 #ifdef NL_EMULATE_DEV
@@ -645,10 +812,11 @@ int netlink_sendskb(struct sock *sk, struct sk_buff *skb, int protocol)
 	}
 #endif
 
-	skb_queue_tail(&sk->sk_receive_queue, skb);
-	sk->sk_data_ready(sk, len);
+	err = netlink_queue_rcv(sk, skb);
+	if (err)
+		kfree_skb(skb);
 	sock_put(sk);
-	return len;
+	return err ? : len;
 }
 
 void netlink_detachskb(struct sock *sk, struct sk_buff *skb)
@@ -747,6 +915,15 @@ static inline int do_one_broadcast(struct sock *sk,
 	if (nlk->pid == p->pid || !(nlk->groups & p->group))
 		goto out;
 
+#ifdef CONFIG_NETLINK_MMAP
+	/* Ring listeners copy from the original, no clone needed */
+	if (nlk->pg_vec && (val = netlink_ring_rcv(sk, p->skb)) <= 0) {
+		if (val == 0)
+			p->delivered = 1;
+		goto out;
+	}
+#endif
+
 	if (p->failure) {
 		netlink_overrun(sk);
 		goto out;
@@ -863,6 +1040,12 @@ void netlink_set_err(struct sock *ssk, u32 pid, u32 group, int code)
 	read_unlock(&nl_table_lock);
 }
 
+/* A dump still has messages to hand to the reader */
+static inline int netlink_dump_pending(struct netlink_sock *nlk)
+{
+	return nlk->cb != NULL || nlk->dump_skb != NULL;
+}
+
 static inline void netlink_rcv_wake(struct sock *sk)
 {
 	struct netlink_sock *nlk = nlk_sk(sk);
@@ -1004,7 +1187,8 @@ static int netlink_recvmsg(struct kiocb *kiocb, struct socket *sock,
 	siocb->scm->creds = *NETLINK_CREDS(skb);
 	skb_free_datagram(sk, skb);
 
-	if (nlk->cb && atomic_read(&sk->sk_rmem_alloc) <= sk->sk_rcvbuf / 2)
+	if (netlink_dump_pending(nlk) &&
+	    atomic_read(&sk->sk_rmem_alloc) <= sk->sk_rcvbuf / 2)
 		netlink_dump(sk);
 
 	scm_recv(sock, msg, siocb->scm, flags);
@@ -1023,6 +1207,294 @@ static void netlink_data_ready(struct sock *sk, int len)
 	netlink_rcv_wake(sk);
 }
 
+#ifdef CONFIG_NETLINK_MMAP
+static unsigned int netlink_poll(struct file *file, struct socket *sock,
+				 poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	struct netlink_sock *nlk = nlk_sk(sk);
+	unsigned int mask;
+
+	/* Ring readers do not call recvmsg, so a dump goes on from here
+	 * once there is a free frame.
+	 */
+	if (netlink_dump_pending(nlk) && netlink_ring_has_room(sk))
+		netlink_dump(sk);
+
+	mask = datagram_poll(file, sock, wait);
+
+	spin_lock_bh(&sk->sk_receive_queue.lock);
+	if (nlk->pg_vec) {
+		unsigned int last = nlk->head ? nlk->head - 1 : nlk->frame_max;
+
+		if (netlink_lookup_frame(nlk, last)->nm_status != NL_MMAP_STATUS_UNUSED)
+			mask |= POLLIN | POLLRDNORM;
+	}
+	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	return mask;
+}
+
+static void netlink_mm_open(struct vm_area_struct *vma)
+{
+	struct file *file = vma->vm_file;
+	struct inode *inode = file->f_dentry->d_inode;
+	struct socket *sock = SOCKET_I(inode);
+	struct sock *sk = sock->sk;
+
+	if (sk)
+		atomic_inc(&nlk_sk(sk)->mapped);
+}
+
+static void netlink_mm_close(struct vm_area_struct *vma)
+{
+	struct file *file = vma->vm_file;
+	struct inode *inode = file->f_dentry->d_inode;
+	struct socket *sock = SOCKET_I(inode);
+	struct sock *sk = sock->sk;
+
+	if (sk)
+		atomic_dec(&nlk_sk(sk)->mapped);
+}
+
+static struct vm_operations_struct netlink_mmap_ops = {
+	.open =		netlink_mm_open,
+	.close =	netlink_mm_close,
+};
+
+static inline struct page *pg_vec_endpage(char *one_pg_vec, unsigned int order)
+{
+	return virt_to_page(one_pg_vec + (PAGE_SIZE << order) - 1);
+}
+
+static void free_pg_vec(char **pg_vec, unsigned order, unsigned len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (pg_vec[i]) {
+			struct page *page, *pend;
+
+			pend = pg_vec_endpage(pg_vec[i], order);
+			for (page = virt_to_page(pg_vec[i]); page <= pend; page++)
+				ClearPageReserved(page);
+			free_pages((unsigned long)pg_vec[i], order);
+		}
+	}
+	kfree(pg_vec);
+}
+
+/*
+ * Set up, or with a zero req tear down, the receive ring.  The pointers
+ * are swapped under sk_receive_queue.lock; writers that looked up a
+ * frame of the old ring before that are waited for before it is freed.
+ */
+static int netlink_set_ring(struct sock *sk, struct nl_mmap_req *req, int closing)
+{
+	struct netlink_sock *nlk = nlk_sk(sk);
+	char **pg_vec = NULL;
+	unsigned int frames_per_block = 0;
+	int order = 0;
+	int err = 0;
+	int i, k;
+
+	if (req->nm_block_nr) {
+		if (nlk->pg_vec)
+			return -EBUSY;
+		if ((int)req->nm_block_size <= 0)
+			return -EINVAL;
+		if (req->nm_block_size & (PAGE_SIZE - 1))
+			return -EINVAL;
+		if (req->nm_frame_size < NL_MMAP_HDRLEN)
+			return -EINVAL;
+		if (req->nm_frame_size & (NL_MMAP_ALIGNMENT - 1))
+			return -EINVAL;
+
+		frames_per_block = req->nm_block_size / req->nm_frame_size;
+		if (frames_per_block == 0)
+			return -EINVAL;
+		if (frames_per_block * req->nm_block_nr != req->nm_frame_nr)
+			return -EINVAL;
+
+		while ((PAGE_SIZE << order) < req->nm_block_size)
+			order++;
+
+		err = -ENOMEM;
+		pg_vec = kmalloc(req->nm_block_nr * sizeof(char *), GFP_KERNEL);
+		if (pg_vec == NULL)
+			goto out;
+		memset(pg_vec, 0, req->nm_block_nr * sizeof(char *));
+
+		for (i = 0; i < req->nm_block_nr; i++) {
+			struct page *page, *pend;
+
+			pg_vec[i] = (char *)__get_free_pages(GFP_KERNEL, order);
+			if (!pg_vec[i])
+				goto out_free_pgvec;
+
+			pend = pg_vec_endpage(pg_vec[i], order);
+			for (page = virt_to_page(pg_vec[i]); page <= pend; page++)
+				SetPageReserved(page);
+
+			for (k = 0; k < frames_per_block; k++) {
+				struct nl_mmap_hdr *hdr;
+
+				hdr = (struct nl_mmap_hdr *)(pg_vec[i] +
+							     k * req->nm_frame_size);
+				hdr->nm_status = NL_MMAP_STATUS_UNUSED;
+			}
+		}
+	} else {
+		if (req->nm_frame_nr)
+			return -EINVAL;
+	}
+
+	lock_sock(sk);
+
+	err = -EBUSY;
+	if (closing || atomic_read(&nlk->mapped) == 0) {
+		err = 0;
+#define XC(a, b) ({ __typeof__ ((a)) __t; __t = (a); (a) = (b); __t; })
+
+		spin_lock_bh(&sk->sk_receive_queue.lock);
+		pg_vec = XC(nlk->pg_vec, pg_vec);
+		nlk->frame_max = req->nm_frame_nr - 1;
+		nlk->head = 0;
+		nlk->frame_size = req->nm_frame_size;
+		nlk->frames_per_block = frames_per_block;
+		spin_unlock_bh(&sk->sk_receive_queue.lock);
+
+		if (pg_vec)
+			synchronize_net();
+
+		order = XC(nlk->pg_vec_order, order);
+		req->nm_block_nr = XC(nlk->pg_vec_len, req->nm_block_nr);
+
+		nlk->pg_vec_pages = req->nm_block_size / PAGE_SIZE;
+#undef XC
+		if (atomic_read(&nlk->mapped))
+			printk(KERN_DEBUG "netlink_mmap: vma is busy: %d\n",
+			       atomic_read(&nlk->mapped));
+	}
+
+	release_sock(sk);
+
+out_free_pgvec:
+	if (pg_vec)
+		free_pg_vec(pg_vec, order, req->nm_block_nr);
+out:
+	return err;
+}
+
+static int netlink_mmap(struct file *file, struct socket *sock,
+			struct vm_area_struct *vma)
+{
+	struct sock *sk = sock->sk;
+	struct netlink_sock *nlk = nlk_sk(sk);
+	unsigned long size;
+	unsigned long start;
+	int err = -EINVAL;
+	int i;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	size = vma->vm_end - vma->vm_start;
+
+	lock_sock(sk);
+	if (nlk->pg_vec == NULL)
+		goto out;
+	if (size != nlk->pg_vec_len * nlk->pg_vec_pages * PAGE_SIZE)
+		goto out;
+
+	atomic_inc(&nlk->mapped);
+	start = vma->vm_start;
+	err = -EAGAIN;
+	for (i = 0; i < nlk->pg_vec_len; i++) {
+		if (remap_pfn_range(vma, start,
+				    __pa(nlk->pg_vec[i]) >> PAGE_SHIFT,
+				    nlk->pg_vec_pages * PAGE_SIZE,
+				    vma->vm_page_prot))
+			goto out;
+		start += nlk->pg_vec_pages * PAGE_SIZE;
+	}
+	vma->vm_ops = &netlink_mmap_ops;
+	err = 0;
+
+out:
+	release_sock(sk);
+	return err;
+}
+#else
+#define netlink_poll	datagram_poll
+#define netlink_mmap	sock_no_mmap
+#endif
+
+static int netlink_setsockopt(struct socket *sock, int level, int optname,
+			      char __user *optval, int optlen)
+{
+	if (level != SOL_NETLINK)
+		return -ENOPROTOOPT;
+
+	switch (optname) {
+#ifdef CONFIG_NETLINK_MMAP
+	case NETLINK_RX_RING:
+	{
+		struct nl_mmap_req req;
+
+		if (optlen < sizeof(req))
+			return -EINVAL;
+		if (copy_from_user(&req, optval, sizeof(req)))
+			return -EFAULT;
+		return netlink_set_ring(sock->sk, &req, 0);
+	}
+#endif
+	default:
+		return -ENOPROTOOPT;
+	}
+}
+
+static int netlink_getsockopt(struct socket *sock, int level, int optname,
+			      char __user *optval, int __user *optlen)
+{
+	int len;
+
+	if (level != SOL_NETLINK)
+		return -ENOPROTOOPT;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	switch (optname) {
+#ifdef CONFIG_NETLINK_MMAP
+	case NETLINK_RING_STATS:
+	{
+		struct sock *sk = sock->sk;
+		struct netlink_sock *nlk = nlk_sk(sk);
+		struct nl_mmap_stats st;
+
+		if (len > sizeof(st))
+			len = sizeof(st);
+		spin_lock_bh(&sk->sk_receive_queue.lock);
+		st = nlk->stats;
+		memset(&nlk->stats, 0, sizeof(st));
+		spin_unlock_bh(&sk->sk_receive_queue.lock);
+
+		if (copy_to_user(optval, &st, len))
+			return -EFAULT;
+		break;
+	}
+#endif
+	default:
+		return -ENOPROTOOPT;
+	}
+
+	if (put_user(len, optlen))
+		return -EFAULT;
+	return 0;
+}
+
 /*
  *	We export these functions to other modules. They provide a 
  *	complete set of kernel non-blocking support for message
@@ -1073,6 +1545,20 @@ static void netlink_destroy_callback(struct netlink_callback *cb)
 	kfree(cb);
 }
 
+/*
+ * Queue a dump message, called with cb_lock held.  When the ring is
+ * full the message is kept for the next netlink_dump rather than lost,
+ * and the reader gets ENOBUFS.
+ */
+static void netlink_dump_queue(struct sock *sk, struct sk_buff *skb)
+{
+	if (netlink_queue_rcv(sk, skb)) {
+		nlk_sk(sk)->dump_skb = skb;
+		sk->sk_err = ENOBUFS;
+		sk->sk_error_report(sk);
+	}
+}
+
 /*
  * It looks a bit ugly.
  * It would be better to create kernel thread.
@@ -1085,7 +1571,25 @@ static int netlink_dump(struct sock *sk)
 	struct sk_buff *skb;
 	struct nlmsghdr *nlh;
 	int len;
-	
+
+	/* A message the ring had no room for goes out before anything new */
+	spin_lock(&nlk->cb_lock);
+	skb = nlk->dump_skb;
+	if (skb) {
+		nlk->dump_skb = NULL;
+		if (netlink_queue_rcv(sk, skb)) {
+			nlk->dump_skb = skb;
+			spin_unlock(&nlk->cb_lock);
+			return -ENOBUFS;
+		}
+	}
+	spin_unlock(&nlk->cb_lock);
+
+#ifdef CONFIG_NETLINK_MMAP
+	if (nlk->pg_vec && !netlink_ring_has_room(sk))
+		return -ENOBUFS;
+#endif
+
 	skb = sock_rmalloc(sk, NLMSG_GOODSIZE, 0, GFP_KERNEL);
 	if (!skb)
 		return -ENOBUFS;
@@ -1093,26 +1597,24 @@ static int netlink_dump(struct sock *sk)
 	spin_lock(&nlk->cb_lock);
 
 	cb = nlk->cb;
-	if (cb == NULL) {
+	if (cb == NULL || nlk->dump_skb) {
 		spin_unlock(&nlk->cb_lock);
 		kfree_skb(skb);
-		return -EINVAL;
+		return cb ? -ENOBUFS : -EINVAL;
 	}
 
 	len = cb->dump(skb, cb);
 
 	if (len > 0) {
+		netlink_dump_queue(sk, skb);
 		spin_unlock(&nlk->cb_lock);
-		skb_queue_tail(&sk->sk_receive_queue, skb);
-		sk->sk_data_ready(sk, len);
 		return 0;
 	}
 
 	nlh = __nlmsg_put(skb, NETLINK_CB(cb->skb).pid, cb->nlh->nlmsg_seq, NLMSG_DONE, sizeof(int));
 	nlh->nlmsg_flags |= NLM_F_MULTI;
 	memcpy(NLMSG_DATA(nlh), &len, sizeof(len));
-	skb_queue_tail(&sk->sk_receive_queue, skb);
-	sk->sk_data_ready(sk, skb->len);
+	netlink_dump_queue(sk, skb);
 
 	cb->done(cb);
 	nlk->cb = NULL;
@@ -1363,15 +1865,15 @@ static struct proto_ops netlink_ops = {
 	.socketpair =	sock_no_socketpair,
 	.accept =	sock_no_accept,
 	.getname =	netlink_getname,
-	.poll =		datagram_poll,
+	.poll =		netlink_poll,
 	.ioctl =	sock_no_ioctl,
 	.listen =	sock_no_listen,
 	.shutdown =	sock_no_shutdown,
-	.setsockopt =	sock_no_setsockopt,
-	.getsockopt =	sock_no_getsockopt,
+	.setsockopt =	netlink_setsockopt,
+	.getsockopt =	netlink_getsockopt,
 	.sendmsg =	netlink_sendmsg,
 	.recvmsg =	netlink_recvmsg,
-	.mmap =		sock_no_mmap,
+	.mmap =		netlink_mmap,
 	.sendpage =	sock_no_sendpage,
 };
 
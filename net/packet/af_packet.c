@@ -72,6 +72,9 @@
 #include <linux/poll.h>
 #include <linux/module.h>
 #include <linux/init.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/ipv6.h>
 
 #ifdef CONFIG_INET
 #include <net/inet_common.h>
@@ -170,6 +173,39 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 
 static void packet_flush_mclist(struct sock *sk);
 
+/*
+   Fanout groups.
+
+   Sockets bound to the same device and protocol may join a group with
+   PACKET_FANOUT.  The group owns a single packet_type hook and hands
+   every frame to exactly one member, chosen by flow hash, receiving
+   CPU or round robin, so that each capture thread can own a socket.
+   The member array is changed under f->lock and read locklessly from
+   the receive path; a socket leaving it is only freed after
+   synchronize_net().
+ */
+
+#define PACKET_FANOUT_MAX	256
+
+struct packet_fanout
+{
+	struct packet_fanout	*next;
+	u16			id;
+	u16			type;
+	int			ifindex;
+	int			sk_ref;		/* members, under fanout_lock */
+	char			running;	/* prot_hook is attached */
+	unsigned int		rr_cur;
+	struct packet_type	prot_hook;
+	spinlock_t		lock;
+	unsigned int		num_members;
+	struct sock		*arr[PACKET_FANOUT_MAX];
+};
+
+static struct packet_fanout *fanout_list;
+static DEFINE_SPINLOCK(fanout_lock);
+static u32 fanout_rnd;
+
 struct packet_sock {
 	/* struct sock has to be the first member of packet_sock */
 	struct sock		sk;
@@ -187,6 +223,7 @@ struct packet_sock {
 	char			running;	/* prot_hook is attached*/
 	int			ifindex;	/* bound device		*/
 	unsigned short		num;
+	struct packet_fanout	*fanout;
 #ifdef CONFIG_PACKET_MULTICAST
 	struct packet_mclist	*mclist;
 #endif
@@ -219,6 +256,76 @@ static inline struct packet_sock *pkt_sk(struct sock *sk)
 	return (struct packet_sock *)sk;
 }
 
+static void __fanout_link(struct sock *sk, struct packet_sock *po)
+{
+	struct packet_fanout *f = po->fanout;
+
+	spin_lock(&f->lock);
+	f->arr[f->num_members] = sk;
+	smp_wmb();
+	f->num_members++;
+	spin_unlock(&f->lock);
+}
+
+static void __fanout_unlink(struct sock *sk, struct packet_sock *po)
+{
+	struct packet_fanout *f = po->fanout;
+	unsigned int i;
+
+	spin_lock(&f->lock);
+	for (i = 0; i < f->num_members; i++) {
+		if (f->arr[i] == sk)
+			break;
+	}
+	BUG_ON(i >= f->num_members);
+	f->arr[i] = f->arr[f->num_members - 1];
+	f->num_members--;
+	spin_unlock(&f->lock);
+}
+
+/*
+ *	Attach the socket to the network: to its own hook, or to the
+ *	member array of its fanout group.  Called with po->bind_lock held.
+ */
+
+static void register_prot_hook(struct sock *sk)
+{
+	struct packet_sock *po = pkt_sk(sk);
+
+	if (!po->running) {
+		if (po->fanout)
+			__fanout_link(sk, po);
+		else
+			dev_add_pack(&po->prot_hook);
+		sock_hold(sk);
+		po->running = 1;
+	}
+}
+
+/*
+ *	Detach a running socket.  Called with po->bind_lock held; with
+ *	sync set the lock is dropped while packets in flight drain, so
+ *	the caller must be able to sleep.
+ */
+
+static void __unregister_prot_hook(struct sock *sk, int sync)
+{
+	struct packet_sock *po = pkt_sk(sk);
+
+	po->running = 0;
+	if (po->fanout)
+		__fanout_unlink(sk, po);
+	else
+		__dev_remove_pack(&po->prot_hook);
+	__sock_put(sk);
+
+	if (sync) {
+		spin_unlock(&po->bind_lock);
+		synchronize_net();
+		spin_lock(&po->bind_lock);
+	}
+}
+
 static void packet_sock_destruct(struct sock *sk)
 {
 	BUG_TRAP(!atomic_read(&sk->sk_rmem_alloc));
@@ -539,6 +646,254 @@ drop:
 	return 0;
 }
 
+#ifdef CONFIG_PACKET_MMAP
+static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,  struct packet_type *pt);
+#endif
+
+/*
+ *	Flow hash for PACKET_FANOUT_HASH.  Addresses and ports are put in
+ *	order before hashing, so both directions of a connection end up
+ *	on the same member.
+ */
+
+static u32 fanout_hash(struct sk_buff *skb)
+{
+	u32 a = 0, b = 0, ports = 0, tmp;
+	u16 sport, dport;
+	u8 proto = 0;
+	int poff = 0;
+	/* Outgoing packets from dev_queue_xmit_nit still have the link
+	 * layer header in front, as in packet_rcv.
+	 */
+	int nhoff = skb->nh.raw - skb->data;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+	{
+		struct iphdr _iph, *iph;
+
+		iph = skb_header_pointer(skb, nhoff, sizeof(_iph), &_iph);
+		if (iph == NULL)
+			break;
+		a = iph->saddr;
+		b = iph->daddr;
+		proto = iph->protocol;
+		if (!(iph->frag_off & htons(IP_MF|IP_OFFSET)))
+			poff = nhoff + iph->ihl * 4;
+		break;
+	}
+	case __constant_htons(ETH_P_IPV6):
+	{
+		struct ipv6hdr _ip6h, *ip6h;
+
+		ip6h = skb_header_pointer(skb, nhoff, sizeof(_ip6h), &_ip6h);
+		if (ip6h == NULL)
+			break;
+		a = ip6h->saddr.s6_addr32[0] ^ ip6h->saddr.s6_addr32[1] ^
+		    ip6h->saddr.s6_addr32[2] ^ ip6h->saddr.s6_addr32[3];
+		b = ip6h->daddr.s6_addr32[0] ^ ip6h->daddr.s6_addr32[1] ^
+		    ip6h->daddr.s6_addr32[2] ^ ip6h->daddr.s6_addr32[3];
+		proto = ip6h->nexthdr;
+		poff = nhoff + sizeof(struct ipv6hdr);
+		break;
+	}
+	}
+
+	if (poff && (proto == IPPROTO_TCP || proto == IPPROTO_UDP)) {
+		u16 _ports[2], *pp;
+
+		pp = skb_header_pointer(skb, poff, sizeof(_ports), _ports);
+		if (pp != NULL) {
+			sport = pp[0];
+			dport = pp[1];
+			if (sport > dport) {
+				tmp = sport;
+				sport = dport;
+				dport = tmp;
+			}
+			ports = ((u32)sport << 16) | dport;
+		}
+	}
+
+	if (a > b) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+	return jhash_3words(a, b, ports ^ proto, fanout_rnd);
+}
+
+/*
+ *	Receive hook of a fanout group: pick one member and hand it the
+ *	packet through the member's own receive function.
+ */
+
+static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev, struct packet_type *pt)
+{
+	struct packet_fanout *f = pt->af_packet_priv;
+	unsigned int num = f->num_members;
+	unsigned int idx;
+	struct packet_sock *po;
+
+	if (num == 0) {
+		kfree_skb(skb);
+		return 0;
+	}
+	smp_rmb();
+
+	switch (f->type) {
+	case PACKET_FANOUT_HASH:
+	default:
+		idx = fanout_hash(skb) % num;
+		break;
+	case PACKET_FANOUT_LB:
+		idx = f->rr_cur++ % num;
+		break;
+	case PACKET_FANOUT_CPU:
+		idx = smp_processor_id() % num;
+		break;
+	}
+
+	po = pkt_sk(f->arr[idx]);
+	return po->prot_hook.func(skb, dev, &po->prot_hook);
+}
+
+/* Take an unused group off fanout_list, with fanout_lock held */
+static void __fanout_unlist(struct packet_fanout *f)
+{
+	struct packet_fanout **fp;
+
+	for (fp = &fanout_list; *fp; fp = &(*fp)->next) {
+		if (*fp == f) {
+			*fp = f->next;
+			break;
+		}
+	}
+	if (f->running) {
+		__dev_remove_pack(&f->prot_hook);
+		f->running = 0;
+	}
+}
+
+/*
+ *	Join fanout group 'id', creating it on first use.  The socket must
+ *	already be bound and running; its own hook is replaced by the one
+ *	of the group.
+ */
+
+static int fanout_add(struct sock *sk, u16 id, u16 type)
+{
+	struct packet_sock *po = pkt_sk(sk);
+	struct packet_fanout *f, *match;
+	int err;
+
+	switch (type) {
+	case PACKET_FANOUT_HASH:
+	case PACKET_FANOUT_LB:
+	case PACKET_FANOUT_CPU:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	match = kmalloc(sizeof(*match), GFP_KERNEL);
+	if (match == NULL)
+		return -ENOMEM;
+
+	lock_sock(sk);
+
+	err = -EINVAL;
+	if (!po->running)
+		goto out;
+	err = -EALREADY;
+	if (po->fanout)
+		goto out;
+
+	spin_lock(&fanout_lock);
+	for (f = fanout_list; f; f = f->next) {
+		if (f->id == id)
+			break;
+	}
+	if (f == NULL) {
+		f = match;
+		match = NULL;
+		memset(f, 0, sizeof(*f));
+		f->id = id;
+		f->type = type;
+		f->ifindex = po->ifindex;
+		spin_lock_init(&f->lock);
+		f->prot_hook.type = po->prot_hook.type;
+		f->prot_hook.dev = po->prot_hook.dev;
+		f->prot_hook.func = packet_rcv_fanout;
+		f->prot_hook.af_packet_priv = f;
+		dev_add_pack(&f->prot_hook);
+		f->running = 1;
+		f->next = fanout_list;
+		fanout_list = f;
+	}
+
+	err = -EINVAL;
+	if (f->type != type || f->ifindex != po->ifindex ||
+	    f->prot_hook.type != po->prot_hook.type)
+		goto out_unlock;
+	err = -ENOSPC;
+	if (f->sk_ref >= PACKET_FANOUT_MAX)
+		goto out_unlock;
+
+	spin_lock(&po->bind_lock);
+	if (po->running) {
+		__dev_remove_pack(&po->prot_hook);
+		po->fanout = f;
+		f->sk_ref++;
+		__fanout_link(sk, po);
+		err = 0;
+	}
+	spin_unlock(&po->bind_lock);
+
+out_unlock:
+	/* A group created for a join that failed has no users */
+	if (f->sk_ref == 0) {
+		__fanout_unlist(f);
+		match = f;
+	}
+	spin_unlock(&fanout_lock);
+	if (err && match == f)
+		synchronize_net();
+out:
+	release_sock(sk);
+	if (match)
+		kfree(match);
+	return err;
+}
+
+/*
+ *	Leave the fanout group on close.  The socket has already been
+ *	unlinked from the member array; the last one out tears the group
+ *	down.
+ */
+
+static void fanout_release(struct sock *sk)
+{
+	struct packet_sock *po = pkt_sk(sk);
+	struct packet_fanout *f;
+
+	f = po->fanout;
+	if (f == NULL)
+		return;
+	po->fanout = NULL;
+
+	spin_lock(&fanout_lock);
+	if (--f->sk_ref) {
+		spin_unlock(&fanout_lock);
+		return;
+	}
+	__fanout_unlist(f);
+	spin_unlock(&fanout_lock);
+
+	synchronize_net();
+	kfree(f);
+}
+
 #ifdef CONFIG_PACKET_MMAP
 static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,  struct packet_type *pt)
 {
@@ -803,15 +1158,17 @@ static int packet_release(struct socket *sock)
 	 *	Unhook packet receive handler.
 	 */
 
+	spin_lock(&po->bind_lock);
 	if (po->running) {
 		/*
 		 *	Remove the protocol hook
 		 */
-		dev_remove_pack(&po->prot_hook);
-		po->running = 0;
 		po->num = 0;
-		__sock_put(sk);
+		__unregister_prot_hook(sk, 1);
 	}
+	spin_unlock(&po->bind_lock);
+
+	fanout_release(sk);
 
 #ifdef CONFIG_PACKET_MULTICAST
 	packet_flush_mclist(sk);
@@ -853,14 +1210,16 @@ static int packet_do_bind(struct sock *sk, struct net_device *dev, int protocol)
 
 	lock_sock(sk);
 
+	/* A fanout member is tied to the device and protocol of its group */
+	if (po->fanout) {
+		release_sock(sk);
+		return -EINVAL;
+	}
+
 	spin_lock(&po->bind_lock);
 	if (po->running) {
-		__sock_put(sk);
-		po->running = 0;
 		po->num = 0;
-		spin_unlock(&po->bind_lock);
-		dev_remove_pack(&po->prot_hook);
-		spin_lock(&po->bind_lock);
+		__unregister_prot_hook(sk, 1);
 	}
 
 	po->num = protocol;
@@ -874,18 +1233,14 @@ static int packet_do_bind(struct sock *sk, struct net_device *dev, int protocol)
 
 	if (dev) {
 		if (dev->flags&IFF_UP) {
-			dev_add_pack(&po->prot_hook);
-			sock_hold(sk);
-			po->running = 1;
+			register_prot_hook(sk);
 		} else {
 			sk->sk_err = ENETDOWN;
 			if (!sock_flag(sk, SOCK_DEAD))
 				sk->sk_error_report(sk);
 		}
 	} else {
-		dev_add_pack(&po->prot_hook);
-		sock_hold(sk);
-		po->running = 1;
+		register_prot_hook(sk);
 	}
 
 out_unlock:
@@ -1012,9 +1367,7 @@ static int packet_create(struct socket *sock, int protocol)
 
 	if (protocol) {
 		po->prot_hook.type = protocol;
-		dev_add_pack(&po->prot_hook);
-		sock_hold(sk);
-		po->running = 1;
+		register_prot_hook(sk);
 	}
 
 	write_lock_bh(&packet_sklist_lock);
@@ -1342,6 +1695,17 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		return 0;
 	}
 #endif
+	case PACKET_FANOUT:
+	{
+		int val;
+
+		if (optlen!=sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val,optval,sizeof(val)))
+			return -EFAULT;
+
+		return fanout_add(sk, val & 0xffff, val >> 16);
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1380,6 +1744,18 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 			return -EFAULT;
 		break;
 	}
+	case PACKET_FANOUT:
+	{
+		int val = 0;
+
+		if (po->fanout)
+			val = po->fanout->id | (po->fanout->type << 16);
+		if (len > sizeof(int))
+			len = sizeof(int);
+		if (copy_to_user(optval, &val, len))
+			return -EFAULT;
+		break;
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1411,9 +1787,7 @@ static int packet_notifier(struct notifier_block *this, unsigned long msg, void
 			if (dev->ifindex == po->ifindex) {
 				spin_lock(&po->bind_lock);
 				if (po->running) {
-					__dev_remove_pack(&po->prot_hook);
-					__sock_put(sk);
-					po->running = 0;
+					__unregister_prot_hook(sk, 0);
 					sk->sk_err = ENETDOWN;
 					if (!sock_flag(sk, SOCK_DEAD))
 						sk->sk_error_report(sk);
@@ -1428,16 +1802,31 @@ static int packet_notifier(struct notifier_block *this, unsigned long msg, void
 		case NETDEV_UP:
 			spin_lock(&po->bind_lock);
 			if (dev->ifindex == po->ifindex && po->num &&
-			    !po->running) {
-				dev_add_pack(&po->prot_hook);
-				sock_hold(sk);
-				po->running = 1;
-			}
+			    !po->running)
+				register_prot_hook(sk);
 			spin_unlock(&po->bind_lock);
 			break;
 		}
 	}
 	read_unlock(&packet_sklist_lock);
+
+	/* The group hooks hold the device too; members were unlinked above */
+	if (msg == NETDEV_UNREGISTER) {
+		struct packet_fanout *f;
+
+		spin_lock(&fanout_lock);
+		for (f = fanout_list; f; f = f->next) {
+			if (f->ifindex != dev->ifindex)
+				continue;
+			if (f->running) {
+				__dev_remove_pack(&f->prot_hook);
+				f->running = 0;
+			}
+			f->ifindex = -1;
+			f->prot_hook.dev = NULL;
+		}
+		spin_unlock(&fanout_lock);
+	}
 	return NOTIFY_DONE;
 }
 
@@ -1653,10 +2042,8 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 	was_running = po->running;
 	num = po->num;
 	if (was_running) {
-		__dev_remove_pack(&po->prot_hook);
 		po->num = 0;
-		po->running = 0;
-		__sock_put(sk);
+		__unregister_prot_hook(sk, 0);
 	}
 	spin_unlock(&po->bind_lock);
 		
@@ -1687,10 +2074,8 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 
 	spin_lock(&po->bind_lock);
 	if (was_running && !po->running) {
-		sock_hold(sk);
-		po->running = 1;
 		po->num = num;
-		dev_add_pack(&po->prot_hook);
+		register_prot_hook(sk);
 	}
 	spin_unlock(&po->bind_lock);
 
@@ -1886,6 +2271,7 @@ static void __exit packet_exit(void)
 
 static int __init packet_init(void)
 {
+	get_random_bytes(&fanout_rnd, sizeof(fanout_rnd));
 	sock_register(&packet_family_ops);
 	register_netdevice_notifier(&packet_netdev_notifier);
 	proc_net_fops_create("packet", 0, &packet_seq_fops);
@@ -0,0 +1,508 @@
+/*
+ * net/sched/cls_flow.c		Flow Hash Classifier.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * A filter picks a set of packet keys (addresses, ports, protocol,
+ * input interface, priority, netfilter mark), hashes them and maps the
+ * result onto "divisor" consecutive classes starting at "baseclass".
+ * This lets any classful qdisc do per-flow, per-host or per-mark
+ * fairness without writing a u32 hash table by hand.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/mm.h>
+#include <linux/errno.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/if_ether.h>
+#include <linux/netdevice.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/rtnetlink.h>
+#include <linux/skbuff.h>
+#include <net/ip.h>
+#include <net/act_api.h>
+#include <net/pkt_cls.h>
+
+struct flow_head
+{
+	u32			hgenerator;
+	struct list_head	flist;
+};
+
+struct flow_filter
+{
+	u32			handle;
+	struct tcf_exts		exts;
+	struct tcf_ematch_tree	ematches;
+	u32			keymask;
+	u32			nkeys;
+	u32			divisor;
+	u32			baseclass;
+	u32			hashrnd;
+	struct list_head	link;
+};
+
+static struct tcf_ext_map flow_ext_map = {
+	.action = TCA_FLOW_ACT,
+	.police = TCA_FLOW_POLICE
+};
+
+static inline u32 addr_fold(void *addr)
+{
+	unsigned long a = (unsigned long)addr;
+
+	return (a & 0xFFFFFFFF) ^ (BITS_PER_LONG > 32 ? a >> 32 : 0);
+}
+
+static inline int flow_has_header(const struct sk_buff *skb, unsigned int len)
+{
+	return skb->nh.raw + len <= skb->tail;
+}
+
+/* Offset of the transport ports from the network header, or -1. */
+static int flow_ports_offset(const struct sk_buff *skb)
+{
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP): {
+		struct iphdr *iph = skb->nh.iph;
+
+		if (!flow_has_header(skb, sizeof(*iph)) ||
+		    (iph->frag_off & htons(IP_MF|IP_OFFSET)))
+			break;
+		if (iph->protocol != IPPROTO_TCP &&
+		    iph->protocol != IPPROTO_UDP &&
+		    iph->protocol != IPPROTO_SCTP)
+			break;
+		if (!flow_has_header(skb, iph->ihl * 4 + 4))
+			break;
+		return iph->ihl * 4;
+	}
+	case __constant_htons(ETH_P_IPV6): {
+		struct ipv6hdr *iph = skb->nh.ipv6h;
+
+		if (!flow_has_header(skb, sizeof(*iph) + 4))
+			break;
+		if (iph->nexthdr != IPPROTO_TCP &&
+		    iph->nexthdr != IPPROTO_UDP &&
+		    iph->nexthdr != IPPROTO_SCTP)
+			break;
+		return sizeof(*iph);
+	}
+	}
+	return -1;
+}
+
+static u32 flow_get_src(const struct sk_buff *skb)
+{
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		if (flow_has_header(skb, sizeof(struct iphdr)))
+			return ntohl(skb->nh.iph->saddr);
+		break;
+	case __constant_htons(ETH_P_IPV6):
+		if (flow_has_header(skb, sizeof(struct ipv6hdr)))
+			return ntohl(skb->nh.ipv6h->saddr.s6_addr32[3]);
+		break;
+	}
+	return addr_fold(skb->sk);
+}
+
+static u32 flow_get_dst(const struct sk_buff *skb)
+{
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		if (flow_has_header(skb, sizeof(struct iphdr)))
+			return ntohl(skb->nh.iph->daddr);
+		break;
+	case __constant_htons(ETH_P_IPV6):
+		if (flow_has_header(skb, sizeof(struct ipv6hdr)))
+			return ntohl(skb->nh.ipv6h->daddr.s6_addr32[3]);
+		break;
+	}
+	return addr_fold(skb->dst) ^ skb->protocol;
+}
+
+static u32 flow_get_proto(const struct sk_buff *skb)
+{
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		if (flow_has_header(skb, sizeof(struct iphdr)))
+			return skb->nh.iph->protocol;
+		break;
+	case __constant_htons(ETH_P_IPV6):
+		if (flow_has_header(skb, sizeof(struct ipv6hdr)))
+			return skb->nh.ipv6h->nexthdr;
+		break;
+	}
+	return 0;
+}
+
+static u32 flow_get_proto_src(const struct sk_buff *skb)
+{
+	int poff = flow_ports_offset(skb);
+
+	if (poff >= 0)
+		return ntohs(*(u16 *)(skb->nh.raw + poff));
+	return addr_fold(skb->sk);
+}
+
+static u32 flow_get_proto_dst(const struct sk_buff *skb)
+{
+	int poff = flow_ports_offset(skb);
+
+	if (poff >= 0)
+		return ntohs(*(u16 *)(skb->nh.raw + poff + 2));
+	return addr_fold(skb->dst) ^ skb->protocol;
+}
+
+static u32 flow_key_get(const struct sk_buff *skb, int key)
+{
+	switch (key) {
+	case FLOW_KEY_SRC:
+		return flow_get_src(skb);
+	case FLOW_KEY_DST:
+		return flow_get_dst(skb);
+	case FLOW_KEY_PROTO:
+		return flow_get_proto(skb);
+	case FLOW_KEY_PROTO_SRC:
+		return flow_get_proto_src(skb);
+	case FLOW_KEY_PROTO_DST:
+		return flow_get_proto_dst(skb);
+	case FLOW_KEY_IIF:
+		return skb->input_dev ? skb->input_dev->ifindex : 0;
+	case FLOW_KEY_PRIORITY:
+		return skb->priority;
+	case FLOW_KEY_MARK:
+#ifdef CONFIG_NETFILTER
+		return skb->nfmark;
+#else
+		return 0;
+#endif
+	default:
+		BUG();
+		return 0;
+	}
+}
+
+static int flow_classify(struct sk_buff *skb, struct tcf_proto *tp,
+			 struct tcf_result *res)
+{
+	struct flow_head *head = (struct flow_head *) tp->root;
+	struct flow_filter *f;
+	u32 keys[FLOW_KEY_MAX + 1];
+	u32 keymask, classid;
+	unsigned int n, key;
+	int r;
+
+	list_for_each_entry(f, &head->flist, link) {
+		if (!tcf_em_tree_match(skb, &f->ematches, NULL))
+			continue;
+
+		keymask = f->keymask;
+		for (n = 0; n < f->nkeys; n++) {
+			key = ffs(keymask) - 1;
+			keymask &= ~(1 << key);
+			keys[n] = flow_key_get(skb, key);
+		}
+
+		classid = jhash2(keys, f->nkeys, f->hashrnd) % f->divisor;
+		res->classid = TC_H_MAKE(f->baseclass, f->baseclass + classid);
+		res->class = 0;
+
+		r = tcf_exts_exec(skb, &f->exts, res);
+		if (r < 0)
+			continue;
+		return r;
+	}
+	return -1;
+}
+
+static unsigned long flow_get(struct tcf_proto *tp, u32 handle)
+{
+	unsigned long l = 0UL;
+	struct flow_head *head = (struct flow_head *) tp->root;
+	struct flow_filter *f;
+
+	if (head == NULL)
+		return 0UL;
+
+	list_for_each_entry(f, &head->flist, link)
+		if (f->handle == handle)
+			l = (unsigned long) f;
+
+	return l;
+}
+
+static void flow_put(struct tcf_proto *tp, unsigned long f)
+{
+}
+
+static int flow_init(struct tcf_proto *tp)
+{
+	return 0;
+}
+
+static inline void flow_delete_filter(struct tcf_proto *tp,
+				      struct flow_filter *f)
+{
+	tcf_exts_destroy(tp, &f->exts);
+	tcf_em_tree_destroy(tp, &f->ematches);
+	kfree(f);
+}
+
+static void flow_destroy(struct tcf_proto *tp)
+{
+	struct flow_head *head = (struct flow_head *) xchg(&tp->root, NULL);
+	struct flow_filter *f, *n;
+
+	if (head == NULL)
+		return;
+
+	list_for_each_entry_safe(f, n, &head->flist, link) {
+		list_del(&f->link);
+		flow_delete_filter(tp, f);
+	}
+	kfree(head);
+}
+
+static int flow_delete(struct tcf_proto *tp, unsigned long arg)
+{
+	struct flow_head *head = (struct flow_head *) tp->root;
+	struct flow_filter *t, *f = (struct flow_filter *) arg;
+
+	list_for_each_entry(t, &head->flist, link)
+		if (t == f) {
+			tcf_tree_lock(tp);
+			list_del(&t->link);
+			tcf_tree_unlock(tp);
+			flow_delete_filter(tp, t);
+			return 0;
+		}
+
+	return -ENOENT;
+}
+
+static inline int flow_set_parms(struct tcf_proto *tp, struct flow_filter *f,
+				 struct rtattr **tb, struct rtattr *est)
+{
+	int err = -EINVAL;
+	struct tcf_exts e;
+	struct tcf_ematch_tree t;
+	u32 keymask = f->keymask, divisor = f->divisor;
+	u32 baseclass = f->baseclass;
+
+	if (tb[TCA_FLOW_KEYS-1]) {
+		if (RTA_PAYLOAD(tb[TCA_FLOW_KEYS-1]) < sizeof(u32))
+			return err;
+		keymask = *(u32*)RTA_DATA(tb[TCA_FLOW_KEYS-1]);
+		if (keymask & ~((1 << (FLOW_KEY_MAX + 1)) - 1))
+			return err;
+	}
+	if (tb[TCA_FLOW_DIVISOR-1]) {
+		if (RTA_PAYLOAD(tb[TCA_FLOW_DIVISOR-1]) < sizeof(u32))
+			return err;
+		divisor = *(u32*)RTA_DATA(tb[TCA_FLOW_DIVISOR-1]);
+		if (divisor > 65536)
+			return err;
+	}
+	if (tb[TCA_FLOW_BASECLASS-1]) {
+		if (RTA_PAYLOAD(tb[TCA_FLOW_BASECLASS-1]) < sizeof(u32))
+			return err;
+		baseclass = *(u32*)RTA_DATA(tb[TCA_FLOW_BASECLASS-1]);
+		if (TC_H_MIN(baseclass) == 0)
+			return err;
+	}
+	if (keymask == 0 || divisor == 0)
+		return err;
+
+	err = tcf_exts_validate(tp, tb, est, &e, &flow_ext_map);
+	if (err < 0)
+		return err;
+
+	err = tcf_em_tree_validate(tp, tb[TCA_FLOW_EMATCHES-1], &t);
+	if (err < 0)
+		goto errout;
+
+	if (baseclass == 0)
+		baseclass = TC_H_MAKE(tp->q->handle, 1);
+
+	tcf_tree_lock(tp);
+	f->keymask = keymask;
+	f->nkeys = hweight32(keymask);
+	f->divisor = divisor;
+	f->baseclass = baseclass;
+	tcf_tree_unlock(tp);
+
+	tcf_exts_change(tp, &f->exts, &e);
+	tcf_em_tree_change(tp, &f->ematches, &t);
+
+	return 0;
+errout:
+	tcf_exts_destroy(tp, &e);
+	return err;
+}
+
+static int flow_change(struct tcf_proto *tp, unsigned long base, u32 handle,
+		       struct rtattr **tca, unsigned long *arg)
+{
+	int err = -EINVAL;
+	struct flow_head *head = (struct flow_head *) tp->root;
+	struct rtattr *tb[TCA_FLOW_MAX];
+	struct flow_filter *f = (struct flow_filter *) *arg;
+
+	if (tca[TCA_OPTIONS-1] == NULL)
+		return -EINVAL;
+
+	if (rtattr_parse_nested(tb, TCA_FLOW_MAX, tca[TCA_OPTIONS-1]) < 0)
+		return -EINVAL;
+
+	if (f != NULL) {
+		if (handle && f->handle != handle)
+			return -EINVAL;
+		return flow_set_parms(tp, f, tb, tca[TCA_RATE-1]);
+	}
+
+	err = -ENOBUFS;
+	if (head == NULL) {
+		head = kmalloc(sizeof(*head), GFP_KERNEL);
+		if (head == NULL)
+			goto errout;
+
+		memset(head, 0, sizeof(*head));
+		INIT_LIST_HEAD(&head->flist);
+		tp->root = head;
+	}
+
+	f = kmalloc(sizeof(*f), GFP_KERNEL);
+	if (f == NULL)
+		goto errout;
+	memset(f, 0, sizeof(*f));
+	get_random_bytes(&f->hashrnd, sizeof(f->hashrnd));
+
+	err = -EINVAL;
+	if (handle)
+		f->handle = handle;
+	else {
+		int i = 0x80000000;
+		do {
+			if (++head->hgenerator == 0x7FFFFFFF)
+				head->hgenerator = 1;
+		} while (--i > 0 && flow_get(tp, head->hgenerator));
+
+		if (i <= 0) {
+			printk(KERN_ERR "Insufficient number of handles\n");
+			goto errout;
+		}
+
+		f->handle = head->hgenerator;
+	}
+
+	err = flow_set_parms(tp, f, tb, tca[TCA_RATE-1]);
+	if (err < 0)
+		goto errout;
+
+	tcf_tree_lock(tp);
+	list_add_tail(&f->link, &head->flist);
+	tcf_tree_unlock(tp);
+	*arg = (unsigned long) f;
+
+	return 0;
+errout:
+	if (*arg == 0UL && f)
+		kfree(f);
+
+	return err;
+}
+
+static void flow_walk(struct tcf_proto *tp, struct tcf_walker *arg)
+{
+	struct flow_head *head = (struct flow_head *) tp->root;
+	struct flow_filter *f;
+
+	if (head == NULL)
+		return;
+
+	list_for_each_entry(f, &head->flist, link) {
+		if (arg->count < arg->skip)
+			goto skip;
+
+		if (arg->fn(tp, (unsigned long) f, arg) < 0) {
+			arg->stop = 1;
+			break;
+		}
+skip:
+		arg->count++;
+	}
+}
+
+static int flow_dump(struct tcf_proto *tp, unsigned long fh,
+		     struct sk_buff *skb, struct tcmsg *t)
+{
+	struct flow_filter *f = (struct flow_filter *) fh;
+	unsigned char *b = skb->tail;
+	struct rtattr *rta;
+
+	if (f == NULL)
+		return skb->len;
+
+	t->tcm_handle = f->handle;
+
+	rta = (struct rtattr *) b;
+	RTA_PUT(skb, TCA_OPTIONS, 0, NULL);
+	RTA_PUT(skb, TCA_FLOW_KEYS, sizeof(u32), &f->keymask);
+	RTA_PUT(skb, TCA_FLOW_DIVISOR, sizeof(u32), &f->divisor);
+	RTA_PUT(skb, TCA_FLOW_BASECLASS, sizeof(u32), &f->baseclass);
+
+	if (tcf_exts_dump(skb, &f->exts, &flow_ext_map) < 0 ||
+	    tcf_em_tree_dump(skb, &f->ematches, TCA_FLOW_EMATCHES) < 0)
+		goto rtattr_failure;
+
+	rta->rta_len = (skb->tail - b);
+
+	if (tcf_exts_dump_stats(skb, &f->exts, &flow_ext_map) < 0)
+		goto rtattr_failure;
+
+	return skb->len;
+
+rtattr_failure:
+	skb_trim(skb, b - skb->data);
+	return -1;
+}
+
+static struct tcf_proto_ops cls_flow_ops = {
+	.kind		=	"flow",
+	.classify	=	flow_classify,
+	.init		=	flow_init,
+	.destroy	=	flow_destroy,
+	.get		=	flow_get,
+	.put		=	flow_put,
+	.change		=	flow_change,
+	.delete		=	flow_delete,
+	.walk		=	flow_walk,
+	.dump		=	flow_dump,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init init_flow(void)
+{
+	return register_tcf_proto_ops(&cls_flow_ops);
+}
+
+static void __exit exit_flow(void)
+{
+	unregister_tcf_proto_ops(&cls_flow_ops);
+}
+
+module_init(init_flow)
+module_exit(exit_flow)
+MODULE_LICENSE("GPL");
@@ -207,6 +207,30 @@ struct Qdisc *qdisc_lookup(struct net_device *dev, u32 handle)
 	return NULL;
 }
 
+/* A qdisc that drops packets other than at enqueue or ->drop() time has
+   to tell its ancestors, whose qlen still counts them.
+
+   Called under dev->queue_lock.  Every change to dev->qdisc_list that a
+   running qdisc can meet is made under it too, so the list is walked
+   without qdisc_tree_lock, which must not be taken after queue_lock.
+ */
+
+void qdisc_tree_decrease_qlen(struct Qdisc *sch, unsigned int n)
+{
+	struct Qdisc *q;
+	u32 parentid;
+
+	while (n && (parentid = sch->parent) != 0 && parentid != TC_H_ROOT) {
+		list_for_each_entry(q, &sch->dev->qdisc_list, list)
+			if (q->handle == TC_H_MAJ(parentid))
+				goto found;
+		return;
+found:
+		q->q.qlen -= n;
+		sch = q;
+	}
+}
+
 static struct Qdisc *qdisc_leaf(struct Qdisc *p, u32 classid)
 {
 	unsigned long cl;
@@ -1267,3 +1291,4 @@ EXPORT_SYMBOL(qdisc_put_rtab);
 EXPORT_SYMBOL(register_qdisc);
 EXPORT_SYMBOL(unregister_qdisc);
 EXPORT_SYMBOL(tc_classify);
+EXPORT_SYMBOL(qdisc_tree_decrease_qlen);
@@ -0,0 +1,817 @@
+/*
+ * net/sched/sch_fq_codel.c	Fair Queue CoDel discipline.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/errno.h>
+#include <linux/in.h>
+#include <linux/if_ether.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/rtnetlink.h>
+#include <net/ip.h>
+#include <linux/ipv6.h>
+#include <net/inet_ecn.h>
+#include <net/dsfield.h>
+#include <net/pkt_sched.h>
+
+/*	Fair Queue CoDel.
+	=================
+
+	Packets are hashed (or classified by attached filters) into a
+	number of flow queues.  Flows are served by deficit round robin
+	from two lists: flows that just became active go on new_flows and
+	get served first, so sparse flows (DNS, interactive ssh, TCP
+	handshakes) see almost no queueing delay; flows that used up their
+	quantum move to old_flows.
+
+	Each flow runs its own CoDel instance.  The time a packet spent in
+	the queue is measured at dequeue; once the sojourn time has stayed
+	above "target" for a full "interval", CoDel drops (or ECN marks)
+	a packet and schedules the next drop at interval/sqrt(count), so
+	the drop rate rises until the standing queue is gone.  Unlike
+	sfq/red this does not depend on the link rate or the queue length,
+	only on how long packets wait.
+
+	Source:
+	K. Nichols, V. Jacobson, "Controlling Queue Delay",
+	ACM Queue, May 2012.
+
+	All times are in psched ticks, which are close to microseconds
+	with any of the scheduler clock sources.
+ */
+
+#define FQ_CODEL_DEF_FLOWS	1024
+#define FQ_CODEL_MAX_FLOWS	65536
+#define FQ_CODEL_DEF_LIMIT	10240
+#define FQ_CODEL_DEF_TARGET	5000	/* 5 ms */
+#define FQ_CODEL_DEF_INTERVAL	100000	/* 100 ms */
+
+/* 1/sqrt(count) is kept in Q0.16 and refined by one Newton step per drop. */
+#define REC_INV_SQRT_BITS	16
+#define REC_INV_SQRT_SHIFT	(32 - REC_INV_SQRT_BITS)
+
+struct codel_vars
+{
+	u32		count;		/* drops since entering dropping state */
+	u32		lastcount;	/* count when we last left it */
+	int		dropping;
+	u32		rec_inv_sqrt;
+	psched_time_t	first_above_time;
+	psched_time_t	drop_next;
+};
+
+struct fq_codel_flow
+{
+	struct sk_buff_head	q;
+	struct list_head	flowchain;	/* on new_flows/old_flows */
+	int			deficit;
+	u32			backlog;	/* bytes queued */
+	u32			dropped;
+	struct codel_vars	cvars;
+};
+
+struct fq_codel_sched_data
+{
+	struct tcf_proto	*filter_list;
+	struct fq_codel_flow	*flows;
+	u32			flows_cnt;
+	int			flows_vmalloc;
+	u32			perturbation;
+	u32			quantum;
+	u32			limit;
+	psched_tdiff_t		target;
+	psched_tdiff_t		interval;
+	int			ecn;
+
+	struct list_head	new_flows;
+	struct list_head	old_flows;
+
+	u32			maxpacket;
+	u32			drop_count;	/* dequeue drops for the parents */
+	u32			drop_overlimit;
+	u32			ecn_mark;
+	u32			new_flow_count;
+};
+
+struct fq_codel_skb_cb
+{
+	psched_time_t	enqueue_time;
+	u32		flow;
+};
+
+#define FQ_CODEL_CB(skb)	((struct fq_codel_skb_cb *)(skb)->cb)
+
+static unsigned int fq_codel_hash(struct fq_codel_sched_data *q,
+				  struct sk_buff *skb)
+{
+	u32 h, h2, h3 = 0;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+	{
+		struct iphdr *iph = skb->nh.iph;
+		h = iph->daddr;
+		h2 = iph->saddr^iph->protocol;
+		if (!(iph->frag_off&htons(IP_MF|IP_OFFSET)) &&
+		    (iph->protocol == IPPROTO_TCP ||
+		     iph->protocol == IPPROTO_UDP ||
+		     iph->protocol == IPPROTO_SCTP ||
+		     iph->protocol == IPPROTO_ESP))
+			h3 = *(((u32*)iph) + iph->ihl);
+		break;
+	}
+	case __constant_htons(ETH_P_IPV6):
+	{
+		struct ipv6hdr *iph = skb->nh.ipv6h;
+		h = iph->daddr.s6_addr32[3]^iph->daddr.s6_addr32[2];
+		h2 = iph->saddr.s6_addr32[3]^iph->saddr.s6_addr32[2]^
+		     iph->nexthdr;
+		if (iph->nexthdr == IPPROTO_TCP ||
+		    iph->nexthdr == IPPROTO_UDP ||
+		    iph->nexthdr == IPPROTO_SCTP ||
+		    iph->nexthdr == IPPROTO_ESP)
+			h3 = *(u32*)&iph[1];
+		break;
+	}
+	default:
+		h = (u32)(unsigned long)skb->dst^skb->protocol;
+		h2 = (u32)(unsigned long)skb->sk;
+	}
+	return jhash_3words(h, h2, h3, q->perturbation) % q->flows_cnt;
+}
+
+/* Returns the flow index plus one, or 0 if the packet is to be dropped. */
+static unsigned int fq_codel_classify(struct sk_buff *skb, struct Qdisc *sch,
+				      int *qerr)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct tcf_result res;
+	int result;
+
+	if (TC_H_MAJ(skb->priority) == sch->handle &&
+	    TC_H_MIN(skb->priority) > 0 &&
+	    TC_H_MIN(skb->priority) <= q->flows_cnt)
+		return TC_H_MIN(skb->priority);
+
+	if (q->filter_list == NULL)
+		return fq_codel_hash(q, skb) + 1;
+
+	*qerr = NET_XMIT_DROP;
+	result = tc_classify(skb, q->filter_list, &res);
+	if (result >= 0) {
+#ifdef CONFIG_NET_CLS_ACT
+		switch (result) {
+		case TC_ACT_STOLEN:
+		case TC_ACT_QUEUED:
+			*qerr = NET_XMIT_SUCCESS;
+		case TC_ACT_SHOT:
+			return 0;
+		}
+#endif
+		if (TC_H_MIN(res.classid) <= q->flows_cnt)
+			return TC_H_MIN(res.classid);
+	}
+	return 0;
+}
+
+static inline struct sk_buff *fq_codel_dequeue_head(struct Qdisc *sch,
+						    struct fq_codel_flow *flow)
+{
+	struct sk_buff *skb = __skb_dequeue(&flow->q);
+
+	if (skb) {
+		flow->backlog -= skb->len;
+		sch->qstats.backlog -= skb->len;
+		sch->q.qlen--;
+	}
+	return skb;
+}
+
+static inline void fq_codel_drop_skb(struct Qdisc *sch,
+				     struct fq_codel_flow *flow,
+				     struct sk_buff *skb)
+{
+	flow->dropped++;
+	sch->qstats.drops++;
+	kfree_skb(skb);
+}
+
+/* Drop the head packet of the flow with the largest backlog. A linear
+ * scan is fine here: with CoDel in charge the limit is rarely hit.
+ */
+static unsigned int fq_codel_drop_fattest(struct Qdisc *sch, unsigned int *len)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow;
+	struct sk_buff *skb;
+	unsigned int i, idx = 0;
+	u32 maxbacklog = 0;
+
+	for (i = 0; i < q->flows_cnt; i++) {
+		flow = &q->flows[i];
+		/* a flow of empty packets has no backlog, but packets */
+		if (flow->backlog > maxbacklog ||
+		    (!maxbacklog && skb_queue_len(&flow->q))) {
+			maxbacklog = flow->backlog;
+			idx = i;
+		}
+	}
+	flow = &q->flows[idx];
+	skb = fq_codel_dequeue_head(sch, flow);
+	if (skb == NULL) {
+		*len = 0;
+		return q->flows_cnt;
+	}
+	*len = skb->len;
+	fq_codel_drop_skb(sch, flow, skb);
+	return idx;
+}
+
+static unsigned int fq_codel_drop(struct Qdisc *sch)
+{
+	unsigned int len;
+
+	if (sch->q.qlen == 0)
+		return 0;
+	fq_codel_drop_fattest(sch, &len);
+	return len;
+}
+
+static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow;
+	unsigned int idx, len;
+	int ret;
+
+	idx = fq_codel_classify(skb, sch, &ret);
+	if (idx == 0) {
+		if (ret == NET_XMIT_DROP)
+			sch->qstats.drops++;
+		kfree_skb(skb);
+		return ret;
+	}
+	idx--;
+
+	PSCHED_GET_TIME(FQ_CODEL_CB(skb)->enqueue_time);
+	FQ_CODEL_CB(skb)->flow = idx;
+
+	flow = &q->flows[idx];
+	__skb_queue_tail(&flow->q, skb);
+	flow->backlog += skb->len;
+	sch->qstats.backlog += skb->len;
+	sch->bstats.bytes += skb->len;
+	sch->bstats.packets++;
+	if (skb->len > q->maxpacket)
+		q->maxpacket = skb->len;
+
+	if (list_empty(&flow->flowchain)) {
+		list_add_tail(&flow->flowchain, &q->new_flows);
+		q->new_flow_count++;
+		flow->deficit = q->quantum;
+		flow->dropped = 0;
+	}
+
+	if (++sch->q.qlen <= q->limit)
+		return NET_XMIT_SUCCESS;
+
+	q->drop_overlimit++;
+	/* Only signal congestion if we dropped from the sender's own flow.
+	 * Otherwise the parents count this packet, and have to forget the
+	 * one dropped in its place.
+	 */
+	if (fq_codel_drop_fattest(sch, &len) == idx)
+		return NET_XMIT_CN;
+	qdisc_tree_decrease_qlen(sch, 1);
+	return NET_XMIT_SUCCESS;
+}
+
+static int fq_codel_requeue(struct sk_buff *skb, struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow = &q->flows[FQ_CODEL_CB(skb)->flow];
+
+	__skb_queue_head(&flow->q, skb);
+	flow->backlog += skb->len;
+	flow->deficit += skb->len;
+	sch->qstats.backlog += skb->len;
+	sch->q.qlen++;
+	sch->qstats.requeues++;
+
+	/* Put the flow back in front so this packet goes out next. */
+	if (list_empty(&flow->flowchain))
+		list_add(&flow->flowchain, &q->new_flows);
+	return NET_XMIT_SUCCESS;
+}
+
+static void codel_Newton_step(struct codel_vars *vars)
+{
+	u32 invsqrt = vars->rec_inv_sqrt << REC_INV_SQRT_SHIFT;
+	u32 invsqrt2 = ((u64)invsqrt * invsqrt) >> 32;
+	u64 val = (3ULL << 32) - ((u64)vars->count * invsqrt2);
+
+	val >>= 2;	/* avoid overflow in the following multiply */
+	val = (val * invsqrt) >> (32 - 2 + 1);
+	vars->rec_inv_sqrt = val >> REC_INV_SQRT_SHIFT;
+}
+
+/* next = t + interval / sqrt(count) */
+static inline void codel_control_law(psched_time_t t, psched_tdiff_t interval,
+				     u32 rec_inv_sqrt, psched_time_t *next)
+{
+	psched_tdiff_t delta;
+
+	delta = ((u64)interval * (rec_inv_sqrt << REC_INV_SQRT_SHIFT)) >> 32;
+	PSCHED_TADD2(t, delta, *next);
+}
+
+static int codel_should_drop(struct sk_buff *skb, struct Qdisc *sch,
+			     struct codel_vars *vars, psched_time_t now)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	psched_tdiff_t sojourn;
+
+	if (skb == NULL) {
+		PSCHED_SET_PASTPERFECT(vars->first_above_time);
+		return 0;
+	}
+
+	sojourn = PSCHED_TDIFF(now, FQ_CODEL_CB(skb)->enqueue_time);
+	if (sojourn < q->target || sch->qstats.backlog <= q->maxpacket) {
+		/* went below target, or not enough queued to fill the link */
+		PSCHED_SET_PASTPERFECT(vars->first_above_time);
+		return 0;
+	}
+	if (PSCHED_IS_PASTPERFECT(vars->first_above_time)) {
+		/* just went above target; give it an interval to drain */
+		PSCHED_TADD2(now, q->interval, vars->first_above_time);
+		return 0;
+	}
+	return !PSCHED_TLESS(now, vars->first_above_time);
+}
+
+static int fq_codel_ecn_mark(struct sk_buff *skb)
+{
+	if (skb->nh.raw + 20 > skb->tail)
+		return 0;
+
+	switch (skb->protocol) {
+	case __constant_htons(ETH_P_IP):
+		if (INET_ECN_is_not_ect(skb->nh.iph->tos))
+			return 0;
+		IP_ECN_set_ce(skb->nh.iph);
+		return 1;
+	case __constant_htons(ETH_P_IPV6):
+		if (INET_ECN_is_not_ect(ipv6_get_dsfield(skb->nh.ipv6h)))
+			return 0;
+		IP6_ECN_set_ce(skb->nh.ipv6h);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static struct sk_buff *codel_dequeue(struct Qdisc *sch,
+				     struct fq_codel_flow *flow)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct codel_vars *vars = &flow->cvars;
+	struct sk_buff *skb;
+	psched_time_t now;
+	u32 delta;
+	int drop;
+
+	skb = fq_codel_dequeue_head(sch, flow);
+	if (skb == NULL) {
+		vars->dropping = 0;
+		return NULL;
+	}
+
+	PSCHED_GET_TIME(now);
+	drop = codel_should_drop(skb, sch, vars, now);
+	if (vars->dropping) {
+		if (!drop) {
+			/* sojourn time below target, leave dropping state */
+			vars->dropping = 0;
+		} else {
+			/* Drop (or mark) as many packets as the control law
+			 * asks for by now, then send the first one left.
+			 */
+			while (vars->dropping &&
+			       !PSCHED_TLESS(now, vars->drop_next)) {
+				vars->count++;
+				codel_Newton_step(vars);
+				if (q->ecn && fq_codel_ecn_mark(skb)) {
+					q->ecn_mark++;
+					codel_control_law(vars->drop_next,
+							  q->interval,
+							  vars->rec_inv_sqrt,
+							  &vars->drop_next);
+					break;
+				}
+				fq_codel_drop_skb(sch, flow, skb);
+				q->drop_count++;
+				skb = fq_codel_dequeue_head(sch, flow);
+				if (!codel_should_drop(skb, sch, vars, now))
+					vars->dropping = 0;
+				else
+					codel_control_law(vars->drop_next,
+							  q->interval,
+							  vars->rec_inv_sqrt,
+							  &vars->drop_next);
+			}
+		}
+	} else if (drop) {
+		if (q->ecn && fq_codel_ecn_mark(skb)) {
+			q->ecn_mark++;
+		} else {
+			fq_codel_drop_skb(sch, flow, skb);
+			q->drop_count++;
+			skb = fq_codel_dequeue_head(sch, flow);
+			codel_should_drop(skb, sch, vars, now);
+		}
+		vars->dropping = 1;
+
+		/* If we were dropping recently, the drop rate that
+		 * controlled the queue last time is a good place to
+		 * start from.
+		 */
+		delta = vars->count - vars->lastcount;
+		if (delta > 1 &&
+		    PSCHED_TDIFF(now, vars->drop_next) < 16 * q->interval) {
+			vars->count = delta;
+			codel_Newton_step(vars);
+		} else {
+			vars->count = 1;
+			vars->rec_inv_sqrt = ~0U >> REC_INV_SQRT_SHIFT;
+		}
+		vars->lastcount = vars->count;
+		codel_control_law(now, q->interval, vars->rec_inv_sqrt,
+				  &vars->drop_next);
+	}
+	return skb;
+}
+
+static struct sk_buff *fq_codel_dequeue(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow;
+	struct list_head *head;
+	struct sk_buff *skb;
+
+begin:
+	head = &q->new_flows;
+	if (list_empty(head)) {
+		head = &q->old_flows;
+		if (list_empty(head)) {
+			skb = NULL;
+			goto out;
+		}
+	}
+	flow = list_entry(head->next, struct fq_codel_flow, flowchain);
+
+	if (flow->deficit <= 0) {
+		flow->deficit += q->quantum;
+		list_move_tail(&flow->flowchain, &q->old_flows);
+		goto begin;
+	}
+
+	skb = codel_dequeue(sch, flow);
+	if (skb == NULL) {
+		/* An emptied new flow passes through old_flows once so a
+		 * flow cannot stay "new" forever by sending just under
+		 * its quantum.
+		 */
+		if (head == &q->new_flows && !list_empty(&q->old_flows))
+			list_move_tail(&flow->flowchain, &q->old_flows);
+		else
+			list_del_init(&flow->flowchain);
+		goto begin;
+	}
+	flow->deficit -= skb->len;
+out:
+	/* CoDel drops at dequeue time, behind the back of the parents */
+	if (q->drop_count) {
+		qdisc_tree_decrease_qlen(sch, q->drop_count);
+		q->drop_count = 0;
+	}
+	return skb;
+}
+
+static void fq_codel_reset(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned int i;
+
+	INIT_LIST_HEAD(&q->new_flows);
+	INIT_LIST_HEAD(&q->old_flows);
+	for (i = 0; i < q->flows_cnt; i++) {
+		struct fq_codel_flow *flow = &q->flows[i];
+
+		skb_queue_purge(&flow->q);
+		INIT_LIST_HEAD(&flow->flowchain);
+		flow->backlog = 0;
+		memset(&flow->cvars, 0, sizeof(flow->cvars));
+	}
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+}
+
+static int fq_codel_change(struct Qdisc *sch, struct rtattr *opt)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct tc_fq_codel_qopt *ctl = RTA_DATA(opt);
+
+	if (opt->rta_len < RTA_LENGTH(sizeof(*ctl)))
+		return -EINVAL;
+
+	/* The flow table is sized at creation time. */
+	if (ctl->flows && ctl->flows != q->flows_cnt)
+		return -EINVAL;
+
+	sch_tree_lock(sch);
+	if (ctl->target)
+		q->target = ctl->target;
+	if (ctl->interval)
+		q->interval = ctl->interval;
+	if (ctl->limit)
+		q->limit = ctl->limit;
+	if (ctl->quantum)
+		q->quantum = max(256U, ctl->quantum);
+	q->ecn = ctl->ecn ? 1 : 0;
+
+	while (sch->q.qlen > q->limit)
+		fq_codel_drop(sch);
+	sch_tree_unlock(sch);
+	return 0;
+}
+
+static void fq_codel_free_flows(struct fq_codel_sched_data *q)
+{
+	if (q->flows_vmalloc)
+		vfree(q->flows);
+	else
+		kfree(q->flows);
+	q->flows = NULL;
+}
+
+static int fq_codel_init(struct Qdisc *sch, struct rtattr *opt)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned int i, size;
+	int err;
+
+	q->flows_cnt = FQ_CODEL_DEF_FLOWS;
+	q->limit = FQ_CODEL_DEF_LIMIT;
+	q->target = FQ_CODEL_DEF_TARGET;
+	q->interval = FQ_CODEL_DEF_INTERVAL;
+	q->quantum = psched_mtu(sch->dev);
+	INIT_LIST_HEAD(&q->new_flows);
+	INIT_LIST_HEAD(&q->old_flows);
+	get_random_bytes(&q->perturbation, sizeof(q->perturbation));
+
+	if (opt) {
+		struct tc_fq_codel_qopt *ctl = RTA_DATA(opt);
+
+		if (opt->rta_len < RTA_LENGTH(sizeof(*ctl)))
+			return -EINVAL;
+		if (ctl->flows > FQ_CODEL_MAX_FLOWS)
+			return -EINVAL;
+		if (ctl->flows)
+			q->flows_cnt = ctl->flows;
+	}
+
+	size = q->flows_cnt * sizeof(struct fq_codel_flow);
+	if (size <= PAGE_SIZE << 4)
+		q->flows = kmalloc(size, GFP_KERNEL);
+	if (q->flows == NULL) {
+		q->flows = vmalloc(size);
+		q->flows_vmalloc = 1;
+	}
+	if (q->flows == NULL)
+		return -ENOMEM;
+
+	memset(q->flows, 0, size);
+	for (i = 0; i < q->flows_cnt; i++) {
+		skb_queue_head_init(&q->flows[i].q);
+		INIT_LIST_HEAD(&q->flows[i].flowchain);
+	}
+
+	if (opt) {
+		err = fq_codel_change(sch, opt);
+		if (err) {
+			fq_codel_free_flows(q);
+			return err;
+		}
+	}
+	return 0;
+}
+
+static void fq_codel_destroy(struct Qdisc *sch)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct tcf_proto *tp;
+
+	while ((tp = q->filter_list) != NULL) {
+		q->filter_list = tp->next;
+		tcf_destroy(tp);
+	}
+	fq_codel_reset(sch);
+	fq_codel_free_flows(q);
+}
+
+static int fq_codel_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned char *b = skb->tail;
+	struct tc_fq_codel_qopt opt;
+
+	opt.target = q->target;
+	opt.interval = q->interval;
+	opt.limit = q->limit;
+	opt.flows = q->flows_cnt;
+	opt.quantum = q->quantum;
+	opt.ecn = q->ecn;
+
+	RTA_PUT(skb, TCA_OPTIONS, sizeof(opt), &opt);
+
+	return skb->len;
+
+rtattr_failure:
+	skb_trim(skb, b - skb->data);
+	return -1;
+}
+
+static int fq_codel_dump_stats(struct Qdisc *sch, struct gnet_dump *d)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct tc_fq_codel_xstats st;
+	struct list_head *pos;
+
+	st.maxpacket = q->maxpacket;
+	st.drop_overlimit = q->drop_overlimit;
+	st.ecn_mark = q->ecn_mark;
+	st.new_flow_count = q->new_flow_count;
+	st.new_flows_len = 0;
+	st.old_flows_len = 0;
+	list_for_each(pos, &q->new_flows)
+		st.new_flows_len++;
+	list_for_each(pos, &q->old_flows)
+		st.old_flows_len++;
+
+	return gnet_stats_copy_app(d, &st, sizeof(st));
+}
+
+/* Flows are exposed as classes 1..flows so filters can steer packets
+ * into a given flow and "tc -s class show" lists the active ones.
+ */
+
+static struct Qdisc *fq_codel_leaf(struct Qdisc *sch, unsigned long arg)
+{
+	return NULL;
+}
+
+static unsigned long fq_codel_get(struct Qdisc *sch, u32 classid)
+{
+	return 0;
+}
+
+static unsigned long fq_codel_bind(struct Qdisc *sch, unsigned long parent,
+				   u32 classid)
+{
+	return 0;
+}
+
+static void fq_codel_put(struct Qdisc *sch, unsigned long cl)
+{
+}
+
+/* The flows come and go with the traffic; they cannot be added or removed */
+static int fq_codel_change_class(struct Qdisc *sch, u32 classid, u32 parent,
+				 struct rtattr **tca, unsigned long *arg)
+{
+	return -EOPNOTSUPP;
+}
+
+static int fq_codel_delete_class(struct Qdisc *sch, unsigned long cl)
+{
+	return -EOPNOTSUPP;
+}
+
+static struct tcf_proto **fq_codel_find_tcf(struct Qdisc *sch,
+					    unsigned long cl)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+
+	if (cl)
+		return NULL;
+	return &q->filter_list;
+}
+
+static int fq_codel_dump_class(struct Qdisc *sch, unsigned long cl,
+			       struct sk_buff *skb, struct tcmsg *tcm)
+{
+	tcm->tcm_handle |= TC_H_MIN(cl);
+	return 0;
+}
+
+static int fq_codel_dump_class_stats(struct Qdisc *sch, unsigned long cl,
+				     struct gnet_dump *d)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	struct fq_codel_flow *flow;
+	struct gnet_stats_queue qs;
+
+	if (cl == 0 || cl > q->flows_cnt)
+		return -1;
+
+	flow = &q->flows[cl - 1];
+	memset(&qs, 0, sizeof(qs));
+	qs.qlen = skb_queue_len(&flow->q);
+	qs.backlog = flow->backlog;
+	qs.drops = flow->dropped;
+
+	return gnet_stats_copy_queue(d, &qs);
+}
+
+static void fq_codel_walk(struct Qdisc *sch, struct qdisc_walker *arg)
+{
+	struct fq_codel_sched_data *q = qdisc_priv(sch);
+	unsigned int i;
+
+	if (arg->stop)
+		return;
+
+	for (i = 0; i < q->flows_cnt; i++) {
+		if (list_empty(&q->flows[i].flowchain))
+			continue;
+		if (arg->count < arg->skip) {
+			arg->count++;
+			continue;
+		}
+		if (arg->fn(sch, i + 1, arg) < 0) {
+			arg->stop = 1;
+			break;
+		}
+		arg->count++;
+	}
+}
+
+static struct Qdisc_class_ops fq_codel_class_ops = {
+	.leaf		=	fq_codel_leaf,
+	.get		=	fq_codel_get,
+	.put		=	fq_codel_put,
+	.change		=	fq_codel_change_class,
+	.delete		=	fq_codel_delete_class,
+	.walk		=	fq_codel_walk,
+	.tcf_chain	=	fq_codel_find_tcf,
+	.bind_tcf	=	fq_codel_bind,
+	.unbind_tcf	=	fq_codel_put,
+	.dump		=	fq_codel_dump_class,
+	.dump_stats	=	fq_codel_dump_class_stats,
+};
+
+static struct Qdisc_ops fq_codel_qdisc_ops = {
+	.next		=	NULL,
+	.cl_ops		=	&fq_codel_class_ops,
+	.id		=	"fq_codel",
+	.priv_size	=	sizeof(struct fq_codel_sched_data),
+	.enqueue	=	fq_codel_enqueue,
+	.dequeue	=	fq_codel_dequeue,
+	.requeue	=	fq_codel_requeue,
+	.drop		=	fq_codel_drop,
+	.init		=	fq_codel_init,
+	.reset		=	fq_codel_reset,
+	.destroy	=	fq_codel_destroy,
+	.change		=	fq_codel_change,
+	.dump		=	fq_codel_dump,
+	.dump_stats	=	fq_codel_dump_stats,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init fq_codel_module_init(void)
+{
+	return register_qdisc(&fq_codel_qdisc_ops);
+}
+static void __exit fq_codel_module_exit(void)
+{
+	unregister_qdisc(&fq_codel_qdisc_ops);
+}
+module_init(fq_codel_module_init)
+module_exit(fq_codel_module_exit)
+MODULE_LICENSE("GPL");
@@ -118,6 +118,7 @@
 #include <linux/mount.h>
 #include <net/checksum.h>
 #include <linux/security.h>
+#include <linux/highmem.h>
 
 int sysctl_unix_max_dgram_qlen = 10;
 
@@ -458,6 +459,8 @@ static int unix_ioctl(struct socket *, unsigned int, unsigned long);
 static int unix_shutdown(struct socket *, int);
 static int unix_stream_sendmsg(struct kiocb *, struct socket *,
 			       struct msghdr *, size_t);
+static ssize_t unix_stream_sendpage(struct socket *, struct page *, int,
+				    size_t, int);
 static int unix_stream_recvmsg(struct kiocb *, struct socket *,
 			       struct msghdr *, size_t, int);
 static int unix_dgram_sendmsg(struct kiocb *, struct socket *,
@@ -487,7 +490,7 @@ static struct proto_ops unix_stream_ops = {
 	.sendmsg =	unix_stream_sendmsg,
 	.recvmsg =	unix_stream_recvmsg,
 	.mmap =		sock_no_mmap,
-	.sendpage =	sock_no_sendpage,
+	.sendpage =	unix_stream_sendpage,
 };
 
 static struct proto_ops unix_dgram_ops = {
@@ -1399,7 +1402,28 @@ out:
 	return err;
 }
 
-		
+/*
+ *	Large stream writes are carried in page fragments: no high order
+ *	allocations, and up to 64K per skb instead of SKB_MAX_ALLOC.
+ */
+#define UNIX_SKB_FRAGS_SZ	(PAGE_SIZE * (MAX_SKB_FRAGS - 2))
+
+static int unix_skb_copy_fromiovec(struct sk_buff *skb, struct iovec *iov)
+{
+	int i, err;
+
+	err = memcpy_fromiovec(skb->data, iov, skb_headlen(skb));
+	for (i = 0; !err && i < skb_shinfo(skb)->nr_frags; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+		u8 *vaddr = kmap(frag->page);
+
+		err = memcpy_fromiovec(vaddr + frag->page_offset, iov,
+				       frag->size);
+		kunmap(frag->page);
+	}
+	return err;
+}
+
 static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 			       struct msghdr *msg, size_t len)
 {
@@ -1407,7 +1431,7 @@ static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 	struct sock *sk = sock->sk;
 	struct sock *other = NULL;
 	struct sockaddr_un *sunaddr=msg->msg_name;
-	int err,size;
+	int err,size,data_len;
 	struct sk_buff *skb;
 	int sent=0;
 	struct scm_cookie tmp_scm;
@@ -1449,32 +1473,29 @@ static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 		if (size > sk->sk_sndbuf / 2 - 64)
 			size = sk->sk_sndbuf / 2 - 64;
 
-		if (size > SKB_MAX_ALLOC)
-			size = SKB_MAX_ALLOC;
-			
+		if (size > SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ)
+			size = SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ;
+
 		/*
-		 *	Grab a buffer
+		 *	Grab a buffer: what does not fit in a page sized
+		 *	head goes to order 0 page fragments.
 		 */
-		 
-		skb=sock_alloc_send_skb(sk,size,msg->msg_flags&MSG_DONTWAIT, &err);
+
+		data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
+		skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
+					   msg->msg_flags&MSG_DONTWAIT, &err);
 
 		if (skb==NULL)
 			goto out_err;
 
-		/*
-		 *	If you pass two values to the sock_alloc_send_skb
-		 *	it tries to grab the large buffer with GFP_NOFS
-		 *	(which can fail easily), and if it fails grab the
-		 *	fallback size buffer which is under a page and will
-		 *	succeed. [Alan]
-		 */
-		size = min_t(int, size, skb_tailroom(skb));
-
 		memcpy(UNIXCREDS(skb), &siocb->scm->creds, sizeof(struct ucred));
 		if (siocb->scm->fp)
 			unix_attach_fds(siocb->scm, skb);
 
-		if ((err = memcpy_fromiovec(skb_put(skb,size), msg->msg_iov, size)) != 0) {
+		skb_put(skb, size - data_len);
+		skb->data_len = data_len;
+		skb->len = size;
+		if ((err = unix_skb_copy_fromiovec(skb, msg->msg_iov)) != 0) {
 			kfree_skb(skb);
 			goto out_err;
 		}
@@ -1512,6 +1533,123 @@ out_err:
 	return sent ? : err;
 }
 
+/* Add a page reference to a stream skb, merging with the last fragment
+ * when it continues it.  Returns 0 when the skb has no room left.
+ */
+static int unix_skb_add_page(struct sk_buff *skb, struct page *page,
+			     int offset, size_t size)
+{
+	int i = skb_shinfo(skb)->nr_frags;
+	skb_frag_t *frag;
+
+	if (i) {
+		frag = &skb_shinfo(skb)->frags[i - 1];
+		if (frag->page == page &&
+		    frag->page_offset + frag->size == offset) {
+			frag->size += size;
+			goto out;
+		}
+	}
+	if (i >= MAX_SKB_FRAGS)
+		return 0;
+
+	get_page(page);
+	frag = &skb_shinfo(skb)->frags[i];
+	frag->page = page;
+	frag->page_offset = offset;
+	frag->size = size;
+	skb_shinfo(skb)->nr_frags = i + 1;
+out:
+	skb->len += size;
+	skb->data_len += size;
+	skb->truesize += size;
+	return 1;
+}
+
+/*
+ *	sendfile() to a stream socket: queue references to the page cache
+ *	pages instead of copying them.  Like TCP, the receiver sees the
+ *	page as it is when it reads it.
+ */
+
+static ssize_t unix_stream_sendpage(struct socket *sock, struct page *page,
+				    int offset, size_t size, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct sock *other;
+	struct sk_buff *skb;
+	struct ucred creds;
+	int err;
+
+	if (flags & MSG_OOB)
+		return -EOPNOTSUPP;
+
+	other = unix_peer_get(sk);
+	if (!other)
+		return -ENOTCONN;
+
+	/* The same credentials scm_send() gives a plain write */
+	creds.pid = current->tgid;
+	creds.uid = current->uid;
+	creds.gid = current->gid;
+
+	err = -EPIPE;
+	if (sk->sk_shutdown & SEND_SHUTDOWN)
+		goto pipe_err;
+
+	/* Most of the time the page just extends the last skb we queued */
+	if (atomic_read(&sk->sk_wmem_alloc) < sk->sk_sndbuf) {
+		unix_state_rlock(other);
+		if (sock_flag(other, SOCK_DEAD) ||
+		    (other->sk_shutdown & RCV_SHUTDOWN)) {
+			unix_state_runlock(other);
+			goto pipe_err;
+		}
+		spin_lock(&other->sk_receive_queue.lock);
+		skb = skb_peek_tail(&other->sk_receive_queue);
+		if (skb && skb->sk == sk && !UNIXCB(skb).fp &&
+		    !memcmp(UNIXCREDS(skb), &creds, sizeof(creds)) &&
+		    unix_skb_add_page(skb, page, offset, size)) {
+			atomic_add(size, &sk->sk_wmem_alloc);
+			spin_unlock(&other->sk_receive_queue.lock);
+			unix_state_runlock(other);
+			goto done;
+		}
+		spin_unlock(&other->sk_receive_queue.lock);
+		unix_state_runlock(other);
+	}
+
+	skb = sock_alloc_send_skb(sk, 0, flags & MSG_DONTWAIT, &err);
+	if (skb == NULL)
+		goto out_err;
+
+	memcpy(UNIXCREDS(skb), &creds, sizeof(creds));
+	unix_skb_add_page(skb, page, offset, size);
+	atomic_add(size, &sk->sk_wmem_alloc);
+
+	unix_state_rlock(other);
+	if (sock_flag(other, SOCK_DEAD) ||
+	    (other->sk_shutdown & RCV_SHUTDOWN)) {
+		unix_state_runlock(other);
+		kfree_skb(skb);
+		err = -EPIPE;
+		goto pipe_err;
+	}
+	skb_queue_tail(&other->sk_receive_queue, skb);
+	unix_state_runlock(other);
+done:
+	other->sk_data_ready(other, size);
+	sock_put(other);
+	return size;
+
+pipe_err:
+	if (!(flags & MSG_NOSIGNAL))
+		send_sig(SIGPIPE, current, 0);
+out_err:
+	sock_put(other);
+	return err;
+}
+
 static int unix_seqpacket_sendmsg(struct kiocb *kiocb, struct socket *sock,
 				  struct msghdr *msg, size_t len)
 {
@@ -1746,8 +1884,9 @@ static int unix_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
 			sunaddr = NULL;
 		}
 
-		chunk = min_t(unsigned int, skb->len, size);
-		if (memcpy_toiovec(msg->msg_iov, skb->data, chunk)) {
+		chunk = min_t(unsigned int, skb->len - UNIXCB(skb).consumed, size);
+		if (skb_copy_datagram_iovec(skb, UNIXCB(skb).consumed,
+					    msg->msg_iov, chunk)) {
 			skb_queue_head(&sk->sk_receive_queue, skb);
 			if (copied == 0)
 				copied = -EFAULT;
@@ -1759,13 +1898,13 @@ static int unix_stream_recvmsg(struct kiocb *iocb, struct socket *sock,
 		/* Mark read part of skb as used */
 		if (!(flags & MSG_PEEK))
 		{
-			skb_pull(skb, chunk);
+			UNIXCB(skb).consumed += chunk;
 
 			if (UNIXCB(skb).fp)
 				unix_detach_fds(siocb->scm, skb);
 
 			/* put the skb back if we didn't use it up.. */
-			if (skb->len)
+			if (UNIXCB(skb).consumed < skb->len)
 			{
 				skb_queue_head(&sk->sk_receive_queue, skb);
 				break;
@@ -1862,7 +2001,7 @@ static int unix_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 			if (sk->sk_type == SOCK_STREAM ||
 			    sk->sk_type == SOCK_SEQPACKET) {
 				skb_queue_walk(&sk->sk_receive_queue, skb)
-					amount += skb->len;
+					amount += skb->len - UNIXCB(skb).consumed;
 			} else {
 				skb = skb_peek(&sk->sk_receive_queue);
 				if (skb)